@@ -0,0 +1,188 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_DATA_COMPACT_FIELD_H
+#define VELES_DATA_COMPACT_FIELD_H
+
+#include <cstdint>
+#include <vector>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "data/bindata.h"
+#include "data/field.h"
+#include "data/repack.h"
+#include "data/types.h"
+
+namespace veles {
+namespace data {
+
+/** Shared description of a field's type: how it is repacked from the blob
+    and how the repacked value should be interpreted.  */
+struct FieldDescriptor {
+  RepackFormat repack;
+  FieldHighType high_type;
+};
+
+/** Interning table for field names and field descriptors.
+
+    Parse trees contain huge numbers of fields, but only a handful of
+    distinct names ("length", "type", "crc32", ...) and types.  Each one is
+    stored here exactly once and referred to by a 32-bit index.  Entries
+    are never removed - the table only grows with the number of distinct
+    names and types, not with the number of fields.  This class is not
+    thread-safe; it is meant to be owned by the database and only touched
+    from the database thread.  */
+class FieldDescriptorPool {
+ public:
+  /** Returns the index of a given name, adding it if necessary.  */
+  uint32_t internName(const QString &name);
+
+  /** Returns the name with a given index.  */
+  const QString &name(uint32_t id) const { return names_[id]; }
+
+  /** Looks up the index of a given name without adding it.  Returns false
+      if the name was never interned (so nothing can be using it).  */
+  bool findName(const QString &name, uint32_t *id) const;
+
+  /** Returns the index of a given descriptor, adding it if necessary.
+      Only the members of high_type relevant for its mode are taken into
+      account, so two types differing only in unused members share
+      an index.  */
+  uint32_t internDescriptor(const RepackFormat &repack,
+                            const FieldHighType &high_type);
+
+  /** Returns the descriptor with a given index.  */
+  const FieldDescriptor &descriptor(uint32_t id) const {
+    return descriptors_[id];
+  }
+
+  size_t namesCount() const { return names_.size(); }
+  size_t descriptorsCount() const { return descriptors_.size(); }
+
+ private:
+  static QByteArray descriptorKey(const RepackFormat &repack,
+                                  const FieldHighType &high_type);
+
+  QHash<QString, uint32_t> name_ids_;
+  QVector<QString> names_;
+  QHash<QByteArray, uint32_t> descriptor_ids_;
+  std::vector<FieldDescriptor> descriptors_;
+};
+
+/** Compact storage for the parse items of a single chunk.
+
+    Conceptually this is a std::vector<ChunkDataItem>, but names and types
+    are interned in a FieldDescriptorPool and FIELD values are not copied
+    if they can be recomputed from the source blob - only their range
+    is kept, and the value is decoded again with repack() when the items
+    are expanded.  Values which can't be recomputed that way (COMPUTED,
+    BITFIELD, or FIELDs whose value doesn't match the blob contents) are
+    stored inline.
+
+    Conversion to and from ChunkDataItem only happens at the API boundary
+    (assign() and expand()), so the same pool and source blob should be
+    passed to both.  */
+class CompactChunkItems {
+ public:
+  CompactChunkItems() : blob_start_(UINT64_MAX), blob_end_(0) {}
+
+  /** Replaces the contents with given items.  source is the blob data
+      the FIELD ranges refer to, or nullptr if values should always be
+      stored inline.  */
+  void assign(const std::vector<ChunkDataItem> &items,
+              FieldDescriptorPool *pool, const BinData *source);
+
+  /** Reconstructs the items passed to assign().  FIELD values stored as
+      blob ranges are decoded from source, which should be the same blob
+      as passed to assign() (but its contents may have changed since).  */
+  std::vector<ChunkDataItem> expand(const FieldDescriptorPool &pool,
+                                    const BinData *source) const;
+
+  /** Reconstructs a single item.  */
+  ChunkDataItem item(size_t idx, const FieldDescriptorPool &pool,
+                     const BinData *source) const;
+
+  /** Returns the distinct name indices used by FIELD, COMPUTED and
+      BITFIELD items.  */
+  std::vector<uint32_t> names() const;
+
+  /** Returns the positions of FIELD, COMPUTED and BITFIELD items with
+      a given name index.  */
+  std::vector<size_t> itemsNamed(uint32_t name) const;
+
+  /** Stores the values of items decoded from the blob inline if their
+      range overlaps [start, end) or, if moved, anything at or past start.
+      Called before that part of the blob is modified (source still has
+      the old contents), so that the values stay what was parsed instead
+      of silently following the new data.  */
+  void detachValues(const FieldDescriptorPool &pool, const BinData *source,
+                    uint64_t start, uint64_t end, bool moved);
+
+  size_t size() const { return items_.size(); }
+  bool empty() const { return items_.empty(); }
+  void clear();
+
+  /** Returns the bounds of the ranges of all FIELD values still stored as
+      blob ranges.  start >= end if there are none.  */
+  uint64_t blobStart() const { return blob_start_; }
+  uint64_t blobEnd() const { return blob_end_; }
+
+  /** Returns the number of heap bytes used by this instance (excluding
+      data shared through the pool).  */
+  size_t memoryUsage() const;
+
+ private:
+  enum class ValueMode : uint8_t {
+    NONE,
+    BLOB,
+    INLINE,
+  };
+
+  struct Item {
+    uint8_t type;
+    ValueMode value_mode;
+    uint32_t name;
+    uint32_t descriptor;
+    // Index into values_ for INLINE values.
+    uint32_t value;
+    uint32_t ref_begin;
+    uint32_t ref_count;
+    uint64_t start;
+    uint64_t end;
+    uint64_t num_elements;
+  };
+
+  static const uint32_t k_no_index = 0xffffffffu;
+
+  static BinData decode(const Item &item, const FieldDescriptor &descriptor,
+                        const BinData *source);
+
+  std::vector<Item> items_;
+  std::vector<BinData> values_;
+  std::vector<ObjectHandle> refs_;
+  // Bounds of the ranges of all BLOB items, to skip detachValues() quickly.
+  uint64_t blob_start_;
+  uint64_t blob_end_;
+};
+
+}  // namespace data
+}  // namespace veles
+
+#endif
@@ -17,12 +17,27 @@
 #ifndef VELES_DB_DB_H
 #define VELES_DB_DB_H
 
+#include <stdint.h>
+
 #include "dbif/types.h"
 
 namespace veles {
 namespace db {
 
+struct DbOptions {
+  // Parser threads used for recursive unpacking, 0 for one per core.
+  unsigned parser_threads;
+  // Limit on blob data held by the database, in octets, 0 for none.
+  // Requests that would go over it fail with MemoryLimitError.
+  uint64_t memory_limit;
+  // Start the network server configured in util::settings::network.
+  bool network;
+  DbOptions() : parser_threads(0), memory_limit(0), network(false) {}
+};
+
+// Starts a database with the network server enabled in the settings.
 dbif::ObjectHandle create_db();
+dbif::ObjectHandle create_db(const DbOptions &options);
 
 };
 };
@@ -37,6 +37,7 @@ class LocalObjectHandle : public dbif::ObjectHandleBase {
   dbif::ObjectType type() const override {
     return type_;
   }
+  uint64_t id() const override;
   PLocalObject obj() const { return obj_; }
 };
 
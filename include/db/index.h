@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_DB_INDEX_H
+#define VELES_DB_INDEX_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+#include "data/compact_field.h"
+#include "dbif/info.h"
+
+namespace veles {
+namespace db {
+
+class ChunkObject;
+
+/** Secondary indices over the chunks of a single blob, kept by the blob
+    and updated by its chunks whenever their bounds, type, name or parsed
+    items change.  Lets QueryRequest avoid walking the whole chunk tree:
+    only the chunks listed under the most selective criterion are
+    checked against the rest.  */
+class ChunkIndex {
+ public:
+  /** Adds a chunk, or re-keys one already present.  */
+  void update(ChunkObject *chunk);
+  void remove(ChunkObject *chunk);
+  /** Appends all chunks matching the request to res, in no particular
+      order.  */
+  void query(const dbif::QueryRequest &req,
+             const data::FieldDescriptorPool &pool,
+             std::vector<ChunkObject *> *res) const;
+  size_t size() const { return entries_.size(); }
+  /** Returns all indexed chunks, in no particular order.  */
+  std::vector<ChunkObject *> chunks() const;
+  /** Appends the chunks that may read field values from blob range
+      [start, end) - or from anywhere past start, if moved - to res.  Lets
+      a data change skip the chunks it can't affect.  */
+  void valuesTouching(uint64_t start, uint64_t end, bool moved,
+                      std::vector<ChunkObject *> *res) const;
+
+ private:
+  struct Entry {
+    uint64_t start;
+    QString chunk_type;
+    QString name;
+    std::vector<uint32_t> field_names;
+    // Bounds of the field values the chunk reads from the blob, which
+    // needn't lie within the chunk.  Empty if it reads none.
+    uint64_t values_start;
+    uint64_t values_end;
+  };
+
+  QHash<ChunkObject *, Entry> entries_;
+  std::multimap<uint64_t, ChunkObject *> by_start_;
+  // Chunks with a non-empty value range, by its start, and the lengths of
+  // these ranges - the longest one bounds how far back to look.
+  std::multimap<uint64_t, ChunkObject *> by_values_start_;
+  std::multiset<uint64_t> values_lengths_;
+  QHash<QString, QSet<ChunkObject *>> by_type_;
+  QHash<QString, QSet<ChunkObject *>> by_name_;
+  QHash<uint32_t, QSet<ChunkObject *>> by_field_;
+
+  void unlink(ChunkObject *chunk, const Entry &entry);
+  static bool matches(const dbif::QueryRequest &req, ChunkObject *chunk,
+                      uint32_t field_name);
+};
+
+}  // namespace db
+}  // namespace veles
+
+#endif
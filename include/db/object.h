@@ -21,12 +21,15 @@
 
 #include <QSet>
 #include <QMap>
+#include <QPointer>
 #include <QtGlobal>
 #include <QEnableSharedFromThis>
 #include "dbif/universe.h"
 #include "dbif/types.h"
 #include "db/types.h"
+#include "db/index.h"
 #include "data/bindata.h"
+#include "data/compact_field.h"
 
 namespace veles {
 namespace db {
@@ -86,25 +89,56 @@ class RootLocalObject : public LocalObject {
   }
 };
 
+class TransformedBlobObject;
+
 class DataBlobObject : public LocalObject {
   LocalObject *parent_;
-  data::BinData data_;
   QMap<InfoGetter *, std::pair<uint64_t, uint64_t>> data_watchers_;
+  QSet<TransformedBlobObject *> transformed_blobs_;
+  ChunkIndex chunk_index_;
+  // Octets of data_ counted in the data usage of the database, which is
+  // kept past kill() to give them back.
+  Universe *usage_db_;
+  uint64_t usage_;
 
   void data_reply(InfoGetter *getter, uint64_t start, uint64_t end);
   void remove_data_watcher(InfoGetter *getter);
 
  protected:
+  data::BinData data_;
+
   DataBlobObject(LocalObject *parent, const data::BinData &data, const QString &name) :
-    LocalObject(parent->db(), name), parent_(parent), data_(data) {}
+    LocalObject(parent->db(), name), parent_(parent), usage_db_(parent->db()),
+    usage_(0), data_(data) { dataResized(); }
   void description_reply(InfoGetter *getter) override;
+  // Called whenever the size of data_ changes.
+  void dataResized();
+  // Returns true if data_ may be replaced with this many octets without
+  // going over the memory limit of the database.
+  bool canResize(uint64_t octets) const;
   void killed() override;
+  // Called before data_ is used.  Blobs with lazily computed contents
+  // fill it here.
+  virtual void ensureData() {}
+  bool hasDataWatchers() const { return !data_watchers_.empty(); }
+  // Sends the whole contents again to all watchers.
+  void data_updated();
+  // Tells blobs transformed from [start, end) of this one that their
+  // source has changed.  If moved, everything after start has changed.
+  void source_changed(uint64_t start, uint64_t end, bool moved);
 
  public:
   LocalObject *parent() { return parent_; }
   void getInfo(InfoGetter *getter, PInfoRequest req, bool once) override;
   void runMethod(MethodRunner *runner, PMethodRequest req) override;
-  const data::BinData &data() const { return data_; }
+  const data::BinData &data() { ensureData(); return data_; }
+  void addTransformedBlob(TransformedBlobObject *blob) {
+    transformed_blobs_.insert(blob);
+  }
+  void removeTransformedBlob(TransformedBlobObject *blob) {
+    transformed_blobs_.remove(blob);
+  }
+  ChunkIndex *chunkIndex() { return &chunk_index_; }
 };
 
 class FileBlobObject : public DataBlobObject {
@@ -147,6 +181,67 @@ class SubBlobObject : public DataBlobObject {
   dbif::ObjectType type() const override { return dbif::SUB_BLOB; };
 };
 
+class TransformedBlobObject : public DataBlobObject {
+  friend class QSharedPointer<TransformedBlobObject>;
+  enum class State { INVALID, COMPUTING, VALID };
+  // A request that came in while the contents were being computed.
+  struct PendingRequest {
+    QPointer<InfoGetter> getter;
+    PInfoRequest info_req;
+    bool once;
+    QPointer<MethodRunner> runner;
+    PMethodRequest method_req;
+  };
+  PLocalObject source_;
+  uint64_t start_;
+  uint64_t end_;
+  QString transform_;
+  QString param_;
+  State state_;
+  // Bumped on every invalidation, so that results of computations started
+  // before it are thrown away.
+  uint64_t generation_;
+  std::vector<PendingRequest> pending_;
+
+  TransformedBlobObject(LocalObject *parent, PLocalObject source,
+                        uint64_t start, uint64_t end,
+                        const QString &transform, const QString &param,
+                        const QString &name) :
+    DataBlobObject(parent, data::BinData(8, 0), name), source_(source),
+    start_(start), end_(end), transform_(transform), param_(param),
+    state_(State::INVALID), generation_(0) {}
+  void transformed(uint64_t generation, const data::BinData &res);
+
+ protected:
+  void description_reply(InfoGetter *getter) override;
+  // Starts computing the contents in a parser pool worker.  Until they
+  // arrive, data_ keeps the previous (possibly empty) contents.
+  void ensureData() override;
+  void killed() override;
+
+ public:
+  static PLocalObject create(LocalObject *parent, PLocalObject source,
+                             uint64_t start, uint64_t end,
+                             const QString &transform, const QString &param,
+                             const QString &name) {
+    auto res = QSharedPointer<TransformedBlobObject>::create(
+      parent, source, start, end, transform, param, name);
+    source.staticCast<DataBlobObject>()->addTransformedBlob(res.data());
+    parent->addChild(res);
+    return res;
+  }
+  dbif::ObjectType type() const override { return dbif::SUB_BLOB; };
+  // Requests are answered once the contents are computed.  The contents
+  // can't be changed directly - they always follow the source.
+  void getInfo(InfoGetter *getter, PInfoRequest req, bool once) override;
+  void runMethod(MethodRunner *runner, PMethodRequest req) override;
+  uint64_t start() const { return start_; }
+  uint64_t end() const { return end_; }
+  // Drops the cached contents.  They are recomputed right away if anyone
+  // is watching or waiting for them, otherwise on next read.
+  void invalidate();
+};
+
 class ChunkObject : public LocalObject {
   friend class QSharedPointer<ChunkObject>;
   PLocalObject blob_;
@@ -154,8 +249,11 @@ class ChunkObject : public LocalObject {
   uint64_t start_;
   uint64_t end_;
   QString chunk_type_;
-  std::vector<data::ChunkDataItem> items_;
-  std::vector<data::ChunkDataItem> parseReplyItems_;
+  data::CompactChunkItems items_;
+  // Chunks referenced by SUBCHUNK items in items_.
+  QSet<PLocalObject> item_chunks_;
+  // SUBCHUNK and SUBBLOB items for children not mentioned in items_.
+  std::vector<data::ChunkDataItem> implicit_items_;
   QSet<InfoGetter *> parse_watchers_;
 
   ChunkObject(PLocalObject blob, PLocalObject parent_chunk,
@@ -164,7 +262,10 @@ class ChunkObject : public LocalObject {
     LocalObject(blob->db(), name), blob_(blob), parent_chunk_(parent_chunk),
     start_(start), end_(end), chunk_type_(chunk_type) {}
   void calcParseReplyItems();
+  const data::BinData *blobData() const;
   void remove_parse_watcher(InfoGetter *getter);
+  // Updates the entry in the chunk index of the blob.
+  void reindex();
 
  protected:
   void description_reply(InfoGetter *getter) override;
@@ -186,12 +287,28 @@ class ChunkObject : public LocalObject {
       parent_chunk->addChild(res);
     else
       blob->addChild(res);
+    res.staticCast<ChunkObject>()->reindex();
     return res;
   }
+  PLocalObject blob() const { return blob_; }
+  PLocalObject parentChunk() const { return parent_chunk_; }
   uint64_t start() const { return start_; }
   uint64_t end() const { return end_; }
   QString chunkType() const { return chunk_type_; }
-  const std::vector<data::ChunkDataItem>& items() const { return items_; }
+  std::vector<data::ChunkDataItem> items() const;
+  void setParse(uint64_t start, uint64_t end,
+                const std::vector<data::ChunkDataItem> &items);
+  size_t itemsMemoryUsage() const { return items_.memoryUsage(); }
+  std::vector<uint32_t> fieldNames() const { return items_.names(); }
+  uint64_t valuesStart() const { return items_.blobStart(); }
+  uint64_t valuesEnd() const { return items_.blobEnd(); }
+  // Checks for an item with a given name and, unless value is empty,
+  // a raw value with these exact octets.
+  bool hasField(uint32_t name, const QByteArray &value) const;
+  // Called by the blob before [start, end) of its data is modified (or,
+  // if moved, everything after start).  Values read from there are
+  // copied, so that they keep showing what was parsed.
+  void blobChanging(uint64_t start, uint64_t end, bool moved);
 };
 
 };
@@ -20,9 +20,11 @@
 #include <QObject>
 #include <QStringList>
 #include "data/bindata.h"
+#include "data/compact_field.h"
 #include "db/types.h"
 #include "dbif/types.h"
 #include "parser/parser.h"
+#include "parser/transform.h"
 
 namespace veles {
 namespace db {
@@ -35,17 +37,35 @@ class ParserWorker : public QObject {
       veles::dbif::ObjectHandle blob, MethodRunner *runner, QString parser_id,
       quint64 start = 0,
       veles::dbif::ObjectHandle parent_chunk = veles::dbif::ObjectHandle());
+  // Applies the transform to src and sends the result to getter as
+  // a BlobDataReply - empty if the transform fails.
+  void applyTransform(QString transform_id, veles::data::BinData src,
+                      QString param, InfoGetter *getter);
 
  public:
+  ParserWorker();
   void registerParser(parser::Parser *parser);
   QStringList parserIdsList();
+  // Transforms are stateless and only registered before the worker
+  // threads start, so these may be used from the database thread.
+  void registerTransform(parser::Transform *transform);
+  parser::Transform *transform(const QString &id);
+  QStringList transformIdsList();
   ~ParserWorker();
 
  private:
   QList<parser::Parser *> _parsers;
+  QList<parser::Transform *> _transforms;
 
 signals:
   void newParser(QString id);
+  // Emitted from other threads to queue a parse() call on this worker.
+  void parseQueued(
+      veles::dbif::ObjectHandle blob, MethodRunner *runner, QString parser_id,
+      quint64 start, veles::dbif::ObjectHandle parent_chunk);
+  // Emitted from other threads to queue an applyTransform() call.
+  void transformQueued(QString transform_id, veles::data::BinData src,
+                       QString param, InfoGetter *getter);
 };
 
 class Universe : public QObject {
@@ -53,13 +73,22 @@ class Universe : public QObject {
 
   PLocalObject root_;
   ParserWorker *parser_;
+  QList<ParserWorker *> parser_pool_;
+  int next_pool_worker_;
+  ParserWorker *transform_worker_;
+  data::FieldDescriptorPool field_pool_;
+  // Octets of blob data held by objects, and the limit on it (0 if none).
+  uint64_t data_usage_;
+  uint64_t memory_limit_;
 
  public slots:
   void getInfo(veles::db::PLocalObject obj, InfoGetter *getter, veles::dbif::PInfoRequest req, bool once);
   void runMethod(veles::db::PLocalObject obj, MethodRunner *runner, veles::dbif::PMethodRequest req);
 
  public:
-  Universe(ParserWorker *parser) : parser_(parser) {}
+  Universe(ParserWorker *parser) : parser_(parser), next_pool_worker_(0),
+                                   transform_worker_(nullptr),
+                                   data_usage_(0), memory_limit_(0) {}
   dbif::ObjectHandle handle(PLocalObject obj);
   void setRoot(PLocalObject root) { root_ = root; }
   ~Universe();
@@ -67,6 +96,26 @@ class Universe : public QObject {
     return parser_->thread();
   }
   ParserWorker* parser() {return parser_;}
+  data::FieldDescriptorPool *fieldPool() { return &field_pool_; }
+  // Workers used for recursive unpacking, in addition to the main parser
+  // thread.
+  void addParserPoolWorker(ParserWorker *worker) { parser_pool_.append(worker); }
+  ParserWorker *parserPoolWorker();
+  // Worker computing the contents of transformed blobs.
+  void setTransformWorker(ParserWorker *worker) { transform_worker_ = worker; }
+  ParserWorker *transformWorker() {
+    return transform_worker_ ? transform_worker_ : parser_;
+  }
+  void setMemoryLimit(uint64_t limit) { memory_limit_ = limit; }
+  uint64_t dataUsage() const { return data_usage_; }
+  // Whether this many more octets of blob data fit within the limit.
+  bool canStore(uint64_t octets) const {
+    return memory_limit_ == 0 || (data_usage_ <= memory_limit_ &&
+                                  octets <= memory_limit_ - data_usage_);
+  }
+  void updateDataUsage(uint64_t old_octets, uint64_t new_octets) {
+    data_usage_ = data_usage_ - old_octets + new_octets;
+  }
 
  signals:
   void parse(
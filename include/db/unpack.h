@@ -0,0 +1,80 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_DB_UNPACK_H
+#define VELES_DB_UNPACK_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QSet>
+#include <QString>
+
+#include "data/bindata.h"
+#include "db/getter.h"
+#include "db/types.h"
+#include "dbif/types.h"
+
+namespace veles {
+namespace db {
+
+/** A recursive unpack job: parses a blob, then every sub-blob created
+    by parsing it, and so on.  Parsing is spread over the parser pool of
+    the Universe, while the job itself lives in the database thread.
+
+    Sub-blobs nested deeper than max_depth are left alone, as are all
+    blobs after max_total_size octets were submitted for parsing in
+    total.  Blobs with the same contents as one parsed before (eg. the
+    same file stored twice in an archive) are only parsed once.
+
+    The job deletes itself after sending the result to the runner.  */
+class RecursiveUnpack {
+ public:
+  RecursiveUnpack(Universe *db, MethodRunner *runner, unsigned max_depth,
+                  uint64_t max_total_size);
+  void start(PLocalObject blob, const QString &parser_id, uint64_t start,
+             dbif::ObjectHandle parent_chunk);
+
+ private:
+  Universe *db_;
+  QPointer<MethodRunner> runner_;
+  unsigned max_depth_;
+  uint64_t max_total_size_;
+  uint64_t total_size_;
+  unsigned pending_;
+  // Blobs submitted for parsing, by sampleKey() of their contents.
+  QHash<QByteArray, QList<PLocalObject>> seen_contents_;
+  QSet<LocalObject *> seen_blobs_;
+
+  void enqueue(PLocalObject blob, unsigned depth, const QString &parser_id,
+               uint64_t start, dbif::ObjectHandle parent_chunk);
+  // Called once the contents of an enqueued blob are available.
+  void submit(PLocalObject blob, unsigned depth, const QString &parser_id,
+              uint64_t start, dbif::ObjectHandle parent_chunk);
+  static QByteArray sampleKey(const data::BinData &data);
+  // Returns true if a blob with the same contents was submitted before,
+  // otherwise remembers this one.
+  bool seenContents(PLocalObject blob, const data::BinData &data);
+  void parsed(PLocalObject blob, unsigned depth);
+  void collectSubBlobs(PLocalObject obj, unsigned depth);
+  void finish();
+};
+
+}  // namespace db
+}  // namespace veles
+
+#endif
@@ -38,6 +38,9 @@ struct ObjectInvalidRequestError : Error {};
 struct BlobDataInvalidRangeError : Error {};
 struct BlobDataInvalidWidthError : Error {};
 struct InvalidTypeError : Error {};
+struct UnknownTransformError : Error {};
+// Storing the data would take the database over its memory limit.
+struct MemoryLimitError : Error {};
 
 };
 };
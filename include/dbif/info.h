@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <vector>
+#include <QByteArray>
 #include <QString>
 
 #include "dbif/types.h"
@@ -41,6 +42,7 @@ struct ChildrenReply;
 struct ParsersListReply;
 struct BlobDataReply;
 struct ChunkDataReply;
+struct QueryReply;
 
 struct DescriptionRequest : InfoRequest {
   typedef DescriptionReply ReplyType;
@@ -66,6 +68,31 @@ struct ChunkDataRequest : InfoRequest {
   typedef ChunkDataReply ReplyType;
 };
 
+// Looks for chunks matching all given criteria, in a blob (including
+// chunks nested in other chunks) or, sent to the root, in all file blobs.
+// Empty strings match anything.  field_value, if not empty, is compared
+// with the raw value of the field in BinData layout.  Only chunks
+// contained in [start, end) are returned.  Matches are sorted by start
+// position, and limit 0 means no limit.
+struct QueryRequest : InfoRequest {
+  const QString chunk_type;
+  const QString name;
+  const QString field_name;
+  const QByteArray field_value;
+  const uint64_t start;
+  const uint64_t end;
+  const uint64_t offset;
+  const uint64_t limit;
+  QueryRequest(const QString &chunk_type, const QString &name,
+               const QString &field_name, const QByteArray &field_value,
+               uint64_t start = 0, uint64_t end = UINT64_MAX,
+               uint64_t offset = 0, uint64_t limit = 0) :
+    chunk_type(chunk_type), name(name), field_name(field_name),
+    field_value(field_value), start(start), end(end), offset(offset),
+    limit(limit) {}
+  typedef QueryReply ReplyType;
+};
+
 // Replies
 
 struct InfoReply {
@@ -149,6 +176,18 @@ struct ChunkDataReply : InfoReply {
     items(items) {}
 };
 
+struct QueryReply : InfoReply {
+  const std::vector<ObjectHandle> objects;
+  // For every object, ids of the objects between the queried one and it.
+  const std::vector<std::vector<uint64_t>> paths;
+  // Number of all matches, ignoring offset and limit.
+  const uint64_t total;
+  QueryReply(const std::vector<ObjectHandle> &objects,
+             const std::vector<std::vector<uint64_t>> &paths,
+             uint64_t total) :
+    objects(objects), paths(paths), total(total) {}
+};
+
 };
 };
 
@@ -18,6 +18,7 @@
 #define VELES_DBIF_METHOD_H
 
 #include <stdint.h>
+#include <utility>
 #include <vector>
 #include <QString>
 
@@ -38,6 +39,7 @@ struct MethodRequest {
 };
 
 struct CreatedReply;
+struct CreatedManyReply;
 struct NullReply;
 
 struct RootCreateFileBlobFromDataRequest : MethodRequest {
@@ -64,13 +66,58 @@ struct ChunkCreateRequest : MethodRequest {
   typedef CreatedReply ReplyType;
 };
 
+// Describes a single chunk for ChunkCreateManyRequest.
+struct ChunkSpec {
+  QString name;
+  QString chunk_type;
+  // Index of the parent chunk in the same request (it has to come before
+  // this one), or -1 for the parent_chunk of the request.
+  int64_t parent;
+  uint64_t start;
+  uint64_t end;
+  // SUBCHUNK items with an empty ref stand for the children of this chunk
+  // from the same request, in order.
+  std::vector<data::ChunkDataItem> items;
+};
+
+// Creates a whole tree of parsed chunks in one go - equivalent to
+// a ChunkCreateRequest and a SetChunkParseRequest per chunk.
+struct ChunkCreateManyRequest : MethodRequest {
+  ObjectHandle parent_chunk;
+  std::vector<ChunkSpec> chunks;
+  ChunkCreateManyRequest(ObjectHandle parent_chunk,
+                         const std::vector<ChunkSpec> &chunks) :
+    parent_chunk(parent_chunk), chunks(chunks) {}
+  typedef CreatedManyReply ReplyType;
+};
+
 struct ChunkCreateSubBlobRequest : MethodRequest {
   data::BinData data;
   QString name;
   explicit ChunkCreateSubBlobRequest(const data::BinData &data,
     const QString &name) : data(data), name(name) {}
   explicit ChunkCreateSubBlobRequest(data::BinData &&data,
-    const QString &name) : data(data), name(name) {}
+    const QString &name) : data(std::move(data)), name(name) {}
+  typedef CreatedReply ReplyType;
+};
+
+// Creates a sub-blob whose contents are computed by applying a transform
+// (see parser::Transform) to a range of the source blob.  The contents are
+// computed on first read and recomputed when the source data changes.
+// If source is null, the blob the target object belongs to is used.
+struct CreateTransformedBlobRequest : MethodRequest {
+  QString name;
+  QString transform;
+  QString param;
+  ObjectHandle source;
+  uint64_t start;
+  uint64_t end;
+  CreateTransformedBlobRequest(const QString &name, const QString &transform,
+                               const QString &param = "",
+                               ObjectHandle source = ObjectHandle(),
+                               uint64_t start = 0, uint64_t end = UINT64_MAX)
+      : name(name), transform(transform), param(param), source(source),
+        start(start), end(end) {}
   typedef CreatedReply ReplyType;
 };
 
@@ -125,9 +172,19 @@ struct BlobParseRequest : MethodRequest {
   QString parser_id;
   uint64_t start;
   ObjectHandle parent_chunk;
+  // If set, sub-blobs created by the parser are parsed as well (with
+  // automatic parser detection), up to max_depth levels deep and
+  // max_total_size octets of parsed data in total.
+  bool recursive;
+  unsigned max_depth;
+  uint64_t max_total_size;
   BlobParseRequest(QString parser_id = "", uint64_t start = 0,
-                   ObjectHandle parent_chunk = ObjectHandle())
-      : parser_id(parser_id), start(start), parent_chunk(parent_chunk){};
+                   ObjectHandle parent_chunk = ObjectHandle(),
+                   bool recursive = false, unsigned max_depth = 8,
+                   uint64_t max_total_size = 1ull << 30)
+      : parser_id(parser_id), start(start), parent_chunk(parent_chunk),
+        recursive(recursive), max_depth(max_depth),
+        max_total_size(max_total_size) {};
   typedef NullReply ReplyType;
 };
 
@@ -147,6 +204,12 @@ struct CreatedReply : MethodReply {
   explicit CreatedReply(ObjectHandle object) : object(object) {}
 };
 
+struct CreatedManyReply : MethodReply {
+  const std::vector<ObjectHandle> objects;
+  explicit CreatedManyReply(const std::vector<ObjectHandle> &objects) :
+    objects(objects) {}
+};
+
 };
 };
 
@@ -88,6 +88,8 @@ class ObjectHandleBase {
   virtual InfoPromise *subInfo(PInfoRequest req) = 0;
   virtual MethodResultPromise *runMethod(PMethodRequest req) = 0;
   virtual ObjectType type() const = 0;
+  // Unique for the lifetime of the database, never changes.
+  virtual uint64_t id() const = 0;
 
   template<typename Request, typename... Args>
   QSharedPointer<typename Request::ReplyType> syncGetInfo(Args... args) {
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_NETWORK_CONNECTION_H
+#define VELES_NETWORK_CONNECTION_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QObject>
+
+#include "data/bindata.h"
+#include "data/compact_field.h"
+#include "dbif/types.h"
+#include "dbif/universe.h"
+#include "network.pb.h"
+
+namespace veles {
+namespace db {
+
+/** A single client of NetworkServer.  Lives in the network thread, and only
+    talks to the database through dbif requests, so that it never blocks
+    the database thread (or waits for it).
+
+    Requests are processed concurrently and answered as soon as they are
+    done, possibly out of order.  Reading from the socket pauses while too
+    many requests are in flight or too much output is waiting, and blob
+    data is fetched from the database piece by piece as the socket drains,
+    so memory use stays bounded no matter how much data the client asks
+    for.  Uploaded data is read straight into the buffer of the new blob,
+    grown as it arrives.
+
+    Subscriptions are kept as subInfo promises, whose replies are turned
+    into events carrying only what changed since the previous one.
+
+    The socket is either a QTcpSocket or a QLocalSocket.  Over the latter
+    (on Linux), blob data can also be handed out as a sealed memfd, passed
+    to the client along with the response.  */
+class NetworkConnection : public QObject {
+  Q_OBJECT
+
+ public:
+  NetworkConnection(dbif::ObjectHandle root, QIODevice *socket,
+                    QObject *parent = nullptr);
+
+ private:
+  typedef std::shared_ptr<network::Request> PRequest;
+  typedef std::function<void(dbif::PInfoReply)> InfoCallback;
+  typedef std::function<void(dbif::PMethodReply)> MethodCallback;
+  typedef std::function<void(dbif::PError)> ErrorCallback;
+  typedef std::function<void(dbif::ObjectHandle, dbif::ObjectHandle)>
+      PathCallback;
+
+  struct PackJob;
+  struct BlobStream;
+  struct Subscription;
+  struct SharedMapping;
+  typedef std::shared_ptr<Subscription> PSubscription;
+
+  // An item of the output queue - either a complete message, blob data
+  // to be fetched and written as the socket drains, or a descriptor to pass.
+  struct Output {
+    QByteArray data;
+    std::shared_ptr<BlobStream> stream;
+    std::shared_ptr<SharedMapping> mapping;
+  };
+
+  // Frame header bits, see network.proto.
+  static const uint32_t k_frame_continued_ = 0x80000000;
+  static const uint32_t k_frame_length_mask_ = 0x7fffffff;
+  // Largest blob data subscription (and thus event) served.
+  static const uint32_t k_max_msg_len_ = 1024*1024*16;
+  // Largest request accepted (eg. an ADD_CHILD_CHUNKS batch with a whole
+  // parse tree).  It's buffered as its frames arrive, so only what's
+  // actually sent is allocated.
+  static const uint32_t k_max_request_len_ = 1024*1024*512;
+  static const unsigned k_max_requests_in_flight_ = 64;
+  // Output is only written to the socket while it has less than this much
+  // pending, and reading pauses while the queue holds more.
+  static const int64_t k_write_buffer_size_ = 1024*1024*4;
+  // Blob data is fetched from the database and sent in frames of at most
+  // this many octets.
+  static const uint32_t k_max_frame_size_ = 1024*1024;
+  // Largest ADD_SUB_BLOB upload accepted.  The buffer grows as the data
+  // arrives, so the declared size alone doesn't allocate anything.
+  static const uint64_t k_max_upload_size_ = 1024*1024*1024;
+
+  dbif::ObjectHandle root_;
+  QIODevice *socket_;
+  // Descriptor of a Unix domain socket, -1 if descriptors can't be passed.
+  int local_descriptor_;
+  unsigned requests_in_flight_;
+  bool reading_;
+  std::deque<Output> output_;
+  int64_t output_size_;
+
+  // Input state - the frame being read, and the message it belongs to.
+  bool in_frame_;
+  bool last_frame_;
+  uint32_t frame_left_;
+  QByteArray message_;
+  // The ADD_SUB_BLOB request whose data message is being read, and the
+  // buffer for the data read so far (null if the data is dropped).
+  PRequest upload_request_;
+  std::shared_ptr<data::BinData> upload_data_;
+  uint64_t upload_pos_;
+
+  // Active subscriptions, by the request id of the SUBSCRIBE_* request.
+  std::map<uint64_t, PSubscription> subscriptions_;
+
+  void readMessages();
+  bool readInput();
+  void messageReceived();
+  void breakConnection(const char *error_msg);
+  void abortConnection();
+  bool canReadMore() const;
+  void growUploadBuffer(uint64_t size);
+
+  void getInfo(dbif::ObjectHandle object, dbif::PInfoRequest req,
+               InfoCallback done, ErrorCallback failed);
+  void runMethod(dbif::ObjectHandle object, dbif::PMethodRequest req,
+                 MethodCallback done, ErrorCallback failed);
+
+  void walkPath(PRequest req, int depth, dbif::ObjectHandle object,
+                dbif::ObjectHandle blob, PathCallback done);
+  void handleRequest(PRequest req, dbif::ObjectHandle target_object,
+                     dbif::ObjectHandle blob);
+  void finishRequest(const network::Response &resp);
+  void requestDone();
+  void failRequest(PRequest req, const char *error_msg);
+
+  void listChildren(PRequest req, dbif::ObjectHandle target_object,
+                    bool list_children = false);
+  void createChunk(PRequest req, dbif::ObjectHandle target_object,
+                   dbif::ObjectHandle blob);
+  void createChunks(PRequest req, dbif::ObjectHandle target_object,
+                    dbif::ObjectHandle blob);
+  void deleteObject(PRequest req, dbif::ObjectHandle target_object);
+  void query(PRequest req, dbif::ObjectHandle target_object);
+  void getBlobData(PRequest req, dbif::ObjectHandle target_object);
+  void mapBlobData(PRequest req, dbif::ObjectHandle target_object);
+  void fillMapping(std::shared_ptr<SharedMapping> mapping);
+  void createSubBlob(PRequest req, dbif::ObjectHandle target_object,
+                     std::shared_ptr<data::BinData> data);
+  void subscribe(PRequest req, dbif::ObjectHandle target_object);
+  void unsubscribe(PRequest req);
+  void endSubscription(PSubscription sub);
+  void subscriptionUpdate(PSubscription sub, dbif::PInfoReply reply);
+  void subscriptionError(PSubscription sub, dbif::PError error);
+  // Ends the subscription with an error - or fails the request, if it
+  // hasn't been answered yet.
+  void failSubscription(PSubscription sub, const char *error_msg);
+  void childrenChanged(PSubscription sub, dbif::PInfoReply reply,
+                       std::shared_ptr<network::Response> resp);
+  void blobDataChanged(PSubscription sub, dbif::PInfoReply reply,
+                       std::shared_ptr<network::Response> resp);
+  void sendEvent(PSubscription sub, const network::Response &resp,
+                 const uint8_t *data = nullptr, size_t octets = 0);
+
+  void packResults(PRequest req, std::shared_ptr<network::Response> resp,
+                   const std::vector<dbif::ObjectHandle> &objects,
+                   bool pack_children);
+  void packObject(std::shared_ptr<PackJob> job, dbif::ObjectHandle object,
+                  network::LocalObject *result, bool pack_children);
+  static void packDescription(dbif::PInfoReply reply,
+                              network::LocalObject *result);
+  static std::shared_ptr<data::FieldDescriptorPool> makeTables(
+      const network::Request &req);
+  static void packItems(dbif::PInfoReply reply, network::LocalObject *result,
+                        data::FieldDescriptorPool *tables);
+  static void packTables(data::FieldDescriptorPool *tables,
+                         network::Response *resp);
+
+  void queueMessage(const network::Response &resp);
+  void queueData(const QByteArray &data);
+  void queueDataMessage(const uint8_t *data, size_t octets);
+  static QByteArray frameHeader(uint32_t length, bool continued);
+  void writeOutput();
+  void fetchStreamData(std::shared_ptr<BlobStream> stream);
+  int sendDescriptor(int fd);
+};
+
+}  // namespace db
+}  // namespace veles
+
+#endif  // VELES_NETWORK_CONNECTION_H
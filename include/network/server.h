@@ -18,43 +18,39 @@
 #ifndef VELES_NETWORK_SERVER_H
 #define VELES_NETWORK_SERVER_H
 
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QLocalServer>
 #include <QtNetwork/QTcpServer>
 
-#include "db/types.h"
-#include "network.pb.h"
+#include "dbif/types.h"
 
 namespace veles {
 namespace db {
 
+/** Accepts network clients, each served by a NetworkConnection.  Meant to
+    live in its own thread - it only accesses the database through dbif.
+
+    Clients on the same host can also connect through a local socket
+    (a Unix domain socket, or a named pipe on Windows).  */
 class NetworkServer : public QObject {
   Q_OBJECT
 
-  void handleRequest(network::Request &req, QTcpSocket *client_connection);
-  void sendResponse(QTcpSocket *client_connection, network::Response &resp);
-  void sendData(QTcpSocket *client_connection, const char *data, uint64_t length);
-  void packObject(PLocalObject object, network::LocalObject* result,
-                  bool pack_children = false);
-
 public:
-  NetworkServer(PLocalObject root);
+  // An empty local_socket disables the local server.
+  NetworkServer(dbif::ObjectHandle root, const QHostAddress &ip_addr,
+                uint16_t port, const QString &local_socket,
+                QObject *parent = nullptr);
+  bool isListening() const { return tcp_server_->isListening(); }
+  QString errorString() const { return tcp_server_->errorString(); }
 
 private slots:
   void handle();
-  void readMessage(QTcpSocket *client_connection);
+  void handleLocal();
 
 private:
-  PLocalObject root_;
+  dbif::ObjectHandle root_;
   QTcpServer *tcp_server_;
-
-  static const uint32_t k_max_msg_len_ = 1024*1024*16;
-
-  void listChildren(PLocalObject target_object, network::Response &resp,
-                    bool list_children = false);
-  void createChunk(PLocalObject target_object, PLocalObject blob,
-                   network::Request &req, network::Response &resp);
-  void deleteObject(PLocalObject target_object, network::Response &resp);
-  void getBlobData(PLocalObject target_object, QTcpSocket *client_connection,
-                   network::Response &resp);
+  QLocalServer *local_server_;
 };
 
 }  // namespace db
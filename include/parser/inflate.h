@@ -0,0 +1,124 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_PARSER_INFLATE_H
+#define VELES_PARSER_INFLATE_H
+
+#include <zlib.h>
+
+#include "data/bindata.h"
+
+namespace veles {
+namespace parser {
+
+/** A growable buffer of octets, backed directly by a BinData so that the
+    final contents can become a sub-blob without another copy if the
+    expected size was known up front.  */
+class OctetBuffer {
+ public:
+  explicit OctetBuffer(size_t capacity = 0) : data_(8, capacity), size_(0) {}
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return data_.size(); }
+
+  /** Makes sure there is room for at least min_capacity octets.  */
+  void reserve(size_t min_capacity);
+
+  /** Returns a pointer to the free space after the current contents.  */
+  uint8_t *tail() { return data_.rawData(size_); }
+  size_t tailSize() const { return data_.size() - size_; }
+
+  /** Marks num octets of the free space as filled.  */
+  void commit(size_t num) { size_ += num; }
+
+  void append(const uint8_t *src, size_t num);
+
+  /** Returns the contents and empties the buffer.  */
+  data::BinData take();
+
+ private:
+  data::BinData data_;
+  size_t size_;
+};
+
+/** Streaming zlib/deflate decompressor.  Compressed data is fed in pieces
+    (eg. one PNG IDAT chunk at a time) and inflated straight into
+    an OctetBuffer.
+
+    Output is limited to max_output octets to protect against
+    decompression bombs - a stream inflating to more than that is treated
+    as broken.  */
+class Inflater {
+ public:
+  enum class State {
+    RUNNING,
+    FINISHED,
+    BROKEN,
+    LIMIT_EXCEEDED,
+  };
+
+  static const uint64_t k_default_max_output = 256 * 1024 * 1024;
+
+  /** size_hint is the expected size of the output, if known - the output
+      buffer grows straight to it (but never above max_output, nor more
+      than a small multiple of the input fed so far).
+      raw selects a bare deflate stream instead of the zlib format.  */
+  explicit Inflater(uint64_t max_output = k_default_max_output,
+                    uint64_t size_hint = 0, bool raw = false);
+  ~Inflater();
+  Inflater(const Inflater &) = delete;
+  Inflater &operator=(const Inflater &) = delete;
+
+  /** Feeds another piece of compressed data.  Returns false if
+      the stream is broken or the limit is exceeded.  Data after the end
+      of the compressed stream is ignored.  */
+  bool feed(const uint8_t *src, size_t num);
+  bool feed(const data::BinData &src) {
+    return feed(src.rawData(), src.octets());
+  }
+
+  State state() const { return state_; }
+  bool finished() const { return state_ == State::FINISHED; }
+  uint64_t totalIn() const { return total_in_; }
+  uint64_t totalOut() const { return out_.size(); }
+  /** Returns the number of octets allocated for the output.  */
+  uint64_t bufferSize() const { return out_.capacity(); }
+
+  /** Returns the inflated data if the stream was finished correctly,
+      or an empty BinData otherwise.  */
+  data::BinData result();
+
+ private:
+  z_stream strm_;
+  bool initialized_;
+  State state_;
+  uint64_t max_output_;
+  uint64_t size_hint_;
+  uint64_t total_in_;
+  OctetBuffer out_;
+
+  void grow();
+  void fail(State state);
+};
+
+/** Inflates a complete zlib stream in one go.  */
+data::BinData inflateData(const data::BinData &src,
+                          uint64_t max_output = Inflater::k_default_max_output);
+
+}  // namespace parser
+}  // namespace veles
+
+#endif
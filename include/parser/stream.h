@@ -19,6 +19,8 @@
 
 #include <assert.h>
 
+#include <algorithm>
+
 #include "dbif/types.h"
 #include "dbif/universe.h"
 #include "dbif/info.h"
@@ -44,10 +46,34 @@ class StreamParser {
   unsigned width_;
   size_t blob_size_;
 
+  // Blob data is read ahead in windows of at least this many elements,
+  // so that parsing small fields doesn't cost a database round trip each.
+  static const uint64_t k_window_size = 0x10000;
+  data::BinData window_;
+  uint64_t window_start_;
+
+  /** Returns blob data in range [start, end), clamped to the blob size.  */
+  data::BinData readData(uint64_t start, uint64_t end) {
+    end = std::min<uint64_t>(end, blob_size_);
+    if (start >= end) {
+      return data::BinData(width_, 0);
+    }
+    if (start < window_start_ || end > window_start_ + window_.size()) {
+      uint64_t window_end = std::min<uint64_t>(
+          blob_size_, std::max<uint64_t>(end, start + k_window_size));
+      window_ = blob_->syncGetInfo<veles::dbif::BlobDataRequest>(
+          start, window_end)->data;
+      window_start_ = start;
+      end = std::min<uint64_t>(end, window_start_ + window_.size());
+    }
+    return window_.data(start - window_start_, end - window_start_);
+  }
+
  public:
   StreamParser(dbif::ObjectHandle blob, uint64_t start,
                dbif::ObjectHandle parent_chunk = dbif::ObjectHandle())
-      : blob_(blob), parent_chunk_(parent_chunk), pos_(start) {
+      : blob_(blob), parent_chunk_(parent_chunk), pos_(start),
+        window_start_(0) {
     auto desc = blob_->syncGetInfo<dbif::DescriptionRequest>();
     width_ = desc.dynamicCast<dbif::BlobDescriptionReply>()->width;
     blob_size_ = desc.dynamicCast<dbif::BlobDescriptionReply>()->size;
@@ -84,9 +110,9 @@ class StreamParser {
     size_t src_sz = data::repackSize(width_, repack, num_elements);
     if (pos_ >= blob_size_)
       return data::BinData();
-    auto data = blob_->syncGetInfo<veles::dbif::BlobDataRequest>(pos_, pos_+src_sz);
+    data::BinData data = readData(pos_, pos_ + src_sz);
     pos_ += src_sz;
-    data::BinData res = data::repack(data->data, repack, 0, num_elements);
+    data::BinData res = data::repack(data, repack, 0, num_elements);
     stack_.back().items.push_back(data::ChunkDataItem::field(
       pos_ - src_sz, pos_, name,
       repack, num_elements, high_type, res
@@ -109,10 +135,7 @@ class StreamParser {
       if (pos_ + src_size > blob_size_) {
         src_size = blob_size_ - pos_;
       }
-      auto data = blob_
-                      ->syncGetInfo<veles::dbif::BlobDataRequest>(
-                          pos_ + bytes_read, pos_ + bytes_read + src_size)
-                      ->data;
+      auto data = readData(pos_ + bytes_read, pos_ + bytes_read + src_size);
 
       data = data::repack(data, repack, 0, num_elements);
 
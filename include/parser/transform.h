@@ -0,0 +1,91 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_PARSER_TRANSFORM_H
+#define VELES_PARSER_TRANSFORM_H
+
+#include <memory>
+
+#include <QList>
+#include <QString>
+
+#include "data/bindata.h"
+#include "util/encoders/encoder.h"
+
+namespace veles {
+namespace parser {
+
+/** A named function turning a range of blob data into the contents of
+    a derived sub-blob (eg. decompressing or decoding it).  Transforms
+    are registered in the ParserWorker, just like parsers, and are applied
+    lazily, on the transform worker thread, when the derived blob is first
+    read.
+
+    Implementations have to be stateless - apply() may be called from
+    the transform worker at any time.  */
+class Transform {
+ public:
+  explicit Transform(const QString &id) : id_(id) {}
+  virtual ~Transform() {}
+  QString id() const { return id_; }
+
+  /** Computes the transformed data.  param is transform-specific (eg. the
+      key for XOR) and may be empty.  Returns false if the source data
+      can't be transformed.  */
+  virtual bool apply(const data::BinData &src, const QString &param,
+                     data::BinData *out) = 0;
+
+ private:
+  QString id_;
+};
+
+/** Inflates zlib ("zlib") or raw deflate ("deflate") streams.  param,
+    if given, is the maximum output size in octets.  */
+class InflateTransform : public Transform {
+ public:
+  InflateTransform(const QString &id, bool raw) : Transform(id), raw_(raw) {}
+  bool apply(const data::BinData &src, const QString &param,
+             data::BinData *out) override;
+
+ private:
+  bool raw_;
+};
+
+/** XORs the data with a repeating key, given in hex as param.  */
+class XorTransform : public Transform {
+ public:
+  XorTransform() : Transform("xor") {}
+  bool apply(const data::BinData &src, const QString &param,
+             data::BinData *out) override;
+};
+
+/** Decodes text data with one of util::encoders (base64, hex).  */
+class DecoderTransform : public Transform {
+ public:
+  explicit DecoderTransform(const QString &encoder_id);
+  bool apply(const data::BinData &src, const QString &param,
+             data::BinData *out) override;
+
+ private:
+  std::unique_ptr<util::encoders::Encoder> encoder_;
+};
+
+QList<Transform *> createAllTransforms();
+
+}  // namespace parser
+}  // namespace veles
+
+#endif
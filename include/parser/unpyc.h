@@ -24,8 +24,9 @@
 namespace veles {
 namespace parser {
 
-void unpycFileBlob(veles::dbif::ObjectHandle blob, uint64_t start = 0,
-                   dbif::ObjectHandle parent_chunk = dbif::ObjectHandle());
+/** Parses a pyc file, returns the number of marshal objects decoded.  */
+uint64_t unpycFileBlob(veles::dbif::ObjectHandle blob, uint64_t start = 0,
+                       dbif::ObjectHandle parent_chunk = dbif::ObjectHandle());
 
 class PycParser : public Parser {
  public:
@@ -29,6 +29,13 @@ dbif::ObjectHandle findSubChunk(dbif::ObjectHandle parent, const QString &name);
 data::ChunkDataItem findField(dbif::ObjectHandle parent, const QString &name);
 dbif::ObjectHandle makeSubBlob(dbif::ObjectHandle parent, const QString &name,
                                const data::BinData &data);
+dbif::ObjectHandle makeTransformedBlob(dbif::ObjectHandle parent,
+                                       const QString &name,
+                                       const QString &transform,
+                                       const QString &param = "",
+                                       uint64_t start = 0,
+                                       uint64_t end = UINT64_MAX,
+                                       dbif::ObjectHandle source = dbif::ObjectHandle());
 QList<Parser *> createAllParsers();
 }
 }
@@ -61,7 +61,8 @@ class FileBlobModel : public QAbstractItemModel {
   bool isRemovable(const QModelIndex &index = QModelIndex());
   void uploadNewData(const QByteArray &buf);
   void parse(QString parser = "", qint64 offset = 0,
-             const QModelIndex &parent = QModelIndex());
+             const QModelIndex &parent = QModelIndex(),
+             bool recursive = false);
 
   dbif::ObjectHandle blob(const QModelIndex &index = QModelIndex());
   QStringList path() {return path_;};
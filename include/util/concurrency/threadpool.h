@@ -17,16 +17,23 @@
 #ifndef VELES_UTIL_CONCURRENCY_THREADPOOL_H
 #define VELES_UTIL_CONCURRENCY_THREADPOOL_H
 
-#include <string>
 #include <functional>
+#include <memory>
+#include <string>
 
 namespace veles {
 namespace util {
 namespace threadpool {
 
 /**
- * Globally accessible thread pool with workers split into
- * topics (worker groups).
+ * Globally accessible thread pool.  All tasks share one set of worker
+ * threads (one per core by default), each with its own lock-free deques -
+ * tasks scheduled from a worker go to its deque, and idle workers steal
+ * from others.  Tasks scheduled from other threads go through a shared
+ * queue.
+ *
+ * Tasks belong to topics, each limiting how many of its tasks may run at
+ * once, so that one kind of work can't take up all the cores.
  */
 
 typedef std::function<void()> Task;
@@ -35,11 +42,111 @@ enum class SchedulingResult {
   SCHEDULED,
   ERR_UNKNOWN_TOPIC,
   ERR_NO_WORKERS,
+  ERR_SHUT_DOWN,
   ERR_UNKNOWN
 };
 
 /**
- * Create a new topic and set number of workers for it.
+ * Workers look for tasks of higher priority first, so these are started
+ * ahead of waiting tasks of lower priority (give or take tasks being
+ * picked up concurrently).  Running tasks are never preempted.
+ */
+enum class Priority {
+  HIGH,
+  NORMAL,
+  LOW
+};
+
+class Scheduler;
+struct Topic;
+struct Job;
+struct Worker;
+struct GroupState;
+
+/**
+ * A set of tasks that can be waited for or cancelled together.  Cancelling
+ * drops the tasks which haven't started yet - running ones can check
+ * cancelled() to stop early.
+ */
+class TaskGroup {
+ public:
+  TaskGroup();
+  /** Waits for the tasks.  */
+  ~TaskGroup();
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  /**
+   * Blocks until all tasks of the group are done (or dropped).  Called from
+   * a worker, runs other tasks meanwhile instead of blocking it - but only
+   * those at least as urgent as the least urgent task of the group, one at
+   * a time, checking in between whether the group is done.
+   */
+  void wait();
+  void cancel();
+  bool cancelled() const;
+  /** Number of tasks scheduled and not done yet.  */
+  size_t pending() const;
+
+ private:
+  std::shared_ptr<GroupState> state_;
+  friend class Scheduler;
+};
+
+/**
+ * The pool itself.  There is a global one behind the functions below,
+ * other instances are mostly useful for tests.
+ */
+class Scheduler {
+ public:
+  /** 0 workers means one per core.  Threads are started right away.  */
+  explicit Scheduler(size_t workers = 0);
+  /** Shuts down.  */
+  ~Scheduler();
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+
+  /**
+   * Creates a topic allowing up to max_running of its tasks to run at once,
+   * or changes the limit of an existing one.
+   */
+  void createTopic(const std::string &topic, size_t max_running);
+  /** See threadpool::mockTopic().  */
+  void mockTopic(const std::string &topic);
+  SchedulingResult runTask(const std::string &topic, Task t,
+                           Priority priority = Priority::NORMAL,
+                           TaskGroup *group = nullptr);
+  /**
+   * Stops the workers.  Tasks which are already running are finished,
+   * the rest is dropped (groups waiting for them are woken up).  Further
+   * runTask() calls fail.
+   */
+  void shutdown();
+  size_t workerCount() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+
+  void submit(Job *job);
+  void enqueue(Job *job);
+  // Finds a task of at most max_priority (numerically) to run.
+  Job *findJob(Worker *self, int max_priority);
+  void execute(Job *job);
+  void finish(Job *job);
+  // Does the bookkeeping of a finished task and returns the task of its
+  // topic to start next, if any.
+  Job *release(Job *job);
+  // Finishes a task without running it, and any it releases.
+  void drop(Job *job);
+  void workerLoop(Worker *self);
+  // Runs one task of at most max_priority, returns false if there is none.
+  bool helpWhileWaiting(int max_priority);
+  friend class TaskGroup;
+};
+
+/**
+ * Create a new topic and set the number of its tasks allowed to run at once.
  */
 void createTopic(std::string topic, size_t workers);
 
@@ -50,11 +157,19 @@ void createTopic(std::string topic, size_t workers);
 void mockTopic(std::string topic);
 
 /**
- * Schedule a job to be run on one of worker threads assigned to a given topic.
- * The job is run asynchronously, use callbacks or similar to communicate its
- * result.
+ * Schedule a job to be run on one of worker threads, counted towards
+ * the limit of a given topic.  The job is run asynchronously, use callbacks
+ * or similar to communicate its result.
+ */
+SchedulingResult runTask(std::string topic, Task t,
+                         Priority priority = Priority::NORMAL,
+                         TaskGroup *group = nullptr);
+
+/**
+ * Shut down the global pool, see Scheduler::shutdown().  Meant to be called
+ * once, at exit.
  */
-SchedulingResult runTask(std::string topic, Task t);
+void shutdown();
 
 
 }  // namespace threadpool
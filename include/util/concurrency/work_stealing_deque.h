@@ -0,0 +1,144 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_CONCURRENCY_WORK_STEALING_DEQUE_H
+#define VELES_UTIL_CONCURRENCY_WORK_STEALING_DEQUE_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace veles {
+namespace util {
+namespace threadpool {
+
+/**
+ * Lock-free Chase-Lev deque of pointers.  The owning thread pushes and pops
+ * at the bottom, any other thread may steal from the top.  Follows "Correct
+ * and Efficient Work-Stealing for Weak Memory Models" (Le et al., 2013).
+ *
+ * Arrays outgrown by the deque are kept until it's destroyed, since
+ * a thief may still be reading from one.
+ */
+template <typename T>
+class WorkStealingDeque {
+ public:
+  /** capacity is the initial one, and has to be a power of 2.  */
+  explicit WorkStealingDeque(int64_t capacity = 64)
+      : top_(0), bottom_(0), array_(new Array(capacity)) {
+    arrays_.emplace_back(array_.load(std::memory_order_relaxed));
+  }
+  WorkStealingDeque(const WorkStealingDeque &) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+  /** Owner only.  */
+  void push(T *item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Array *a = array_.load(std::memory_order_relaxed);
+    if (b - t > a->capacity - 1) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item);
+    // Publishes the item to thieves, who load bottom_ with acquire.
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  /** Owner only.  Returns nullptr if empty.  */
+  T *pop() {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array *a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T *item = a->get(b);
+    if (t == b) {
+      // The last item - race against thieves for it.
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  /** Any thread.  Returns nullptr if empty or another thread won the item.  */
+  T *steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    Array *a = array_.load(std::memory_order_acquire);
+    T *item = a->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  /** Approximate when other threads are pushing or popping.  */
+  bool empty() const {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    return b <= t;
+  }
+
+ private:
+  struct Array {
+    int64_t capacity;
+    std::unique_ptr<std::atomic<T *>[]> items;
+    explicit Array(int64_t capacity)
+        : capacity(capacity), items(new std::atomic<T *>[capacity]) {}
+    T *get(int64_t i) const {
+      return items[i & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+    void put(int64_t i, T *item) {
+      items[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+    }
+  };
+
+  std::atomic<int64_t> top_;
+  std::atomic<int64_t> bottom_;
+  std::atomic<Array *> array_;
+  // Owner only.
+  std::vector<std::unique_ptr<Array>> arrays_;
+
+  Array *grow(Array *a, int64_t t, int64_t b) {
+    Array *res = new Array(a->capacity * 2);
+    arrays_.emplace_back(res);
+    for (int64_t i = t; i < b; i++) {
+      res->put(i, a->get(i));
+    }
+    array_.store(res, std::memory_order_release);
+    return res;
+  }
+};
+
+}  // namespace threadpool
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef DATA_SOURCE_H
+#define DATA_SOURCE_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+namespace veles {
+namespace util {
+
+typedef std::function<void(size_t offset, size_t size)> DataChangedCallback;
+typedef int DataChangedCallbackId;
+
+/**
+ * Input of a sampler. Samplers only read the parts of the data they need
+ * through read(), so the data doesn't have to be in memory as a whole
+ * (see PagedDataSource).
+ *
+ * Sources whose data can be modified in place (the size never changes)
+ * report it through changed(), so that users can update what they computed
+ * from the affected range only, instead of starting over.
+ *
+ * All methods may be called from multiple threads at once.
+ */
+class IDataSource {
+ public:
+  IDataSource() : next_cb_id_(0) {}
+  virtual ~IDataSource() {}
+
+  virtual size_t size() = 0;
+
+  /**
+   * Copy size octets starting at offset to out. The range must lie within
+   * the data.
+   */
+  virtual void read(size_t offset, size_t size, char *out) = 0;
+
+  /**
+   * Return the whole data as a simple array if it's in memory anyway,
+   * nullptr otherwise.
+   */
+  virtual const char *contiguousData() { return nullptr; }
+
+  /**
+   * Register a callback called with the modified range whenever the data
+   * changes. Callbacks are called in registration order, in the thread that
+   * made the change, with an internal lock held - they must not register
+   * or remove callbacks themselves.
+   * Returned value is callback id, that can be later used to remove this
+   * callback.
+   */
+  DataChangedCallbackId registerChangeCallback(DataChangedCallback cb);
+
+  /**
+   * Remove change callback with a given id. Once this returns, the callback
+   * isn't running and won't be called again.
+   */
+  void removeChangeCallback(DataChangedCallbackId cb_id);
+
+  /**
+   * Tell the source (and its users) that size octets starting at offset
+   * were modified. Sources that modify their own data call this themselves,
+   * others need to be told when the underlying data changed.
+   */
+  void changed(size_t offset, size_t size);
+
+ protected:
+  /**
+   * Drop anything cached about the modified range. Called by changed()
+   * before the callbacks.
+   */
+  virtual void invalidate(size_t offset, size_t size) {}
+
+ private:
+  std::mutex callbacks_mutex_;
+  DataChangedCallbackId next_cb_id_;
+  std::map<DataChangedCallbackId, DataChangedCallback> callbacks_;
+};
+
+/**
+ * Data source over a QByteArray. It doesn't make a copy - the array must
+ * outlive the source and not be modified.
+ */
+class ByteArrayDataSource : public IDataSource {
+ public:
+  explicit ByteArrayDataSource(const QByteArray &data) : data_(data) {}
+
+  size_t size() override;
+  void read(size_t offset, size_t size, char *out) override;
+  const char *contiguousData() override;
+
+ private:
+  const QByteArray &data_;
+};
+
+/**
+ * Data source keeping its own (implicitly shared) copy of a QByteArray,
+ * for sources that may outlive the original array (eg. when used from
+ * background tasks).
+ */
+class BufferDataSource : public IDataSource {
+ public:
+  explicit BufferDataSource(const QByteArray &data) : data_(data) {}
+
+  size_t size() override;
+  void read(size_t offset, size_t size, char *out) override;
+  const char *contiguousData() override;
+
+  /**
+   * Overwrite size octets starting at offset with data (the range must lie
+   * within the data) and notify change callbacks. The first write detaches
+   * the copy from the original array (so contiguousData() changes), later
+   * ones modify it in place. Readers in other threads must be kept from
+   * reading the range meanwhile.
+   */
+  void write(size_t offset, const char *data, size_t size);
+
+ private:
+  QByteArray data_;
+};
+
+/**
+ * Base of data sources which fetch data in pages of a fixed size (from
+ * a file, over the network, ...), keeping at most max_pages of the most
+ * recently used ones in memory.
+ */
+class PagedDataSource : public IDataSource {
+ public:
+  static const size_t k_default_page_size = 1024 * 1024;
+  static const size_t k_default_max_pages = 64;
+
+  explicit PagedDataSource(size_t page_size = k_default_page_size,
+                           size_t max_pages = k_default_max_pages);
+
+  void read(size_t offset, size_t size, char *out) override;
+
+ protected:
+  /**
+   * Drop cached pages overlapping the range, they're fetched again when
+   * needed.
+   */
+  void invalidate(size_t offset, size_t size) override;
+
+  /**
+   * Fetch size octets starting at offset to out. Called with an internal
+   * lock held, so calls never overlap.
+   */
+  virtual void fetch(size_t offset, size_t size, char *out) = 0;
+
+ private:
+  typedef std::shared_ptr<std::vector<char>> Page;
+
+  Page getPage(size_t index);
+
+  size_t page_size_, max_pages_;
+  std::mutex mutex_;
+  // Most recently used pages first.
+  std::list<std::pair<size_t, Page>> pages_;
+  std::unordered_map<size_t,
+      std::list<std::pair<size_t, Page>>::iterator> page_index_;
+};
+
+/**
+ * Data source reading a file as needed, so the file may be larger than
+ * the available memory.
+ */
+class FileDataSource : public PagedDataSource {
+ public:
+  /**
+   * Open the file - check isOpen() afterwards.
+   */
+  explicit FileDataSource(const QString &path,
+                          size_t page_size = k_default_page_size,
+                          size_t max_pages = k_default_max_pages);
+
+  bool isOpen() const;
+  size_t size() override;
+
+ protected:
+  void fetch(size_t offset, size_t size, char *out) override;
+
+ private:
+  QFile file_;
+  size_t size_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef ENTROPY_SAMPLER_H
+#define ENTROPY_SAMPLER_H
+
+#include <vector>
+#include "util/sampling/window_sampler.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Importance sampler - windows are taken more densely from regions of high
+ * byte entropy (compressed or encrypted data, code) than from low entropy
+ * ones (padding, tables), so that small interesting regions of big files
+ * still show up in the sample. Low entropy regions are never skipped
+ * completely.
+ *
+ * Local entropy is estimated for blocks of the sampled range from a few
+ * probes spread over each block.
+ */
+class EntropySampler : public WindowSampler {
+ public:
+  explicit EntropySampler(const QByteArray &data) : WindowSampler(data) {}
+
+  explicit EntropySampler(std::shared_ptr<IDataSource> source)
+      : WindowSampler(std::move(source)) {}
+ private:
+  EntropySampler(const EntropySampler& other) : WindowSampler(other) {}
+  bool chooseWindows(SamplerConfig *sc, size_t window_size,
+                     std::vector<size_t> *windows) override;
+  EntropySampler* cloneImpl() override;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -25,6 +25,8 @@ namespace util {
 class FakeSampler : public ISampler {
  public:
   explicit FakeSampler(const QByteArray &data) : ISampler(data) {}
+  explicit FakeSampler(std::shared_ptr<IDataSource> source)
+      : ISampler(std::move(source)) {}
  protected:
   size_t getRealSampleSize() override;
  private:
@@ -36,6 +38,9 @@ class FakeSampler : public ISampler {
   void applyResample(ResampleData *rd) override;
   void cleanupResample(ResampleData *rd) override;
   FakeSampler* cloneImpl() override;
+  bool affectedSampleRanges(
+      size_t start, size_t end,
+      std::vector<std::pair<size_t, size_t>> *ranges) override;
 };
 
 }  // namespace util
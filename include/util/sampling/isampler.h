@@ -18,14 +18,21 @@
 #define ISAMPLER_H
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
 #include <future>
+#include <memory>
 #include <utility>
+#include <vector>
 #include <map>
 #include <QByteArray>
 
+#include "util/sampling/data_source.h"
+#include "util/stats/block_stats.h"
+
 namespace veles {
 namespace util {
 
@@ -47,13 +54,24 @@ typedef int ResampleCallbackId;
  * operation immediately. As this can be rather expensive time-wise
  * the sampler can be changed to asynchronous mode. In that case the resampling
  * is performed in a separate thread and a set of registered callbacks is
- * called once it's done.
+ * called once it's done. Requests made while a resample is running are
+ * coalesced - only the most recent one is processed next, and the running
+ * one is cancelled (see resampleCancelled()).
  *
  * When working in asynchronous mode it is recommended to perform any
  * operations on the data while keeping the mutex returned by sampler.lock().
  * Otherwise the sample we're looking at can suddenly change leading to
  * inconsistencies.
  *
+ * The input is read through an IDataSource, so it doesn't need to be in memory
+ * as a whole - samplers should only read the parts they need with readData().
+ * When the data source reports a change (see IDataSource::changed()), only
+ * the sample bytes taken from the modified range and the cached statistics
+ * are updated, if the implementation supports it (see
+ * affectedSampleRanges()), and resample callbacks are called as after
+ * a resample - in both modes, and even if the change missed the sampled
+ * range, as pointers returned by data() may have changed anyway.
+ *
  * Example usage:
  * MySampler sampler(some_data);
  * MySampler.setSampleSize(2048);
@@ -63,8 +81,30 @@ typedef int ResampleCallbackId;
  */
 class ISampler {
  public:
+  /**
+   * Counters and timings of asynchronous resampling, see resampleStats().
+   * Latency is measured from the request (setRange(), setSampleSize(), etc.)
+   * to the moment its result is applied.
+   */
+  struct ResampleStats {
+    uint64_t requested;
+    // Requests replaced by a newer one before being started.
+    uint64_t coalesced;
+    // Requests started, but superseded before being applied.
+    uint64_t cancelled;
+    uint64_t completed;
+    uint64_t last_latency_us;
+    uint64_t max_latency_us;
+    uint64_t total_latency_us;
+
+    uint64_t averageLatencyUs() const {
+      return completed ? total_latency_us / completed : 0;
+    }
+  };
+
   explicit ISampler(const QByteArray &data);
-  virtual ~ISampler() {}
+  explicit ISampler(std::shared_ptr<IDataSource> source);
+  virtual ~ISampler();
 
   /**
    * Set the range of bytes from data to use as a base for sampling.
@@ -149,6 +189,16 @@ class ISampler {
    */
   const char* data();
 
+  /**
+   * Return statistics of the whole sample (see BlockStats), computed on
+   * first use after each resample and shared by all users, so that
+   * visualisations don't recount the same bytes. Digram counts are only
+   * computed if with_digrams is set (or some earlier call needed them).
+   * Like the pointer returned by data(), the result is only valid until
+   * the next resample - keep sampler lock while using it.
+   */
+  std::shared_ptr<const BlockStats> statistics(bool with_digrams = false);
+
   /**
    * Return true if sample is empty.
    * Generally true if underlying data is empty.
@@ -220,13 +270,25 @@ class ISampler {
    * use locks and register callbacks.
    * Otherwise all calls are synchronous and blocking. No locks are being used
    * in this case and calling any methods from multiple threads will have
-   * undefined behaviour. No callbacks will be executed.
+   * undefined behaviour. Callbacks are only executed after data changes,
+   * in the thread reporting them.
    * Calling this method while any other method is being run (synchronously
    * or asynchronously) will result in undefined behaviour.
    * Default value is false.
    */
   void allowAsynchronousResampling(bool allow);
 
+  /**
+   * Return resampling statistics gathered since creation or the last
+   * resetResampleStats() call. Only asynchronous resampling is accounted.
+   */
+  ResampleStats resampleStats();
+
+  /**
+   * Zero all resampling statistics.
+   */
+  void resetResampleStats();
+
  protected:
   /**
    * Derive this struct if you want to pass any data between resample and
@@ -241,6 +303,9 @@ class ISampler {
    */
   struct SamplerConfig {
     size_t start, end, sample_size;
+    // Filled by runResample().
+    int version;
+    std::chrono::steady_clock::time_point requested_at;
   };
 
   /**
@@ -274,13 +339,31 @@ class ISampler {
    */
   virtual size_t getRealSampleSize();
 
+  /**
+   * Copy size bytes of input data, starting at index, to out. Indexing is
+   * the same as in getDataByte(). Safe to call from multiple threads.
+   */
+  void readData(size_t index, size_t size, char *out,
+                SamplerConfig *sc = nullptr);
+
   /**
    * Return the input data as simple array. Size of array is getDataSize().
    * If sc is provided it uses the range represented by sc instead of this
    * stored by sampler.
+   * If the data source isn't contiguous, the whole range is read into
+   * memory first (and kept until the next call for another range), so this
+   * is best avoided in prepareResample().
    */
   const char* getRawData(SamplerConfig *sc = nullptr);
 
+  /**
+   * Return true if the resample for sc was superseded by a newer request and
+   * its result would be thrown away anyway. Long running prepareResample()
+   * implementations should check this every now and then and return early
+   * (possibly nullptr) if it's true. Always false in synchronous mode.
+   */
+  bool resampleCancelled(SamplerConfig *sc);
+
   ISampler(const ISampler& other);
 
  private:
@@ -315,6 +398,8 @@ class ISampler {
    * later be passed to applyResample method.
    * Any call to method accepting SamplerConfig (getDataSize(),
    * getRawData(), etc) should pass the provided SamplerConfig.
+   * Expensive implementations should poll resampleCancelled(sc) and give up
+   * early when it returns true.
    */
   virtual ResampleData* prepareResample(SamplerConfig *sc) = 0;
 
@@ -333,7 +418,7 @@ class ISampler {
    * Delete ResampleData prepared by prepareResample method.
    * This will be called instead of applyResample if the prepared ResampleData
    * is outdated, etc. The method should delete the ResampleData provided
-   * doing any necessary cleanup.
+   * doing any necessary cleanup. It's never called with nullptr.
    */
   virtual void cleanupResample(ResampleData *rd) = 0;
 
@@ -342,13 +427,32 @@ class ISampler {
    */
   virtual ISampler* cloneImpl() = 0;
 
+  /**
+   * Append to ranges the [first, last) ranges of sample indexes taken from
+   * input data in [start, end) (indexed as in getDataByte()) and return
+   * true, or return false if the sample has to be taken anew, which is
+   * the default. Called with sampler lock held, only when sampling is
+   * required and no resample is pending.
+   */
+  virtual bool affectedSampleRanges(
+      size_t start, size_t end,
+      std::vector<std::pair<size_t, size_t>> *ranges);
+
+  /**
+   * Read sample bytes [first, last), returned by affectedSampleRanges(),
+   * from the input again after it was modified.
+   */
+  virtual void refreshSample(size_t first, size_t last);
+
 
   size_t samplingRequired(SamplerConfig *sc = nullptr);
   void applySamplerConfig(SamplerConfig *sc);
   void runResample(SamplerConfig *sc);
-  void resampleAsync(int target_version, SamplerConfig *sc);
+  void resampleAsync();
+  void notifyResampled();
+  void dataChanged(size_t offset, size_t size);
 
-  const QByteArray &data_;
+  std::shared_ptr<IDataSource> source_;
   size_t start_, end_, sample_size_;
   bool allow_async_;
 
@@ -358,6 +462,19 @@ class ISampler {
   std::atomic<int> current_version_, requested_version_;
   ResampleCallbackId next_cb_id_;
   std::map<ResampleCallbackId, ResampleCallback> callbacks_;
+  // The newest request not yet picked up by resampleAsync(), and whether
+  // a resampleAsync() job is scheduled or running (at most one is).
+  std::unique_ptr<SamplerConfig> pending_config_;
+  bool resample_scheduled_;
+  ResampleStats stats_;
+  // Cache of statistics(), dropped on resample and updated in place on
+  // data changes.
+  std::shared_ptr<BlockStats> statistics_;
+  DataChangedCallbackId data_changed_cb_id_;
+  // Copy of the range returned by getRawData() for non-contiguous sources.
+  std::mutex raw_copy_mutex_;
+  std::vector<char> raw_copy_;
+  size_t raw_copy_start_;
 };
 
 }  // namespace util
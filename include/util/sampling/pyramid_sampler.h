@@ -0,0 +1,64 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef PYRAMID_SAMPLER_H
+#define PYRAMID_SAMPLER_H
+
+#include <memory>
+#include <vector>
+#include "util/sampling/sample_pyramid.h"
+#include "util/sampling/window_sampler.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Sampler serving samples from a SamplePyramid. Windows are those kept by
+ * the pyramid, evenly picked from the coarsest level with enough of them in
+ * range, so once the pyramid is built, resampling any range takes time
+ * proportional to the sample size and doesn't touch the data source. Until
+ * then windows are read from the data source instead. When the range has
+ * fewer level 0 windows than the sample needs, all of them are used and
+ * the remaining windows are spaced evenly between them and read from
+ * the data source.
+ *
+ * Any number of samplers (and their clones) can share one pyramid.
+ */
+class PyramidSampler : public WindowSampler {
+ public:
+  explicit PyramidSampler(std::shared_ptr<SamplePyramid> pyramid);
+
+ private:
+  PyramidSampler(const PyramidSampler& other);
+  bool chooseWindows(SamplerConfig *sc, size_t window_size,
+                     std::vector<size_t> *windows) override;
+  void readWindow(SamplerConfig *sc, size_t index, size_t size,
+                  char *out) override;
+  PyramidSampler* cloneImpl() override;
+  /**
+   * Find the blocks [first, last) of level with windows within
+   * [start, end).
+   */
+  void windowsInRange(size_t level, size_t start, size_t end, size_t *first,
+                      size_t *last);
+
+  std::shared_ptr<SamplePyramid> pyramid_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SAMPLE_PYRAMID_H
+#define SAMPLE_PYRAMID_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "util/sampling/data_source.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Multi-resolution summary of data, built once (in the background) and
+ * then used to serve samples of any range without rescanning the data.
+ *
+ * Data is split into level 0 blocks of blockSize() octets. Each next level
+ * has one block per k_fanout blocks of the previous one, up to a single
+ * block covering everything. For every block of every level the pyramid
+ * keeps a copy of one window of windowSize() octets from its middle, so
+ * windows of a level are evenly spaced at that level's resolution, like
+ * the levels of a mipmap. Level 0 blocks are as small as k_min_block_size,
+ * so the windows take at most 1/12 of the data size (and at most
+ * k_max_blocks level 0 blocks for larger data). Block geometry only depends
+ * on data size, so it's known before the pyramid is built.
+ *
+ * All methods may be called from multiple threads at once.
+ */
+class SamplePyramid : public std::enable_shared_from_this<SamplePyramid> {
+ public:
+  static const size_t k_fanout = 4;
+  static const size_t k_min_block_size = 4096;
+  static const size_t k_max_blocks = 262144;
+  static const size_t k_no_window = static_cast<size_t>(-1);
+
+  explicit SamplePyramid(std::shared_ptr<IDataSource> source);
+  ~SamplePyramid();
+
+  std::shared_ptr<IDataSource> source() const;
+  size_t dataSize() const;
+  size_t levelsCount() const;
+  size_t blockSize(size_t level = 0) const;
+  size_t blocksCount(size_t level = 0) const;
+  size_t windowSize() const;
+
+  /**
+   * Return the offset of the window of a block, or k_no_window if
+   * the block is too short to have one.
+   */
+  size_t windowOffset(size_t level, size_t block) const;
+
+  /**
+   * Build the pyramid in the calling thread.
+   */
+  void build();
+
+  /**
+   * Build the pyramid as a low priority task on the "sampling" topic of
+   * the thread pool (or in the calling thread if that's not possible), then
+   * call done (in the thread that built it).
+   */
+  void buildAsync(std::function<void()> done = nullptr);
+
+  bool isBuilt();
+
+  /**
+   * Reread the windows overlapping [offset, offset + size) after the data
+   * was modified there. The data size must not change. Called
+   * automatically on changes reported by the data source.
+   */
+  void update(size_t offset, size_t size);
+
+  /**
+   * Keep the pyramid from reading the data source while the lock is held,
+   * e.g. while the data is being written. build() reads a block at a time
+   * under this lock, and update() takes it as well (recursively, so it may
+   * be called by the holder).
+   */
+  std::unique_lock<std::recursive_mutex> lockSource();
+
+  /**
+   * Copy the window of a block to out, return false if it's not
+   * available (not built yet or no window).
+   */
+  bool readWindow(size_t level, size_t block, char *out);
+
+ private:
+  struct Level {
+    size_t block_size, blocks_count;
+    // Index of the first window of the level in windows_.
+    size_t first_window;
+  };
+
+  void readWindows(size_t level, size_t first, size_t last, char *out);
+
+  std::shared_ptr<IDataSource> source_;
+  size_t data_size_, window_size_;
+  // Geometry never changes.
+  std::vector<Level> levels_;
+
+  std::recursive_mutex source_mutex_;
+  std::mutex mutex_;
+  // windows_, built_ and generation_ are guarded by mutex_.
+  std::vector<char> windows_;
+  bool built_;
+  // Incremented by update(), so that build() can notice it raced with one.
+  uint64_t generation_;
+  DataChangedCallbackId data_changed_cb_id_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef STRATIFIED_SAMPLER_H
+#define STRATIFIED_SAMPLER_H
+
+#include <vector>
+#include "util/sampling/window_sampler.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Sampler splitting the data into as many equal strata as there are windows
+ * and taking one window at a random offset from each of them. Every part of
+ * the data is represented in the sample, unlike with UniformSampler.
+ */
+class StratifiedSampler : public WindowSampler {
+ public:
+  explicit StratifiedSampler(const QByteArray &data) : WindowSampler(data) {}
+
+  explicit StratifiedSampler(std::shared_ptr<IDataSource> source)
+      : WindowSampler(std::move(source)) {}
+ private:
+  StratifiedSampler(const StratifiedSampler& other) : WindowSampler(other) {}
+  bool chooseWindows(SamplerConfig *sc, size_t window_size,
+                     std::vector<size_t> *windows) override;
+  StratifiedSampler* cloneImpl() override;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
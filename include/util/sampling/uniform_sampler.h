@@ -18,39 +18,25 @@
 #define UNIFORM_SAMPLER_H
 
 #include <vector>
-#include "util/sampling/isampler.h"
+#include "util/sampling/window_sampler.h"
 
 namespace veles {
 namespace util {
 
-class UniformSampler : public ISampler {
+/**
+ * Sampler taking windows at uniformly random offsets.
+ */
+class UniformSampler : public WindowSampler {
  public:
-  explicit UniformSampler(const QByteArray &data);
-  ~UniformSampler();
+  explicit UniformSampler(const QByteArray &data) : WindowSampler(data) {}
 
-  void setWindowSize(size_t size);
+  explicit UniformSampler(std::shared_ptr<IDataSource> source)
+      : WindowSampler(std::move(source)) {}
  private:
-  struct UniformSamplerResampleData : public ResampleData {
-    size_t window_size, windows_count;
-    std::vector<size_t> windows;
-    char *data;
-  };
-
-  UniformSampler(const UniformSampler& other);
-  char getSampleByte(size_t index) override;
-  const char* getData() override;
-  size_t getRealSampleSize() override;
-  size_t getFileOffsetImpl(size_t index) override;
-  size_t getSampleOffsetImpl(size_t address) override;
-  ResampleData* prepareResample(SamplerConfig *sc) override;
-  void applyResample(ResampleData *rd) override;
-  void cleanupResample(ResampleData *rd) override;
+  UniformSampler(const UniformSampler& other) : WindowSampler(other) {}
+  bool chooseWindows(SamplerConfig *sc, size_t window_size,
+                     std::vector<size_t> *windows) override;
   UniformSampler* cloneImpl() override;
-
-  size_t window_size_, windows_count_;
-  bool use_default_window_size_;
-  std::vector<size_t> windows_;
-  char *buffer_;
 };
 
 }  // namespace util
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef WINDOW_SAMPLER_H
+#define WINDOW_SAMPLER_H
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+#include "util/sampling/isampler.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Base of samplers whose sample is a sorted sequence of non-overlapping
+ * windows of input data, all of the same size. Implementations only choose
+ * the window offsets, copying the windows and mapping offsets between
+ * the sample and the data is done here.
+ *
+ * Unless set with setWindowSize(), the window size is the square root of
+ * the sample size. Any randomness should come from generators returned by
+ * makeGenerator(), so that a sampler with a given seed always produces
+ * the same sample.
+ *
+ * Modifications of the data only refresh the windows containing them, the
+ * choice of windows is kept until the next resample.
+ */
+class WindowSampler : public ISampler {
+ public:
+  explicit WindowSampler(const QByteArray &data);
+  explicit WindowSampler(std::shared_ptr<IDataSource> source);
+  ~WindowSampler();
+
+  /**
+   * Set the size of a single window, 0 restores the default.
+   */
+  void setWindowSize(size_t size);
+
+  /**
+   * Set the seed of random number generators, the default is 0.
+   */
+  void setSeed(uint32_t seed);
+
+ protected:
+  WindowSampler(const WindowSampler& other);
+
+  /**
+   * Choose windows for the sample described by sc. windows has the size of
+   * the number of windows to choose, and should be filled with their offsets
+   * (relative to the start of the range): sorted, at least window_size apart
+   * and not greater than getDataSize(sc) - window_size.
+   * This is called from prepareResample(), so the same restrictions apply.
+   * Return false if the resample got cancelled (see resampleCancelled()).
+   */
+  virtual bool chooseWindows(SamplerConfig *sc, size_t window_size,
+                             std::vector<size_t> *windows) = 0;
+
+  /**
+   * Copy the window starting at index (relative to the start of the range)
+   * to out. By default it's read from the data source, implementations may
+   * have faster ways. Called from multiple threads at once.
+   */
+  virtual void readWindow(SamplerConfig *sc, size_t index, size_t size,
+                          char *out);
+
+  /**
+   * Return a random number generator for the given part of the work, seeded
+   * with the sampler seed and the part number.
+   */
+  std::default_random_engine makeGenerator(size_t part = 0);
+
+  /**
+   * Return the number of parts to split work on items into (with at least
+   * min_items_per_part items in each). It doesn't depend on the number of
+   * workers, so the sample is the same on every machine.
+   */
+  static size_t partsFor(size_t items, size_t min_items_per_part);
+
+  /**
+   * Return value * numerator / denominator, rounded down, without
+   * overflowing for numerator <= denominator.
+   */
+  static size_t scale(size_t value, size_t numerator, size_t denominator);
+
+  /**
+   * Run part(0) ... part(parts - 1) on the "sampling" topic of the thread
+   * pool and wait for them. Parts which can't be scheduled (eg. when
+   * the topic doesn't exist) are run in the calling thread.
+   */
+  static void runInParts(size_t parts,
+                         const std::function<void(size_t)> &part);
+
+ private:
+  struct WindowSamplerResampleData : public ResampleData {
+    size_t window_size, windows_count;
+    std::vector<size_t> windows;
+    char *data;
+  };
+
+  char getSampleByte(size_t index) override;
+  const char* getData() override;
+  size_t getRealSampleSize() override;
+  size_t getFileOffsetImpl(size_t index) override;
+  size_t getSampleOffsetImpl(size_t address) override;
+  ResampleData* prepareResample(SamplerConfig *sc) override;
+  void applyResample(ResampleData *rd) override;
+  void cleanupResample(ResampleData *rd) override;
+  bool affectedSampleRanges(
+      size_t start, size_t end,
+      std::vector<std::pair<size_t, size_t>> *ranges) override;
+  void refreshSample(size_t first, size_t last) override;
+
+  size_t window_size_, windows_count_;
+  bool use_default_window_size_;
+  uint32_t seed_;
+  std::vector<size_t> windows_;
+  char *buffer_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -29,6 +29,9 @@ uint32_t port ();
 void setPort (uint32_t port);
 QString ipAddress ();
 void setIpAddress (QString addr);
+// Name (or path) of the local socket, empty if disabled.
+QString localSocket();
+void setLocalSocket(QString name);
 
 }  // namespace network
 }  // namespace settings
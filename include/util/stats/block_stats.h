@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_STATS_BLOCK_STATS_H
+#define VELES_UTIL_STATS_BLOCK_STATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace veles {
+namespace util {
+
+/**
+ * Byte and digram statistics of a buffer, precomputed so that the
+ * histogram, entropy or digram counts of any range can be answered without
+ * rescanning it.
+ *
+ * Byte counts are kept in prefix form at every k_block_size boundary, so
+ * a range histogram is a difference of two prefixes plus a direct count of
+ * the unaligned ends (less than 2 * k_block_size octets). Digram counts
+ * are 65536 bins each, so they're kept in the same form at no more than
+ * k_max_digram_checkpoints + 1 coarser boundaries, and only if requested.
+ *
+ * BlockStats doesn't copy the buffer - queries read the unaligned ends
+ * straight from it, so it must outlive the object (for statistics of
+ * a sampler, see ISampler::statistics()).
+ */
+class BlockStats {
+ public:
+  typedef std::array<uint64_t, 256> Histogram;
+
+  static const size_t k_block_size = 4096;
+  static const size_t k_max_digram_checkpoints = 16;
+
+  BlockStats(const char *data, size_t size, bool with_digrams = false);
+
+  size_t size() const;
+  bool hasDigrams() const;
+
+  /**
+   * Histogram of bytes in [start, end).
+   */
+  Histogram histogram(size_t start, size_t end) const;
+  Histogram histogram() const;
+
+  /**
+   * Shannon entropy of bytes in [start, end), in bits per byte (0 - 8).
+   */
+  double entropy(size_t start, size_t end) const;
+  static double entropy(const Histogram &histogram, uint64_t total);
+
+  /**
+   * Add counts of digrams (pairs of adjacent bytes, both in [start, end))
+   * to counts, indexed by first_byte * 256 + second_byte, and the sums of
+   * their offsets (of the first byte) to position_sums, unless it's
+   * nullptr. Both must have 65536 elements. Requires hasDigrams().
+   */
+  void digrams(size_t start, size_t end, uint64_t *counts,
+               uint64_t *position_sums = nullptr) const;
+
+  /**
+   * Update the statistics after bytes in [start, end) were modified. data
+   * is the buffer (of the same size), in case it moved. Only the blocks
+   * (and digram checkpoint intervals) containing the range are recounted,
+   * later prefixes are adjusted by the difference.
+   */
+  void update(const char *data, size_t start, size_t end);
+
+ private:
+  void countBytes(size_t start, size_t end, uint64_t *counts) const;
+  void countDigrams(size_t first, size_t last, uint64_t *counts,
+                    uint64_t *position_sums) const;
+
+  const uint8_t *data_;
+  size_t size_;
+  // Counts of [0, n * k_block_size) at 256 * n.
+  std::vector<uint32_t> byte_prefix_;
+  // Counts (and offset sums) of digrams starting in
+  // [0, n * digram_stride_) at 65536 * n.
+  size_t digram_stride_;
+  std::vector<uint32_t> digram_prefix_;
+  std::vector<uint64_t> position_prefix_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_STATS_ENTROPY_PROFILE_H
+#define VELES_UTIL_STATS_ENTROPY_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/sampling/data_source.h"
+#include "util/stats/kernels.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Entropy of a multiset of bytes that changes one byte at a time, e.g.
+ * a sliding window. Keeps the counts and the running sum of c * log2(c)
+ * over them, so that adding or removing a byte and getting the entropy
+ * are all O(1), instead of O(256) for computing it from the histogram.
+ */
+class EntropyAccumulator {
+ public:
+  EntropyAccumulator();
+
+  void add(uint8_t byte) {
+    uint64_t count = counts_[byte]++;
+    sum_ += nLog2N(count + 1) - nLog2N(count);
+    total_ += 1;
+  }
+
+  void remove(uint8_t byte) {
+    uint64_t count = counts_[byte]--;
+    sum_ -= nLog2N(count) - nLog2N(count - 1);
+    total_ -= 1;
+  }
+
+  void add(const uint8_t *data, size_t size);
+  void remove(const uint8_t *data, size_t size);
+  void clear();
+
+  uint64_t count() const {
+    return total_;
+  }
+
+  /**
+   * Return Shannon entropy of the bytes, in bits per byte (0 - 8).
+   */
+  double entropy() const {
+    if (total_ == 0) {
+      return 0.0;
+    }
+    // log2(t) - sum(c * log2(c)) / t
+    double result = (nLog2N(total_) - sum_) / total_;
+    return result > 0.0 ? result : 0.0;
+  }
+
+ private:
+  double nLog2N(uint64_t n) const {
+    return n < kernels::k_n_log2_n_table_size ?
+        n_log2_n_[n] : kernels::nLog2N(n);
+  }
+
+  const double *n_log2_n_;
+  uint64_t counts_[256];
+  uint64_t total_;
+  // Sum of c * log2(c) over counts_. It's only ever updated, the rounding
+  // errors that pile up this way stay well below float precision.
+  double sum_;
+};
+
+/**
+ * Return the number of points entropyProfile() computes for given sizes:
+ * one for each step octets, as long as a whole window fits (but at least
+ * one, for the whole data, if it's shorter than a window).
+ */
+size_t entropyProfileSize(size_t size, size_t window_size, size_t step = 1);
+
+/**
+ * Compute the entropy (in bits per byte) of windows of window_size octets
+ * starting at each step-th offset of data. Takes O(1) per octet no matter
+ * the window size.
+ */
+std::vector<float> entropyProfile(const uint8_t *data, size_t size,
+                                  size_t window_size, size_t step = 1);
+
+/**
+ * Same as above, but reading the data from source piece by piece, so whole
+ * files can be profiled without keeping them in memory.
+ */
+std::vector<float> entropyProfile(IDataSource *source, size_t window_size,
+                                  size_t step = 1);
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_STATS_KERNELS_H
+#define VELES_UTIL_STATS_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace veles {
+namespace util {
+namespace kernels {
+
+/**
+ * Low level loops used by byte statistics (histograms, sums, entropy).
+ *
+ * Kernels that benefit from vector instructions have a variant for each
+ * instruction set, the best one supported by the CPU is picked at
+ * runtime. Histograms are counted into several interleaved banks, so that
+ * runs of equal bytes don't serialize on the same counter.
+ */
+enum class InstructionSet {SCALAR, SSE2, AVX2, NEON};
+
+/**
+ * Return the best instruction set supported by both the build and the CPU.
+ */
+InstructionSet detectInstructionSet();
+
+/**
+ * Return the instruction set currently used by the kernels.
+ */
+InstructionSet instructionSet();
+
+/**
+ * Make the kernels use given instruction set (meant for tests and
+ * benchmarks). Return false and change nothing if it's not supported.
+ */
+bool setInstructionSet(InstructionSet set);
+
+const char* instructionSetName(InstructionSet set);
+
+/**
+ * Add the number of occurrences of each byte value in data to counts
+ * (256 elements).
+ */
+void countBytes(const uint8_t *data, size_t size, uint64_t *counts);
+
+/**
+ * Return the sum of all bytes of data.
+ */
+uint64_t sumBytes(const uint8_t *data, size_t size);
+
+/**
+ * Return n * log2(n) (0 for n = 0), from a precomputed table for small n.
+ */
+double nLog2N(uint64_t n);
+
+/**
+ * Return the table used by nLog2N(), with k_n_log2_n_table_size elements,
+ * for loops that can't afford a call per lookup.
+ */
+static const size_t k_n_log2_n_table_size = 4096;
+const double* nLog2NTable();
+
+/**
+ * Return Shannon entropy, in bits per byte (0 - 8), of bytes with given
+ * histogram (256 elements) and total count.
+ */
+double entropy(const uint64_t *counts, uint64_t total);
+
+}  // namespace kernels
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -83,6 +83,9 @@ class VisualisationWidget : public QOpenGLWidget,
   size_t getDataSize();
   const char* getData();
   char getByte(size_t index);
+  // Statistics of the sample, see ISampler::statistics().
+  std::shared_ptr<const util::BlockStats> getStatistics(
+      bool with_digrams = false);
 
  private:
 
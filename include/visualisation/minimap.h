@@ -63,6 +63,7 @@ class VisualisationMinimap : public QOpenGLWidget,
 
  signals:
   void selectionChanged(size_t start, size_t end);
+  void resampled();
 
  protected:
   void mouseMoveEvent(QMouseEvent *event) override;
@@ -100,23 +101,27 @@ class VisualisationMinimap : public QOpenGLWidget,
   size_t lineToOffset(float line_position);
   float offsetToLine(size_t offset);
 
+  static size_t pointStart(size_t index, double point_size,
+                           size_t sample_size);
   static float* calculateAverageValueTexture(
       const uint8_t *sample, size_t sample_size,
       size_t texture_size, double point_size);
   static float* calculateEntropyTexture(
       const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
+      size_t texture_size, double point_size,
+      const util::BlockStats &stats);
 
   static float* calculateEntropyTexturePerPixel(
-      const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
+      size_t sample_size, size_t texture_size, double point_size,
+      const util::BlockStats &stats);
   static float* calculateEntropyTextureSlidingWindow(
       const uint8_t *sample, size_t sample_size,
       size_t texture_size, double point_size);
   static float* calculateEntropyTextureSingleWindow(
       const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
-  static float calculateEntropyValue(uint64_t bytes_counts[],
+      size_t texture_size, double point_size,
+      const util::BlockStats &stats);
+  static float calculateEntropyValue(const uint64_t bytes_counts[],
                                      uint64_t total_count);
 
   bool empty();
@@ -138,6 +143,7 @@ class VisualisationMinimap : public QOpenGLWidget,
   bool initialised_;
   bool gl_initialised_;
   util::ISampler *sampler_;
+  util::ResampleCallbackId resample_cb_id_;
 
   size_t rows_, cols_, texture_rows_, texture_cols_;
   size_t selection_start_, selection_end_;
@@ -23,6 +23,9 @@
 #include <QSpacerItem>
 #include <QVector>
 
+#include <mutex>
+#include <vector>
+
 #include "util/sampling/isampler.h"
 #include "visualisation/minimap.h"
 #include "visualisation/selectrangedialog.h"
@@ -40,6 +43,12 @@ class MinimapPanel : public QWidget {
   void setSampler(util::ISampler *sampler);
   QPair<size_t, size_t> getSelection();
 
+  /**
+   * Wait for and lock the sampler set with setSampler() and all its clones
+   * used by minimaps (see ISampler::waitAndLock()).
+   */
+  std::vector<std::unique_lock<util::SamplerMutex>> waitAndLockSamplers();
+
  signals:
   void selectionChanged(size_t start, size_t end);
 
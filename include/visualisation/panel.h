@@ -26,8 +26,10 @@
 #include <QString>
 
 #include <map>
+#include <memory>
 
 #include "ui/dockwidget.h"
+#include "util/sampling/sample_pyramid.h"
 #include "visualisation/base.h"
 #include "visualisation/minimap_panel.h"
 
@@ -42,6 +44,18 @@ class VisualisationPanel : public ui::View {
   ~VisualisationPanel();
 
   void setData(const QByteArray &data);
+  /**
+   * Overwrite data starting at offset with bytes (which must fit within
+   * the data). Samplers only re-read what the change touches, instead of
+   * being recreated as by setData().
+   */
+  void updateData(size_t offset, const QByteArray &bytes);
+  /**
+   * Replace data with a new version of it. If the size didn't change, only
+   * the range that differs is written with updateData(), otherwise this is
+   * the same as setData().
+   */
+  void replaceData(const QByteArray &data);
   void setRange(const size_t start, const size_t end);
 
  private slots:
@@ -53,7 +67,8 @@ class VisualisationPanel : public ui::View {
   void minimapSelectionChanged(size_t start, size_t end);
 
  private:
-  enum class ESampler {NO_SAMPLER, UNIFORM_SAMPLER};
+  enum class ESampler {NO_SAMPLER, UNIFORM_SAMPLER, STRIDE_SAMPLER,
+                       STRATIFIED_SAMPLER, ENTROPY_SAMPLER};
   enum class EVisualisation {DIGRAM, TRIGRAM, LAYERED_DIGRAM};
 
   static const std::map<QString, ESampler> k_sampler_map;
@@ -63,8 +78,9 @@ class VisualisationPanel : public ui::View {
   static const int k_minimap_sample_size = 4096;
 
   static util::ISampler* getSampler(ESampler type,
-                                    const QByteArray &data,
+                                    std::shared_ptr<util::IDataSource> source,
                                     int sample_size);
+  util::ISampler* getMinimapSampler();
   static VisualisationWidget* getVisualisation(EVisualisation type,
                                                QWidget *parent = 0);
   static QString prepareAddressString(size_t start, size_t end);
@@ -75,11 +91,14 @@ class VisualisationPanel : public ui::View {
   void initOptionsPanel();
   QBoxLayout* prepareVisualisationOptions();
 
-  QByteArray data_;
+  // Shared by all samplers, so that edits reach them all.
+  std::shared_ptr<util::BufferDataSource> source_;
   ESampler sampler_type_;
   EVisualisation visualisation_type_;
   int sample_size_;
   util::ISampler *sampler_, *minimap_sampler_;
+  // Shared by the minimap samplers, so that zooming doesn't rescan data.
+  std::shared_ptr<util::SamplePyramid> pyramid_;
   MinimapPanel *minimap_;
   VisualisationWidget *visualisation_;
 
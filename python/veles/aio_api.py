@@ -0,0 +1,464 @@
+# Copyright 2017 CodiLime
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""asyncio client for Veles (Python 3.5+).
+
+Unlike VelesClient, it works on id paths and raw network_pb2 objects, and
+any number of requests can be in flight at once - on one connection or
+spread over a ConnectionPool.
+"""
+import asyncio
+import collections
+import itertools
+import os
+import struct
+import tempfile
+
+from veles import exceptions as exc
+from veles import network_pb2
+
+FRAME_CONTINUED = 0x80000000
+FRAME_LENGTH_MASK = 0x7fffffff
+MAX_FRAME_SIZE = 1 << 20
+
+DATA_REQUESTS = (
+    network_pb2.Request.GET_BLOB_DATA,
+    network_pb2.Request.GET_BLOB_DATA_RANGES,
+    network_pb2.Request.SUBSCRIBE_BLOB_DATA,
+)
+
+_HEADER = struct.Struct('<I')
+
+# Reads straight into our buffer where asyncio supports it (3.7+).
+_ProtocolBase = getattr(asyncio, 'BufferedProtocol', asyncio.Protocol)
+
+
+class _VelesProtocol(_ProtocolBase):
+    """Splits incoming data into frames and messages.  Received data goes
+    to a preallocated buffer, which only grows to hold the largest frame
+    seen."""
+
+    INITIAL_BUFFER_SIZE = 1 << 18
+
+    def __init__(self, message_received, connection_lost):
+        self._message_received = message_received
+        self._connection_lost = connection_lost
+        self._buf = bytearray(self.INITIAL_BUFFER_SIZE)
+        self._view = memoryview(self._buf)
+        self._start = 0
+        self._end = 0
+        self._frames = []
+        self.transport = None
+        self._paused = False
+        self._drain_waiters = []
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def connection_lost(self, ex):
+        self._connection_lost(ex)
+        for waiter in self._drain_waiters:
+            if not waiter.done():
+                waiter.set_result(None)
+
+    def pause_writing(self):
+        self._paused = True
+
+    def resume_writing(self):
+        self._paused = False
+        for waiter in self._drain_waiters:
+            if not waiter.done():
+                waiter.set_result(None)
+        self._drain_waiters = []
+
+    async def drain(self):
+        if self._paused and not self.transport.is_closing():
+            waiter = asyncio.get_event_loop().create_future()
+            self._drain_waiters.append(waiter)
+            await waiter
+
+    def _reserve(self, size):
+        """Makes room for size more octets after the buffered data."""
+        if len(self._buf) - self._end >= size:
+            return
+        pending = self._end - self._start
+        if pending + size > len(self._buf):
+            new_buf = bytearray(max(2 * len(self._buf), pending + size))
+            new_buf[:pending] = self._view[self._start:self._end]
+            self._buf = new_buf
+            self._view = memoryview(self._buf)
+        else:
+            self._view[:pending] = self._view[self._start:self._end]
+        self._start = 0
+        self._end = pending
+
+    def get_buffer(self, sizehint):
+        self._reserve(max(sizehint, 1 << 16))
+        return self._view[self._end:]
+
+    def buffer_updated(self, nbytes):
+        self._end += nbytes
+        self._parse()
+
+    def data_received(self, data):
+        self._reserve(len(data))
+        self._view[self._end:self._end + len(data)] = data
+        self.buffer_updated(len(data))
+
+    def _parse(self):
+        while self._end - self._start >= _HEADER.size:
+            header, = _HEADER.unpack_from(self._buf, self._start)
+            length = header & FRAME_LENGTH_MASK
+            if self._end - self._start - _HEADER.size < length:
+                # Make sure the whole frame will fit.
+                self._reserve(_HEADER.size + length)
+                return
+            start = self._start + _HEADER.size
+            self._frames.append(bytes(self._view[start:start + length]))
+            self._start = start + length
+            if not header & FRAME_CONTINUED:
+                frames, self._frames = self._frames, []
+                self._message_received(b''.join(frames))
+        if self._start == self._end:
+            self._start = self._end = 0
+
+
+class AsyncConnection(object):
+    """A single connection, with requests pipelined on it.  Use open() to
+    create one."""
+
+    def __init__(self, max_in_flight=64):
+        self._protocol = None
+        self._last_request_id = 0
+        # request id -> (future, whether a data message follows)
+        self._in_flight = collections.OrderedDict()
+        # Request whose data message is expected next.
+        self._data_for = None
+        # subscription id -> function called with (response, data)
+        self._subscriptions = {}
+        self._event = None
+        self._slots = asyncio.Semaphore(max_in_flight)
+        self._error = None
+
+    @classmethod
+    async def open(cls, ip_addr='127.0.0.1', port=3135, local_socket=None,
+                   max_in_flight=64):
+        """Connects over TCP, or to the given local socket."""
+        conn = cls(max_in_flight)
+        loop = asyncio.get_event_loop()
+
+        def factory():
+            return _VelesProtocol(conn._message_received,
+                                  conn._connection_lost)
+
+        try:
+            if local_socket is not None:
+                if not os.path.isabs(local_socket):
+                    local_socket = os.path.join(tempfile.gettempdir(),
+                                                local_socket)
+                _, conn._protocol = await loop.create_unix_connection(
+                    factory, local_socket)
+            else:
+                _, conn._protocol = await loop.create_connection(
+                    factory, ip_addr, port)
+        except OSError as ex:
+            raise exc.ConnectionException(str(ex))
+        return conn
+
+    def close(self):
+        self._protocol.transport.close()
+
+    @property
+    def in_flight(self):
+        return len(self._in_flight)
+
+    def _connection_lost(self, ex):
+        self._error = exc.ConnectionException(
+            str(ex) if ex else 'socket connection broken')
+        futures = [future for future, _ in self._in_flight.values()]
+        if self._data_for is not None:
+            futures.append(self._data_for[0])
+        for future in futures:
+            if not future.done():
+                future.set_exception(self._error)
+        self._in_flight.clear()
+
+    def _message_received(self, msg):
+        if self._data_for is not None:
+            future, resp = self._data_for
+            self._data_for = None
+            if not future.done():
+                future.set_result((resp, msg))
+            return
+        if self._event is not None:
+            resp, self._event = self._event, None
+            self._dispatch_event(resp, msg)
+            return
+
+        resp = network_pb2.Response()
+        resp.ParseFromString(msg)
+        request_id = resp.request_id
+        if request_id in self._subscriptions and resp.event:
+            if resp.data_ranges:
+                self._event = resp
+            else:
+                self._dispatch_event(resp, None)
+            return
+        if request_id not in self._in_flight:
+            if not self._in_flight:
+                # An event of a subscription we've just dropped.
+                return
+            # Servers that don't know about request ids reply in order.
+            request_id = next(iter(self._in_flight))
+        future, expects_data = self._in_flight.pop(request_id)
+        if expects_data and resp.ok:
+            self._data_for = (future, resp)
+        elif future.done():
+            pass
+        elif not resp.ok:
+            future.set_exception(exc.RequestFailed(resp.error_msg))
+        else:
+            future.set_result((resp, None))
+
+    def _dispatch_event(self, resp, data):
+        if resp.gone:
+            callback = self._subscriptions.pop(resp.request_id, None)
+        else:
+            callback = self._subscriptions.get(resp.request_id)
+        if callback is not None:
+            callback(resp, data)
+
+    def _write_msg(self, msg, data_message=False):
+        transport = self._protocol.transport
+        if len(msg) <= MAX_FRAME_SIZE and not data_message:
+            transport.write(_HEADER.pack(len(msg)) + msg)
+            return
+        view = memoryview(msg)
+        for pos in range(0, len(msg), MAX_FRAME_SIZE):
+            piece = view[pos:pos + MAX_FRAME_SIZE]
+            transport.write(_HEADER.pack(len(piece) | FRAME_CONTINUED))
+            transport.write(piece)
+        transport.write(_HEADER.pack(0))
+
+    async def request(self, req, data=None, subscription=None):
+        """Sends a request and waits for its response, returns it along
+        with the data message that followed it (if any).  data is sent
+        after the request, for ADD_SUB_BLOB.  Any number of requests can
+        be awaited at once.
+
+        subscription is the event callback of SUBSCRIBE_* requests."""
+        await self._slots.acquire()
+        try:
+            if self._error is not None:
+                raise self._error
+            self._last_request_id += 1
+            request_id = self._last_request_id
+            req.request_id = request_id
+            req.full_items = True
+            if data is not None:
+                req.data_size = len(data)
+            future = asyncio.get_event_loop().create_future()
+            self._in_flight[request_id] = (future,
+                                           req.type in DATA_REQUESTS)
+            if subscription is not None:
+                # Events may follow the response right away.
+                self._subscriptions[request_id] = subscription
+            self._write_msg(req.SerializeToString())
+            if data is not None:
+                self._write_msg(data, data_message=True)
+            await self._protocol.drain()
+            try:
+                resp, data = await future
+            except exc.VelesException:
+                if subscription is not None:
+                    self._subscriptions.pop(request_id, None)
+                raise
+            return resp, data
+        finally:
+            self._slots.release()
+
+    async def subscribe(self, id_path, sub_type, callback, offset=0,
+                        length=None):
+        """See VelesClient.subscribe."""
+        req = _request(sub_type, id_path)
+        req.data_offset = offset
+        if length is not None:
+            req.data_length = length
+        resp, data = await self.request(req, subscription=callback)
+        return resp.request_id, resp, data
+
+    async def unsubscribe(self, subscription_id):
+        self._subscriptions[subscription_id] = None
+        req = _request(network_pb2.Request.UNSUBSCRIBE)
+        req.subscription_id = subscription_id
+        try:
+            await self.request(req)
+        finally:
+            self._subscriptions.pop(subscription_id, None)
+
+
+def _request(req_type, id_path=()):
+    req = network_pb2.Request()
+    req.type = req_type
+    req.id.extend(id_path)
+    return req
+
+
+class _Requests(object):
+    """Typed requests, on top of request()."""
+
+    async def list_children(self, id_path=(), recursive=False):
+        """Returns network_pb2.LocalObject children of the object, with
+        their own children too if recursive."""
+        req = _request(network_pb2.Request.LIST_CHILDREN_RECURSIVE
+                       if recursive else network_pb2.Request.LIST_CHILDREN,
+                       id_path)
+        resp, _ = await self.request(req)
+        return list(resp.results)
+
+    async def create_chunk(self, id_path, name, start, end, comment='',
+                           chunk_type=''):
+        req = _request(network_pb2.Request.ADD_CHILD_CHUNK, id_path)
+        req.name = name
+        req.comment = comment
+        req.chunk_start = start
+        req.chunk_end = end
+        req.chunk_type = chunk_type
+        resp, _ = await self.request(req)
+        return resp.results[0]
+
+    async def create_chunks(self, id_path, chunks):
+        """See VelesClient.create_chunks."""
+        req = _request(network_pb2.Request.ADD_CHILD_CHUNKS, id_path)
+        for chunk in chunks:
+            new_chunk = req.chunks.add()
+            new_chunk.name = chunk['name']
+            new_chunk.start = chunk['start']
+            new_chunk.end = chunk['end']
+            new_chunk.comment = chunk.get('comment', '')
+            new_chunk.chunk_type = chunk.get('chunk_type', '')
+            if chunk.get('parent') is not None:
+                new_chunk.parent = chunk['parent'] + 1
+        resp, _ = await self.request(req)
+        return list(resp.results)
+
+    async def create_sub_blob(self, id_path, name, data):
+        req = _request(network_pb2.Request.ADD_SUB_BLOB, id_path)
+        req.name = name
+        resp, _ = await self.request(req, data=data)
+        return resp.results[0]
+
+    async def delete_object(self, id_path):
+        await self.request(
+            _request(network_pb2.Request.DELETE_OBJECT, id_path))
+
+    async def query(self, id_path=(), chunk_type='', name='', field_name='',
+                    field_value=b'', start=0, end=None, offset=0, limit=0):
+        """See VelesClient.query.  Returns network_pb2.LocalObject matches,
+        with ids of the objects between id_path and each one in its path
+        field, and the number of all matches."""
+        req = _request(network_pb2.Request.QUERY, id_path)
+        req.query.chunk_type = chunk_type
+        req.query.name = name
+        req.query.field_name = field_name
+        req.query.field_value = field_value
+        req.query.range.offset = start
+        if end is not None:
+            req.query.range.length = end - start
+        req.query.offset = offset
+        req.query.limit = limit
+        resp, _ = await self.request(req)
+        return list(resp.results), resp.total
+
+    async def get_blob_data(self, id_path, offset=0, length=None):
+        if length == 0:
+            return b''
+        req = _request(network_pb2.Request.GET_BLOB_DATA, id_path)
+        req.data_offset = offset
+        if length is not None:
+            req.data_length = length
+        _, data = await self.request(req)
+        return data
+
+    async def get_blob_data_ranges(self, id_path, ranges):
+        req = _request(network_pb2.Request.GET_BLOB_DATA_RANGES, id_path)
+        for offset, length in ranges:
+            data_range = req.data_ranges.add()
+            data_range.offset = offset
+            data_range.length = length
+        resp, data = await self.request(req)
+        element_size = (resp.data_width + 7) // 8
+        results = []
+        pos = 0
+        for data_range in resp.data_ranges:
+            size = data_range.length * element_size
+            results.append(data[pos:pos + size])
+            pos += size
+        return results
+
+
+class AsyncClient(AsyncConnection, _Requests):
+    """A single pipelined connection, with typed requests."""
+
+
+class ConnectionPool(_Requests):
+    """Spreads requests over several connections, each sent on the one with
+    the fewest in flight.  Requests on different connections may be handled
+    in any order, so requests depending on each other should be awaited one
+    after another."""
+
+    def __init__(self, connections):
+        self.connections = connections
+        # Pool subscription ids -> (connection, id on that connection).
+        self._subscriptions = {}
+        self._subscription_ids = itertools.count(1)
+
+    @classmethod
+    async def open(cls, size=4, ip_addr='127.0.0.1', port=3135,
+                   local_socket=None, max_in_flight=64):
+        connections = []
+        try:
+            for _ in range(size):
+                connections.append(await AsyncConnection.open(
+                    ip_addr, port, local_socket, max_in_flight))
+        except exc.VelesException:
+            for conn in connections:
+                conn.close()
+            raise
+        return cls(connections)
+
+    def close(self):
+        for conn in self.connections:
+            conn.close()
+
+    def _least_busy(self):
+        return min(self.connections, key=lambda conn: conn.in_flight)
+
+    async def request(self, req, data=None):
+        return await self._least_busy().request(req, data)
+
+    async def subscribe(self, id_path, sub_type, callback, offset=0,
+                        length=None):
+        """See VelesClient.subscribe.  Events come on the connection the
+        subscription was made on - the returned id is the pool's own, since
+        request ids of different connections may collide."""
+        conn = self._least_busy()
+        conn_id, resp, data = await conn.subscribe(
+            id_path, sub_type, callback, offset, length)
+        subscription_id = next(self._subscription_ids)
+        self._subscriptions[subscription_id] = (conn, conn_id)
+        return subscription_id, resp, data
+
+    async def unsubscribe(self, subscription_id):
+        conn, conn_id = self._subscriptions.pop(subscription_id)
+        await conn.unsubscribe(conn_id)
@@ -1,4 +1,3 @@
-from veles import network_pb2
 from veles.objects.base import LocalObject
 
 
@@ -10,17 +9,33 @@ class Blob(LocalObject):
 
     def fetch_data(self):
         if self._data is None:
-            req = network_pb2.Request()
-            req.type = network_pb2.Request.GET_BLOB_DATA
-            req.id.extend(self._id_path)
-            self._client._send_req(req)
-            self._data = self._client._recv_msg()
+            self._data = self._client.get_blob_data(self)
+
+    def fetch_ranges(self, ranges):
+        if self._data is not None:
+            return [self._data[offset:offset + length]
+                    for offset, length in ranges]
+        return self._client.get_blob_data_ranges(self, ranges)
 
     def __iter__(self):
         self.fetch_data()
         return self._data.__iter__()
 
     def __getitem__(self, i):
+        # Without the whole blob at hand, only fetch the requested range -
+        # unless it's relative to the blob end, which we don't know.
+        if self._data is None:
+            if isinstance(i, int) and i >= 0:
+                data = self._client.get_blob_data(self, i, 1)
+                if not data:
+                    raise IndexError('blob index out of range')
+                return data[0]
+            if (isinstance(i, slice) and i.step in (None, 1) and
+                    (i.start is None or i.start >= 0) and
+                    i.stop is not None and i.stop >= 0):
+                start = i.start or 0
+                return self._client.get_blob_data(
+                    self, start, max(i.stop - start, 0))
         self.fetch_data()
         return self._data[i]
 
@@ -0,0 +1,127 @@
+# Copyright 2017 CodiLime
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+import struct
+import sys
+import unittest
+
+from veles import exceptions
+from veles import network_pb2
+
+if sys.version_info >= (3, 5):
+    import asyncio
+
+    from veles import aio_api
+
+    class FakeServer(asyncio.Protocol):
+        """Waits for a number of requests, then answers them in reverse
+        order.  GET_BLOB_DATA gets blob_data in small frames."""
+
+        def __init__(self, expected, blob_data):
+            self.expected = expected
+            self.blob_data = blob_data
+            self.buf = b''
+            self.requests = []
+
+        def connection_made(self, transport):
+            self.transport = transport
+
+        def data_received(self, data):
+            self.buf += data
+            while len(self.buf) >= 4:
+                length = struct.unpack('<I', self.buf[:4])[0]
+                if len(self.buf) < 4 + length:
+                    return
+                req = network_pb2.Request()
+                req.ParseFromString(self.buf[4:4 + length])
+                self.buf = self.buf[4 + length:]
+                self.requests.append(req)
+            if len(self.requests) == self.expected:
+                for req in reversed(self.requests):
+                    self.respond(req)
+
+        def write_msg(self, msg, continued=False):
+            header = len(msg) | (aio_api.FRAME_CONTINUED if continued else 0)
+            self.transport.write(struct.pack('<I', header) + msg)
+
+        def respond(self, req):
+            resp = network_pb2.Response()
+            resp.request_id = req.request_id
+            resp.ok = req.type != network_pb2.Request.DELETE_OBJECT
+            if req.type == network_pb2.Request.LIST_CHILDREN:
+                resp.results.add(id=7, name='file')
+            self.write_msg(resp.SerializeToString())
+            if req.type == network_pb2.Request.GET_BLOB_DATA:
+                step = 100000
+                for pos in range(0, len(self.blob_data), step):
+                    self.write_msg(self.blob_data[pos:pos + step], True)
+                self.write_msg(b'')
+
+
+@unittest.skipIf(sys.version_info < (3, 5), 'needs asyncio')
+class TestAioApi(unittest.TestCase):
+    def setUp(self):
+        self.loop = asyncio.new_event_loop()
+        asyncio.set_event_loop(self.loop)
+        self.addCleanup(self.loop.close)
+
+    def _serve(self, expected, blob_data=b''):
+        server = self.loop.run_until_complete(self.loop.create_server(
+            lambda: FakeServer(expected, blob_data), '127.0.0.1', 0))
+        self.addCleanup(server.close)
+        return server.sockets[0].getsockname()[1]
+
+    def test_pipelined_requests(self):
+        blob_data = bytes(range(256)) * 2048
+        port = self._serve(3, blob_data)
+        client = self.loop.run_until_complete(
+            aio_api.AsyncClient.open('127.0.0.1', port))
+        self.addCleanup(client.close)
+
+        results = self.loop.run_until_complete(asyncio.gather(
+            client.list_children(),
+            client.get_blob_data([7]),
+            client.delete_object([7, 8]),
+            return_exceptions=True))
+        self.assertEqual([obj.name for obj in results[0]], ['file'])
+        self.assertEqual(results[1], blob_data)
+        self.assertIsInstance(results[2], exceptions.RequestFailed)
+
+    def test_pool(self):
+        port = self._serve(1)
+        pool = self.loop.run_until_complete(
+            aio_api.ConnectionPool.open(2, '127.0.0.1', port))
+        self.addCleanup(pool.close)
+
+        results = self.loop.run_until_complete(asyncio.gather(
+            pool.list_children(), pool.list_children()))
+        self.assertEqual([[obj.id for obj in res] for res in results],
+                         [[7], [7]])
+
+    def test_pool_subscribe(self):
+        port = self._serve(1)
+        pool = self.loop.run_until_complete(
+            aio_api.ConnectionPool.open(2, '127.0.0.1', port))
+        self.addCleanup(pool.close)
+
+        results = self.loop.run_until_complete(asyncio.gather(
+            pool.subscribe([7], network_pb2.Request.SUBSCRIBE_DESCRIPTION,
+                           lambda resp, data: None),
+            pool.subscribe([7], network_pb2.Request.SUBSCRIBE_DESCRIPTION,
+                           lambda resp, data: None)))
+        # Each went to its own connection, with the same request id there.
+        ids = [res[0] for res in results]
+        self.assertEqual(len(set(ids)), 2)
+        conns = [pool._subscriptions[sub_id] for sub_id in ids]
+        self.assertIsNot(conns[0][0], conns[1][0])
+        self.assertEqual(conns[0][1], conns[1][1])
@@ -1,3 +1,4 @@
+import os
 import socket
 import struct
 import unittest
@@ -5,6 +6,7 @@ import unittest
 import mock
 
 from veles import exceptions
+from veles import network_pb2
 from veles import veles_api
 
 
@@ -38,6 +40,19 @@ class TestVelesApi(unittest.TestCase):
         with self.assertRaises(exceptions.ConnectionException):
             client._recv_data(3)
 
+    def test_recv_msg_frames(self):
+        client = self._create_client()
+        recv = [struct.pack('<I', 3 | client.FRAME_CONTINUED), b'abc',
+                struct.pack('<I', 2 | client.FRAME_CONTINUED), b'de',
+                struct.pack('<I', 0)]
+        self.socket_mock().recv.side_effect = recv
+        self.assertEqual(client._recv_msg(), b'abcde')
+
+        pieces = []
+        self.socket_mock().recv.side_effect = recv
+        self.assertEqual(client._recv_msg(pieces.append), b'')
+        self.assertEqual(pieces, [b'abc', b'de'])
+
     @mock.patch('veles.network_pb2.Response')
     def test_send_req(self, RespClass):
         client = self._create_client()
@@ -54,3 +69,163 @@ class TestVelesApi(unittest.TestCase):
         self.socket_mock().recv.assert_has_calls([mock.call(4), mock.call(6)])
         RespClass.assert_called_once_with()
         RespClass().ParseFromString.assert_called_once_with(b'123456')
+
+    def test_get_blob_data_ranges(self):
+        client = self._create_client()
+        blob = mock.MagicMock()
+        blob._id_path = [1]
+        resp = network_pb2.Response()
+        resp.ok = True
+        resp.data_width = 8
+        for offset, length in [(2, 3), (10, 1)]:
+            data_range = resp.data_ranges.add()
+            data_range.offset = offset
+            data_range.length = length
+        resp_msg = resp.SerializeToString()
+        self.socket_mock().recv.side_effect = [
+            struct.pack('<I', len(resp_msg)), resp_msg,
+            struct.pack('<I', 4), b'abcd']
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+
+        ret = client.get_blob_data_ranges(blob, [(2, 3), (10, 1)])
+        self.assertEqual(ret, [b'abc', b'd'])
+        sent = self.socket_mock().send.call_args[0][0]
+        req = network_pb2.Request()
+        req.ParseFromString(sent[4:])
+        self.assertEqual(req.type, network_pb2.Request.GET_BLOB_DATA_RANGES)
+        self.assertEqual([(r.offset, r.length) for r in req.data_ranges],
+                         [(2, 3), (10, 1)])
+
+    def _response(self, request_id, ok=True):
+        resp = network_pb2.Response()
+        resp.ok = ok
+        resp.request_id = request_id
+        msg = resp.SerializeToString()
+        return [struct.pack('<I', len(msg)), msg]
+
+    def test_out_of_order_responses(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        self.socket_mock().recv.side_effect = (
+            self._response(2) + self._response(1, ok=False))
+
+        first = client.send_request(network_pb2.Request())
+        second = client.send_request(network_pb2.Request())
+        self.assertEqual((first, second), (1, 2))
+        with self.assertRaises(exceptions.RequestFailed):
+            client.wait_response(first)
+        resp, data = client.wait_response(second)
+        self.assertEqual(resp.request_id, 2)
+        self.assertIsNone(data)
+
+    def _message(self, resp):
+        msg = resp.SerializeToString()
+        return [struct.pack('<I', len(msg)), msg]
+
+    def test_subscribe_children(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        parent = mock.MagicMock()
+        parent._id_path = [1]
+        resp = network_pb2.Response()
+        resp.ok = True
+        resp.request_id = 1
+        resp.results.add(id=2, type=client.ObjectTypes.CHUNK)
+        event = network_pb2.Response()
+        event.ok = True
+        event.request_id = 1
+        event.event = True
+        event.removed_ids.append(2)
+        event.results.add(id=3, type=client.ObjectTypes.CHUNK)
+        self.socket_mock().recv.side_effect = (
+            self._message(resp) + self._message(event))
+
+        changes = []
+        client.subscribe_children(
+            parent, lambda added, removed: changes.append((
+                [obj.id for obj in added], [obj.id for obj in removed])))
+        self.assertEqual([child.id for child in parent.children], [2])
+        client.process_events()
+        self.assertEqual(changes, [([3], [2])])
+        self.assertEqual([child.id for child in parent.children], [3])
+        self.assertEqual(parent.children[0]._id_path, [1, 3])
+
+    @unittest.skipUnless(hasattr(os, 'memfd_create'), 'needs memfd')
+    def test_map_blob_data(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        blob = mock.MagicMock()
+        blob._id_path = [1]
+        resp = network_pb2.Response()
+        resp.ok = True
+        resp.request_id = 1
+        resp.data_width = 8
+        resp.data_ranges.add(offset=0, length=4)
+        self.socket_mock().recv.side_effect = self._message(resp)
+        fd = os.memfd_create('test')
+        os.write(fd, b'abcd')
+        self.socket_mock().recvmsg.return_value = (
+            b'\0', [(socket.SOL_SOCKET, socket.SCM_RIGHTS,
+                     struct.pack('i', fd))], 0, None)
+
+        data = client.map_blob_data(blob)
+        self.assertEqual(data[:], b'abcd')
+        data.close()
+        with self.assertRaises(OSError):
+            os.fstat(fd)
+
+    def test_full_items(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        responses = []
+        for request_id, strings in [(1, ['', 'len', 'Foo']),
+                                    (2, ['', 'Foo', 'len'])]:
+            resp = network_pb2.Response()
+            resp.ok = True
+            resp.request_id = request_id
+            resp.strings.extend(strings)
+            resp.field_types.add(mode=5, type_name=strings.index('Foo'))
+            chunk = resp.results.add(id=request_id)
+            chunk.items.add(type=3, name_index=strings.index('len'),
+                            field_type=0, value=b'\x01')
+            responses.append(resp)
+        self.socket_mock().recv.side_effect = (
+            self._message(responses[0]) + self._message(responses[1]))
+
+        first = client.send_request(network_pb2.Request())
+        second = client.send_request(network_pb2.Request())
+        items = [client.wait_response(request_id)[0].results[0].items[0]
+                 for request_id in (first, second)]
+        for item in items:
+            self.assertEqual(item.name, 'len')
+            self.assertEqual(client.strings[item.name_index], 'len')
+            field_type = client.field_types[item.field_type]
+            self.assertEqual(client.strings[field_type.type_name], 'Foo')
+        self.assertEqual(len(client.field_types), 1)
+
+    def test_query(self):
+        client = self._create_client()
+        sent = []
+        self.socket_mock().send.side_effect = (
+            lambda msg: sent.append(msg) or len(msg))
+        blob = mock.MagicMock()
+        blob._id_path = [1]
+        resp = network_pb2.Response()
+        resp.ok = True
+        resp.request_id = 1
+        resp.total = 5
+        resp.results.add(id=4, type=client.ObjectTypes.CHUNK, path=[2, 3])
+        self.socket_mock().recv.side_effect = self._message(resp)
+
+        chunks, total = client.query(blob, chunk_type='header', start=16,
+                                     end=48, offset=2, limit=1)
+        self.assertEqual(total, 5)
+        self.assertEqual([chunk._id_path for chunk in chunks], [[1, 2, 3, 4]])
+        req = network_pb2.Request()
+        req.ParseFromString(sent[0][4:])
+        self.assertEqual(req.type, network_pb2.Request.QUERY)
+        self.assertEqual(list(req.id), [1])
+        self.assertEqual(req.query.chunk_type, 'header')
+        self.assertEqual((req.query.range.offset, req.query.range.length),
+                         (16, 32))
+        self.assertEqual((req.query.offset, req.query.limit), (2, 1))
@@ -11,8 +11,12 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
+import collections
+import mmap
+import os
 import socket
 import struct
+import tempfile
 import weakref
 
 from veles import exceptions as exc
@@ -37,20 +41,59 @@ class VelesClient(object):
             CHUNK: objects.Chunk,
         }
 
-    def __init__(self, ip_addr='127.0.0.1', port=3135):
+    def __init__(self, ip_addr='127.0.0.1', port=3135, local_socket=None):
+        """Connects over TCP, or to the local socket of the given name (or
+        path) if one is given - the latter also enables map_blob_data."""
         self.ip_addr = ip_addr
         self.port = port
-        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        if local_socket is not None:
+            address = local_socket
+            if not os.path.isabs(address):
+                # Where Qt puts local sockets given by name.
+                address = os.path.join(tempfile.gettempdir(), address)
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        else:
+            address = (ip_addr, port)
+            self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         self._objects = weakref.WeakValueDictionary()
+        self._last_request_id = 0
+        # request id -> None, or where the data message following the
+        # response goes: a sink function or a list to collect it in
+        self._in_flight = collections.OrderedDict()
+        # request id -> (response, data)
+        self._responses = {}
+        # Names and field types of chunk data items, interned across all
+        # responses - items and types refer to them by index.
+        self.strings = ['']
+        self._string_ids = {'': 0}
+        self.field_types = []
+        self._field_type_ids = {}
+        # subscription id -> function called with (response, data) of
+        # each event, or None while it's being cancelled
+        self._subscriptions = {}
         try:
-            self.sock.connect((ip_addr, port))
+            self.sock.connect(address)
         except socket.error as ex:
             raise exc.ConnectionException(str(ex))
 
-    def _recv_msg(self):
-        length = self._recv_data(4)
-        length = struct.unpack('<I', length)[0]
-        return self._recv_data(length)
+    # Messages are sent in frames, see network.proto.
+    FRAME_CONTINUED = 0x80000000
+    FRAME_LENGTH_MASK = 0x7fffffff
+    MAX_FRAME_SIZE = 1 << 20
+
+    def _recv_msg(self, sink=None):
+        """Receives a whole message, or passes it frame by frame to sink
+        if given."""
+        frames = []
+        while True:
+            header = struct.unpack('<I', self._recv_data(4))[0]
+            frame = self._recv_data(header & self.FRAME_LENGTH_MASK)
+            if sink is None:
+                frames.append(frame)
+            elif frame:
+                sink(frame)
+            if not header & self.FRAME_CONTINUED:
+                return b''.join(frames)
 
     def _recv_data(self, length):
         total_recv = 0
@@ -66,8 +109,27 @@ class VelesClient(object):
             total_recv += len(recv)
         return b''.join(chunks)
 
-    def _send_req(self, req):
-        msg = struct.pack('<I', req.ByteSize()) + req.SerializeToString()
+    DATA_REQUESTS = (
+        network_pb2.Request.GET_BLOB_DATA,
+        network_pb2.Request.GET_BLOB_DATA_RANGES,
+        network_pb2.Request.SUBSCRIBE_BLOB_DATA,
+    )
+
+    # Marks MAP_BLOB_DATA requests in _in_flight.
+    _RECV_FD = object()
+
+    def _recv_fd(self):
+        fd_size = struct.calcsize('i')
+        try:
+            _, ancdata, _, _ = self.sock.recvmsg(1, socket.CMSG_SPACE(fd_size))
+        except socket.error as ex:
+            raise exc.ConnectionException(str(ex))
+        for level, cmsg_type, cmsg_data in ancdata:
+            if level == socket.SOL_SOCKET and cmsg_type == socket.SCM_RIGHTS:
+                return struct.unpack('i', cmsg_data[:fd_size])[0]
+        raise exc.ConnectionException('no descriptor received')
+
+    def _send_all(self, msg):
         total_sent = 0
         while total_sent < len(msg):
             try:
@@ -78,12 +140,148 @@ class VelesClient(object):
                 raise exc.ConnectionException('socket connection broken')
             total_sent += sent
 
-        response = self._recv_msg()
+    def _send_frames(self, pieces):
+        """Sends a message made of the given pieces, one frame each."""
+        for piece in pieces:
+            header = len(piece) | self.FRAME_CONTINUED
+            self._send_all(struct.pack('<I', header) + piece)
+        self._send_all(struct.pack('<I', 0))
+
+    def _send_msg(self, req):
+        size = req.ByteSize()
+        data = req.SerializeToString()
+        if size <= self.MAX_FRAME_SIZE:
+            self._send_all(struct.pack('<I', size) + data)
+        else:
+            self._send_frames(
+                data[pos:pos + self.MAX_FRAME_SIZE]
+                for pos in range(0, size, self.MAX_FRAME_SIZE))
+
+    def _data_pieces(self, data, size):
+        if hasattr(data, 'read'):
+            while size:
+                piece = data.read(min(size, self.MAX_FRAME_SIZE))
+                if not piece:
+                    raise exc.VelesException('Not enough data to send')
+                size -= len(piece)
+                yield piece
+        else:
+            for pos in range(0, size, self.MAX_FRAME_SIZE):
+                yield data[pos:min(pos + self.MAX_FRAME_SIZE, size)]
 
+    def send_request(self, req, data=None, data_size=None, sink=None):
+        """Sends a request without waiting for the response, returns its
+        id to be passed to wait_response.  Any number of requests can be
+        in flight at once.
+
+        data is sent right after the request (for ADD_SUB_BLOB), it can be
+        bytes or a file-like object to read data_size bytes from.  Blob data
+        sent in response is passed to sink piece by piece, if given."""
+        self._last_request_id += 1
+        request_id = self._last_request_id
+        req.request_id = request_id
+        req.full_items = True
+        if data is not None:
+            if data_size is None:
+                data_size = len(data)
+            req.data_size = data_size
+        self._send_msg(req)
+        if data is not None:
+            self._send_frames(self._data_pieces(data, data_size))
+        if req.type == network_pb2.Request.MAP_BLOB_DATA:
+            self._in_flight[request_id] = self._RECV_FD
+        elif req.type in self.DATA_REQUESTS:
+            self._in_flight[request_id] = sink or []
+        else:
+            self._in_flight[request_id] = None
+        return request_id
+
+    def _recv_response(self):
         resp = network_pb2.Response()
-        resp.ParseFromString(response)
+        resp.ParseFromString(self._recv_msg())
+        if resp.field_types or resp.strings:
+            self._intern_tables(resp)
+        request_id = resp.request_id
+        if resp.request_id in self._subscriptions and resp.event:
+            self._dispatch_event(resp)
+            return
+        if request_id not in self._in_flight:
+            # Servers that don't know about request ids reply in order.
+            request_id = next(iter(self._in_flight))
+        sink = self._in_flight.pop(request_id)
+        data = None
+        if sink is not None and resp.ok:
+            if sink is self._RECV_FD:
+                data = self._recv_fd()
+            elif callable(sink):
+                self._recv_msg(sink)
+            else:
+                data = self._recv_msg()
+        self._responses[request_id] = (resp, data)
+
+    def _intern_string(self, string):
+        if string not in self._string_ids:
+            self._string_ids[string] = len(self.strings)
+            self.strings.append(string)
+        return self._string_ids[string]
+
+    def _intern_tables(self, resp):
+        """Makes the indices in chunk data items of the response point to
+        self.strings and self.field_types, and fills in item names."""
+        type_ids = []
+        for field_type in resp.field_types:
+            field_type.type_name = self._intern_string(
+                resp.strings[field_type.type_name])
+            key = field_type.SerializeToString()
+            if key not in self._field_type_ids:
+                self._field_type_ids[key] = len(self.field_types)
+                self.field_types.append(field_type)
+            type_ids.append(self._field_type_ids[key])
+
+        def fix_items(obj):
+            for item in obj.items:
+                item.name = resp.strings[item.name_index]
+                item.name_index = self._intern_string(item.name)
+                if item.field_type < len(type_ids):
+                    item.field_type = type_ids[item.field_type]
+            for child in obj.children:
+                fix_items(child)
+
+        for result in resp.results:
+            fix_items(result)
+
+    def _dispatch_event(self, resp):
+        data = None
+        if resp.data_ranges:
+            data = self._recv_msg()
+        if resp.gone:
+            callback = self._subscriptions.pop(resp.request_id, None)
+        else:
+            callback = self._subscriptions.get(resp.request_id)
+        # Events racing with unsubscribe are dropped.
+        if callback is not None:
+            callback(resp, data)
+
+    def process_events(self):
+        """Waits for the next message from the server - subscription
+        events are only delivered while waiting for something."""
+        self._recv_response()
+
+    def wait_response(self, request_id):
+        """Waits for the response to the given request, returns it along
+        with the data message that followed it (if any)."""
+        while request_id not in self._responses:
+            self._recv_response()
+        resp, data = self._responses.pop(request_id)
         if not resp.ok:
             raise exc.RequestFailed(resp.error_msg)
+        return resp, data
+
+    def _send_raw_req(self, req):
+        return self.wait_response(self.send_request(req))
+
+    def _send_req(self, req):
+        resp, _ = self._send_raw_req(req)
 
         objs = []
         for res in resp.results:
@@ -137,6 +335,36 @@ class VelesClient(object):
         parent.children.append(new_chunk)
         return new_chunk
 
+    def create_chunks(self, parent, chunks):
+        """Creates many chunks with a single request.  chunks is a list
+        of dicts with name, start and end keys, and optionally comment,
+        chunk_type and parent - the index of an earlier entry on the list
+        to create the chunk in, instead of in parent."""
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.ADD_CHILD_CHUNKS
+        req.id.extend(parent._id_path)
+        for chunk in chunks:
+            new_chunk = req.chunks.add()
+            new_chunk.name = chunk['name']
+            new_chunk.start = chunk['start']
+            new_chunk.end = chunk['end']
+            new_chunk.comment = chunk.get('comment', '')
+            new_chunk.chunk_type = chunk.get('chunk_type', '')
+            if chunk.get('parent') is not None:
+                new_chunk.parent = chunk['parent'] + 1
+        resp, _ = self._send_raw_req(req)
+
+        created = []
+        for chunk, res in zip(chunks, resp.results):
+            chunk_parent = parent
+            if chunk.get('parent') is not None:
+                chunk_parent = created[chunk['parent']]
+            obj = self._prepare_object(res, chunk_parent._id_path,
+                                       chunk_parent)
+            chunk_parent.children.append(obj)
+            created.append(obj)
+        return created
+
     def delete_object(self, obj):
         if obj.type not in [self.ObjectTypes.SUB_BLOB, self.ObjectTypes.CHUNK]:
             raise exc.VelesException('Unsupported object type to delete')
@@ -147,3 +375,168 @@ class VelesClient(object):
         self._send_req(req)
         if obj.parent:
             obj.parent.children.remove(obj)
+
+    def query(self, obj=None, chunk_type='', name='', field_name='',
+              field_value=b'', start=0, end=None, offset=0, limit=0):
+        """Finds chunks of the blob obj (or of all files, if obj is None)
+        matching all given criteria - see the Query message in
+        network.proto.  Only chunks lying wholly within [start, end) are
+        returned, sorted by their start.  offset and limit (0 meaning
+        no limit) select a page of matches.  Returns the list of chunks,
+        and the number of all matches."""
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.QUERY
+        id_path = obj._id_path if obj is not None else []
+        req.id.extend(id_path)
+        req.query.chunk_type = chunk_type
+        req.query.name = name
+        req.query.field_name = field_name
+        req.query.field_value = field_value
+        req.query.range.offset = start
+        if end is not None:
+            req.query.range.length = end - start
+        req.query.offset = offset
+        req.query.limit = limit
+        resp, _ = self._send_raw_req(req)
+        chunks = [self._prepare_object(res, id_path + list(res.path))
+                  for res in resp.results]
+        return chunks, resp.total
+
+    def _split_ranges(self, resp, data):
+        element_size = (resp.data_width + 7) // 8
+        results = []
+        pos = 0
+        for data_range in resp.data_ranges:
+            size = data_range.length * element_size
+            results.append(data[pos:pos + size])
+            pos += size
+        return results
+
+    def get_blob_data(self, blob, offset=0, length=None):
+        """Downloads length elements of blob data starting at offset,
+        or everything after offset if length is None.  The range is
+        clipped to the blob size."""
+        if length == 0:
+            return b''
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.GET_BLOB_DATA
+        req.id.extend(blob._id_path)
+        req.data_offset = offset
+        if length is not None:
+            req.data_length = length
+        resp, data = self._send_raw_req(req)
+        return self._split_ranges(resp, data)[0]
+
+    def download_blob_data(self, blob, out, offset=0, length=None):
+        """Like get_blob_data, but writes the data to the file-like object
+        out as it arrives, without keeping it all in memory."""
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.GET_BLOB_DATA
+        req.id.extend(blob._id_path)
+        req.data_offset = offset
+        if length is not None:
+            req.data_length = length
+        resp, _ = self.wait_response(self.send_request(req, sink=out.write))
+        return resp.data_ranges[0].length
+
+    def map_blob_data(self, blob, offset=0, length=None):
+        """Like get_blob_data, but maps the data into memory straight from
+        the server, without copying it through the socket.  Only works
+        over a local socket.  Returns a read-only mmap object."""
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.MAP_BLOB_DATA
+        req.id.extend(blob._id_path)
+        req.data_offset = offset
+        if length is not None:
+            req.data_length = length
+        resp, fd = self._send_raw_req(req)
+        try:
+            size = resp.data_ranges[0].length * ((resp.data_width + 7) // 8)
+            if not size:
+                return b''
+            return mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+
+    def create_sub_blob(self, chunk, name, data, size=None):
+        """Creates a sub-blob of the chunk.  data can be bytes, or
+        a file-like object to read size bytes from - it's streamed to
+        the server, so it doesn't need to fit in memory."""
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.ADD_SUB_BLOB
+        req.id.extend(chunk._id_path)
+        req.name = name
+        resp, _ = self.wait_response(
+            self.send_request(req, data=data, data_size=size))
+        blob = self._prepare_object(resp.results[0], chunk._id_path, chunk)
+        chunk.children.append(blob)
+        return blob
+
+    def get_blob_data_ranges(self, blob, ranges):
+        """Downloads several (offset, length) ranges of blob data in
+        a single round trip, returns a list of their contents."""
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.GET_BLOB_DATA_RANGES
+        req.id.extend(blob._id_path)
+        for offset, length in ranges:
+            data_range = req.data_ranges.add()
+            data_range.offset = offset
+            data_range.length = length
+        resp, data = self._send_raw_req(req)
+        return self._split_ranges(resp, data)
+
+    def subscribe(self, obj, sub_type, callback, offset=0, length=None):
+        """Subscribes to changes of obj.  sub_type is one of the
+        Request.SUBSCRIBE_* operations, offset and length select the range
+        of SUBSCRIBE_BLOB_DATA.  Returns the subscription id, and the
+        current state (response and data) - from then on callback is called
+        with the response and data of each event, see network.proto."""
+        req = network_pb2.Request()
+        req.type = sub_type
+        req.id.extend(obj._id_path)
+        req.data_offset = offset
+        if length is not None:
+            req.data_length = length
+        request_id = self.send_request(req)
+        # Events may come right after the response.
+        self._subscriptions[request_id] = callback
+        try:
+            resp, data = self.wait_response(request_id)
+        except exc.VelesException:
+            self._subscriptions.pop(request_id, None)
+            raise
+        return request_id, resp, data
+
+    def subscribe_children(self, obj, callback):
+        """Keeps obj.children up to date, calling callback with the lists
+        of added and removed objects after each change."""
+        def on_event(resp, _):
+            if resp.gone:
+                callback([], [])
+                return
+            removed_ids = set(resp.removed_ids)
+            removed = [child for child in obj.children
+                       if child.id in removed_ids]
+            obj.children = [child for child in obj.children
+                            if child.id not in removed_ids]
+            added = [self._prepare_object(res, obj._id_path, obj)
+                     for res in resp.results]
+            obj.children.extend(added)
+            callback(added, removed)
+
+        subscription_id, resp, _ = self.subscribe(
+            obj, network_pb2.Request.SUBSCRIBE_CHILDREN, on_event)
+        obj.children = [self._prepare_object(res, obj._id_path, obj)
+                        for res in resp.results]
+        return subscription_id
+
+    def unsubscribe(self, subscription_id):
+        # Events may still come until the response.
+        self._subscriptions[subscription_id] = None
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.UNSUBSCRIBE
+        req.subscription_id = subscription_id
+        try:
+            self._send_raw_req(req)
+        finally:
+            self._subscriptions.pop(subscription_id, None)
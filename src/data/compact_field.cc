@@ -0,0 +1,282 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "data/compact_field.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <QDataStream>
+
+namespace veles {
+namespace data {
+
+uint32_t FieldDescriptorPool::internName(const QString &name) {
+  auto it = name_ids_.find(name);
+  if (it != name_ids_.end()) {
+    return it.value();
+  }
+  uint32_t id = names_.size();
+  names_.append(name);
+  name_ids_.insert(name, id);
+  return id;
+}
+
+bool FieldDescriptorPool::findName(const QString &name, uint32_t *id) const {
+  auto it = name_ids_.find(name);
+  if (it == name_ids_.end()) {
+    return false;
+  }
+  *id = it.value();
+  return true;
+}
+
+QByteArray FieldDescriptorPool::descriptorKey(const RepackFormat &repack,
+                                              const FieldHighType &high_type) {
+  // The FieldHighType factories leave members irrelevant for the chosen
+  // mode uninitialized, so only the relevant ones may go into the key.
+  QByteArray key;
+  QDataStream stream(&key, QIODevice::WriteOnly);
+  stream << static_cast<qint32>(repack.endian) << repack.width
+         << repack.highPad << repack.lowPad
+         << static_cast<qint32>(high_type.mode);
+  switch (high_type.mode) {
+  case FieldHighType::FIXED:
+    stream << static_cast<qint32>(high_type.shift)
+           << static_cast<qint32>(high_type.sign_mode);
+    break;
+  case FieldHighType::FLOAT:
+    stream << static_cast<qint32>(high_type.float_mode)
+           << high_type.float_complex;
+    break;
+  case FieldHighType::STRING:
+    stream << static_cast<qint32>(high_type.string_mode)
+           << static_cast<qint32>(high_type.string_encoding);
+    break;
+  case FieldHighType::POINTER:
+    stream << static_cast<qint32>(high_type.shift) << high_type.type_name;
+    break;
+  case FieldHighType::ENUM:
+    stream << high_type.type_name;
+    break;
+  case FieldHighType::NONE:
+    break;
+  }
+  return key;
+}
+
+uint32_t FieldDescriptorPool::internDescriptor(
+    const RepackFormat &repack, const FieldHighType &high_type) {
+  QByteArray key = descriptorKey(repack, high_type);
+  auto it = descriptor_ids_.find(key);
+  if (it != descriptor_ids_.end()) {
+    return it.value();
+  }
+  uint32_t id = descriptors_.size();
+  descriptors_.push_back(FieldDescriptor{repack, high_type});
+  descriptor_ids_.insert(key, id);
+  return id;
+}
+
+static bool sameBinData(const BinData &a, const BinData &b) {
+  return a.width() == b.width() && a.size() == b.size() &&
+      memcmp(a.rawData(), b.rawData(), a.octets()) == 0;
+}
+
+BinData CompactChunkItems::decode(const Item &item,
+                                  const FieldDescriptor &descriptor,
+                                  const BinData *source) {
+  // Parsers may emit fields running past the end of the blob - the value
+  // is then truncated, just like when it was originally read.
+  uint64_t end = source ? std::min<uint64_t>(item.end, source->size()) : 0;
+  if (source == nullptr || item.start > end) {
+    return BinData(descriptor.repack.width, 0);
+  }
+  return repack(source->data(item.start, end), descriptor.repack, 0,
+                item.num_elements);
+}
+
+void CompactChunkItems::assign(const std::vector<ChunkDataItem> &items,
+                               FieldDescriptorPool *pool,
+                               const BinData *source) {
+  clear();
+  items_.reserve(items.size());
+  for (auto &src : items) {
+    Item item;
+    item.type = src.type;
+    item.value_mode = ValueMode::NONE;
+    item.name = pool->internName(src.name);
+    item.descriptor = k_no_index;
+    item.value = k_no_index;
+    item.ref_begin = refs_.size();
+    item.ref_count = src.ref.size();
+    item.start = src.start;
+    item.end = src.end;
+    item.num_elements = src.num_elements;
+    refs_.insert(refs_.end(), src.ref.begin(), src.ref.end());
+
+    switch (src.type) {
+    case ChunkDataItem::FIELD:
+      item.descriptor = pool->internDescriptor(src.repack, src.high_type);
+      break;
+    case ChunkDataItem::BITFIELD:
+    case ChunkDataItem::COMPUTED:
+      // repack is only meaningful (and initialized) for FIELDs.
+      item.descriptor = pool->internDescriptor(
+          RepackFormat{RepackEndian::LITTLE, 0, 0, 0}, src.high_type);
+      break;
+    default:
+      break;
+    }
+
+    if (item.descriptor != k_no_index) {
+      item.value_mode = ValueMode::INLINE;
+      if (src.type == ChunkDataItem::FIELD && source != nullptr &&
+          sameBinData(decode(item, pool->descriptor(item.descriptor), source),
+                      src.raw_value)) {
+        item.value_mode = ValueMode::BLOB;
+        blob_start_ = std::min(blob_start_, item.start);
+        blob_end_ = std::max(blob_end_, item.end);
+      } else {
+        item.value = values_.size();
+        values_.push_back(src.raw_value);
+      }
+    }
+    items_.push_back(item);
+  }
+  items_.shrink_to_fit();
+  values_.shrink_to_fit();
+  refs_.shrink_to_fit();
+}
+
+ChunkDataItem CompactChunkItems::item(size_t idx,
+                                      const FieldDescriptorPool &pool,
+                                      const BinData *source) const {
+  const Item &item = items_[idx];
+  ChunkDataItem res;
+  res.type = static_cast<ChunkDataItem::ChunkDataItemType>(item.type);
+  res.start = item.start;
+  res.end = item.end;
+  res.name = pool.name(item.name);
+  res.num_elements = item.num_elements;
+  if (item.descriptor != k_no_index) {
+    const FieldDescriptor &descriptor = pool.descriptor(item.descriptor);
+    res.repack = descriptor.repack;
+    res.high_type = descriptor.high_type;
+  }
+  switch (item.value_mode) {
+  case ValueMode::BLOB:
+    res.raw_value = decode(item, pool.descriptor(item.descriptor), source);
+    break;
+  case ValueMode::INLINE:
+    res.raw_value = values_[item.value];
+    break;
+  case ValueMode::NONE:
+    break;
+  }
+  res.ref.assign(refs_.begin() + item.ref_begin,
+                 refs_.begin() + item.ref_begin + item.ref_count);
+  return res;
+}
+
+std::vector<ChunkDataItem> CompactChunkItems::expand(
+    const FieldDescriptorPool &pool, const BinData *source) const {
+  std::vector<ChunkDataItem> res;
+  res.reserve(items_.size());
+  for (size_t i = 0; i < items_.size(); i++) {
+    res.push_back(item(i, pool, source));
+  }
+  return res;
+}
+
+// Items with a value of their own - subchunks and subblobs only borrow
+// the name of the object they point to.
+static bool isField(uint8_t type) {
+  return type == ChunkDataItem::FIELD || type == ChunkDataItem::COMPUTED ||
+         type == ChunkDataItem::BITFIELD;
+}
+
+std::vector<uint32_t> CompactChunkItems::names() const {
+  std::vector<uint32_t> res;
+  res.reserve(items_.size());
+  for (auto &item : items_) {
+    if (isField(item.type)) {
+      res.push_back(item.name);
+    }
+  }
+  std::sort(res.begin(), res.end());
+  res.erase(std::unique(res.begin(), res.end()), res.end());
+  return res;
+}
+
+std::vector<size_t> CompactChunkItems::itemsNamed(uint32_t name) const {
+  std::vector<size_t> res;
+  for (size_t i = 0; i < items_.size(); i++) {
+    if (items_[i].name == name && isField(items_[i].type)) {
+      res.push_back(i);
+    }
+  }
+  return res;
+}
+
+void CompactChunkItems::detachValues(const FieldDescriptorPool &pool,
+                                     const BinData *source, uint64_t start,
+                                     uint64_t end, bool moved) {
+  if (blob_end_ <= start || (!moved && blob_start_ >= end)) {
+    return;
+  }
+  blob_start_ = UINT64_MAX;
+  blob_end_ = 0;
+  for (auto &item : items_) {
+    if (item.value_mode != ValueMode::BLOB) {
+      continue;
+    }
+    if (item.end > start && (moved || item.start < end)) {
+      item.value_mode = ValueMode::INLINE;
+      item.value = values_.size();
+      values_.push_back(decode(item, pool.descriptor(item.descriptor),
+                               source));
+    } else {
+      blob_start_ = std::min(blob_start_, item.start);
+      blob_end_ = std::max(blob_end_, item.end);
+    }
+  }
+}
+
+void CompactChunkItems::clear() {
+  items_.clear();
+  values_.clear();
+  refs_.clear();
+  blob_start_ = UINT64_MAX;
+  blob_end_ = 0;
+}
+
+size_t CompactChunkItems::memoryUsage() const {
+  size_t res = items_.capacity() * sizeof(Item) +
+      values_.capacity() * sizeof(BinData) +
+      refs_.capacity() * sizeof(ObjectHandle);
+  for (auto &value : values_) {
+    // Single elements of up to 64 bits are stored inside the BinData itself.
+    if (value.size() > 1 || value.width() > 64) {
+      res += value.octets();
+    }
+  }
+  return res;
+}
+
+}  // namespace data
+}  // namespace veles
@@ -70,6 +70,10 @@ MethodResultPromise *LocalObjectHandle::runMethod(PMethodRequest req) {
   return promise;
 }
 
+uint64_t LocalObjectHandle::id() const {
+  return obj_->id();
+}
+
 MethodRunner *MethodRunner::forwarder(QThread *thread) {
   MethodRunner *res = new MethodRunner;
   res->moveToThread(thread);
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "db/index.h"
+
+#include "db/object.h"
+
+namespace veles {
+namespace db {
+
+namespace {
+
+template <typename Key>
+void pickSmaller(const QHash<Key, QSet<ChunkObject *>> &index, const Key &key,
+                 const QSet<ChunkObject *> **candidates) {
+  static const QSet<ChunkObject *> none;
+  auto it = index.find(key);
+  const QSet<ChunkObject *> *set = it == index.end() ? &none : &it.value();
+  if (*candidates == nullptr || set->size() < (*candidates)->size()) {
+    *candidates = set;
+  }
+}
+
+}  // namespace
+
+void ChunkIndex::update(ChunkObject *chunk) {
+  auto it = entries_.find(chunk);
+  if (it != entries_.end()) {
+    unlink(chunk, it.value());
+  }
+  Entry entry{chunk->start(), chunk->chunkType(), chunk->name(),
+              chunk->fieldNames(), chunk->valuesStart(), chunk->valuesEnd()};
+  by_start_.insert(std::make_pair(entry.start, chunk));
+  if (entry.values_start < entry.values_end) {
+    by_values_start_.insert(std::make_pair(entry.values_start, chunk));
+    values_lengths_.insert(entry.values_end - entry.values_start);
+  }
+  by_type_[entry.chunk_type].insert(chunk);
+  by_name_[entry.name].insert(chunk);
+  for (auto name : entry.field_names) {
+    by_field_[name].insert(chunk);
+  }
+  entries_.insert(chunk, entry);
+}
+
+std::vector<ChunkObject *> ChunkIndex::chunks() const {
+  std::vector<ChunkObject *> res;
+  res.reserve(entries_.size());
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    res.push_back(it.key());
+  }
+  return res;
+}
+
+void ChunkIndex::valuesTouching(uint64_t start, uint64_t end, bool moved,
+                                std::vector<ChunkObject *> *res) const {
+  if (values_lengths_.empty()) {
+    return;
+  }
+  // A range starting before start - longest can't reach start.
+  uint64_t longest = *values_lengths_.rbegin();
+  uint64_t from = start > longest ? start - longest : 0;
+  for (auto it = by_values_start_.lower_bound(from);
+       it != by_values_start_.end() && (moved || it->first < end); ++it) {
+    if (entries_.find(it->second).value().values_end > start) {
+      res->push_back(it->second);
+    }
+  }
+}
+
+void ChunkIndex::remove(ChunkObject *chunk) {
+  auto it = entries_.find(chunk);
+  if (it == entries_.end()) {
+    return;
+  }
+  unlink(chunk, it.value());
+  entries_.erase(it);
+}
+
+void ChunkIndex::unlink(ChunkObject *chunk, const Entry &entry) {
+  auto range = by_start_.equal_range(entry.start);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == chunk) {
+      by_start_.erase(it);
+      break;
+    }
+  }
+  if (entry.values_start < entry.values_end) {
+    range = by_values_start_.equal_range(entry.values_start);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == chunk) {
+        by_values_start_.erase(it);
+        break;
+      }
+    }
+    values_lengths_.erase(
+        values_lengths_.find(entry.values_end - entry.values_start));
+  }
+  auto drop = [chunk](QSet<ChunkObject *> &set) {
+    set.remove(chunk);
+    return set.empty();
+  };
+  if (drop(by_type_[entry.chunk_type])) {
+    by_type_.remove(entry.chunk_type);
+  }
+  if (drop(by_name_[entry.name])) {
+    by_name_.remove(entry.name);
+  }
+  for (auto name : entry.field_names) {
+    if (drop(by_field_[name])) {
+      by_field_.remove(name);
+    }
+  }
+}
+
+bool ChunkIndex::matches(const dbif::QueryRequest &req, ChunkObject *chunk,
+                         uint32_t field_name) {
+  if (chunk->start() < req.start || chunk->end() > req.end) {
+    return false;
+  }
+  if (!req.chunk_type.isEmpty() && chunk->chunkType() != req.chunk_type) {
+    return false;
+  }
+  if (!req.name.isEmpty() && chunk->name() != req.name) {
+    return false;
+  }
+  if (!req.field_name.isEmpty()
+      && !chunk->hasField(field_name, req.field_value)) {
+    return false;
+  }
+  return true;
+}
+
+void ChunkIndex::query(const dbif::QueryRequest &req,
+                       const data::FieldDescriptorPool &pool,
+                       std::vector<ChunkObject *> *res) const {
+  uint32_t field_name = 0;
+  if (!req.field_name.isEmpty() && !pool.findName(req.field_name,
+                                                  &field_name)) {
+    return;
+  }
+  // Pick the smallest candidate set out of the exact-match criteria.
+  const QSet<ChunkObject *> *candidates = nullptr;
+  if (!req.chunk_type.isEmpty()) {
+    pickSmaller(by_type_, req.chunk_type, &candidates);
+  }
+  if (!req.name.isEmpty()) {
+    pickSmaller(by_name_, req.name, &candidates);
+  }
+  if (!req.field_name.isEmpty()) {
+    pickSmaller(by_field_, field_name, &candidates);
+  }
+  if (candidates != nullptr) {
+    for (auto chunk : *candidates) {
+      if (matches(req, chunk, field_name)) {
+        res->push_back(chunk);
+      }
+    }
+    return;
+  }
+  // No exact-match criteria - only the range is left.
+  for (auto it = by_start_.lower_bound(req.start);
+       it != by_start_.end() && it->first < req.end; ++it) {
+    if (matches(req, it->second, field_name)) {
+      res->push_back(it->second);
+    }
+  }
+}
+
+}  // namespace db
+}  // namespace veles
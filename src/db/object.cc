@@ -14,10 +14,15 @@
  * limitations under the License.
  *
  */
+#include <string.h>
+
+#include <algorithm>
+
 #include "db/handle.h"
 #include "db/object.h"
 #include "db/getter.h"
 #include "db/universe.h"
+#include "db/unpack.h"
 #include "dbif/error.h"
 #include "dbif/info.h"
 #include "dbif/method.h"
@@ -138,6 +143,10 @@ void LocalObject::kill() {
 
 void RootLocalObject::runMethod(MethodRunner *runner, PMethodRequest req) {
   if (auto blobreq = req.dynamicCast<dbif::RootCreateFileBlobFromDataRequest>()) {
+    if (!db()->canStore(blobreq->data.octets())) {
+      runner->sendError<dbif::MemoryLimitError>();
+      return;
+    }
     PLocalObject obj = FileBlobObject::create(this, blobreq->data, blobreq->path);
     runner->sendResult<dbif::CreatedReply>(db()->handle(obj));
   } else {
@@ -145,8 +154,62 @@ void RootLocalObject::runMethod(MethodRunner *runner, PMethodRequest req) {
   }
 }
 
+// The object a chunk or blob is nested in, for query result paths.
+static LocalObject *queryParent(LocalObject *obj) {
+  if (auto chunk = dynamic_cast<ChunkObject *>(obj)) {
+    if (chunk->parentChunk()) {
+      return chunk->parentChunk().data();
+    }
+    return chunk->blob().data();
+  }
+  if (auto blob = dynamic_cast<DataBlobObject *>(obj)) {
+    return blob->parent();
+  }
+  return nullptr;
+}
+
+static void queryReply(LocalObject *target, InfoGetter *getter,
+                       const dbif::QueryRequest &req,
+                       std::vector<ChunkObject *> matches) {
+  std::sort(matches.begin(), matches.end(),
+            [](ChunkObject *a, ChunkObject *b) {
+    if (a->start() != b->start()) {
+      return a->start() < b->start();
+    }
+    return a->id() < b->id();
+  });
+  uint64_t total = matches.size();
+  uint64_t first = std::min(req.offset, total);
+  uint64_t last = total;
+  if (req.limit != 0 && req.limit < last - first) {
+    last = first + req.limit;
+  }
+  std::vector<dbif::ObjectHandle> objects;
+  std::vector<std::vector<uint64_t>> paths;
+  for (uint64_t i = first; i < last; i++) {
+    ChunkObject *chunk = matches[i];
+    objects.push_back(target->db()->handle(chunk->sharedFromThis()));
+    std::vector<uint64_t> path;
+    for (LocalObject *obj = queryParent(chunk); obj != nullptr && obj != target;
+         obj = queryParent(obj)) {
+      path.push_back(obj->id());
+    }
+    std::reverse(path.begin(), path.end());
+    paths.push_back(path);
+  }
+  getter->sendInfo<dbif::QueryReply>(objects, paths, total);
+}
+
 void RootLocalObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
-    if (auto parsersreq = req.dynamicCast<dbif::ParsersListRequest>()) {
+    if (auto queryreq = req.dynamicCast<dbif::QueryRequest>()) {
+      std::vector<ChunkObject *> matches;
+      for (auto obj : children()) {
+        if (auto blob = obj.dynamicCast<DataBlobObject>()) {
+          blob->chunkIndex()->query(*queryreq, *db()->fieldPool(), &matches);
+        }
+      }
+      queryReply(this, getter, *queryreq, matches);
+    } else if (auto parsersreq = req.dynamicCast<dbif::ParsersListRequest>()) {
         parsers_list_reply(getter);
         if (!once) {
           parsers_list_watchers_.insert(getter);
@@ -175,7 +238,48 @@ void DataBlobObject::remove_data_watcher(InfoGetter *getter) {
   data_watchers_.remove(getter);
 }
 
+void DataBlobObject::data_updated() {
+  for (auto iter = data_watchers_.begin(); iter != data_watchers_.end(); iter++) {
+    data_reply(iter.key(), iter.value().first, iter.value().second);
+  }
+}
+
+void DataBlobObject::source_changed(uint64_t start, uint64_t end, bool moved) {
+  auto transformed_blobs = transformed_blobs_;
+  for (auto blob : transformed_blobs) {
+    if (blob->end() >= start && (moved || blob->start() <= end)) {
+      blob->invalidate();
+    }
+  }
+}
+
+static void createTransformedBlob(
+    LocalObject *parent, PLocalObject default_source, MethodRunner *runner,
+    QSharedPointer<dbif::CreateTransformedBlobRequest> req) {
+  if (!parent->db()->parser()->transform(req->transform)) {
+    runner->sendError<dbif::UnknownTransformError>();
+    return;
+  }
+  PLocalObject source = default_source;
+  if (req->source) {
+    source = req->source.dynamicCast<LocalObjectHandle>()->obj();
+  }
+  if (!source.dynamicCast<DataBlobObject>()) {
+    runner->sendError<dbif::InvalidTypeError>();
+    return;
+  }
+  if (req->start > req->end) {
+    runner->sendError<dbif::BlobDataInvalidRangeError>();
+    return;
+  }
+  PLocalObject obj = TransformedBlobObject::create(
+    parent, source, req->start, req->end, req->transform, req->param,
+    req->name);
+  runner->sendResult<dbif::CreatedReply>(parent->db()->handle(obj));
+}
+
 void DataBlobObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
+  ensureData();
   if (auto datareq = req.dynamicCast<dbif::BlobDataRequest>()) {
     if (datareq->start > data_.size()) {
       getter->sendError<dbif::BlobDataInvalidRangeError>();
@@ -189,12 +293,17 @@ void DataBlobObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
         shared_this.dynamicCast<DataBlobObject>()->remove_data_watcher(getter);
       });
     }
+  } else if (auto queryreq = req.dynamicCast<dbif::QueryRequest>()) {
+    std::vector<ChunkObject *> matches;
+    chunk_index_.query(*queryreq, *db()->fieldPool(), &matches);
+    queryReply(this, getter, *queryreq, matches);
   } else {
     LocalObject::getInfo(getter, req, once);
   }
 }
 
 void DataBlobObject::runMethod(MethodRunner *runner, PMethodRequest req) {
+  ensureData();
   if (auto datareq = req.dynamicCast<dbif::ChangeDataRequest>()) {
     if (datareq->start >= data_.size()) {
       runner->sendError<dbif::BlobDataInvalidRangeError>();
@@ -208,6 +317,18 @@ void DataBlobObject::runMethod(MethodRunner *runner, PMethodRequest req) {
       runner->sendError<dbif::BlobDataInvalidWidthError>();
       return;
     }
+    if (newdata.size() > oldsize &&
+        !db()->canStore((newdata.size() - oldsize) *
+                        data_.octetsPerElement())) {
+      runner->sendError<dbif::MemoryLimitError>();
+      return;
+    }
+    bool moved = newdata.size() != oldsize;
+    std::vector<ChunkObject *> touched;
+    chunk_index_.valuesTouching(start, end, moved, &touched);
+    for (auto chunk : touched) {
+      chunk->blobChanging(start, end, moved);
+    }
     if (oldsize == newdata.size()) {
       data_.setData(start, end, newdata);
     } else {
@@ -217,14 +338,15 @@ void DataBlobObject::runMethod(MethodRunner *runner, PMethodRequest req) {
       merged.setData(start, newend, newdata);
       merged.setData(newend, merged.size(), data_.data(end, data_.size()));
       std::swap(data_, merged);
+      dataResized();
     }
-    bool moved = newdata.size() != oldsize;
     for (auto iter = data_watchers_.begin(); iter != data_watchers_.end(); iter++) {
       if (iter.value().second >= start &&
           (moved || iter.value().first <= end)) {
         data_reply(iter.key(), iter.value().first, iter.value().second);
       }
     }
+    source_changed(start, end, moved);
     runner->sendResult<dbif::NullReply>();
   } else if (auto chreq = req.dynamicCast<dbif::ChunkCreateRequest>()) {
     PLocalObject parent_chunk;
@@ -238,17 +360,87 @@ void DataBlobObject::runMethod(MethodRunner *runner, PMethodRequest req) {
     PLocalObject obj = ChunkObject::create(sharedFromThis(), parent_chunk,
       chreq->start, chreq->end, chreq->chunk_type, chreq->name);
     runner->sendResult<dbif::CreatedReply>(db()->handle(obj));
+  } else if (auto manyreq = req.dynamicCast<dbif::ChunkCreateManyRequest>()) {
+    PLocalObject parent_chunk;
+    if (manyreq->parent_chunk) {
+      parent_chunk = manyreq->parent_chunk.dynamicCast<LocalObjectHandle>()->obj();
+      if (!parent_chunk.dynamicCast<ChunkObject>()) {
+        runner->sendError<dbif::InvalidTypeError>();
+        return;
+      }
+    }
+    auto &specs = manyreq->chunks;
+    for (size_t i = 0; i < specs.size(); i++) {
+      if (specs[i].parent >= static_cast<int64_t>(i) || specs[i].parent < -1) {
+        runner->sendError<dbif::ObjectInvalidRequestError>();
+        return;
+      }
+    }
+    std::vector<PLocalObject> created;
+    std::vector<std::vector<PLocalObject>> children(specs.size());
+    created.reserve(specs.size());
+    for (auto &spec : specs) {
+      PLocalObject parent = parent_chunk;
+      if (spec.parent >= 0) {
+        parent = created[spec.parent];
+      }
+      PLocalObject obj = ChunkObject::create(sharedFromThis(), parent,
+        spec.start, spec.end, spec.chunk_type, spec.name);
+      if (spec.parent >= 0) {
+        children[spec.parent].push_back(obj);
+      }
+      created.push_back(obj);
+    }
+    std::vector<dbif::ObjectHandle> handles;
+    handles.reserve(specs.size());
+    for (size_t i = 0; i < specs.size(); i++) {
+      std::vector<data::ChunkDataItem> items = specs[i].items;
+      size_t next_child = 0;
+      for (auto &item : items) {
+        if (item.type == data::ChunkDataItem::SUBCHUNK && item.ref.empty() &&
+            next_child < children[i].size()) {
+          item.ref = {db()->handle(children[i][next_child++])};
+        }
+      }
+      created[i].staticCast<ChunkObject>()->setParse(
+        specs[i].start, specs[i].end, items);
+      handles.push_back(db()->handle(created[i]));
+    }
+    runner->sendResult<dbif::CreatedManyReply>(handles);
   } else if (auto parse_req = req.dynamicCast<dbif::BlobParseRequest>()) {
-    emit db()->parse(
-        db()->handle(sharedFromThis()), runner->forwarder(db()->parserThread()),
-        parse_req->parser_id, parse_req->start, parse_req->parent_chunk);
+    if (parse_req->recursive) {
+      auto unpack = new RecursiveUnpack(db(), runner, parse_req->max_depth,
+                                        parse_req->max_total_size);
+      unpack->start(sharedFromThis(), parse_req->parser_id, parse_req->start,
+                    parse_req->parent_chunk);
+    } else {
+      emit db()->parse(
+          db()->handle(sharedFromThis()), runner->forwarder(db()->parserThread()),
+          parse_req->parser_id, parse_req->start, parse_req->parent_chunk);
+    }
+  } else if (auto transreq = req.dynamicCast<dbif::CreateTransformedBlobRequest>()) {
+    createTransformedBlob(this, sharedFromThis(), runner, transreq);
   } else {
     LocalObject::runMethod(runner, req);
   }
 }
 
+void DataBlobObject::dataResized() {
+  if (dead()) {
+    return;
+  }
+  usage_db_->updateDataUsage(usage_, data_.octets());
+  usage_ = data_.octets();
+}
+
+bool DataBlobObject::canResize(uint64_t octets) const {
+  return octets <= usage_ || usage_db_->canStore(octets - usage_);
+}
+
 void DataBlobObject::killed() {
   LocalObject::killed();
+  usage_db_->updateDataUsage(usage_, 0);
+  usage_ = 0;
   parent_->delChild(sharedFromThis());
   auto data_watchers = data_watchers_.keys();
   for (auto getter: data_watchers) {
@@ -268,6 +460,129 @@ void SubBlobObject::description_reply(InfoGetter *getter) {
   );
 }
 
+void TransformedBlobObject::description_reply(InfoGetter *getter) {
+  getter->sendInfo<dbif::SubBlobDescriptionReply>(
+    name(), comment(), 0, data().size(), 8, db()->handle(parent()->sharedFromThis())
+  );
+}
+
+void TransformedBlobObject::ensureData() {
+  if (state_ != State::INVALID || dead()) {
+    return;
+  }
+  state_ = State::COMPUTING;
+  uint64_t generation = generation_;
+  // A source that is being computed itself gives its previous contents
+  // here, and invalidates this blob once the new ones arrive.
+  const data::BinData &src = source_.staticCast<DataBlobObject>()->data();
+  uint64_t end = std::min(end_, uint64_t(src.size()));
+  uint64_t start = std::min(start_, end);
+  ParserWorker *worker = db()->transformWorker();
+  InfoGetter *getter = new InfoGetter;
+  auto shared_this = sharedFromThis().staticCast<TransformedBlobObject>();
+  QObject::connect(getter, &InfoGetter::gotInfo, getter,
+                   [shared_this, getter, generation] (dbif::PInfoReply reply) {
+    getter->deleteLater();
+    shared_this->transformed(
+        generation, reply.staticCast<dbif::BlobDataReply>()->data);
+  });
+  emit worker->transformQueued(transform_, src.data(start, end), param_,
+                               getter);
+}
+
+void TransformedBlobObject::transformed(uint64_t generation,
+                                        const data::BinData &res) {
+  if (dead() || generation != generation_) {
+    return;
+  }
+  state_ = State::VALID;
+  // Chunks may have been parsed against the previous contents while these
+  // were computed - detach their values before those go away.
+  for (auto chunk : chunkIndex()->chunks()) {
+    chunk->blobChanging(0, UINT64_MAX, true);
+  }
+  // Contents that don't fit in the memory limit are left empty, like
+  // those of a failed transform.
+  if (canResize(res.octets())) {
+    data_ = res;
+  } else {
+    data_ = data::BinData(8, 0);
+  }
+  dataResized();
+  source_changed(0, UINT64_MAX, true);
+  data_updated();
+  description_updated();
+  std::vector<PendingRequest> pending;
+  std::swap(pending, pending_);
+  for (auto &req : pending) {
+    if (dead()) {
+      break;
+    }
+    if (req.getter) {
+      getInfo(req.getter, req.info_req, req.once);
+    } else if (req.runner) {
+      runMethod(req.runner, req.method_req);
+    }
+  }
+}
+
+void TransformedBlobObject::getInfo(InfoGetter *getter, PInfoRequest req,
+                                    bool once) {
+  if (state_ != State::VALID) {
+    ensureData();
+    pending_.push_back(PendingRequest{getter, req, once, nullptr,
+                                      PMethodRequest()});
+    return;
+  }
+  DataBlobObject::getInfo(getter, req, once);
+}
+
+void TransformedBlobObject::runMethod(MethodRunner *runner,
+                                      PMethodRequest req) {
+  if (req.dynamicCast<dbif::ChangeDataRequest>()) {
+    // Changes would be lost on the next recomputation.
+    runner->sendError<dbif::ObjectInvalidRequestError>();
+    return;
+  }
+  if (state_ != State::VALID) {
+    ensureData();
+    pending_.push_back(PendingRequest{nullptr, PInfoRequest(), false, runner,
+                                      req});
+    return;
+  }
+  DataBlobObject::runMethod(runner, req);
+}
+
+void TransformedBlobObject::invalidate() {
+  if (state_ == State::INVALID) {
+    return;
+  }
+  for (auto chunk : chunkIndex()->chunks()) {
+    chunk->blobChanging(0, UINT64_MAX, true);
+  }
+  state_ = State::INVALID;
+  generation_++;
+  source_changed(0, UINT64_MAX, true);
+  if (hasDataWatchers() || !pending_.empty()) {
+    ensureData();
+  }
+  description_updated();
+}
+
+void TransformedBlobObject::killed() {
+  DataBlobObject::killed();
+  source_.staticCast<DataBlobObject>()->removeTransformedBlob(this);
+  std::vector<PendingRequest> pending;
+  std::swap(pending, pending_);
+  for (auto &req : pending) {
+    if (req.getter) {
+      req.getter->sendError<dbif::ObjectGoneError>();
+    } else if (req.runner) {
+      req.runner->sendError<dbif::ObjectGoneError>();
+    }
+  }
+}
+
 void ChunkObject::children_updated() {
   LocalObject::children_updated();
   parse_updated();
@@ -281,35 +596,74 @@ void ChunkObject::parse_updated() {
 }
 
 void ChunkObject::calcParseReplyItems() {
-  parseReplyItems_ = items_;
-
-  QSet<PLocalObject> chunksInItems;
-  for (auto &item : items_) {
-    if (item.type != data::ChunkDataItem::SUBCHUNK) {
-      continue;
-    }
-    if (auto localObjectHandle = item.ref[0].dynamicCast<LocalObjectHandle>()) {
-      chunksInItems.insert(localObjectHandle->obj());
-    }
-  }
-
+  implicit_items_.clear();
   for (PLocalObject obj : children()) {
-    if (chunksInItems.contains(obj)) {
+    if (item_chunks_.contains(obj)) {
       continue;
     }
     if (auto chunkObj = obj.dynamicCast<ChunkObject>()) {
-      parseReplyItems_.push_back(
+      implicit_items_.push_back(
           data::ChunkDataItem::subchunk(chunkObj->start_, chunkObj->end_,
                                         chunkObj->name(), db()->handle(obj)));
     } else if (auto subBlobObj = obj.dynamicCast<SubBlobObject>()) {
-      parseReplyItems_.push_back(
+      implicit_items_.push_back(
           data::ChunkDataItem::subblob(subBlobObj->name(), db()->handle(obj)));
     }
   }
 }
 
+void ChunkObject::reindex() {
+  if (auto blob = blob_.dynamicCast<DataBlobObject>()) {
+    blob->chunkIndex()->update(this);
+  }
+}
+
+bool ChunkObject::hasField(uint32_t name, const QByteArray &value) const {
+  for (auto idx : items_.itemsNamed(name)) {
+    if (value.isEmpty()) {
+      return true;
+    }
+    auto item = items_.item(idx, *db()->fieldPool(), blobData());
+    const data::BinData &raw = item.raw_value;
+    if (raw.octets() == static_cast<size_t>(value.size())
+        && memcmp(raw.rawData(), value.constData(), value.size()) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ChunkObject::blobChanging(uint64_t start, uint64_t end, bool moved) {
+  if (dead()) {
+    return;
+  }
+  uint64_t values_start = items_.blobStart();
+  uint64_t values_end = items_.blobEnd();
+  items_.detachValues(*db()->fieldPool(), blobData(), start, end, moved);
+  if (items_.blobStart() != values_start || items_.blobEnd() != values_end) {
+    reindex();
+  }
+}
+
+const data::BinData *ChunkObject::blobData() const {
+  if (auto blob = blob_.dynamicCast<DataBlobObject>()) {
+    return &blob->data();
+  }
+  return nullptr;
+}
+
+std::vector<data::ChunkDataItem> ChunkObject::items() const {
+  if (dead()) {
+    return {};
+  }
+  return items_.expand(*db()->fieldPool(), blobData());
+}
+
 void ChunkObject::parse_reply(InfoGetter *getter) {
-  getter->sendInfo<dbif::ChunkDataReply>(parseReplyItems_);
+  std::vector<data::ChunkDataItem> reply_items = items();
+  reply_items.insert(reply_items.end(), implicit_items_.begin(),
+                     implicit_items_.end());
+  getter->sendInfo<dbif::ChunkDataReply>(reply_items);
 }
 
 void RootLocalObject::parsers_list_reply(InfoGetter *getter) {
@@ -352,22 +706,47 @@ void ChunkObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
   }
 }
 
+void ChunkObject::setParse(uint64_t start, uint64_t end,
+                           const std::vector<data::ChunkDataItem> &items) {
+  start_ = start;
+  end_ = end;
+  items_.assign(items, db()->fieldPool(), blobData());
+  item_chunks_.clear();
+  for (auto &item : items) {
+    if (item.type != data::ChunkDataItem::SUBCHUNK || item.ref.empty()) {
+      continue;
+    }
+    if (auto localObjectHandle = item.ref[0].dynamicCast<LocalObjectHandle>()) {
+      item_chunks_.insert(localObjectHandle->obj());
+    }
+  }
+  reindex();
+  description_updated();
+  parse_updated();
+}
+
 void ChunkObject::runMethod(MethodRunner *runner, PMethodRequest req) {
   if (auto chreq = req.dynamicCast<dbif::SetChunkBoundsRequest>()) {
     start_ = chreq->start;
     end_ = chreq->end;
+    reindex();
     description_updated();
     runner->sendResult<dbif::NullReply>();
   } else if (auto preq = req.dynamicCast<dbif::SetChunkParseRequest>()) {
-    start_ = preq->start;
-    end_ = preq->end;
-    items_ = preq->items;
-    description_updated();
-    parse_updated();
+    setParse(preq->start, preq->end, preq->items);
     runner->sendResult<dbif::NullReply>();
   } else if (auto blobreq = req.dynamicCast<dbif::ChunkCreateSubBlobRequest>()) {
+    if (!db()->canStore(blobreq->data.octets())) {
+      runner->sendError<dbif::MemoryLimitError>();
+      return;
+    }
     PLocalObject obj = SubBlobObject::create(this, blobreq->data, blobreq->name);
     runner->sendResult<dbif::CreatedReply>(db()->handle(obj));
+  } else if (auto transreq = req.dynamicCast<dbif::CreateTransformedBlobRequest>()) {
+    createTransformedBlob(this, blob_, runner, transreq);
+  } else if (req.dynamicCast<dbif::SetNameRequest>()) {
+    LocalObject::runMethod(runner, req);
+    reindex();
   } else {
     LocalObject::runMethod(runner, req);
   }
@@ -375,6 +754,9 @@ void ChunkObject::runMethod(MethodRunner *runner, PMethodRequest req) {
 
 void ChunkObject::killed() {
   LocalObject::killed();
+  if (auto blob = blob_.dynamicCast<DataBlobObject>()) {
+    blob->chunkIndex()->remove(this);
+  }
   if (parent_chunk_)
     parent_chunk_->delChild(sharedFromThis());
   else
@@ -391,6 +773,7 @@ class Register {
  public:
   Register() {
     qRegisterMetaType<veles::db::PLocalObject>("veles::db::PLocalObject");
+    qRegisterMetaType<veles::data::BinData>("veles::data::BinData");
   }
 } _;
 };
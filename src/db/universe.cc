@@ -14,11 +14,14 @@
  * limitations under the License.
  *
  */
+#include <algorithm>
+
 #include <QThread>
 
 #include "db/universe.h"
 #include "dbif/promise.h"
 #include "dbif/error.h"
+#include "dbif/info.h"
 #include "db/handle.h"
 #include "db/object.h"
 #include "db/getter.h"
@@ -39,11 +42,21 @@ class DbThread : public QThread {
 };
 
 dbif::ObjectHandle create_db() {
+  DbOptions options;
+  options.network = util::settings::network::enabled();
+  return create_db(options);
+}
+
+dbif::ObjectHandle create_db(const DbOptions &options) {
   ParserWorker *parser_worker = new ParserWorker;
   for (auto parser : parser::createAllParsers()) {
     parser_worker->registerParser(parser);
   }
+  for (auto transform : parser::createAllTransforms()) {
+    parser_worker->registerTransform(transform);
+  }
   Universe *db = new Universe(parser_worker);
+  db->setMemoryLimit(options.memory_limit);
   PLocalObject root = RootLocalObject::create(db);
   db->setRoot(root);
   DbThread *thr = new DbThread;
@@ -57,13 +70,45 @@ dbif::ObjectHandle create_db() {
   QObject::connect(parser_worker, &ParserWorker::newParser, [root] {
     root.dynamicCast<RootLocalObject>()->parsers_list_updated();
   });
-  if (util::settings::network::enabled()) {
-    NetworkServer *network = new NetworkServer(root);
+  if (options.network) {
+    NetworkServer *network = new NetworkServer(
+        db->handle(root), QHostAddress(util::settings::network::ipAddress()),
+        util::settings::network::port(),
+        util::settings::network::localSocket());
     DbThread *network_thr = new DbThread;
     network->moveToThread(network_thr);
     QObject::connect(network, &QObject::destroyed, network_thr, &QThread::quit);
     network_thr->start();
   }
+  int pool_size = options.parser_threads
+      ? static_cast<int>(options.parser_threads)
+      : std::max(1, QThread::idealThreadCount());
+  for (int i = 0; i < pool_size; i++) {
+    ParserWorker *pool_worker = new ParserWorker;
+    for (auto parser : parser::createAllParsers()) {
+      pool_worker->registerParser(parser);
+    }
+    DbThread *pool_thr = new DbThread;
+    pool_worker->moveToThread(pool_thr);
+    QObject::connect(pool_worker, &QObject::destroyed, pool_thr, &QThread::quit);
+    QObject::connect(db, &QObject::destroyed, pool_worker, &QObject::deleteLater);
+    db->addParserPoolWorker(pool_worker);
+    pool_thr->start();
+  }
+  // Transforms get a worker of their own: parsers block on database
+  // requests, which may be waiting for a transformed blob.
+  ParserWorker *transform_worker = new ParserWorker;
+  for (auto transform : parser::createAllTransforms()) {
+    transform_worker->registerTransform(transform);
+  }
+  DbThread *transform_thr = new DbThread;
+  transform_worker->moveToThread(transform_thr);
+  QObject::connect(transform_worker, &QObject::destroyed, transform_thr,
+                   &QThread::quit);
+  QObject::connect(db, &QObject::destroyed, transform_worker,
+                   &QObject::deleteLater);
+  db->setTransformWorker(transform_worker);
+  transform_thr->start();
   thr->start();
   parser_thr->start();
 
@@ -78,6 +123,14 @@ dbif::ObjectHandle Universe::handle(PLocalObject obj) {
   return objHandle;
 }
 
+ParserWorker *Universe::parserPoolWorker() {
+  if (parser_pool_.empty()) {
+    return parser_;
+  }
+  next_pool_worker_ = (next_pool_worker_ + 1) % parser_pool_.size();
+  return parser_pool_[next_pool_worker_];
+}
+
 Universe::~Universe() {
   root_->kill();
 }
@@ -98,7 +151,17 @@ void Universe::runMethod(PLocalObject obj, MethodRunner *runner, dbif::PMethodRe
   }
 }
 
-ParserWorker::~ParserWorker() { qDeleteAll(_parsers); }
+ParserWorker::ParserWorker() {
+  connect(this, &ParserWorker::parseQueued, this, &ParserWorker::parse,
+          Qt::QueuedConnection);
+  connect(this, &ParserWorker::transformQueued, this,
+          &ParserWorker::applyTransform, Qt::QueuedConnection);
+}
+
+ParserWorker::~ParserWorker() {
+  qDeleteAll(_parsers);
+  qDeleteAll(_transforms);
+}
 
 void ParserWorker::registerParser(parser::Parser *parser) {
   _parsers.append(parser);
@@ -114,22 +177,62 @@ QStringList ParserWorker::parserIdsList() {
   return res;
 }
 
+void ParserWorker::registerTransform(parser::Transform *transform) {
+  _transforms.append(transform);
+}
+
+parser::Transform *ParserWorker::transform(const QString &id) {
+  for (auto transform : _transforms) {
+    if (transform->id() == id) {
+      return transform;
+    }
+  }
+  return nullptr;
+}
+
+QStringList ParserWorker::transformIdsList() {
+  QStringList res;
+  for (auto transform : _transforms) {
+    res.append(transform->id());
+  }
+  res.sort();
+  return res;
+}
+
 void ParserWorker::parse(dbif::ObjectHandle blob, MethodRunner *runner,
                          QString parser_id, quint64 start,
                          veles::dbif::ObjectHandle parent_chunk) {
-  for (auto parser : _parsers) {
-    if (parser_id == "" && parser->magic().size() > 0) {
-      if (parser->verifyAndParse(blob, start, parent_chunk)) {
+  // Requests made by the parser fail if the blob is deleted meanwhile,
+  // or the database runs out of its memory limit.
+  try {
+    for (auto parser : _parsers) {
+      if (parser_id == "" && parser->magic().size() > 0) {
+        if (parser->verifyAndParse(blob, start, parent_chunk)) {
+          break;
+        }
+      } else if (parser->id() == parser_id) {
+        parser->verifyAndParse(blob, start, parent_chunk);
         break;
       }
-    } else if (parser->id() == parser_id) {
-      parser->verifyAndParse(blob, start, parent_chunk);
-      break;
     }
+  } catch (dbif::PError error) {
+    emit runner->gotError(error);
+    delete runner;
+    return;
   }
 
   runner->sendResult<dbif::NullReply>();
   delete runner;
 }
+
+void ParserWorker::applyTransform(QString transform_id, data::BinData src,
+                                  QString param, InfoGetter *getter) {
+  data::BinData res(8, 0);
+  parser::Transform *transform = this->transform(transform_id);
+  if (!transform || !transform->apply(src, param, &res)) {
+    res = data::BinData(8, 0);
+  }
+  getter->sendInfo<dbif::BlobDataReply>(std::move(res));
+}
 };
 };
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "db/unpack.h"
+
+#include <string.h>
+
+#include <QCryptographicHash>
+
+#include "db/getter.h"
+#include "db/object.h"
+#include "db/universe.h"
+#include "dbif/info.h"
+#include "dbif/method.h"
+
+namespace veles {
+namespace db {
+
+RecursiveUnpack::RecursiveUnpack(Universe *db, MethodRunner *runner,
+                                 unsigned max_depth, uint64_t max_total_size)
+    : db_(db), runner_(runner), max_depth_(max_depth),
+      max_total_size_(max_total_size), total_size_(0), pending_(0) {}
+
+void RecursiveUnpack::start(PLocalObject blob, const QString &parser_id,
+                            uint64_t start, dbif::ObjectHandle parent_chunk) {
+  enqueue(blob, 0, parser_id, start, parent_chunk);
+  if (!pending_) {
+    finish();
+  }
+}
+
+void RecursiveUnpack::enqueue(PLocalObject blob, unsigned depth,
+                              const QString &parser_id, uint64_t start,
+                              dbif::ObjectHandle parent_chunk) {
+  if (depth > max_depth_ || blob->dead() || seen_blobs_.contains(blob.data())) {
+    return;
+  }
+  seen_blobs_.insert(blob.data());
+  // Contents of transformed blobs may still be being computed - the
+  // description is only sent once they are in.  The reply is queued even
+  // for other blobs, so that the job never finishes inside enqueue().
+  pending_++;
+  InfoGetter *getter = new InfoGetter;
+  QObject::connect(getter, &InfoGetter::gotInfo, getter,
+                   [this, getter, blob, depth, parser_id, start,
+                    parent_chunk] (dbif::PInfoReply) {
+    getter->deleteLater();
+    if (!blob->dead()) {
+      submit(blob, depth, parser_id, start, parent_chunk);
+    }
+    if (!--pending_) {
+      finish();
+    }
+  }, Qt::QueuedConnection);
+  QObject::connect(getter, &InfoGetter::gotError, getter,
+                   [this, getter] (dbif::PError) {
+    getter->deleteLater();
+    if (!--pending_) {
+      finish();
+    }
+  }, Qt::QueuedConnection);
+  blob->getInfo(getter, QSharedPointer<dbif::DescriptionRequest>::create(),
+                true);
+}
+
+QByteArray RecursiveUnpack::sampleKey(const data::BinData &data) {
+  // Hashing whole blobs would stall the database thread for big ones, so
+  // the key only covers k_samples evenly spaced pieces of the contents.
+  // Blobs with equal keys are compared in full.
+  static const size_t k_samples = 64;
+  static const size_t k_sample_size = 64;
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  const char *raw = reinterpret_cast<const char *>(data.rawData());
+  size_t octets = data.octets();
+  if (octets <= k_samples * k_sample_size) {
+    hash.addData(raw, static_cast<int>(octets));
+  } else {
+    size_t stride = (octets - k_sample_size) / (k_samples - 1);
+    for (size_t i = 0; i < k_samples; i++) {
+      hash.addData(raw + i * stride, static_cast<int>(k_sample_size));
+    }
+  }
+  return QByteArray::number(data.width()) + ":" +
+         QByteArray::number(static_cast<qulonglong>(data.size())) + ":" +
+         hash.result();
+}
+
+bool RecursiveUnpack::seenContents(PLocalObject blob,
+                                   const data::BinData &data) {
+  QByteArray key = sampleKey(data);
+  QList<PLocalObject> &same_key = seen_contents_[key];
+  for (auto other : same_key) {
+    if (other->dead()) {
+      continue;
+    }
+    const data::BinData &other_data =
+        other.staticCast<DataBlobObject>()->data();
+    if (other_data.width() == data.width() &&
+        other_data.size() == data.size() &&
+        memcmp(other_data.rawData(), data.rawData(), data.octets()) == 0) {
+      return true;
+    }
+  }
+  same_key.append(blob);
+  return false;
+}
+
+void RecursiveUnpack::submit(PLocalObject blob, unsigned depth,
+                             const QString &parser_id, uint64_t start,
+                             dbif::ObjectHandle parent_chunk) {
+  const data::BinData &data = blob.staticCast<DataBlobObject>()->data();
+  if (total_size_ + data.octets() > max_total_size_ ||
+      seenContents(blob, data)) {
+    return;
+  }
+  total_size_ += data.octets();
+
+  pending_++;
+  ParserWorker *worker = db_->parserPoolWorker();
+  MethodRunner *task_runner = new MethodRunner;
+  auto done = [this, task_runner, blob, depth] () {
+    task_runner->deleteLater();
+    parsed(blob, depth);
+  };
+  QObject::connect(task_runner, &MethodRunner::gotResult, task_runner,
+                   [done] (dbif::PMethodReply) { done(); });
+  QObject::connect(task_runner, &MethodRunner::gotError, task_runner,
+                   [done] (dbif::PError) { done(); });
+  emit worker->parseQueued(db_->handle(blob),
+                           task_runner->forwarder(worker->thread()),
+                           parser_id, start, parent_chunk);
+}
+
+void RecursiveUnpack::collectSubBlobs(PLocalObject obj, unsigned depth) {
+  for (PLocalObject child : obj->children()) {
+    if (child.dynamicCast<ChunkObject>()) {
+      collectSubBlobs(child, depth);
+    } else if (child.dynamicCast<DataBlobObject>()) {
+      enqueue(child, depth, "", 0, dbif::ObjectHandle());
+    }
+  }
+}
+
+void RecursiveUnpack::parsed(PLocalObject blob, unsigned depth) {
+  // Parsing only ever adds chunks to the blob - sub-blobs hang off them.
+  if (!blob->dead()) {
+    for (PLocalObject child : blob->children()) {
+      if (child.dynamicCast<ChunkObject>()) {
+        collectSubBlobs(child, depth + 1);
+      }
+    }
+  }
+  if (!--pending_) {
+    finish();
+  }
+}
+
+void RecursiveUnpack::finish() {
+  // The requester may have given up waiting in the meantime.
+  if (runner_) {
+    runner_->sendResult<dbif::NullReply>();
+  }
+  delete this;
+}
+
+}  // namespace db
+}  // namespace veles
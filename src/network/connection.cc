@@ -0,0 +1,1355 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "network/connection.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <set>
+
+#include <QPointer>
+#include <QTimer>
+#include <QtEndian>
+#include <QtNetwork/QLocalSocket>
+#include <QtNetwork/QTcpSocket>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+#include "dbif/error.h"
+#include "dbif/info.h"
+#include "dbif/method.h"
+#include "dbif/promise.h"
+
+namespace veles {
+namespace db {
+
+// Counts outstanding dbif requests needed to fill in a response.
+struct NetworkConnection::PackJob {
+  unsigned pending;
+  std::function<void()> done;
+  // Names and field types of chunk data items, if full items are sent.
+  std::shared_ptr<data::FieldDescriptorPool> tables;
+
+  void release() {
+    if (!--pending) {
+      done();
+    }
+  }
+};
+
+// Blob data of a GET_BLOB_DATA response that wasn't sent yet.
+struct NetworkConnection::BlobStream {
+  dbif::ObjectHandle blob;
+  unsigned octets_per_element;
+  // [start, end) in elements.
+  std::deque<std::pair<uint64_t, uint64_t>> ranges;
+  bool fetching;
+};
+
+// A SUBSCRIBE_* request, along with what the client was told so far.
+struct NetworkConnection::Subscription {
+  PRequest req;
+  dbif::ObjectHandle object;
+  QPointer<dbif::InfoPromise> promise;
+  // The response to the request was sent, everything after it is an event.
+  bool started;
+  bool active;
+  // Set while the new children of an event are packed.  Changes seen in
+  // the meantime are merged into the next event.
+  bool busy;
+  dbif::PInfoReply pending;
+  std::set<uint64_t> children;
+  data::BinData data;
+};
+
+// Blob data being copied to a memfd for MAP_BLOB_DATA.
+struct NetworkConnection::SharedMapping {
+  PRequest req;
+  network::Response resp;
+  dbif::ObjectHandle blob;
+  int fd;
+  unsigned octets_per_element;
+  // Elements still to be copied, and where they go in the memfd.
+  uint64_t start;
+  uint64_t end;
+  uint64_t pos;
+
+  SharedMapping() : fd(-1) {}
+  ~SharedMapping() {
+#ifdef Q_OS_LINUX
+    if (fd >= 0) {
+      ::close(fd);
+    }
+#endif
+  }
+};
+
+NetworkConnection::NetworkConnection(dbif::ObjectHandle root,
+                                     QIODevice *socket, QObject *parent)
+    : QObject(parent), root_(root), socket_(socket), local_descriptor_(-1),
+      requests_in_flight_(0),
+      reading_(false), output_size_(0), in_frame_(false), last_frame_(false),
+      frame_left_(0), upload_pos_(0) {
+  socket_->setParent(this);
+  // Once we stop reading, let flow control slow the client down.
+  if (auto tcp_socket = qobject_cast<QTcpSocket *>(socket_)) {
+    tcp_socket->setReadBufferSize(k_max_frame_size_);
+    connect(tcp_socket, &QAbstractSocket::disconnected,
+            this, &QObject::deleteLater);
+  } else if (auto local_socket = qobject_cast<QLocalSocket *>(socket_)) {
+    local_socket->setReadBufferSize(k_max_frame_size_);
+    connect(local_socket, &QLocalSocket::disconnected,
+            this, &QObject::deleteLater);
+#ifdef Q_OS_LINUX
+    local_descriptor_ = static_cast<int>(local_socket->socketDescriptor());
+#endif
+  }
+  connect(socket_, &QIODevice::readyRead, this, [this] () {
+    readMessages();
+  });
+  connect(socket_, &QIODevice::bytesWritten, this, [this] (qint64) {
+    writeOutput();
+  });
+}
+
+bool NetworkConnection::canReadMore() const {
+  return requests_in_flight_ < k_max_requests_in_flight_ &&
+      output_.size() < k_max_requests_in_flight_ &&
+      output_size_ < k_write_buffer_size_;
+}
+
+void NetworkConnection::readMessages() {
+  // Requests failing right away get here again through requestDone().
+  if (reading_) {
+    return;
+  }
+  reading_ = true;
+  while (canReadMore() && readInput()) {}
+  reading_ = false;
+}
+
+bool NetworkConnection::readInput() {
+  if (!in_frame_) {
+    uint32_t header;
+    if (socket_->bytesAvailable() < static_cast<int64_t>(sizeof(header))) {
+      return false;
+    }
+    socket_->read(reinterpret_cast<char*>(&header), sizeof(header));
+    header = qFromLittleEndian(header);
+    in_frame_ = true;
+    frame_left_ = header & k_frame_length_mask_;
+    last_frame_ = !(header & k_frame_continued_);
+    if (upload_request_) {
+      if (upload_pos_ + frame_left_ > upload_request_->data_size()) {
+        breakConnection("Sub-blob data longer than declared - "
+                        "breaking conection.");
+        return false;
+      }
+      if (upload_data_ &&
+          upload_pos_ + frame_left_ > upload_data_->octets()) {
+        growUploadBuffer(upload_pos_ + frame_left_);
+      }
+    } else if (message_.size() + frame_left_ > k_max_request_len_) {
+      breakConnection("Request too long - breaking conection.");
+      return false;
+    }
+  }
+
+  if (frame_left_) {
+    int64_t len = std::min<int64_t>(socket_->bytesAvailable(), frame_left_);
+    if (!len) {
+      return false;
+    }
+    // Data goes straight to its destination, whatever the frame size.
+    if (upload_request_) {
+      if (upload_data_) {
+        socket_->read(reinterpret_cast<char*>(
+            upload_data_->rawData()) + upload_pos_, len);
+      } else {
+        socket_->read(len);
+      }
+      upload_pos_ += len;
+    } else {
+      int old_size = message_.size();
+      message_.resize(old_size + static_cast<int>(len));
+      socket_->read(message_.data() + old_size, len);
+    }
+    frame_left_ -= len;
+    if (frame_left_) {
+      return true;
+    }
+  }
+
+  in_frame_ = false;
+  if (last_frame_) {
+    messageReceived();
+  }
+  return true;
+}
+
+void NetworkConnection::growUploadBuffer(uint64_t size) {
+  // Grown geometrically, but never past the declared size.
+  uint64_t new_size = std::max<uint64_t>(
+      size, std::max<uint64_t>(upload_data_->octets() * 2, k_max_frame_size_));
+  new_size = std::min<uint64_t>(new_size, upload_request_->data_size());
+  auto grown = std::make_shared<data::BinData>(8, new_size);
+  memcpy(grown->rawData(), upload_data_->rawData(), upload_pos_);
+  upload_data_ = grown;
+}
+
+void NetworkConnection::messageReceived() {
+  if (upload_request_) {
+    PRequest req = upload_request_;
+    std::shared_ptr<data::BinData> data = upload_data_;
+    bool complete = upload_pos_ == req->data_size();
+    upload_request_.reset();
+    upload_data_.reset();
+    upload_pos_ = 0;
+    if (!data) {
+      failRequest(req, "Sub-blob data too long.");
+      return;
+    }
+    if (!complete) {
+      failRequest(req, "Sub-blob data shorter than declared.");
+      return;
+    }
+    walkPath(req, 0, root_, dbif::ObjectHandle(),
+             [this, req, data] (dbif::ObjectHandle target_object,
+                                dbif::ObjectHandle) {
+      createSubBlob(req, target_object, data);
+    });
+    return;
+  }
+
+  PRequest request = std::make_shared<network::Request>();
+  bool ok = request->ParseFromArray(message_.constData(), message_.size());
+  message_.clear();
+  if (!ok) {
+    network::Response response;
+    response.set_ok(false);
+    response.set_error_msg("Failed to decode request.");
+    queueMessage(response);
+    writeOutput();
+    return;
+  }
+  requests_in_flight_++;
+  if (request->type() == network::Request::ADD_SUB_BLOB) {
+    // The request is only started once its data is read.
+    upload_request_ = request;
+    upload_data_.reset();
+    if (request->data_size() <= k_max_upload_size_) {
+      upload_data_ = std::make_shared<data::BinData>(8, 0);
+    }
+    upload_pos_ = 0;
+    return;
+  }
+  walkPath(request, 0, root_, dbif::ObjectHandle(),
+           [this, request] (dbif::ObjectHandle target_object,
+                            dbif::ObjectHandle blob) {
+    handleRequest(request, target_object, blob);
+  });
+}
+
+void NetworkConnection::breakConnection(const char *error_msg) {
+  network::Response response;
+  response.set_ok(false);
+  response.set_error_msg(error_msg);
+  queueMessage(response);
+  writeOutput();
+  socket_->close();
+}
+
+void NetworkConnection::abortConnection() {
+  if (auto tcp_socket = qobject_cast<QTcpSocket *>(socket_)) {
+    tcp_socket->abort();
+  } else if (auto local_socket = qobject_cast<QLocalSocket *>(socket_)) {
+    local_socket->abort();
+  }
+}
+
+void NetworkConnection::getInfo(dbif::ObjectHandle object,
+                                dbif::PInfoRequest req, InfoCallback done,
+                                ErrorCallback failed) {
+  dbif::InfoPromise *promise = object->getInfo(req);
+  // Dropped along with the callbacks if the client goes away.
+  promise->setParent(this);
+  connect(promise, &dbif::InfoPromise::gotInfo, this, done);
+  connect(promise, &dbif::InfoPromise::gotError, this, failed);
+}
+
+void NetworkConnection::runMethod(dbif::ObjectHandle object,
+                                  dbif::PMethodRequest req,
+                                  MethodCallback done, ErrorCallback failed) {
+  dbif::MethodResultPromise *promise = object->runMethod(req);
+  promise->setParent(this);
+  connect(promise, &dbif::MethodResultPromise::gotResult, this, done);
+  connect(promise, &dbif::MethodResultPromise::gotError, this, failed);
+}
+
+void NetworkConnection::walkPath(PRequest req, int depth,
+                                 dbif::ObjectHandle object,
+                                 dbif::ObjectHandle blob, PathCallback done) {
+  if (depth == req->id_size()) {
+    done(object, blob);
+    return;
+  }
+  getInfo(object, QSharedPointer<dbif::ChildrenRequest>::create(),
+      [this, req, depth, blob, done] (dbif::PInfoReply reply) {
+    for (auto child : reply.dynamicCast<dbif::ChildrenReply>()->objects) {
+      if (child->id() == req->id(depth)) {
+        walkPath(req, depth + 1, child,
+                 child->type() == dbif::FILE_BLOB ? child : blob, done);
+        return;
+      }
+    }
+    failRequest(req, "Bad ID provided.");
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Bad ID provided.");
+  });
+}
+
+void NetworkConnection::handleRequest(PRequest req,
+                                      dbif::ObjectHandle target_object,
+                                      dbif::ObjectHandle blob) {
+  switch (req->type()) {
+  case network::Request::LIST_CHILDREN:
+    listChildren(req, target_object);
+    break;
+  case network::Request::LIST_CHILDREN_RECURSIVE:
+    listChildren(req, target_object, true);
+    break;
+  case network::Request::ADD_CHILD_CHUNK:
+    createChunk(req, target_object, blob);
+    break;
+  case network::Request::ADD_CHILD_CHUNKS:
+    createChunks(req, target_object, blob);
+    break;
+  case network::Request::DELETE_OBJECT:
+    deleteObject(req, target_object);
+    break;
+  case network::Request::GET_BLOB_DATA:
+  case network::Request::GET_BLOB_DATA_RANGES:
+    getBlobData(req, target_object);
+    break;
+  case network::Request::MAP_BLOB_DATA:
+    mapBlobData(req, target_object);
+    break;
+  case network::Request::SUBSCRIBE_CHILDREN:
+  case network::Request::SUBSCRIBE_DESCRIPTION:
+  case network::Request::SUBSCRIBE_CHUNK_DATA:
+  case network::Request::SUBSCRIBE_BLOB_DATA:
+    subscribe(req, target_object);
+    break;
+  case network::Request::UNSUBSCRIBE:
+    unsubscribe(req);
+    break;
+  case network::Request::QUERY:
+    query(req, target_object);
+    break;
+  // ADD_SUB_BLOB is started from messageReceived(), along with its data.
+  default:
+    failRequest(req, "Unknown request type.");
+    break;
+  }
+}
+
+void NetworkConnection::finishRequest(const network::Response &resp) {
+  queueMessage(resp);
+  requestDone();
+}
+
+void NetworkConnection::requestDone() {
+  requests_in_flight_--;
+  writeOutput();
+}
+
+void NetworkConnection::failRequest(PRequest req, const char *error_msg) {
+  network::Response resp;
+  resp.set_request_id(req->request_id());
+  resp.set_ok(false);
+  resp.set_error_msg(error_msg);
+  finishRequest(resp);
+}
+
+void NetworkConnection::listChildren(PRequest req,
+                                     dbif::ObjectHandle target_object,
+                                     bool list_children) {
+  getInfo(target_object, QSharedPointer<dbif::ChildrenRequest>::create(),
+      [this, req, list_children] (dbif::PInfoReply reply) {
+    packResults(req, std::make_shared<network::Response>(),
+                reply.dynamicCast<dbif::ChildrenReply>()->objects,
+                list_children);
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Bad ID provided.");
+  });
+}
+
+void NetworkConnection::query(PRequest req, dbif::ObjectHandle target_object) {
+  auto &query = req->query();
+  // Ranges reaching past the address space just go to the end.
+  uint64_t end = UINT64_MAX;
+  if (query.range().length() != 0 &&
+      query.range().length() <= UINT64_MAX - query.range().offset()) {
+    end = query.range().offset() + query.range().length();
+  }
+  getInfo(target_object, QSharedPointer<dbif::QueryRequest>::create(
+      QString::fromStdString(query.chunk_type()),
+      QString::fromStdString(query.name()),
+      QString::fromStdString(query.field_name()),
+      QByteArray(query.field_value().data(),
+                 static_cast<int>(query.field_value().size())),
+      query.range().offset(), end, query.offset(), query.limit()),
+      [this, req] (dbif::PInfoReply reply) {
+    auto query_reply = reply.dynamicCast<dbif::QueryReply>();
+    auto resp = std::make_shared<network::Response>();
+    resp->set_total(query_reply->total);
+    for (auto &path : query_reply->paths) {
+      auto result = resp->add_results();
+      for (auto id : path) {
+        result->add_path(id);
+      }
+    }
+    packResults(req, resp, query_reply->objects, false);
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Query not supported by this object.");
+  });
+}
+
+void NetworkConnection::createChunk(PRequest req,
+                                    dbif::ObjectHandle target_object,
+                                    dbif::ObjectHandle blob) {
+  dbif::ObjectHandle parent;
+  if (target_object->type() == dbif::CHUNK) {
+    parent = target_object;
+  } else if (target_object->type() != dbif::FILE_BLOB) {
+    failRequest(req, "Bad ID provided.");
+    return;
+  }
+  if (!blob) {
+    failRequest(req, "Bad ID provided.");
+    return;
+  }
+
+  QString comment = QString::fromStdString(req->comment());
+  runMethod(blob, QSharedPointer<dbif::ChunkCreateRequest>::create(
+      QString::fromStdString(req->name()),
+      QString::fromStdString(req->chunk_type()),
+      parent, req->chunk_start(), req->chunk_end()),
+      [this, req, comment] (dbif::PMethodReply reply) {
+    dbif::ObjectHandle created =
+        reply.dynamicCast<dbif::CreatedReply>()->object;
+    auto pack = [this, req, created] () {
+      packResults(req, std::make_shared<network::Response>(),
+                  std::vector<dbif::ObjectHandle>{created}, false);
+    };
+    if (comment.isEmpty()) {
+      pack();
+      return;
+    }
+    runMethod(created,
+              QSharedPointer<dbif::SetCommentRequest>::create(comment),
+              [pack] (dbif::PMethodReply) { pack(); },
+              [pack] (dbif::PError) { pack(); });
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Failed to create chunk.");
+  });
+}
+
+void NetworkConnection::createChunks(PRequest req,
+                                     dbif::ObjectHandle target_object,
+                                     dbif::ObjectHandle blob) {
+  dbif::ObjectHandle parent;
+  if (target_object->type() == dbif::CHUNK) {
+    parent = target_object;
+  } else if (target_object->type() != dbif::FILE_BLOB) {
+    failRequest(req, "Bad ID provided.");
+    return;
+  }
+  if (!blob) {
+    failRequest(req, "Bad ID provided.");
+    return;
+  }
+
+  std::vector<dbif::ChunkSpec> specs;
+  specs.reserve(req->chunks_size());
+  for (int i = 0; i < req->chunks_size(); i++) {
+    auto &chunk = req->chunks(i);
+    if (chunk.parent() > static_cast<uint64_t>(i)) {
+      failRequest(req, "Bad parent index provided.");
+      return;
+    }
+    dbif::ChunkSpec spec;
+    spec.name = QString::fromStdString(chunk.name());
+    spec.chunk_type = QString::fromStdString(chunk.chunk_type());
+    spec.parent = static_cast<int64_t>(chunk.parent()) - 1;
+    spec.start = chunk.start();
+    spec.end = chunk.end();
+    specs.push_back(spec);
+  }
+
+  runMethod(blob, QSharedPointer<dbif::ChunkCreateManyRequest>::create(
+      parent, specs), [this, req] (dbif::PMethodReply reply) {
+    std::vector<dbif::ObjectHandle> created =
+        reply.dynamicCast<dbif::CreatedManyReply>()->objects;
+    auto job = std::make_shared<PackJob>();
+    job->pending = 1;
+    job->done = [this, req, created] () {
+      packResults(req, std::make_shared<network::Response>(), created, false);
+    };
+    for (size_t i = 0; i < created.size(); i++) {
+      QString comment = QString::fromStdString(
+          req->chunks(static_cast<int>(i)).comment());
+      if (comment.isEmpty()) {
+        continue;
+      }
+      job->pending++;
+      runMethod(created[i],
+                QSharedPointer<dbif::SetCommentRequest>::create(comment),
+                [job] (dbif::PMethodReply) { job->release(); },
+                [job] (dbif::PError) { job->release(); });
+    }
+    job->release();
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Failed to create chunks.");
+  });
+}
+
+void NetworkConnection::deleteObject(PRequest req,
+                                     dbif::ObjectHandle target_object) {
+  if (target_object->type() == dbif::ROOT ||
+      target_object->type() == dbif::FILE_BLOB) {
+    failRequest(req, "Unsupported object type to delete.");
+    return;
+  }
+  runMethod(target_object, QSharedPointer<dbif::DeleteRequest>::create(),
+      [this, req] (dbif::PMethodReply) {
+    network::Response resp;
+    resp.set_request_id(req->request_id());
+    resp.set_ok(true);
+    finishRequest(resp);
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Failed to delete object.");
+  });
+}
+
+void NetworkConnection::getBlobData(PRequest req,
+                                    dbif::ObjectHandle target_object) {
+  if (target_object->type() != dbif::FILE_BLOB &&
+      target_object->type() != dbif::SUB_BLOB) {
+    failRequest(req, "Unsupported object type to get file data.");
+    return;
+  }
+  getInfo(target_object, QSharedPointer<dbif::DescriptionRequest>::create(),
+      [this, req, target_object] (dbif::PInfoReply reply) {
+    auto desc = reply.dynamicCast<dbif::BlobDescriptionReply>();
+    if (!desc) {
+      failRequest(req, "Unsupported object type to get file data.");
+      return;
+    }
+    network::Response resp;
+    resp.set_request_id(req->request_id());
+    auto stream = std::make_shared<BlobStream>();
+    stream->blob = target_object;
+    stream->octets_per_element = (desc->width + 7) / 8;
+    stream->fetching = false;
+    uint64_t size = desc->size;
+    auto addRange = [&] (uint64_t offset, uint64_t length) {
+      offset = std::min<uint64_t>(offset, size);
+      length = std::min<uint64_t>(length, size - offset);
+      network::DataRange *range = resp.add_data_ranges();
+      range->set_offset(offset);
+      range->set_length(length);
+      stream->ranges.emplace_back(offset, offset + length);
+    };
+    if (req->type() == network::Request::GET_BLOB_DATA_RANGES) {
+      for (auto &range : req->data_ranges()) {
+        addRange(range.offset(), range.length());
+      }
+    } else {
+      addRange(req->data_offset(),
+               req->data_length() ? req->data_length() : size);
+    }
+    resp.set_ok(true);
+    resp.set_data_width(desc->width);
+
+    // The response and the data message have to go out back to back.
+    queueMessage(resp);
+    Output out;
+    out.stream = stream;
+    output_.push_back(out);
+    requestDone();
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Unsupported object type to get file data.");
+  });
+}
+
+void NetworkConnection::mapBlobData(PRequest req,
+                                    dbif::ObjectHandle target_object) {
+#ifdef Q_OS_LINUX
+  if (local_descriptor_ < 0) {
+    failRequest(req, "Shared memory is only available over a local socket.");
+    return;
+  }
+  if (target_object->type() != dbif::FILE_BLOB &&
+      target_object->type() != dbif::SUB_BLOB) {
+    failRequest(req, "Unsupported object type to get file data.");
+    return;
+  }
+  getInfo(target_object, QSharedPointer<dbif::DescriptionRequest>::create(),
+      [this, req, target_object] (dbif::PInfoReply reply) {
+    auto desc = reply.dynamicCast<dbif::BlobDescriptionReply>();
+    if (!desc) {
+      failRequest(req, "Unsupported object type to get file data.");
+      return;
+    }
+    auto mapping = std::make_shared<SharedMapping>();
+    mapping->req = req;
+    mapping->blob = target_object;
+    mapping->octets_per_element = (desc->width + 7) / 8;
+    uint64_t offset = std::min<uint64_t>(req->data_offset(), desc->size);
+    uint64_t length = std::min<uint64_t>(
+        req->data_length() ? req->data_length() : desc->size,
+        desc->size - offset);
+    mapping->start = offset;
+    mapping->end = offset + length;
+    mapping->pos = 0;
+    mapping->fd = memfd_create("veles-blob", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mapping->fd < 0 || ftruncate(
+        mapping->fd, static_cast<off_t>(
+            length * mapping->octets_per_element)) < 0) {
+      failRequest(req, "Failed to create shared memory.");
+      return;
+    }
+    network::DataRange *range = mapping->resp.add_data_ranges();
+    range->set_offset(offset);
+    range->set_length(length);
+    mapping->resp.set_data_width(desc->width);
+    mapping->resp.set_request_id(req->request_id());
+    mapping->resp.set_ok(true);
+    fillMapping(mapping);
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Unsupported object type to get file data.");
+  });
+#else
+  (void)target_object;
+  failRequest(req, "Shared memory is not supported on this platform.");
+#endif
+}
+
+void NetworkConnection::fillMapping(std::shared_ptr<SharedMapping> mapping) {
+#ifdef Q_OS_LINUX
+  if (mapping->start == mapping->end) {
+    // The client can't change the data, and we won't either.  Unsealed
+    // memory is never handed out - the descriptor is closed along with
+    // the mapping.
+    if (fcntl(mapping->fd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+      failRequest(mapping->req, "Failed to seal shared memory.");
+      return;
+    }
+    // The descriptor is passed right after the response.
+    queueMessage(mapping->resp);
+    Output out;
+    out.mapping = mapping;
+    output_.push_back(out);
+    requestDone();
+    return;
+  }
+  uint64_t start = mapping->start;
+  uint64_t end = std::min<uint64_t>(
+      mapping->end, start + std::max<uint64_t>(
+          1, k_write_buffer_size_ / mapping->octets_per_element));
+  getInfo(mapping->blob,
+          QSharedPointer<dbif::BlobDataRequest>::create(start, end),
+          [this, mapping, start, end] (dbif::PInfoReply reply) {
+    const data::BinData &data =
+        reply.dynamicCast<dbif::BlobDataReply>()->data;
+    if (data.size() != end - start) {
+      failRequest(mapping->req, "Blob changed while being mapped.");
+      return;
+    }
+    const uint8_t *src = data.rawData();
+    size_t left = data.octets();
+    while (left) {
+      ssize_t written = pwrite(mapping->fd, src, left,
+                               static_cast<off_t>(mapping->pos));
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        failRequest(mapping->req, "Failed to create shared memory.");
+        return;
+      }
+      src += written;
+      left -= written;
+      mapping->pos += written;
+    }
+    mapping->start = end;
+    fillMapping(mapping);
+  }, [this, mapping] (dbif::PError) {
+    failRequest(mapping->req, "Blob changed while being mapped.");
+  });
+#else
+  (void)mapping;
+#endif
+}
+
+void NetworkConnection::createSubBlob(PRequest req,
+                                      dbif::ObjectHandle target_object,
+                                      std::shared_ptr<data::BinData> data) {
+  if (target_object->type() != dbif::CHUNK) {
+    failRequest(req, "Sub-blobs can only be created in chunks.");
+    return;
+  }
+  runMethod(target_object,
+            QSharedPointer<dbif::ChunkCreateSubBlobRequest>::create(
+                std::move(*data), QString::fromStdString(req->name())),
+            [this, req] (dbif::PMethodReply reply) {
+    packResults(req, std::make_shared<network::Response>(),
+                std::vector<dbif::ObjectHandle>{
+                    reply.dynamicCast<dbif::CreatedReply>()->object},
+                false);
+  }, [this, req] (dbif::PError) {
+    failRequest(req, "Failed to create sub-blob.");
+  });
+}
+
+void NetworkConnection::subscribe(PRequest req,
+                                  dbif::ObjectHandle target_object) {
+  if (subscriptions_.count(req->request_id())) {
+    failRequest(req, "Subscription id already in use.");
+    return;
+  }
+  dbif::PInfoRequest info_req;
+  switch (req->type()) {
+  case network::Request::SUBSCRIBE_CHILDREN:
+    info_req = QSharedPointer<dbif::ChildrenRequest>::create();
+    break;
+  case network::Request::SUBSCRIBE_DESCRIPTION:
+    info_req = QSharedPointer<dbif::DescriptionRequest>::create();
+    break;
+  case network::Request::SUBSCRIBE_CHUNK_DATA:
+    if (target_object->type() != dbif::CHUNK) {
+      failRequest(req, "Unsupported object type to subscribe to.");
+      return;
+    }
+    info_req = QSharedPointer<dbif::ChunkDataRequest>::create();
+    break;
+  default: {
+    if (target_object->type() != dbif::FILE_BLOB &&
+        target_object->type() != dbif::SUB_BLOB) {
+      failRequest(req, "Unsupported object type to subscribe to.");
+      return;
+    }
+    // Elements take at least an octet each.
+    if (req->data_length() > k_max_msg_len_) {
+      failRequest(req, "Subscribed blob data range too big.");
+      return;
+    }
+    // Up to the end of the blob is still bounded - by one element more than
+    // can be sent, so that the database never copies more than that, and
+    // the subscription fails once the blob extends past it.
+    uint64_t start = req->data_offset();
+    uint64_t length = req->data_length() ? req->data_length()
+                                         : k_max_msg_len_ + uint64_t(1);
+    uint64_t end = length <= ~start ? start + length : ~uint64_t(0);
+    info_req = QSharedPointer<dbif::BlobDataRequest>::create(start, end);
+    break;
+  }
+  }
+
+  auto sub = std::make_shared<Subscription>();
+  sub->req = req;
+  sub->object = target_object;
+  sub->started = false;
+  sub->active = true;
+  sub->busy = false;
+  subscriptions_[req->request_id()] = sub;
+  dbif::InfoPromise *promise = target_object->subInfo(info_req);
+  promise->setParent(this);
+  sub->promise = promise;
+  connect(promise, &dbif::InfoPromise::gotInfo, this,
+          [this, sub] (dbif::PInfoReply reply) {
+    subscriptionUpdate(sub, reply);
+  });
+  connect(promise, &dbif::InfoPromise::gotError, this,
+          [this, sub] (dbif::PError error) {
+    subscriptionError(sub, error);
+  });
+}
+
+void NetworkConnection::unsubscribe(PRequest req) {
+  auto it = subscriptions_.find(req->subscription_id());
+  if (it == subscriptions_.end()) {
+    failRequest(req, "Unknown subscription.");
+    return;
+  }
+  endSubscription(it->second);
+  network::Response resp;
+  resp.set_request_id(req->request_id());
+  resp.set_ok(true);
+  finishRequest(resp);
+}
+
+void NetworkConnection::endSubscription(PSubscription sub) {
+  sub->active = false;
+  subscriptions_.erase(sub->req->request_id());
+  // Takes the watcher down with it.
+  if (sub->promise) {
+    sub->promise->deleteLater();
+  }
+  if (!sub->started) {
+    failRequest(sub->req, "Subscription cancelled.");
+  }
+}
+
+void NetworkConnection::subscriptionError(PSubscription sub,
+                                          dbif::PError error) {
+  if (!sub->active) {
+    return;
+  }
+  if (!sub->started) {
+    // There is nothing to subscribe to - fail the request instead.
+    failSubscription(sub, "Failed to subscribe.");
+    return;
+  }
+  if (error.dynamicCast<dbif::ObjectGoneError>().isNull()) {
+    failSubscription(sub, "Subscription failed.");
+    return;
+  }
+  endSubscription(sub);
+  network::Response resp;
+  resp.set_request_id(sub->req->request_id());
+  resp.set_ok(true);
+  resp.set_event(true);
+  resp.set_gone(true);
+  queueMessage(resp);
+  writeOutput();
+}
+
+void NetworkConnection::failSubscription(PSubscription sub,
+                                         const char *error_msg) {
+  if (!sub->started) {
+    sub->active = false;
+    subscriptions_.erase(sub->req->request_id());
+    if (sub->promise) {
+      sub->promise->deleteLater();
+    }
+    failRequest(sub->req, error_msg);
+    return;
+  }
+  endSubscription(sub);
+  network::Response resp;
+  resp.set_request_id(sub->req->request_id());
+  resp.set_ok(false);
+  resp.set_error_msg(error_msg);
+  resp.set_event(true);
+  resp.set_gone(true);
+  queueMessage(resp);
+  writeOutput();
+}
+
+void NetworkConnection::subscriptionUpdate(PSubscription sub,
+                                           dbif::PInfoReply reply) {
+  if (!sub->active) {
+    return;
+  }
+  if (sub->busy) {
+    sub->pending = reply;
+    return;
+  }
+  auto resp = std::make_shared<network::Response>();
+  resp->set_request_id(sub->req->request_id());
+  resp->set_ok(true);
+  resp->set_event(sub->started);
+  switch (sub->req->type()) {
+  case network::Request::SUBSCRIBE_CHILDREN:
+    childrenChanged(sub, reply, resp);
+    return;
+  case network::Request::SUBSCRIBE_BLOB_DATA:
+    blobDataChanged(sub, reply, resp);
+    return;
+  case network::Request::SUBSCRIBE_DESCRIPTION: {
+    network::LocalObject *result = resp->add_results();
+    result->set_id(sub->object->id());
+    result->set_type(sub->object->type());
+    packDescription(reply, result);
+    break;
+  }
+  default: {
+    network::LocalObject *result = resp->add_results();
+    result->set_id(sub->object->id());
+    result->set_type(sub->object->type());
+    auto tables = makeTables(*sub->req);
+    packItems(reply, result, tables.get());
+    packTables(tables.get(), resp.get());
+    break;
+  }
+  }
+  sendEvent(sub, *resp);
+}
+
+void NetworkConnection::childrenChanged(
+    PSubscription sub, dbif::PInfoReply reply,
+    std::shared_ptr<network::Response> resp) {
+  std::vector<dbif::ObjectHandle> added;
+  std::set<uint64_t> children;
+  for (auto child : reply.dynamicCast<dbif::ChildrenReply>()->objects) {
+    children.insert(child->id());
+    if (!sub->children.count(child->id())) {
+      added.push_back(child);
+    }
+  }
+  for (uint64_t id : sub->children) {
+    if (!children.count(id)) {
+      resp->add_removed_ids(id);
+    }
+  }
+  sub->children.swap(children);
+  if (sub->started && added.empty() && !resp->removed_ids_size()) {
+    return;
+  }
+
+  // Events have to go out in order, so the next one waits for this one.
+  sub->busy = true;
+  auto job = std::make_shared<PackJob>();
+  job->pending = 1;
+  auto tables = makeTables(*sub->req);
+  job->tables = tables;
+  job->done = [this, sub, resp, tables] () {
+    packTables(tables.get(), resp.get());
+    sub->busy = false;
+    sendEvent(sub, *resp);
+    if (sub->pending) {
+      dbif::PInfoReply pending = sub->pending;
+      sub->pending.reset();
+      subscriptionUpdate(sub, pending);
+    }
+  };
+  for (auto &child : added) {
+    packObject(job, child, resp->add_results(), false);
+  }
+  job->release();
+}
+
+void NetworkConnection::blobDataChanged(
+    PSubscription sub, dbif::PInfoReply reply,
+    std::shared_ptr<network::Response> resp) {
+  const data::BinData &data = reply.dynamicCast<dbif::BlobDataReply>()->data;
+  unsigned octets_per_element = data.octetsPerElement();
+  // The subscription keeps a copy of the range to diff against, so its
+  // size is bounded.  A range that grows past it ends the subscription.
+  if (data.octets() > k_max_msg_len_) {
+    failSubscription(sub, "Subscribed blob data range too big.");
+    return;
+  }
+  size_t size = data.size();
+
+  // Only the part that differs from what the client has is sent.
+  size_t first = 0;
+  size_t last = size;
+  if (sub->started && data.width() == sub->data.width()) {
+    size_t common = std::min(size, sub->data.size()) * octets_per_element;
+    const uint8_t *new_data = data.rawData();
+    const uint8_t *old_data = sub->data.rawData();
+    first = (std::mismatch(new_data, new_data + common, old_data).first -
+             new_data) / octets_per_element;
+    if (size == sub->data.size()) {
+      auto rest = std::mismatch(
+          std::reverse_iterator<const uint8_t *>(new_data + common),
+          std::reverse_iterator<const uint8_t *>(new_data + first *
+                                                 octets_per_element),
+          std::reverse_iterator<const uint8_t *>(old_data + common)).first;
+      last = (rest.base() - new_data + octets_per_element - 1) /
+          octets_per_element;
+      if (first == last) {
+        return;
+      }
+    }
+  }
+
+  resp->set_data_width(data.width());
+  network::DataRange *range = resp->add_data_ranges();
+  range->set_offset(sub->req->data_offset() + first);
+  range->set_length(last - first);
+  resp->mutable_subscribed_range()->set_offset(sub->req->data_offset());
+  resp->mutable_subscribed_range()->set_length(size);
+  sub->data = data.data(0, size);
+  sendEvent(sub, *resp, sub->data.rawData(first),
+            (last - first) * octets_per_element);
+}
+
+void NetworkConnection::sendEvent(PSubscription sub,
+                                  const network::Response &resp,
+                                  const uint8_t *data, size_t octets) {
+  if (!sub->active) {
+    return;
+  }
+  queueMessage(resp);
+  if (resp.data_ranges_size()) {
+    queueDataMessage(data, octets);
+  }
+  if (!sub->started) {
+    sub->started = true;
+    requestDone();
+  } else {
+    writeOutput();
+  }
+}
+
+void NetworkConnection::packResults(
+    PRequest req, std::shared_ptr<network::Response> resp,
+    const std::vector<dbif::ObjectHandle> &objects, bool pack_children) {
+  auto job = std::make_shared<PackJob>();
+  job->pending = 1;
+  auto tables = makeTables(*req);
+  job->tables = tables;
+  job->done = [this, req, resp, tables] () {
+    packTables(tables.get(), resp.get());
+    resp->set_request_id(req->request_id());
+    resp->set_ok(true);
+    finishRequest(*resp);
+  };
+  // Results already present (with some fields set by the caller) are
+  // filled in order, the rest is added.
+  for (size_t i = 0; i < objects.size(); i++) {
+    auto result = static_cast<int>(i) < resp->results_size()
+        ? resp->mutable_results(static_cast<int>(i)) : resp->add_results();
+    packObject(job, objects[i], result, pack_children);
+  }
+  job->release();
+}
+
+void NetworkConnection::packObject(std::shared_ptr<PackJob> job,
+                                   dbif::ObjectHandle object,
+                                   network::LocalObject *result,
+                                   bool pack_children) {
+  // Objects may be deleted while we're at it - they're still sent, just
+  // with whatever was gathered before.
+  result->set_id(object->id());
+  result->set_type(object->type());
+
+  job->pending++;
+  getInfo(object, QSharedPointer<dbif::DescriptionRequest>::create(),
+      [job, result] (dbif::PInfoReply reply) {
+    packDescription(reply, result);
+    job->release();
+  }, [job] (dbif::PError) { job->release(); });
+
+  if (object->type() == dbif::CHUNK) {
+    job->pending++;
+    getInfo(object, QSharedPointer<dbif::ChunkDataRequest>::create(),
+        [job, result] (dbif::PInfoReply reply) {
+      packItems(reply, result, job->tables.get());
+      job->release();
+    }, [job] (dbif::PError) { job->release(); });
+  }
+
+  if (pack_children) {
+    job->pending++;
+    getInfo(object, QSharedPointer<dbif::ChildrenRequest>::create(),
+        [this, job, result] (dbif::PInfoReply reply) {
+      for (auto child : reply.dynamicCast<dbif::ChildrenReply>()->objects) {
+        packObject(job, child, result->add_children(), true);
+      }
+      job->release();
+    }, [job] (dbif::PError) { job->release(); });
+  }
+}
+
+void NetworkConnection::packDescription(dbif::PInfoReply reply,
+                                        network::LocalObject *result) {
+  auto desc = reply.dynamicCast<dbif::DescriptionReply>();
+  result->set_name(desc->name.toStdString());
+  result->set_comment(desc->comment.toStdString());
+  if (auto file = reply.dynamicCast<dbif::FileBlobDescriptionReply>()) {
+    result->set_file_blob_path(file->path.toStdString());
+  } else if (auto chunk = reply.dynamicCast<dbif::ChunkDescriptionReply>()) {
+    result->set_chunk_start(chunk->start);
+    result->set_chunk_end(chunk->end);
+    result->set_chunk_type(chunk->chunk_type.toStdString());
+  }
+}
+
+std::shared_ptr<data::FieldDescriptorPool> NetworkConnection::makeTables(
+    const network::Request &req) {
+  if (!req.full_items()) {
+    return nullptr;
+  }
+  auto tables = std::make_shared<data::FieldDescriptorPool>();
+  // Index 0 is for items without a name.
+  tables->internName(QString());
+  return tables;
+}
+
+void NetworkConnection::packItems(dbif::PInfoReply reply,
+                                  network::LocalObject *result,
+                                  data::FieldDescriptorPool *tables) {
+  for (auto &item : reply.dynamicCast<dbif::ChunkDataReply>()->items) {
+    if (!tables) {
+      // Old clients only know about fields.
+      if (item.type != data::ChunkDataItem::FIELD) {
+        continue;
+      }
+      network::ChunkDataItem* packed_item = result->add_items();
+      packed_item->set_start(item.start);
+      packed_item->set_end(item.end);
+      packed_item->set_name(item.name.toStdString());
+      continue;
+    }
+
+    network::ChunkDataItem* packed_item = result->add_items();
+    packed_item->set_type(item.type);
+    if (item.type != data::ChunkDataItem::COMPUTED &&
+        item.type != data::ChunkDataItem::SUBBLOB) {
+      packed_item->set_start(item.start);
+      packed_item->set_end(item.end);
+    }
+    if (item.type != data::ChunkDataItem::PAD) {
+      packed_item->set_name_index(tables->internName(item.name));
+    }
+    if (item.type == data::ChunkDataItem::FIELD ||
+        item.type == data::ChunkDataItem::BITFIELD ||
+        item.type == data::ChunkDataItem::COMPUTED) {
+      // Only fields are repacked from the blob.
+      data::RepackFormat repack = {data::RepackEndian::LITTLE, 0, 0, 0};
+      if (item.type == data::ChunkDataItem::FIELD) {
+        repack = item.repack;
+        packed_item->set_num_elements(item.num_elements);
+      }
+      packed_item->set_field_type(
+          tables->internDescriptor(repack, item.high_type));
+      packed_item->set_value(item.raw_value.rawData(),
+                             item.raw_value.octets());
+      packed_item->set_value_width(item.raw_value.width());
+    }
+    for (auto &ref : item.ref) {
+      if (ref) {
+        packed_item->add_refs(ref->id());
+      }
+    }
+  }
+}
+
+void NetworkConnection::packTables(data::FieldDescriptorPool *tables,
+                                   network::Response *resp) {
+  if (!tables) {
+    return;
+  }
+  // Type names go to the string table too, so types come first.
+  for (size_t i = 0; i < tables->descriptorsCount(); i++) {
+    const data::FieldDescriptor &desc =
+        tables->descriptor(static_cast<uint32_t>(i));
+    const data::FieldHighType &high_type = desc.high_type;
+    network::FieldType *type = resp->add_field_types();
+    type->set_mode(high_type.mode);
+    type->set_big_endian(desc.repack.endian == data::RepackEndian::BIG);
+    type->set_width(desc.repack.width);
+    type->set_high_pad(desc.repack.highPad);
+    type->set_low_pad(desc.repack.lowPad);
+    // Members irrelevant for the mode aren't initialized.
+    switch (high_type.mode) {
+    case data::FieldHighType::FIXED:
+      type->set_shift(high_type.shift);
+      type->set_is_signed(
+          high_type.sign_mode == data::FieldHighType::SIGNED);
+      break;
+    case data::FieldHighType::FLOAT:
+      type->set_float_mode(high_type.float_mode);
+      type->set_float_complex(high_type.float_complex);
+      break;
+    case data::FieldHighType::STRING:
+      type->set_string_mode(high_type.string_mode);
+      type->set_string_encoding(high_type.string_encoding);
+      break;
+    case data::FieldHighType::POINTER:
+      type->set_shift(high_type.shift);
+      type->set_type_name(tables->internName(high_type.type_name));
+      break;
+    case data::FieldHighType::ENUM:
+      type->set_type_name(tables->internName(high_type.type_name));
+      break;
+    default:
+      break;
+    }
+  }
+  for (size_t i = 0; i < tables->namesCount(); i++) {
+    resp->add_strings(tables->name(static_cast<uint32_t>(i)).toStdString());
+  }
+}
+
+QByteArray NetworkConnection::frameHeader(uint32_t length, bool continued) {
+  QByteArray header(sizeof(uint32_t), Qt::Uninitialized);
+  qToLittleEndian<quint32>(length | (continued ? k_frame_continued_ : 0),
+                           reinterpret_cast<uchar *>(header.data()));
+  return header;
+}
+
+void NetworkConnection::queueMessage(const network::Response &resp) {
+  QByteArray serialized(resp.ByteSize(), Qt::Uninitialized);
+  resp.SerializeToArray(serialized.data(), serialized.size());
+  QByteArray message;
+  int pos = 0;
+  do {
+    int len = std::min<int>(serialized.size() - pos, k_max_frame_size_);
+    message += frameHeader(len, pos + len < serialized.size());
+    message.append(serialized.constData() + pos, len);
+    pos += len;
+  } while (pos < serialized.size());
+  queueData(message);
+}
+
+void NetworkConnection::queueData(const QByteArray &data) {
+  Output out;
+  out.data = data;
+  output_.push_back(out);
+  output_size_ += data.size();
+}
+
+void NetworkConnection::queueDataMessage(const uint8_t *data, size_t octets) {
+  QByteArray message;
+  for (size_t pos = 0; pos < octets; pos += k_max_frame_size_) {
+    size_t len = std::min<size_t>(octets - pos, k_max_frame_size_);
+    message += frameHeader(static_cast<uint32_t>(len), true);
+    message.append(reinterpret_cast<const char *>(data) + pos,
+                   static_cast<int>(len));
+  }
+  message += frameHeader(0, false);
+  queueData(message);
+}
+
+void NetworkConnection::writeOutput() {
+  while (!output_.empty() &&
+         socket_->bytesToWrite() < k_write_buffer_size_) {
+    Output &out = output_.front();
+    if (out.mapping) {
+      // Has to go after everything queued so far, in order.
+      if (socket_->bytesToWrite()) {
+        break;
+      }
+      int res = sendDescriptor(out.mapping->fd);
+      if (res < 0) {
+        abortConnection();
+        return;
+      }
+      if (!res) {
+        QTimer::singleShot(1, this, [this] () { writeOutput(); });
+        break;
+      }
+    } else if (out.stream) {
+      auto &ranges = out.stream->ranges;
+      while (!ranges.empty() && ranges.front().first == ranges.front().second) {
+        ranges.pop_front();
+      }
+      if (!ranges.empty()) {
+        fetchStreamData(out.stream);
+        break;
+      }
+      // Data is sent in continued frames, an empty one ends it.
+      socket_->write(frameHeader(0, false));
+    } else {
+      socket_->write(out.data);
+      output_size_ -= out.data.size();
+    }
+    output_.pop_front();
+  }
+  // Draining output may have made room for more requests.
+  readMessages();
+}
+
+void NetworkConnection::fetchStreamData(std::shared_ptr<BlobStream> stream) {
+  if (stream->fetching) {
+    return;
+  }
+  stream->fetching = true;
+  uint64_t start = stream->ranges.front().first;
+  uint64_t end = std::min<uint64_t>(
+      stream->ranges.front().second,
+      start + std::max<uint64_t>(
+          1, k_max_frame_size_ / stream->octets_per_element));
+  getInfo(stream->blob,
+          QSharedPointer<dbif::BlobDataRequest>::create(start, end),
+          [this, stream, start, end] (dbif::PInfoReply reply) {
+    stream->fetching = false;
+    const data::BinData &data =
+        reply.dynamicCast<dbif::BlobDataReply>()->data;
+    if (data.size() != end - start) {
+      // The blob shrank since the response went out - there's no way
+      // to tell the client, other than breaking the connection.
+      abortConnection();
+      return;
+    }
+    socket_->write(frameHeader(data.octets(), true));
+    socket_->write(reinterpret_cast<const char *>(data.rawData()),
+                   data.octets());
+    auto &range = stream->ranges.front();
+    range.first = end;
+    if (range.first == range.second) {
+      stream->ranges.pop_front();
+    }
+    writeOutput();
+  }, [this] (dbif::PError) {
+    abortConnection();
+  });
+}
+
+int NetworkConnection::sendDescriptor(int fd) {
+#ifdef Q_OS_LINUX
+  // A single octet carries the descriptor.
+  char octet = 0;
+  struct iovec iov;
+  iov.iov_base = &octet;
+  iov.iov_len = 1;
+  union {
+    struct cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  std::memset(&control, 0, sizeof(control));
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  ssize_t res;
+  do {
+    res = sendmsg(local_descriptor_, &msg, MSG_NOSIGNAL);
+  } while (res < 0 && errno == EINTR);
+  if (res < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  }
+  return 1;
+#else
+  (void)fd;
+  return -1;
+#endif
+}
+
+}  // namespace db
+}  // namespace veles
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "parser/inflate.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace veles {
+namespace parser {
+
+// The size hint usually comes from untrusted headers, so the buffer is only
+// sized up to it as far as the compressed data seen so far could
+// plausibly inflate - past that it grows geometrically as usual.
+static const uint64_t k_max_hinted_ratio = 16;
+
+void OctetBuffer::reserve(size_t min_capacity) {
+  if (min_capacity <= data_.size()) {
+    return;
+  }
+  data::BinData grown(8, min_capacity);
+  memcpy(grown.rawData(), data_.rawData(), size_);
+  data_ = std::move(grown);
+}
+
+void OctetBuffer::append(const uint8_t *src, size_t num) {
+  if (tailSize() < num) {
+    reserve(std::max(size_ + num, capacity() * 2));
+  }
+  memcpy(tail(), src, num);
+  commit(num);
+}
+
+data::BinData OctetBuffer::take() {
+  data::BinData res;
+  if (size_ == data_.size()) {
+    res = std::move(data_);
+  } else {
+    res = data_.data(0, size_);
+  }
+  data_ = data::BinData(8, 0);
+  size_ = 0;
+  return res;
+}
+
+Inflater::Inflater(uint64_t max_output, uint64_t size_hint, bool raw)
+    : initialized_(false), state_(State::RUNNING), max_output_(max_output),
+      size_hint_(std::min(size_hint, max_output)), total_in_(0) {
+  strm_.zalloc = Z_NULL;
+  strm_.zfree = Z_NULL;
+  strm_.opaque = Z_NULL;
+  strm_.next_in = Z_NULL;
+  strm_.avail_in = 0;
+  int ret = raw ? inflateInit2(&strm_, -MAX_WBITS) : inflateInit(&strm_);
+  if (ret != Z_OK) {
+    state_ = State::BROKEN;
+    return;
+  }
+  initialized_ = true;
+}
+
+Inflater::~Inflater() {
+  if (initialized_) {
+    inflateEnd(&strm_);
+  }
+}
+
+void Inflater::fail(State state) {
+  state_ = state;
+  inflateEnd(&strm_);
+  initialized_ = false;
+  out_ = OctetBuffer();
+}
+
+void Inflater::grow() {
+  uint64_t want = std::max<uint64_t>(out_.capacity() * 2, 0x4000);
+  if (size_hint_ > out_.size()) {
+    uint64_t plausible = total_in_ * k_max_hinted_ratio;
+    if (total_in_ > std::numeric_limits<uint64_t>::max() / k_max_hinted_ratio) {
+      plausible = std::numeric_limits<uint64_t>::max();
+    }
+    // Stopping exactly at the hint lets take() skip a copy if it was right.
+    want = std::min(size_hint_, std::max(want, plausible));
+  }
+  // Going one octet over max_output is enough to detect exceeding it.
+  if (max_output_ < std::numeric_limits<uint64_t>::max()) {
+    want = std::min(want, max_output_ + 1);
+  }
+  out_.reserve(want);
+}
+
+bool Inflater::feed(const uint8_t *src, size_t num) {
+  if (state_ != State::RUNNING) {
+    return state_ == State::FINISHED;
+  }
+  total_in_ += num;
+  while (num) {
+    // zlib counts in uInt, which may be narrower than size_t.
+    uInt piece = static_cast<uInt>(
+        std::min<size_t>(num, std::numeric_limits<uInt>::max()));
+    strm_.next_in = const_cast<Bytef *>(src);
+    strm_.avail_in = piece;
+    while (strm_.avail_in) {
+      uInt avail_out = static_cast<uInt>(
+          std::min<size_t>(out_.tailSize(), std::numeric_limits<uInt>::max()));
+      strm_.next_out = out_.tail();
+      strm_.avail_out = avail_out;
+      int ret = ::inflate(&strm_, Z_NO_FLUSH);
+      out_.commit(avail_out - strm_.avail_out);
+      if (out_.size() > max_output_) {
+        fail(State::LIMIT_EXCEEDED);
+        return false;
+      }
+      switch (ret) {
+      case Z_OK:
+      case Z_BUF_ERROR:
+        // Z_BUF_ERROR only means no progress was possible - with input
+        // still available, that's because the output buffer is full.
+        if (!strm_.avail_out) {
+          grow();
+        }
+        break;
+      case Z_STREAM_END:
+        state_ = State::FINISHED;
+        inflateEnd(&strm_);
+        initialized_ = false;
+        return true;
+      default:
+        fail(State::BROKEN);
+        return false;
+      }
+    }
+    src += piece;
+    num -= piece;
+  }
+  return true;
+}
+
+data::BinData Inflater::result() {
+  if (state_ != State::FINISHED) {
+    return data::BinData(8, 0);
+  }
+  return out_.take();
+}
+
+data::BinData inflateData(const data::BinData &src, uint64_t max_output) {
+  Inflater inflater(max_output);
+  inflater.feed(src);
+  return inflater.result();
+}
+
+}  // namespace parser
+}  // namespace veles
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "parser/transform.h"
+
+#include <limits>
+
+#include <QByteArray>
+
+#include "parser/inflate.h"
+#include "util/encoders/factory.h"
+
+namespace veles {
+namespace parser {
+
+bool InflateTransform::apply(const data::BinData &src, const QString &param,
+                             data::BinData *out) {
+  if (src.width() != 8) {
+    return false;
+  }
+  uint64_t max_output = Inflater::k_default_max_output;
+  if (!param.isEmpty()) {
+    bool ok;
+    max_output = param.toULongLong(&ok);
+    if (!ok) {
+      return false;
+    }
+  }
+  Inflater inflater(max_output, 0, raw_);
+  inflater.feed(src);
+  if (!inflater.finished()) {
+    return false;
+  }
+  *out = inflater.result();
+  return true;
+}
+
+bool XorTransform::apply(const data::BinData &src, const QString &param,
+                         data::BinData *out) {
+  QByteArray key = QByteArray::fromHex(param.toLatin1());
+  if (src.width() != 8 || key.isEmpty()) {
+    return false;
+  }
+  data::BinData res(8, src.size(), src.rawData());
+  uint8_t *dst = res.rawData();
+  size_t key_size = key.size();
+  for (size_t i = 0, k = 0; i < res.size(); i++) {
+    dst[i] ^= static_cast<uint8_t>(key[static_cast<int>(k)]);
+    if (++k == key_size) {
+      k = 0;
+    }
+  }
+  *out = std::move(res);
+  return true;
+}
+
+DecoderTransform::DecoderTransform(const QString &encoder_id)
+    : Transform(encoder_id),
+      encoder_(util::encoders::EncodersFactory::create(encoder_id)) {}
+
+bool DecoderTransform::apply(const data::BinData &src, const QString &,
+                             data::BinData *out) {
+  // QString can't hold more than INT_MAX characters.
+  if (src.width() != 8 || !encoder_ ||
+      src.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    return false;
+  }
+  QString text = QString::fromLatin1(
+      reinterpret_cast<const char *>(src.rawData()),
+      static_cast<int>(src.size())).trimmed();
+  // Decoders skip characters they don't understand, so only input with
+  // nothing decodable in it is rejected - a full validateEncoded() round
+  // trip would be too slow for big blobs.
+  QByteArray decoded = encoder_->decode(text);
+  if (decoded.isEmpty() && !text.isEmpty()) {
+    return false;
+  }
+  *out = data::BinData(8, decoded.size(),
+                       reinterpret_cast<const uint8_t *>(decoded.data()));
+  return true;
+}
+
+QList<Transform *> createAllTransforms() {
+  QList<Transform *> res;
+  res.append(new InflateTransform("zlib", false));
+  res.append(new InflateTransform("deflate", true));
+  res.append(new XorTransform());
+  for (auto &key : util::encoders::EncodersFactory::keys()) {
+    res.append(new DecoderTransform(key));
+  }
+  return res;
+}
+
+}  // namespace parser
+}  // namespace veles
@@ -16,54 +16,75 @@
  */
 #include "parser/unpng.h"
 
+#include "parser/inflate.h"
 #include "parser/stream.h"
 #include "parser/utils.h"
 
-#include <stdio.h>
-#include <vector>
-
-#include <zlib.h>
+#include <limits>
+#include <memory>
 
 namespace veles {
 namespace parser {
 
-std::vector<uint8_t> do_inflate(const std::vector<uint8_t> &d) {
-  std::vector<uint8_t> res;
-  z_stream strm;
-  strm.zalloc = Z_NULL;
-  strm.zfree = Z_NULL;
-  strm.opaque = Z_NULL;
-  strm.avail_in = static_cast<uInt>(d.size());
-  // fuck you too.
-  strm.next_in = const_cast<uint8_t *>(d.data());
-  if (inflateInit(&strm) != Z_OK)
-    return res;
-  const unsigned BUFSZ = 0x4000;
-  uint8_t buf[BUFSZ];
-  while (1) {
-    strm.avail_out = BUFSZ;
-    strm.next_out = buf;
-    auto ret = inflate(&strm, Z_NO_FLUSH);
-    switch (ret) {
-    case Z_STREAM_ERROR:
-    case Z_BUF_ERROR:
-    case Z_DATA_ERROR:
-    case Z_NEED_DICT:
-      // :(
-      inflateEnd(&strm);
-      return std::vector<uint8_t>();
-    }
-    res.insert(res.end(), buf, buf + BUFSZ - strm.avail_out);
-    if (ret == Z_STREAM_END) {
-      inflateEnd(&strm);
-      return res;
-    }
-    if (strm.avail_out) {
-      // buffer not completely filled, but we have no more input stream - oops.
-      inflateEnd(&strm);
-      return std::vector<uint8_t>();
-    }
+/** Multiplies a by b, returns false on overflow.  */
+static bool checkedMul(uint64_t a, uint64_t b, uint64_t *res) {
+  if (b != 0 && a > std::numeric_limits<uint64_t>::max() / b) {
+    return false;
+  }
+  *res = a * b;
+  return true;
+}
+
+/** Returns the expected size of the inflated image data, as described by
+    the IHDR chunk contents, or 0 if it can't be determined.  */
+static uint64_t inflatedSizeHint(const data::BinData &ihdr) {
+  if (ihdr.size() < 13) {
+    return 0;
+  }
+  auto be32 = [&ihdr](size_t pos) {
+    return static_cast<uint64_t>(ihdr.element64(pos)) << 24 |
+        ihdr.element64(pos + 1) << 16 | ihdr.element64(pos + 2) << 8 |
+        ihdr.element64(pos + 3);
+  };
+  uint64_t width = be32(0);
+  uint64_t height = be32(4);
+  uint64_t bit_depth = ihdr.element64(8);
+  uint64_t channels;
+  switch (ihdr.element64(9)) {
+  case 0: channels = 1; break;  // greyscale
+  case 2: channels = 3; break;  // RGB
+  case 3: channels = 1; break;  // palette
+  case 4: channels = 2; break;  // greyscale + alpha
+  case 6: channels = 4; break;  // RGBA
+  default: return 0;
   }
+  // Each scanline is prefixed with a filter type byte.  Interlaced images
+  // are slightly bigger, which is fine for a hint.  All fields come from
+  // the file, so they may be anything.
+  uint64_t line_bits, size;
+  if (!checkedMul(width, channels * bit_depth, &line_bits) ||
+      !checkedMul(height, 1 + line_bits / 8 + (line_bits % 8 != 0), &size)) {
+    return 0;
+  }
+  return size;
+}
+
+/** zTXt and iCCP chunks hold a keyword, a NUL, a compression method byte
+    and zlib-compressed data.  The data is decompressed on demand into
+    a transformed blob.  */
+static void makeCompressedBlob(dbif::ObjectHandle chunk,
+                               const data::BinData &d, uint64_t data_pos,
+                               const QString &name) {
+  size_t keyword_end = 0;
+  while (keyword_end < d.size() && d.element64(keyword_end) != 0) {
+    keyword_end++;
+  }
+  // Method 0 (deflate) is the only one defined.
+  if (keyword_end + 1 >= d.size() || d.element64(keyword_end + 1) != 0) {
+    return;
+  }
+  makeTransformedBlob(chunk, name, "zlib", "", data_pos + keyword_end + 2,
+                      data_pos + d.size());
 }
 
 void unpngFileBlob(dbif::ObjectHandle blob, uint64_t start,
@@ -73,25 +94,46 @@ void unpngFileBlob(dbif::ObjectHandle blob, uint64_t start,
   parser.startChunk("png_header", "header");
   parser.getBytes("sig", 8);
   parser.endChunk();
-  std::vector<uint8_t> jointIdats;
+  OctetBuffer joint_idats;
+  std::unique_ptr<Inflater> inflater;
   for (unsigned idx = 0; !parser.eof(); idx++) {
     parser.startChunk("png_chunk", QString("chunks[%1]").arg(idx));
     uint32_t len = parser.getBe32("length");
     auto type = parser.getBytes("type", 4);
-    auto d = parser.getBytes("data", len);
+    uint64_t data_pos = parser.pos();
+    auto d = parser.getData(
+        "data", data::RepackFormat{data::RepackEndian::LITTLE, 8}, len,
+        data::FieldHighType());
     parser.getBe32("crc32");
-    parser.endChunk();
+    auto chunk = parser.endChunk();
+    if (type.size() < 4)
+      break;
+    if ((type[0] == 'z' && type[1] == 'T' && type[2] == 'X' &&
+         type[3] == 't') ||
+        (type[0] == 'i' && type[1] == 'C' && type[2] == 'C' &&
+         type[3] == 'P')) {
+      makeCompressedBlob(chunk, d, data_pos,
+                         type[0] == 'z' ? "text" : "profile");
+    }
+    if (type[0] == 'I' && type[1] == 'H' && type[2] == 'D' && type[3] == 'R' &&
+        !inflater) {
+      inflater.reset(new Inflater(Inflater::k_default_max_output,
+                                  inflatedSizeHint(d)));
+    }
     if (type[0] == 'I' && type[1] == 'D' && type[2] == 'A' && type[3] == 'T') {
-      jointIdats.insert(jointIdats.end(), d.begin(), d.end());
+      if (!inflater) {
+        inflater.reset(new Inflater());
+      }
+      joint_idats.append(d.rawData(), d.octets());
+      inflater->feed(d);
     }
     if (type[0] == 'I' && type[1] == 'E' && type[2] == 'N' && type[3] == 'D')
       break;
   }
   auto png = parser.endChunk();
-  makeSubBlob(png, "deflated_data", data::BinData(8, jointIdats.size(), jointIdats.data()));
-  auto decompressed = do_inflate(jointIdats);
-  if (decompressed.size())
-    makeSubBlob(png, "inflated_data", data::BinData(8, decompressed.size(), decompressed.data()));
+  makeSubBlob(png, "deflated_data", joint_idats.take());
+  if (inflater && inflater->finished())
+    makeSubBlob(png, "inflated_data", inflater->result());
 }
 
 }
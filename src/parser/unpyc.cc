@@ -14,208 +14,382 @@
  * limitations under the License.
  *
  */
-#include <typeinfo>
-#include "db/db.h"
+#include <algorithm>
+#include <vector>
+
 #include "dbif/info.h"
 #include "dbif/method.h"
-#include "dbif/promise.h"
-#include "dbif/error.h"
 #include "dbif/universe.h"
-#include "parser/stream.h"
 #include "parser/utils.h"
 #include "data/field.h"
+#include "data/repack.h"
 #include "parser/unpyc.h"
 
 namespace veles {
 namespace parser {
 
-void parseCode(dbif::ObjectHandle code);
+namespace {
+
+/** What follows the type byte of a marshal object.  */
+enum class MarshalKind : uint8_t {
+  INVALID,
+  // Nothing (None, True, ...).
+  EMPTY,
+  // 32-bit signed int.
+  INT32,
+  // 32-bit signed digit count, then 16-bit digits.
+  BIGINT,
+  // Binary double.
+  FLOAT,
+  // Two binary doubles.
+  COMPLEX,
+  // 32-bit length, then bytes.
+  BYTES,
+  // 32-bit length, then characters.
+  STR32,
+  // 8-bit length, then characters.
+  STR8,
+  // 32-bit length, then elements.
+  TUPLE32,
+  // 8-bit length, then elements.
+  TUPLE8,
+  // 32-bit ref index.
+  REF,
+  CODE,
+};
+
+struct MarshalKindTable {
+  MarshalKind kinds[0x80];
+
+  MarshalKindTable() {
+    std::fill(kinds, kinds + 0x80, MarshalKind::INVALID);
+    set("0NTF.S", MarshalKind::EMPTY);
+    set("i", MarshalKind::INT32);
+    set("l", MarshalKind::BIGINT);
+    set("g", MarshalKind::FLOAT);
+    set("y", MarshalKind::COMPLEX);
+    set("s", MarshalKind::BYTES);
+    set("utaA", MarshalKind::STR32);
+    set("zZ", MarshalKind::STR8);
+    set("(", MarshalKind::TUPLE32);
+    set(")", MarshalKind::TUPLE8);
+    set("r", MarshalKind::REF);
+    set("c", MarshalKind::CODE);
+  }
+
+  void set(const char *types, MarshalKind kind) {
+    for (; *types; types++) {
+      kinds[static_cast<uint8_t>(*types)] = kind;
+    }
+  }
+};
+
+const MarshalKindTable k_marshal_kinds;
+
+// Same as CPython's limit - deeper nesting can't come from marshal.dumps.
+const unsigned k_max_marshal_depth = 2000;
+
+/** A code object found while decoding, to get its bytecode and line
+    number table extracted into sub-blobs once the chunks exist.  */
+struct CodeInfo {
+  size_t chunk;
+  bool has_bytecode;
+  data::BinData bytecode;
+  bool has_lnotab;
+  data::BinData lnotab;
+  bool has_firstlineno;
+  uint32_t firstlineno;
+};
+
+/** Decodes a marshal stream from a local copy of the blob data, building
+    the chunk tree in memory.  Chunks and fields are laid out exactly as
+    StreamParser would, but the whole tree is then created with a single
+    ChunkCreateManyRequest instead of two requests per chunk.  */
+class MarshalDecoder {
+ public:
+  MarshalDecoder(const data::BinData &data, uint64_t base)
+      : data_(data), base_(base), pos_(0), objects_(0) {}
+
+  std::vector<dbif::ChunkSpec> &chunks() { return chunks_; }
+  std::vector<CodeInfo> &codeObjects() { return code_objects_; }
+  uint64_t objects() const { return objects_; }
+  bool eof() const { return pos_ >= data_.size(); }
+
+  void startChunk(const QString &type, const QString &name) {
+    dbif::ChunkSpec spec;
+    spec.name = name;
+    spec.chunk_type = type;
+    spec.parent = stack_.empty() ? -1 : static_cast<int64_t>(stack_.back());
+    spec.start = spec.end = base_ + pos_;
+    stack_.push_back(chunks_.size());
+    chunks_.push_back(spec);
+  }
+
+  void endChunk() {
+    size_t idx = stack_.back();
+    stack_.pop_back();
+    auto &spec = chunks_[idx];
+    spec.end = base_ + pos_;
+    if (spec.parent >= 0) {
+      auto item = data::ChunkDataItem::subchunk(spec.start, spec.end,
+                                                spec.name, dbif::ObjectHandle());
+      // Filled in by the database with the handle of the created chunk.
+      item.ref.clear();
+      chunks_[spec.parent].items.push_back(item);
+    }
+  }
+
+  /** Reads a field, the same way StreamParser::getData does - returns
+      an empty BinData at the end of data, and a truncated value if it
+      runs past the end.  */
+  data::BinData getData(const QString &name, const data::RepackFormat &repack,
+                        size_t num_elements,
+                        const data::FieldHighType &high_type) {
+    if (pos_ >= data_.size()) {
+      return data::BinData();
+    }
+    size_t src_sz = data::repackSize(data_.width(), repack, num_elements);
+    size_t end = std::min<uint64_t>(uint64_t(pos_) + src_sz, data_.size());
+    data::BinData res;
+    if (data_.width() == 8 && repack.width == 8 && !repack.highPad &&
+        !repack.lowPad) {
+      res = data_.data(pos_, end);
+    } else {
+      res = data::repack(data_.data(pos_, end), repack, 0, num_elements);
+    }
+    chunks_[stack_.back()].items.push_back(data::ChunkDataItem::field(
+        base_ + pos_, base_ + pos_ + src_sz, name, repack, num_elements,
+        high_type, res));
+    pos_ += src_sz;
+    return res;
+  }
+
+  uint32_t getLe32(const QString &name,
+                   data::FieldHighType::FieldSignMode sign_mode =
+                       data::FieldHighType::UNSIGNED,
+                   bool *ok = nullptr) {
+    auto res = getData(name, data::RepackFormat{data::RepackEndian::LITTLE, 32},
+                       1, data::FieldHighType::fixed(sign_mode));
+    if (ok) {
+      *ok = res.size() == 1;
+    }
+    return res.size() ? res.element64() : 0;
+  }
+
+  uint8_t getByte(const QString &name) {
+    auto res = getData(name, data::RepackFormat{data::RepackEndian::LITTLE, 8},
+                       1, data::FieldHighType());
+    return res.size() ? res.element64() : 0;
+  }
+
+  data::BinData getBytes(const QString &name, uint64_t len) {
+    return getData(name, data::RepackFormat{data::RepackEndian::LITTLE, 8},
+                   len, data::FieldHighType());
+  }
+
+  void getLe16(const QString &name, uint64_t num) {
+    getData(name, data::RepackFormat{data::RepackEndian::LITTLE, 16}, num,
+            data::FieldHighType());
+  }
+
+  bool parseObject(const QString &name, unsigned depth = 0);
+
+ private:
+  const data::BinData &data_;
+  uint64_t base_;
+  size_t pos_;
+  uint64_t objects_;
+  std::vector<size_t> stack_;
+  std::vector<dbif::ChunkSpec> chunks_;
+  std::vector<CodeInfo> code_objects_;
+
+  bool parseElements(uint32_t len, unsigned depth);
+  bool findBytes(size_t chunk, data::BinData *out);
+};
+
+bool MarshalDecoder::parseElements(uint32_t len, unsigned depth) {
+  for (uint32_t i = 0; i != len; i++) {
+    if (!parseObject(QString("elements[%1]").arg(i), depth + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MarshalDecoder::findBytes(size_t chunk, data::BinData *out) {
+  if (chunk >= chunks_.size()) {
+    return false;
+  }
+  for (auto &item : chunks_[chunk].items) {
+    if (item.type == data::ChunkDataItem::FIELD && item.name == "bytes") {
+      *out = item.raw_value;
+      return true;
+    }
+  }
+  return false;
+}
 
-bool parseMarshal(StreamParser &parser, const QString &name) {
-  parser.startChunk("marshal", name);
-  uint8_t mtype = parser.getByte("type");
+bool MarshalDecoder::parseObject(const QString &name, unsigned depth) {
+  if (depth > k_max_marshal_depth) {
+    return false;
+  }
+  objects_++;
+  startChunk("marshal", name);
+  uint8_t mtype = getByte("type");
   // XXX: annotate type enum val & ref bit
   // XXX: store ref
-  switch (mtype & 0x7f) {
-  case '0': // NULL
-  case 'N': // None
-  case 'T': // True
-  case 'F': // False
-  case '.': // ...
-  case 'S': // StopIteration (unused)
+  bool ok = true;
+  switch (k_marshal_kinds.kinds[mtype & 0x7f]) {
+  case MarshalKind::EMPTY:
     break;
-  case 'i': {
-    // 32-bit signed int
-    parser.getLe32("value", data::FieldHighType::SIGNED);
+  case MarshalKind::INT32:
+    getLe32("value", data::FieldHighType::SIGNED);
     break;
-  }
-  case 'l': {
-    // big int
+  case MarshalKind::BIGINT: {
     // XXX: annotate with bignum value
-    int32_t slen = parser.getLe32("len", data::FieldHighType::SIGNED);
+    int32_t slen = getLe32("len", data::FieldHighType::SIGNED);
     uint32_t len = slen < 0 ? -slen : slen;
-    parser.getLe16("digits", len);
+    getLe16("digits", len);
     break;
   }
-  case 'g': {
+  case MarshalKind::FLOAT:
     // XXX: get as 64-bit, annotate as double
-    parser.getBytes("value", 8);
+    getBytes("value", 8);
     break;
-  }
-  case 'y': {
-    // XXX: get as 64-bit, annotate as double
-    parser.getBytes("real", 8);
-    parser.getBytes("imag", 8);
+  case MarshalKind::COMPLEX:
+    getBytes("real", 8);
+    getBytes("imag", 8);
     break;
-  }
-  case 's': {
-    // bytestring
-    uint32_t len = parser.getLe32("length");
+  case MarshalKind::BYTES: {
     // XXX: annotate as string, unless it's code / lnotab?
-    parser.getBytes("bytes", len);
+    uint32_t len = getLe32("length");
+    getBytes("bytes", len);
     break;
   }
-  case 'u':
-  case 't': {
-    // UTF-8 unicode string, 32-bit length
-    // XXX: annotate as number
-    uint32_t len = parser.getLe32("length");
-    parser.getBytes("chars", len);
+  case MarshalKind::STR32: {
+    uint32_t len = getLe32("length");
+    getBytes("chars", len);
     break;
   }
-  case 'a':
-  case 'A': {
-    // 7-bit-only unicode string, 32-bit length
-    // XXX: annotate as number
-    uint32_t len = parser.getLe32("length");
-    parser.getBytes("chars", len);
+  case MarshalKind::STR8: {
+    uint32_t len = getByte("length");
+    getBytes("chars", len);
     break;
   }
-  case 'z':
-  case 'Z': {
-    // 7-bit-only unicode string, 8-bit length
-    // XXX: annotate as number
-    uint32_t len = parser.getByte("length");
-    parser.getBytes("chars", len);
+  case MarshalKind::TUPLE32:
+    ok = parseElements(getLe32("length"), depth);
     break;
-  }
-  case '(': {
-    // tuple, 32-bit length
-    // XXX: annotate as number
-    uint32_t len = parser.getLe32("length");
-    for (uint32_t i = 0; i != len; i++) {
-      if (!parseMarshal(parser, QString("elements[%1]").arg(i))) {
-        goto err;
-      }
-    }
+  case MarshalKind::TUPLE8:
+    ok = parseElements(getByte("length"), depth);
     break;
-  }
-  case ')': {
-    // tuple, 8-bit length
-    // XXX: annotate as number
-    uint32_t len = parser.getByte("length");
-    for (uint32_t i = 0; i != len; i++) {
-      if (!parseMarshal(parser, QString("elements[%1]").arg(i))) {
-        goto err;
-      }
+  case MarshalKind::REF:
+    // XXX: find that thing and annotate
+    getLe32("idx");
+    break;
+  case MarshalKind::CODE: {
+    CodeInfo code;
+    code.chunk = stack_.back();
+    // XXX: annotate all these as numbers
+    getLe32("argcount");
+    getLe32("kwonlyargcount");
+    getLe32("nlocals");
+    getLe32("stacksize");
+    getLe32("flags");
+    size_t bytecode_chunk = chunks_.size();
+    ok = parseObject("code", depth + 1);
+    code.has_bytecode = ok && findBytes(bytecode_chunk, &code.bytecode);
+    for (const char *sub : {"consts", "names", "varnames", "freevars",
+                            "cellvars", "filename", "name"}) {
+      ok = ok && parseObject(sub, depth + 1);
+    }
+    if (!ok) {
+      break;
+    }
+    code.firstlineno = getLe32("firstlineno", data::FieldHighType::UNSIGNED,
+                               &code.has_firstlineno);
+    size_t lnotab_chunk = chunks_.size();
+    ok = parseObject("lnotab", depth + 1);
+    code.has_lnotab = ok && findBytes(lnotab_chunk, &code.lnotab);
+    if (ok) {
+      code_objects_.push_back(code);
     }
     break;
   }
-  // '>': frozenset
-  case 'r': {
-    // ref
-    // XXX: find that thing and annotate
-    parser.getLe32("idx");
+  case MarshalKind::INVALID:
+    ok = false;
     break;
   }
-  case 'c': {
-    // code object
-    // XXX: annotate all these as numbers
-    parser.getLe32("argcount");
-    parser.getLe32("kwonlyargcount");
-    parser.getLe32("nlocals");
-    parser.getLe32("stacksize");
-    parser.getLe32("flags");
-    if (!parseMarshal(parser, "code")) goto err;
-    if (!parseMarshal(parser, "consts")) goto err;
-    if (!parseMarshal(parser, "names")) goto err;
-    if (!parseMarshal(parser, "varnames")) goto err;
-    if (!parseMarshal(parser, "freevars")) goto err;
-    if (!parseMarshal(parser, "cellvars")) goto err;
-    if (!parseMarshal(parser, "filename")) goto err;
-    if (!parseMarshal(parser, "name")) goto err;
-    parser.getLe32("firstlineno");
-    if (!parseMarshal(parser, "lnotab")) goto err;
-    parseCode(parser.endChunk());
-    return true;
-  }
-  default:
-err:
-    parser.endChunk();
-    return false;
-  }
-  parser.endChunk();
-  return true;
+  endChunk();
+  return ok;
 }
 
-void parseLnotab(dbif::ObjectHandle code, dbif::ObjectHandle bytecodeBlob) {
-  auto lnotabObj = findSubChunk(code, "lnotab");
-  if (!lnotabObj)
-    return;
-  auto lnotabField = findField(lnotabObj, "bytes");
-  if (!lnotabField)
+void parseLnotab(const CodeInfo &code, dbif::ObjectHandle code_chunk,
+                 dbif::ObjectHandle bytecode_blob) {
+  if (!code.has_lnotab || !code.has_firstlineno)
     return;
-  auto firstlinenoField = findField(code, "firstlineno");
-  if (!firstlinenoField || firstlinenoField.raw_value.size() != 1 || firstlinenoField.raw_value.width() > 64)
-    return;
-  uint32_t firstlineno = firstlinenoField.raw_value.element64();
-  auto lnotabBlob = makeSubBlob(code, "lnotab", lnotabField.raw_value);
-  StreamParser parser(lnotabBlob, 0);
-  uint64_t line = firstlineno;
+  auto lnotab_blob = makeSubBlob(code_chunk, "lnotab", code.lnotab);
+  MarshalDecoder lnotab(code.lnotab, 0);
+  std::vector<dbif::ChunkSpec> line_tags;
+  auto addLineTag = [&line_tags] (uint64_t line, uint64_t start, uint64_t end) {
+    dbif::ChunkSpec spec;
+    spec.name = QString("line_%1").arg(line);
+    spec.chunk_type = "pyc_line_tag";
+    spec.parent = -1;
+    spec.start = start;
+    spec.end = end;
+    line_tags.push_back(spec);
+  };
+  uint64_t line = code.firstlineno;
   uint64_t addr = 0, prev_addr = 0;
-  parser.startChunk("pyc_lnotab", "lnotab");
-  for (uint64_t idx = 0; !parser.eof(); idx++) {
-    uint8_t addr_inc = parser.getByte(QString("item[%1].addr_inc").arg(idx));
-    uint8_t line_inc = parser.getByte(QString("item[%1].line_inc").arg(idx));
+  lnotab.startChunk("pyc_lnotab", "lnotab");
+  for (uint64_t idx = 0; !lnotab.eof(); idx++) {
+    uint8_t addr_inc = lnotab.getByte(QString("item[%1].addr_inc").arg(idx));
+    uint8_t line_inc = lnotab.getByte(QString("item[%1].line_inc").arg(idx));
     addr += addr_inc;
     if (line_inc && addr != prev_addr) {
       // XXX set some sort of a prop with line no
-      bytecodeBlob->syncRunMethod<dbif::ChunkCreateRequest>(
-        QString("line_%1").arg(line), "pyc_line_tag", dbif::ObjectHandle(), prev_addr, addr);
+      addLineTag(line, prev_addr, addr);
       prev_addr = addr;
     }
     line += line_inc;
   }
-  auto bytecodeDesc = bytecodeBlob->syncGetInfo<dbif::DescriptionRequest>();
-  uint64_t bytecodeSize = bytecodeDesc.dynamicCast<dbif::BlobDescriptionReply>()->size;
-  bytecodeBlob->syncRunMethod<dbif::ChunkCreateRequest>(
-    QString("line_%1").arg(line), "pyc_line_tag", dbif::ObjectHandle(), prev_addr,
-    bytecodeSize);
-  parser.endChunk();
+  addLineTag(line, prev_addr, code.bytecode.size());
+  lnotab.endChunk();
+  bytecode_blob->syncRunMethod<dbif::ChunkCreateManyRequest>(
+    dbif::ObjectHandle(), line_tags);
+  lnotab_blob->syncRunMethod<dbif::ChunkCreateManyRequest>(
+    dbif::ObjectHandle(), lnotab.chunks());
 }
 
-void parseCode(dbif::ObjectHandle code) {
-  // XXX: needs ref support
-  auto bytecodeObj = findSubChunk(code, "code");
-  if (!bytecodeObj)
-    return;
-  auto bytecodeField = findField(bytecodeObj, "bytes");
-  if (!bytecodeField)
-    return;
-  auto bytecodeBlob = makeSubBlob(code, "code", bytecodeField.raw_value);
-  parseLnotab(code, bytecodeBlob);
-}
+}  // namespace
 
-void unpycFileBlob(dbif::ObjectHandle blob, uint64_t start,
-                   dbif::ObjectHandle parent_chunk) {
-  StreamParser parser(blob, start, parent_chunk);
-  parser.startChunk("pycheader", "header");
-  parser.getLe32("sig");
-  parser.getLe32("time");
-  parser.getLe32("size");
-  parser.endChunk();
-  parseMarshal(parser, "module");
-}
+uint64_t unpycFileBlob(dbif::ObjectHandle blob, uint64_t start,
+                       dbif::ObjectHandle parent_chunk) {
+  auto desc = blob->syncGetInfo<dbif::DescriptionRequest>();
+  uint64_t size = desc.dynamicCast<dbif::BlobDescriptionReply>()->size;
+  data::BinData data = blob->syncGetInfo<dbif::BlobDataRequest>(
+    start, std::max(start, size))->data;
 
+  MarshalDecoder decoder(data, start);
+  decoder.startChunk("pycheader", "header");
+  decoder.getLe32("sig");
+  decoder.getLe32("time");
+  decoder.getLe32("size");
+  decoder.endChunk();
+  decoder.parseObject("module");
+
+  auto created = blob->syncRunMethod<dbif::ChunkCreateManyRequest>(
+    parent_chunk, decoder.chunks());
+  for (auto &code : decoder.codeObjects()) {
+    // XXX: needs ref support
+    if (!code.has_bytecode)
+      continue;
+    auto code_chunk = created->objects[code.chunk];
+    auto bytecode_blob = makeSubBlob(code_chunk, "code", code.bytecode);
+    parseLnotab(code, code_chunk, bytecode_blob);
+  }
+  return decoder.objects();
 }
-}
+
+}  // namespace parser
+}  // namespace veles
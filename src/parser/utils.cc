@@ -57,6 +57,15 @@ dbif::ObjectHandle makeSubBlob(dbif::ObjectHandle parent, const QString &name, c
   return parent->syncRunMethod<dbif::ChunkCreateSubBlobRequest>(data, name)->object;
 }
 
+dbif::ObjectHandle makeTransformedBlob(dbif::ObjectHandle parent,
+                                       const QString &name,
+                                       const QString &transform,
+                                       const QString &param, uint64_t start,
+                                       uint64_t end, dbif::ObjectHandle source) {
+  return parent->syncRunMethod<dbif::CreateTransformedBlobRequest>(
+      name, transform, param, source, start, end)->object;
+}
+
 QList<Parser *> createAllParsers() {
   QList<Parser *> res;
   res.append(new PycParser());
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+
+#include "util/concurrency/threadpool.h"
+#include "util/sampling/uniform_sampler.h"
+
+using veles::util::UniformSampler;
+namespace threadpool = veles::util::threadpool;
+
+// Average time of a single resample, in milliseconds.
+static double benchmark(const QByteArray &data, size_t sample_size,
+                        size_t window_size, unsigned iterations) {
+  UniformSampler sampler(data);
+  sampler.setSampleSize(sample_size);
+  sampler.setWindowSize(window_size);
+  QElapsedTimer timer;
+  timer.start();
+  for (unsigned i = 0; i < iterations; ++i) {
+    sampler.resample();
+  }
+  return timer.nsecsElapsed() / 1e6 / iterations;
+}
+
+int main(int argc, char **argv) {
+  // sampler_bench [<data size in MiB> [<iterations>]]
+  unsigned data_mib = 256, iterations = 10;
+  bool ok = true;
+  if (argc > 1) {
+    data_mib = QString(argv[1]).toUInt(&ok);
+  }
+  if (ok && argc > 2) {
+    iterations = QString(argv[2]).toUInt(&ok);
+  }
+  if (!ok || argc > 3 || !data_mib || !iterations) {
+    fprintf(stderr, "usage: %s [<data size in MiB> [<iterations>]]\n",
+            argv[0]);
+    return 1;
+  }
+
+  QByteArray data(static_cast<int>(data_mib << 20), Qt::Uninitialized);
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 255);
+  for (int i = 0; i < data.size(); ++i) {
+    data.data()[i] = static_cast<char>(distribution(generator));
+  }
+
+  const size_t sample_sizes[] = {1 << 16, 1 << 20, 1 << 22, 1 << 24};
+  // 0 is the default, square root of the sample size.
+  const size_t window_sizes[] = {0, 64, 4096};
+  unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+  printf("%10s %8s %12s %12s\n", "sample", "window", "serial ms",
+         "parallel ms");
+  for (size_t sample_size : sample_sizes) {
+    if (sample_size >= static_cast<size_t>(data.size())) continue;
+    for (size_t window_size : window_sizes) {
+      // With no workers allowed for the topic everything runs in this thread.
+      threadpool::createTopic("sampling", 0);
+      double serial = benchmark(data, sample_size, window_size, iterations);
+      threadpool::createTopic("sampling", workers);
+      double parallel = benchmark(data, sample_size, window_size, iterations);
+      printf("%10zu %8zu %12.3f %12.3f\n", sample_size, window_size, serial,
+             parallel);
+    }
+  }
+  threadpool::shutdown();
+  return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include "util/stats/entropy_profile.h"
+#include "util/stats/kernels.h"
+
+namespace kernels = veles::util::kernels;
+using kernels::InstructionSet;
+
+// Throughput of fn run over data of given size, in MiB/s.
+static double benchmark(size_t size, unsigned iterations,
+                        std::function<void()> fn) {
+  QElapsedTimer timer;
+  timer.start();
+  for (unsigned i = 0; i < iterations; ++i) {
+    fn();
+  }
+  double seconds = timer.nsecsElapsed() / 1e9;
+  return static_cast<double>(size) * iterations / (1 << 20) / seconds;
+}
+
+int main(int argc, char **argv) {
+  // stats_bench [<data size in MiB> [<iterations>]]
+  unsigned data_mib = 64, iterations = 10;
+  bool ok = true;
+  if (argc > 1) {
+    data_mib = QString(argv[1]).toUInt(&ok);
+  }
+  if (ok && argc > 2) {
+    iterations = QString(argv[2]).toUInt(&ok);
+  }
+  if (!ok || argc > 3 || !data_mib || !iterations) {
+    fprintf(stderr, "usage: %s [<data size in MiB> [<iterations>]]\n",
+            argv[0]);
+    return 1;
+  }
+
+  // Half random, half runs of equal bytes (as in typical executables).
+  std::vector<uint8_t> data(static_cast<size_t>(data_mib) << 20);
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 255);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(
+        (i / 4096) % 2 ? distribution(generator) : (i / 65536) % 3);
+  }
+  volatile uint64_t sink = 0;
+
+  printf("%-28s %12s\n", "kernel", "MiB/s");
+  printf("%-28s %12.1f\n", "countBytes (single bank)",
+         benchmark(data.size(), iterations, [&] {
+    uint64_t counts[256] = {};
+    for (uint8_t byte : data) {
+      ++counts[byte];
+    }
+    sink = sink + counts[0];
+  }));
+  printf("%-28s %12.1f\n", "countBytes",
+         benchmark(data.size(), iterations, [&] {
+    uint64_t counts[256] = {};
+    kernels::countBytes(data.data(), data.size(), counts);
+    sink = sink + counts[0];
+  }));
+
+  const InstructionSet sets[] = {
+    InstructionSet::SCALAR, InstructionSet::SSE2, InstructionSet::AVX2,
+    InstructionSet::NEON};
+  InstructionSet detected = kernels::instructionSet();
+  for (InstructionSet set : sets) {
+    if (!kernels::setInstructionSet(set)) {
+      continue;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "sumBytes (%s)",
+             kernels::instructionSetName(set));
+    printf("%-28s %12.1f\n", name,
+           benchmark(data.size(), iterations, [&] {
+      sink = sink + kernels::sumBytes(data.data(), data.size());
+    }));
+  }
+  kernels::setInstructionSet(detected);
+
+  // Entropy of every 256 octet window, as done for the minimap.
+  const size_t window = 256;
+  std::vector<uint64_t> counts(256 * (data.size() / window), 0);
+  for (size_t i = 0; i + window <= data.size(); i += window) {
+    kernels::countBytes(data.data() + i, window, &counts[i / window * 256]);
+  }
+  printf("%-28s %12.1f\n", "entropy (log2 per bin)",
+         benchmark(data.size(), iterations, [&] {
+    double total = 0;
+    for (size_t w = 0; w < counts.size(); w += 256) {
+      for (size_t i = 0; i < 256; ++i) {
+        if (counts[w + i] > 0) {
+          double p = static_cast<double>(counts[w + i]) / window;
+          total -= p * std::log2(p);
+        }
+      }
+    }
+    sink = sink + static_cast<uint64_t>(total);
+  }));
+  printf("%-28s %12.1f\n", "entropy",
+         benchmark(data.size(), iterations, [&] {
+    double total = 0;
+    for (size_t w = 0; w < counts.size(); w += 256) {
+      total += kernels::entropy(&counts[w], window);
+    }
+    sink = sink + static_cast<uint64_t>(total);
+  }));
+  printf("%-28s %12.1f\n", "entropyProfile (window 256)",
+         benchmark(data.size(), iterations, [&] {
+    auto profile = veles::util::entropyProfile(data.data(), data.size(),
+                                               window);
+    sink = sink + profile.size();
+  }));
+  printf("using %s kernels\n", kernels::instructionSetName(detected));
+  return 0;
+}
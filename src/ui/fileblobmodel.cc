@@ -363,13 +363,13 @@ void FileBlobModel::uploadNewData(const QByteArray& buf) {
 }
 
 void FileBlobModel::parse(QString parser, qint64 offset,
-                          const QModelIndex& parent) {
+                          const QModelIndex& parent, bool recursive) {
   dbif::ObjectHandle parent_chunk;
   if (parent.isValid()) {
     parent_chunk = itemFromIndex(parent)->objectHandle();
   }
   fileBlob_->asyncRunMethod<dbif::BlobParseRequest>(this, parser, offset,
-                                                    parent_chunk);
+                                                    parent_chunk, recursive);
 }
 
 bool FileBlobModel::isRemovable(const QModelIndex &index) {
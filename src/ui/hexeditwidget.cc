@@ -234,6 +234,12 @@ void HexEditWidget::showVisualisation() {
                             static_cast<int>(data_model_->binData().size())));
   panel->setWindowTitle(cur_file_path_);
   panel->setAttribute(Qt::WA_DeleteOnClose);
+  // Keep the panel in sync with the blob, the connection goes away with it.
+  FileBlobModel *model = data_model_.data();
+  connect(model, &FileBlobModel::newBinData, panel, [model, panel]() {
+    panel->replaceData(QByteArray((const char *)model->binData().rawData(),
+        static_cast<int>(model->binData().size())));
+  });
 
   main_window_->addTab(panel,
       data_model_->path().join(" : "));
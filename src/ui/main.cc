@@ -14,7 +14,9 @@
  * limitations under the License.
  *
  */
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 #include <QApplication>
 #include <QSurfaceFormat>
@@ -57,6 +59,8 @@ int main(int argc, char *argv[]) {
   app.installTranslator(&translator);
 
   veles::util::threadpool::createTopic("visualisation", 3);
+  veles::util::threadpool::createTopic("sampling",
+      std::max(1u, std::thread::hardware_concurrency()));
 
   qRegisterMetaType<veles::visualisation::VisualisationWidget::AdditionalResampleDataPtr>("AdditionalResampleDataPtr");
 
@@ -73,7 +77,10 @@ int main(int argc, char *argv[]) {
       {"ip", "IP address the server will listen on.\n"
        "Value specified will be persistent.", "ip"},
       {{"p", "port"}, "Port the server will listen on.\n"
-       "Value specified will be persistent.", "port"}
+       "Value specified will be persistent.", "port"},
+      {"local-socket", "Name (or path) of the local socket the server will "
+       "listen on, empty to disable.\n"
+       "Value specified will be persistent.", "name"}
   });
   parser.process(app);
 
@@ -101,6 +108,11 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (parser.isSet("local-socket")) {
+    veles::util::settings::network::setLocalSocket(
+        parser.value("local-socket"));
+  }
+
   veles::ui::VelesMainWindow *mainWin = new veles::ui::VelesMainWindow;
   mainWin->showMaximized();
 
@@ -109,5 +121,8 @@ int main(int argc, char *argv[]) {
     mainWin->addFile(file);
   }
 
-  return app.exec();
+  int res = app.exec();
+  // Let running tasks finish while everything they may use still exists.
+  veles::util::threadpool::shutdown();
+  return res;
 }
@@ -229,6 +229,7 @@ void NodeTreeWidget::setupDataModelHandlers() {
 void NodeTreeWidget::initParsersMenu() {
   parsers_menu_.clear();
   parsers_menu_.addAction("auto");
+  parsers_menu_.addAction("auto (recursive)");
   parsers_menu_.addSeparator();
   for (auto id : parsers_ids_) {
     parsers_menu_.addAction(id);
@@ -278,6 +279,12 @@ void NodeTreeWidget::showVisualisation() {
       static_cast<int>(data_model_->binData().size())));
   panel->setWindowTitle(cur_file_path_);
   panel->setAttribute(Qt::WA_DeleteOnClose);
+  // Keep the panel in sync with the blob, the connection goes away with it.
+  FileBlobModel *model = data_model_.data();
+  connect(model, &FileBlobModel::newBinData, panel, [model, panel]() {
+    panel->replaceData(QByteArray((const char *)model->binData().rawData(),
+        static_cast<int>(model->binData().size())));
+  });
 
   main_window_->addTab(panel,
       data_model_->path().join(" : "));
@@ -286,6 +293,8 @@ void NodeTreeWidget::showVisualisation() {
 void NodeTreeWidget::parse(QAction *action) {
   if (action->text() == "auto") {
     data_model_->parse();
+  } else if (action->text() == "auto (recursive)") {
+    data_model_->parse("", 0, QModelIndex(), true);
   } else {
     data_model_->parse(action->text());
   }
@@ -14,9 +14,13 @@
  * limitations under the License.
  *
  */
+#include <cstdio>
+
 #include <QCoreApplication>
 #include <QDebug>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
 #include <QFile>
 #include "parser/unpyc.h"
 #include "db/db.h"
@@ -30,7 +34,20 @@
 
 int main(int argc, char **argv) {
   QCoreApplication app(argc, argv);
-  QFile f(argv[1]);
+  // unpyc [--benchmark <iterations>] <file>
+  QStringList args = app.arguments();
+  unsigned iterations = 0;
+  if (args.size() == 4 && args[1] == "--benchmark") {
+    bool ok;
+    iterations = args[2].toUInt(&ok);
+    if (!ok || !iterations)
+      return 1;
+    args.removeAt(1);
+    args.removeAt(1);
+  }
+  if (args.size() != 2)
+    return 1;
+  QFile f(args[1]);
   bool ok = f.open(QIODevice::ReadOnly);
   if (!ok)
     return 1;
@@ -38,7 +55,25 @@ int main(int argc, char **argv) {
   QByteArray qdata = f.read(size);
   veles::dbif::ObjectHandle obj = veles::db::create_db();
   veles::data::BinData vec(8, qdata.size(), reinterpret_cast<uint8_t *>(qdata.data()));
-  auto blob = obj->syncRunMethod<veles::dbif::RootCreateFileBlobFromDataRequest>(vec, argv[1])->object;
-  veles::parser::unpycFileBlob(blob);
+  if (!iterations) {
+    auto blob = obj->syncRunMethod<veles::dbif::RootCreateFileBlobFromDataRequest>(vec, args[1])->object;
+    veles::parser::unpycFileBlob(blob);
+    return 0;
+  }
+  uint64_t objects = 0;
+  qint64 elapsed = 0;
+  for (unsigned i = 0; i < iterations; i++) {
+    // Each iteration parses a fresh blob, so that chunks don't pile up.
+    auto blob = obj->syncRunMethod<veles::dbif::RootCreateFileBlobFromDataRequest>(vec, args[1])->object;
+    QElapsedTimer timer;
+    timer.start();
+    objects += veles::parser::unpycFileBlob(blob);
+    elapsed += timer.nsecsElapsed();
+    blob->syncRunMethod<veles::dbif::DeleteRequest>();
+  }
+  double seconds = elapsed / 1e9;
+  printf("%u iterations, %llu objects in %.3f s: %.0f objects/s, %.1f MiB/s\n",
+         iterations, static_cast<unsigned long long>(objects), seconds,
+         objects / seconds, size * iterations / seconds / (1 << 20));
   return 0;
 }
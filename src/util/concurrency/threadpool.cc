@@ -15,83 +15,435 @@
  *
  */
 #include "util/concurrency/threadpool.h"
-#include <thread>
-#include <mutex>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
-#include <deque>
 
+#include "util/concurrency/work_stealing_deque.h"
 
 namespace veles {
 namespace util {
 namespace threadpool {
 
-struct TopicInfo {
+static const int k_priorities = 3;
+
+struct Topic {
+  bool mock;
+  size_t max_running;
+  // Guarded by mutex, as are the waiting tasks - these are only touched
+  // when a task of the topic is scheduled or done.
+  std::mutex mutex;
+  size_t running;
+  std::deque<Job *> waiting[k_priorities];
+};
+
+struct Job {
+  Task task;
+  Topic *topic;
+  int priority;
+  std::shared_ptr<GroupState> group;
+};
+
+struct Worker {
+  Scheduler *scheduler;
+  size_t index;
+  WorkStealingDeque<Job> deques[k_priorities];
+  std::thread thread;
+};
+
+struct GroupState {
+  std::atomic<bool> cancelled;
+  std::atomic<size_t> pending;
+  // The least urgent priority of the tasks, wait() only helps with tasks at
+  // least as urgent as that.
+  std::atomic<int> priority;
+  // The scheduler the tasks were submitted to, for wait() to help it.
+  std::atomic<Scheduler *> scheduler;
   std::mutex mutex;
   std::condition_variable cv;
-  std::vector<std::thread> workers;
-  std::deque<Task> tasks;
-  bool mock;
+  GroupState() : cancelled(false), pending(0), priority(0),
+                 scheduler(nullptr) {}
 };
 
-std::map<std::string, TopicInfo*> topics_;
-std::mutex map_mutex_;
+struct Scheduler::Impl {
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  std::mutex topics_mutex;
+  std::map<std::string, std::unique_ptr<Topic>> topics;
+
+  // Guards injected and sleeping workers.
+  std::mutex mutex;
+  std::condition_variable cv;
+  // Tasks scheduled from outside the workers.
+  std::deque<Job *> injected[k_priorities];
+  std::atomic<size_t> injected_count;
+  std::atomic<size_t> sleeping;
+  std::atomic<bool> stopping;
+
+  Impl() : injected_count(0), sleeping(0), stopping(false) {}
 
-void threadFunction(TopicInfo *ti) {
-  while (true) {
-    std::unique_lock<std::mutex> lc(ti->mutex);
-    while (ti->tasks.empty()) {
-      ti->cv.wait(lc);
+  bool hasWork() const {
+    if (injected_count.load() != 0) {
+      return true;
     }
-    Task t = ti->tasks.front();
-    ti->tasks.pop_front();
-    lc.unlock();
-    t();
+    for (auto &worker : workers) {
+      for (auto &deque : worker->deques) {
+        if (!deque.empty()) {
+          return true;
+        }
+      }
+    }
+    return false;
   }
+};
+
+static thread_local Worker *current_worker = nullptr;
+
+TaskGroup::TaskGroup() : state_(std::make_shared<GroupState>()) {}
+
+TaskGroup::~TaskGroup() {
+  wait();
 }
 
-void createTopic(std::string topic, size_t workers) {
-  std::unique_lock<std::mutex> lc(map_mutex_);
-  if (topics_.find(topic) != topics_.end()) return;
-  TopicInfo *ti = new TopicInfo();
-  ti->mock = false;
-  topics_[topic] = ti;
-  std::unique_lock<std::mutex> topic_lc(ti->mutex);
-  for (size_t i = 0; i < workers; ++i) {
-    ti->workers.push_back(std::thread(threadFunction, ti));
+void TaskGroup::wait() {
+  while (state_->pending.load() != 0) {
+    Scheduler *scheduler = state_->scheduler.load();
+    bool on_worker = current_worker != nullptr && scheduler != nullptr &&
+                     current_worker->scheduler == scheduler;
+    // Only with tasks at least as urgent as ours, so that a long task of
+    // lower priority doesn't hold this one up after the group is done.
+    if (on_worker
+        && scheduler->helpWhileWaiting(state_->priority.load())) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    auto done = [this] { return state_->pending.load() == 0; };
+    if (on_worker) {
+      // Nothing to help with right now, but there may be soon.
+      state_->cv.wait_for(lock, std::chrono::milliseconds(1), done);
+    } else {
+      state_->cv.wait(lock, done);
+    }
   }
 }
 
-void mockTopic(std::string topic) {
-  std::unique_lock<std::mutex> lc(map_mutex_);
-  if (topics_.find(topic) != topics_.end()) return;
-  TopicInfo *ti = new TopicInfo();
-  ti->mock = true;
-  topics_[topic] = ti;
-}
-
-SchedulingResult runTask(std::string topic, Task t) {
-  std::unique_lock<std::mutex> lc(map_mutex_);
-  if (topics_.find(topic) == topics_.end()) {
-    return SchedulingResult::ERR_UNKNOWN_TOPIC;
-  }
-  TopicInfo *ti = topics_[topic];
-  std::unique_lock<std::mutex> topic_lc(ti->mutex);
-  lc.unlock();
-  if (ti->mock) {
-    t();
+void TaskGroup::cancel() {
+  state_->cancelled = true;
+}
+
+bool TaskGroup::cancelled() const {
+  return state_->cancelled.load();
+}
+
+size_t TaskGroup::pending() const {
+  return state_->pending.load();
+}
+
+Scheduler::Scheduler(size_t workers) : impl_(new Impl) {
+  if (workers == 0) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < workers; i++) {
+    impl_->workers.emplace_back(new Worker);
+    impl_->workers.back()->scheduler = this;
+    impl_->workers.back()->index = i;
+  }
+  // Only start once all workers exist, since they steal from each other.
+  for (auto &worker : impl_->workers) {
+    worker->thread = std::thread(&Scheduler::workerLoop, this, worker.get());
+  }
+}
+
+Scheduler::~Scheduler() {
+  shutdown();
+}
+
+size_t Scheduler::workerCount() const {
+  return impl_->workers.size();
+}
+
+void Scheduler::createTopic(const std::string &topic, size_t max_running) {
+  std::unique_lock<std::mutex> lc(impl_->topics_mutex);
+  auto &info = impl_->topics[topic];
+  if (!info) {
+    info.reset(new Topic);
+    info->mock = false;
+    info->max_running = max_running;
+    info->running = 0;
+    return;
+  }
+  // A raised limit may let some waiting tasks start.
+  std::vector<Job *> start;
+  {
+    std::unique_lock<std::mutex> topic_lc(info->mutex);
+    info->max_running = max_running;
+    for (auto &waiting : info->waiting) {
+      while (!waiting.empty() && info->running < info->max_running) {
+        start.push_back(waiting.front());
+        waiting.pop_front();
+        info->running++;
+      }
+    }
+  }
+  for (auto job : start) {
+    enqueue(job);
+  }
+}
+
+void Scheduler::mockTopic(const std::string &topic) {
+  std::unique_lock<std::mutex> lc(impl_->topics_mutex);
+  auto &info = impl_->topics[topic];
+  if (!info) {
+    info.reset(new Topic);
+    info->mock = true;
+    info->max_running = 0;
+    info->running = 0;
+  }
+}
+
+SchedulingResult Scheduler::runTask(const std::string &topic, Task t,
+                                    Priority priority, TaskGroup *group) {
+  Topic *info;
+  {
+    std::unique_lock<std::mutex> lc(impl_->topics_mutex);
+    auto it = impl_->topics.find(topic);
+    if (it == impl_->topics.end()) {
+      return SchedulingResult::ERR_UNKNOWN_TOPIC;
+    }
+    info = it->second.get();
+  }
+  if (info->mock) {
+    if (group == nullptr || !group->cancelled()) {
+      t();
+    }
     return SchedulingResult::SCHEDULED;
   }
-  if (ti->workers.size() == 0) {
+  if (impl_->stopping.load()) {
+    return SchedulingResult::ERR_SHUT_DOWN;
+  }
+  size_t max_running;
+  {
+    std::unique_lock<std::mutex> lc(info->mutex);
+    max_running = info->max_running;
+  }
+  if (max_running == 0 || impl_->workers.empty()) {
     return SchedulingResult::ERR_NO_WORKERS;
   }
-  ti->tasks.push_back(t);
-  topic_lc.unlock();
-  ti->cv.notify_one();
+  Job *job = new Job{std::move(t), info, static_cast<int>(priority),
+                     nullptr};
+  if (group != nullptr) {
+    job->group = group->state_;
+    job->group->scheduler = this;
+    job->group->pending++;
+    int least_urgent = job->group->priority.load();
+    while (least_urgent < job->priority
+           && !job->group->priority.compare_exchange_weak(least_urgent,
+                                                          job->priority)) {
+    }
+  }
+  submit(job);
   return SchedulingResult::SCHEDULED;
 }
 
+void Scheduler::submit(Job *job) {
+  Topic *topic = job->topic;
+  {
+    std::unique_lock<std::mutex> lc(topic->mutex);
+    if (topic->running >= topic->max_running) {
+      topic->waiting[job->priority].push_back(job);
+      return;
+    }
+    topic->running++;
+  }
+  enqueue(job);
+}
+
+void Scheduler::enqueue(Job *job) {
+  Worker *self = current_worker;
+  if (self != nullptr && self->scheduler == this) {
+    self->deques[job->priority].push(job);
+  } else {
+    std::unique_lock<std::mutex> lc(impl_->mutex);
+    // Checked under the lock shutdown() sets it under: a task either gets
+    // in before shutdown() drains the queues, or is dropped right here.
+    // Workers only push to their own deques before they are joined.
+    if (impl_->stopping.load()) {
+      lc.unlock();
+      drop(job);
+      return;
+    }
+    impl_->injected[job->priority].push_back(job);
+    impl_->injected_count++;
+  }
+  // Pairs with the fence in workerLoop() - either we see the worker going
+  // to sleep, or it sees the new task.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (impl_->sleeping.load() != 0) {
+    std::unique_lock<std::mutex> lc(impl_->mutex);
+    impl_->cv.notify_one();
+  }
+}
+
+Job *Scheduler::findJob(Worker *self, int max_priority) {
+  size_t workers = impl_->workers.size();
+  for (int priority = 0; priority <= max_priority; priority++) {
+    if (self != nullptr) {
+      if (Job *job = self->deques[priority].pop()) {
+        return job;
+      }
+    }
+    if (impl_->injected_count.load() != 0) {
+      std::unique_lock<std::mutex> lc(impl_->mutex);
+      auto &injected = impl_->injected[priority];
+      if (!injected.empty()) {
+        Job *job = injected.front();
+        injected.pop_front();
+        impl_->injected_count--;
+        return job;
+      }
+    }
+    // Start with the next worker, so that thieves spread out.
+    size_t start = self != nullptr ? self->index + 1 : 0;
+    for (size_t i = 0; i < workers; i++) {
+      Worker *victim = impl_->workers[(start + i) % workers].get();
+      if (victim == self) {
+        continue;
+      }
+      if (Job *job = victim->deques[priority].steal()) {
+        return job;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void Scheduler::execute(Job *job) {
+  if (!job->group || !job->group->cancelled.load()) {
+    job->task();
+  }
+  finish(job);
+}
+
+void Scheduler::finish(Job *job) {
+  if (Job *next = release(job)) {
+    enqueue(next);
+  }
+}
+
+Job *Scheduler::release(Job *job) {
+  Topic *topic = job->topic;
+  Job *next = nullptr;
+  {
+    std::unique_lock<std::mutex> lc(topic->mutex);
+    for (auto &waiting : topic->waiting) {
+      if (!waiting.empty()) {
+        next = waiting.front();
+        waiting.pop_front();
+        break;
+      }
+    }
+    // The slot passes on to the next task, if any.
+    if (next == nullptr) {
+      topic->running--;
+    }
+  }
+  auto group = std::move(job->group);
+  delete job;
+  if (group && --group->pending == 0) {
+    std::unique_lock<std::mutex> lc(group->mutex);
+    group->cv.notify_all();
+  }
+  return next;
+}
+
+void Scheduler::drop(Job *job) {
+  while (job != nullptr) {
+    job = release(job);
+  }
+}
+
+bool Scheduler::helpWhileWaiting(int max_priority) {
+  if (impl_->stopping.load()) {
+    return false;
+  }
+  Job *job = findJob(current_worker, max_priority);
+  if (job == nullptr) {
+    return false;
+  }
+  execute(job);
+  return true;
+}
+
+void Scheduler::workerLoop(Worker *self) {
+  current_worker = self;
+  while (!impl_->stopping.load()) {
+    if (Job *job = findJob(self, k_priorities - 1)) {
+      execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lc(impl_->mutex);
+    if (impl_->stopping.load()) {
+      break;
+    }
+    impl_->sleeping++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!impl_->hasWork()) {
+      impl_->cv.wait(lc);
+    }
+    impl_->sleeping--;
+  }
+  current_worker = nullptr;
+}
+
+void Scheduler::shutdown() {
+  {
+    std::unique_lock<std::mutex> lc(impl_->mutex);
+    if (impl_->stopping.load()) {
+      return;
+    }
+    impl_->stopping = true;
+    impl_->cv.notify_all();
+  }
+  for (auto &worker : impl_->workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+  // Drop whatever is left, along with the tasks waiting for its topics.
+  while (Job *job = findJob(nullptr, k_priorities - 1)) {
+    drop(job);
+  }
+}
+
+static Scheduler &globalScheduler() {
+  static Scheduler scheduler;
+  return scheduler;
+}
+
+void createTopic(std::string topic, size_t workers) {
+  globalScheduler().createTopic(topic, workers);
+}
+
+void mockTopic(std::string topic) {
+  globalScheduler().mockTopic(topic);
+}
+
+SchedulingResult runTask(std::string topic, Task t, Priority priority,
+                         TaskGroup *group) {
+  return globalScheduler().runTask(topic, std::move(t), priority, group);
+}
+
+void shutdown() {
+  globalScheduler().shutdown();
+}
+
 
 }  // namespace threadpool
 }  // namespace util
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "util/sampling/data_source.h"
+
+
+namespace veles {
+namespace util {
+
+/*****************************************************************************/
+/* IDataSource */
+/*****************************************************************************/
+
+DataChangedCallbackId IDataSource::registerChangeCallback(
+    DataChangedCallback cb) {
+  std::unique_lock<std::mutex> lc(callbacks_mutex_);
+  DataChangedCallbackId id = next_cb_id_++;
+  callbacks_[id] = cb;
+  return id;
+}
+
+void IDataSource::removeChangeCallback(DataChangedCallbackId cb_id) {
+  std::unique_lock<std::mutex> lc(callbacks_mutex_);
+  callbacks_.erase(cb_id);
+}
+
+void IDataSource::changed(size_t offset, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  invalidate(offset, size);
+  std::unique_lock<std::mutex> lc(callbacks_mutex_);
+  for (auto &cb : callbacks_) {
+    cb.second(offset, size);
+  }
+}
+
+/*****************************************************************************/
+/* ByteArrayDataSource */
+/*****************************************************************************/
+
+size_t ByteArrayDataSource::size() {
+  return static_cast<size_t>(data_.size());
+}
+
+void ByteArrayDataSource::read(size_t offset, size_t size, char *out) {
+  std::memcpy(out, data_.constData() + offset, size);
+}
+
+const char *ByteArrayDataSource::contiguousData() {
+  return data_.constData();
+}
+
+/*****************************************************************************/
+/* BufferDataSource */
+/*****************************************************************************/
+
+size_t BufferDataSource::size() {
+  return static_cast<size_t>(data_.size());
+}
+
+void BufferDataSource::read(size_t offset, size_t size, char *out) {
+  std::memcpy(out, data_.constData() + offset, size);
+}
+
+const char *BufferDataSource::contiguousData() {
+  return data_.constData();
+}
+
+void BufferDataSource::write(size_t offset, const char *data, size_t size) {
+  assert(offset + size <= BufferDataSource::size());
+  std::memcpy(data_.data() + offset, data, size);
+  changed(offset, size);
+}
+
+/*****************************************************************************/
+/* PagedDataSource */
+/*****************************************************************************/
+
+PagedDataSource::PagedDataSource(size_t page_size, size_t max_pages) :
+    page_size_(page_size), max_pages_(std::max<size_t>(1, max_pages)) {}
+
+void PagedDataSource::read(size_t offset, size_t size, char *out) {
+  while (size > 0) {
+    size_t index = offset / page_size_;
+    size_t page_offset = offset % page_size_;
+    Page page = getPage(index);
+    size_t chunk = std::min(size, page->size() - page_offset);
+    std::memcpy(out, page->data() + page_offset, chunk);
+    offset += chunk;
+    size -= chunk;
+    out += chunk;
+  }
+}
+
+void PagedDataSource::invalidate(size_t offset, size_t size) {
+  std::unique_lock<std::mutex> lc(mutex_);
+  size_t first = offset / page_size_;
+  size_t last = (offset + size - 1) / page_size_;
+  for (auto it = pages_.begin(); it != pages_.end();) {
+    if (it->first >= first && it->first <= last) {
+      page_index_.erase(it->first);
+      it = pages_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+PagedDataSource::Page PagedDataSource::getPage(size_t index) {
+  std::unique_lock<std::mutex> lc(mutex_);
+  auto it = page_index_.find(index);
+  if (it != page_index_.end()) {
+    pages_.splice(pages_.begin(), pages_, it->second);
+    return it->second->second;
+  }
+  size_t start = index * page_size_;
+  Page page = std::make_shared<std::vector<char>>(
+      std::min(page_size_, size() - start));
+  fetch(start, page->size(), page->data());
+  pages_.emplace_front(index, page);
+  page_index_[index] = pages_.begin();
+  if (pages_.size() > max_pages_) {
+    page_index_.erase(pages_.back().first);
+    pages_.pop_back();
+  }
+  return page;
+}
+
+/*****************************************************************************/
+/* FileDataSource */
+/*****************************************************************************/
+
+FileDataSource::FileDataSource(const QString &path, size_t page_size,
+                               size_t max_pages) :
+    PagedDataSource(page_size, max_pages), file_(path), size_(0) {
+  if (file_.open(QIODevice::ReadOnly)) {
+    size_ = static_cast<size_t>(file_.size());
+  }
+}
+
+bool FileDataSource::isOpen() const {
+  return file_.isOpen();
+}
+
+size_t FileDataSource::size() {
+  return size_;
+}
+
+void FileDataSource::fetch(size_t offset, size_t size, char *out) {
+  // A short read (eg. when the file was truncated meanwhile) leaves zeros.
+  std::memset(out, 0, size);
+  if (file_.seek(static_cast<qint64>(offset))) {
+    file_.read(out, static_cast<qint64>(size));
+  }
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cstdint>
+#include <random>
+
+#include "util/sampling/entropy_sampler.h"
+#include "util/stats/kernels.h"
+
+
+namespace veles {
+namespace util {
+
+// The sampled range is split into at most this many blocks of uniform
+// entropy (but not smaller than a window).
+static const size_t k_max_blocks = 4096;
+// Entropy of a block is estimated from this many probes of k_probe_size
+// octets, spread evenly over the block.
+static const size_t k_probes_per_block = 16;
+static const size_t k_probe_size = 256;
+static const size_t k_min_blocks_per_part = 64;
+
+// Sampling density of a block with entropy e (in bits per octet) is
+// proportional to (e + 1)^2 - from 1 for constant data to 81 for random.
+static double blockWeight(double entropy) {
+  return (entropy + 1) * (entropy + 1);
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+bool EntropySampler::chooseWindows(SamplerConfig *sc, size_t window_size,
+                                   std::vector<size_t> *windows) {
+  size_t windows_count = windows->size();
+  size_t data_size = getDataSize(sc);
+  size_t block_size = std::max(window_size,
+                               (data_size + k_max_blocks - 1) / k_max_blocks);
+  size_t blocks_count = (data_size + block_size - 1) / block_size;
+
+  // 1. Weigh the blocks.
+  std::vector<double> weights(blocks_count);
+  size_t parts = partsFor(blocks_count, k_min_blocks_per_part);
+  runInParts(parts, [&](size_t part) {
+    std::vector<char> buffer(k_probes_per_block * k_probe_size);
+    size_t end = blocks_count * (part + 1) / parts;
+    for (size_t block = blocks_count * part / parts; block < end; ++block) {
+      if (resampleCancelled(sc)) {
+        return;
+      }
+      size_t start = block * block_size;
+      size_t size = std::min(block_size, data_size - start);
+      uint64_t counts[256] = {};
+      uint64_t total = 0;
+      size_t probes = size > k_probes_per_block * k_probe_size
+          ? k_probes_per_block : 1;
+      size_t probe_size = probes > 1 ? k_probe_size : size;
+      for (size_t probe = 0; probe < probes; ++probe) {
+        readData(start + scale(size - probe_size, probe,
+                               std::max<size_t>(1, probes - 1)),
+                 probe_size, buffer.data(), sc);
+        kernels::countBytes(reinterpret_cast<const uint8_t *>(
+            buffer.data()), probe_size, counts);
+        total += probe_size;
+      }
+      weights[block] = blockWeight(kernels::entropy(counts, total)) * size;
+    }
+  });
+  if (resampleCancelled(sc)) {
+    return false;
+  }
+
+  // 2. Pick m points of the data by systematic sampling of the weight
+  //    distribution - point j is where the cumulative weight reaches
+  //    (j + u) / m of the total, for one random u in [0, 1).
+  // 3. Map each point p_j to {0, 1 ... n - m*k} (see UniformSampler) as
+  //    c_j = p_j * (n - m*k) / n and take d_j = c_j + j*k.  Windows land
+  //    near the points where the data allows (dense points are pushed
+  //    apart, as windows can't overlap), and d_j is sorted because p_j is.
+  double total_weight = 0;
+  for (double weight : weights) {
+    total_weight += weight;
+  }
+  auto generator = makeGenerator();
+  std::uniform_real_distribution<double> distribution(0, 1);
+  double u = distribution(generator);
+  size_t max_index = data_size - windows_count * window_size;
+  size_t block = 0, c = 0;
+  double block_begin_weight = 0;
+  for (size_t j = 0; j < windows_count; ++j) {
+    double target = (j + u) / windows_count * total_weight;
+    while (block + 1 < blocks_count
+           && block_begin_weight + weights[block] <= target) {
+      block_begin_weight += weights[block];
+      ++block;
+    }
+    size_t start = block * block_size;
+    size_t size = std::min(block_size, data_size - start);
+    double within = weights[block] > 0
+        ? (target - block_begin_weight) / weights[block] : 0;
+    double point = start + std::min(1.0, std::max(0.0, within)) * size;
+    // Guard against rounding errors breaking the order.
+    size_t point_index = static_cast<size_t>(point / data_size * max_index);
+    c = std::max(c, std::min(max_index, point_index));
+    (*windows)[j] = c + j * window_size;
+  }
+  return true;
+}
+
+EntropySampler* EntropySampler::cloneImpl() {
+  return new EntropySampler(*this);
+}
+
+}  // namespace util
+}  // namespace veles
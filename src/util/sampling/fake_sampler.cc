@@ -51,5 +51,13 @@ void FakeSampler::applyResample(ISampler::ResampleData *rd) {}
 
 void FakeSampler::cleanupResample(ResampleData *rd) {};
 
+bool FakeSampler::affectedSampleRanges(
+    size_t start, size_t end,
+    std::vector<std::pair<size_t, size_t>> *ranges) {
+  // The sample is the data itself, nothing to re-read.
+  ranges->emplace_back(start, end);
+  return true;
+}
+
 }  // namespace util
 }  // namespace veles
@@ -16,6 +16,8 @@
  */
 #include "assert.h"
 
+#include <algorithm>
+
 #include "util/sampling/isampler.h"
 #include "util/concurrency/threadpool.h"
 
@@ -28,18 +30,31 @@ namespace util {
 /*****************************************************************************/
 
 ISampler::ISampler(const QByteArray &data) :
-    data_(data), start_(0), sample_size_(0),
+    ISampler(std::make_shared<ByteArrayDataSource>(data)) {}
+
+ISampler::ISampler(std::shared_ptr<IDataSource> source) :
+    source_(std::move(source)), start_(0), sample_size_(0),
     allow_async_(false), current_version_(0),
-    requested_version_(0), next_cb_id_(0) {
-  end_ = static_cast<size_t>(data_.size());
+    requested_version_(0), next_cb_id_(0), resample_scheduled_(false),
+    raw_copy_start_(0) {
+  end_ = source_->size();
   last_config_.start = start_;
   last_config_.end = end_;
   last_config_.sample_size = sample_size_;
+  last_config_.version = 0;
+  resetResampleStats();
+  data_changed_cb_id_ = source_->registerChangeCallback(
+      std::bind(&ISampler::dataChanged, this, std::placeholders::_1,
+                std::placeholders::_2));
+}
+
+ISampler::~ISampler() {
+  source_->removeChangeCallback(data_changed_cb_id_);
 }
 
 void ISampler::setRange(size_t start, size_t end) {
   assert(!empty());
-  assert(end <= static_cast<size_t>(data_.size()));
+  assert(end <= source_->size());
   auto lc = lock();
   last_config_.start = start;
   last_config_.end = end;
@@ -117,8 +132,19 @@ const char* ISampler::data() {
   return getData();
 }
 
+std::shared_ptr<const BlockStats> ISampler::statistics(bool with_digrams) {
+  assert(!empty());
+  auto lc = lock();
+  if (statistics_ == nullptr
+      || (with_digrams && !statistics_->hasDigrams())) {
+    statistics_ = std::make_shared<BlockStats>(data(), getSampleSize(),
+                                               with_digrams);
+  }
+  return statistics_;
+}
+
 bool ISampler::empty() {
-  return data_.isEmpty();
+  return source_->size() == 0;
 }
 
 std::unique_lock<SamplerMutex> ISampler::lock() {
@@ -172,28 +198,56 @@ void ISampler::allowAsynchronousResampling(bool allow) {
   allow_async_ = allow;
 }
 
+ISampler::ResampleStats ISampler::resampleStats() {
+  auto lc = lock();
+  return stats_;
+}
+
+void ISampler::resetResampleStats() {
+  auto lc = lock();
+  stats_ = ResampleStats();
+}
+
 /*****************************************************************************/
 /* Protected methods */
 /*****************************************************************************/
 
-ISampler::ISampler(const ISampler& other) : data_(other.data_),
+ISampler::ISampler(const ISampler& other) : source_(other.source_),
                    start_(other.start_), end_(other.end_),
                    sample_size_(other.sample_size_),
                    allow_async_(other.allow_async_),
                    last_config_(other.last_config_),
                    current_version_(0), requested_version_(0),
-                   callbacks_(other.callbacks_) {}
+                   next_cb_id_(other.next_cb_id_),
+                   callbacks_(other.callbacks_), resample_scheduled_(false),
+                   stats_(), raw_copy_start_(0) {
+  data_changed_cb_id_ = source_->registerChangeCallback(
+      std::bind(&ISampler::dataChanged, this, std::placeholders::_1,
+                std::placeholders::_2));
+}
 
 size_t ISampler::getDataSize(SamplerConfig *sc) {
   if (sc == nullptr) {
-    return std::min((size_t)data_.size(), end_ - start_);
+    return std::min(source_->size(), end_ - start_);
   }
-  return std::min((size_t)data_.size(), sc->end - sc->start);
+  return std::min(source_->size(), sc->end - sc->start);
 }
 
 char ISampler::getDataByte(size_t index, SamplerConfig *sc) {
   size_t start = (sc == nullptr) ? start_ : sc->start;
-  return data_[static_cast<int>(start + index)];
+  const char *data = source_->contiguousData();
+  if (data != nullptr) {
+    return data[start + index];
+  }
+  char result;
+  source_->read(start + index, 1, &result);
+  return result;
+}
+
+void ISampler::readData(size_t index, size_t size, char *out,
+                        SamplerConfig *sc) {
+  size_t start = (sc == nullptr) ? start_ : sc->start;
+  source_->read(start + index, size, out);
 }
 
 size_t ISampler::getRealSampleSize() {
@@ -207,13 +261,37 @@ size_t ISampler::getRequestedSampleSize(SamplerConfig *sc) {
 
 const char* ISampler::getRawData(SamplerConfig *sc) {
   size_t start = (sc == nullptr) ? start_ : sc->start;
-  return data_.data() + start;
+  const char *data = source_->contiguousData();
+  if (data != nullptr) {
+    return data + start;
+  }
+  size_t size = getDataSize(sc);
+  std::unique_lock<std::mutex> lc(raw_copy_mutex_);
+  if (raw_copy_start_ != start || raw_copy_.size() != size) {
+    raw_copy_.resize(size);
+    raw_copy_start_ = start;
+    source_->read(start, size, raw_copy_.data());
+  }
+  return raw_copy_.data();
+}
+
+bool ISampler::resampleCancelled(SamplerConfig *sc) {
+  return allow_async_ && sc != nullptr
+      && sc->version != requested_version_.load();
 }
 
 /*****************************************************************************/
 /* Private methods */
 /*****************************************************************************/
 
+bool ISampler::affectedSampleRanges(
+    size_t start, size_t end,
+    std::vector<std::pair<size_t, size_t>> *ranges) {
+  return false;
+}
+
+void ISampler::refreshSample(size_t first, size_t last) {}
+
 size_t ISampler::samplingRequired(SamplerConfig *sc) {
   return ((!empty()) && getRequestedSampleSize(sc) < getDataSize(sc));
 }
@@ -224,23 +302,37 @@ void ISampler::applySamplerConfig(SamplerConfig *sc) {
     end_ = sc->end;
     sample_size_ = sc->sample_size;
   }
+  statistics_.reset();
 }
 
 void ISampler::runResample(SamplerConfig *sc) {
   if (allow_async_) {
+    auto lc = lock();
+    sc->version = ++requested_version_;
+    sc->requested_at = std::chrono::steady_clock::now();
+    ++stats_.requested;
+    if (pending_config_ != nullptr) {
+      ++stats_.coalesced;
+    }
     if (!samplingRequired(sc)) {
-      auto lc = lock();
-      current_version_ = ++requested_version_;
+      pending_config_.reset();
+      current_version_ = sc->version;
       applySamplerConfig(sc);
-      for (auto i = callbacks_.rbegin(); i != callbacks_.rend(); ++i) {
-        (i->second)();
-      }
-      lc.unlock();
       delete sc;
+      notifyResampled();
       return;
     }
-    threadpool::runTask("visualisation",
-      std::bind(&ISampler::resampleAsync, this, ++requested_version_, sc));
+    // A running job picks the new config up once it's done (or cancelled),
+    // so only schedule one if there is none.
+    pending_config_.reset(sc);
+    if (!resample_scheduled_) {
+      resample_scheduled_ = true;
+      if (threadpool::runTask("visualisation",
+          std::bind(&ISampler::resampleAsync, this))
+          != threadpool::SchedulingResult::SCHEDULED) {
+        resampleAsync();
+      }
+    }
   } else {
     if (samplingRequired(sc)) {
       ResampleData *prepared = prepareResample(sc);
@@ -251,25 +343,92 @@ void ISampler::runResample(SamplerConfig *sc) {
   }
 }
 
-void ISampler::resampleAsync(int target_version, SamplerConfig *sc) {
-  if (target_version < requested_version_.load()) return;
-  ResampleData *prepared = prepareResample(sc);
+void ISampler::resampleAsync() {
   auto lc = lock();
-  if (target_version > current_version_) {
+  while (pending_config_ != nullptr) {
+    std::unique_ptr<SamplerConfig> sc(std::move(pending_config_));
+    lc.unlock();
+    ResampleData *prepared = prepareResample(sc.get());
+    lc.lock();
+    if (resampleCancelled(sc.get())) {
+      ++stats_.cancelled;
+      if (prepared != nullptr) {
+        cleanupResample(prepared);
+      }
+      continue;
+    }
     applyResample(prepared);
-    applySamplerConfig(sc);
-    current_version_ = target_version;
-    for (auto i = callbacks_.rbegin(); i != callbacks_.rend(); ++i) {
-      (i->second)();
+    applySamplerConfig(sc.get());
+    current_version_ = sc->version;
+    uint64_t latency = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - sc->requested_at).count());
+    ++stats_.completed;
+    stats_.last_latency_us = latency;
+    stats_.max_latency_us = std::max(stats_.max_latency_us, latency);
+    stats_.total_latency_us += latency;
+    notifyResampled();
+  }
+  resample_scheduled_ = false;
+}
+
+void ISampler::notifyResampled() {
+  for (auto i = callbacks_.rbegin(); i != callbacks_.rend(); ++i) {
+    (i->second)();
+  }
+  sampler_condition_.notify_all();
+}
+
+void ISampler::dataChanged(size_t offset, size_t size) {
+  auto lc = lock();
+  {
+    std::unique_lock<std::mutex> raw_lc(raw_copy_mutex_);
+    size_t copy_start = std::max(offset, raw_copy_start_);
+    size_t copy_end = std::min(offset + size,
+                               raw_copy_start_ + raw_copy_.size());
+    if (copy_start < copy_end) {
+      source_->read(copy_start, copy_end - copy_start,
+                    raw_copy_.data() + (copy_start - raw_copy_start_));
+    }
+  }
+  // Writes may move the data (see BufferDataSource::write()), so refresh
+  // the pointer kept by statistics even if the sampled range wasn't touched.
+  if (statistics_ != nullptr) {
+    statistics_->update(data(), 0, 0);
+  }
+  // The modified range, relative to the start of the sampled range.
+  size_t start = std::max(offset, start_);
+  size_t end = std::min(offset + size, start_ + getDataSize());
+  if (start < end) {
+    start -= start_;
+    end -= start_;
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (allow_async_ && !isFinished()) {
+      // The resample in progress may have read the old data - redo it.
+      resample();
+      return;
+    } else if (!samplingRequired()) {
+      if (statistics_ != nullptr) {
+        statistics_->update(data(), start, end);
+      }
+    } else if (affectedSampleRanges(start, end, &ranges)) {
+      for (auto &range : ranges) {
+        refreshSample(range.first, range.second);
+        if (statistics_ != nullptr) {
+          statistics_->update(data(), range.first, range.second);
+        }
+      }
+    } else {
+      resample();
+      if (allow_async_) {
+        // Callbacks are called once it's done.
+        return;
+      }
     }
-    lc.unlock();
-    delete sc;
-    sampler_condition_.notify_all();
-  } else {
-    lc.unlock();
-    cleanupResample(prepared);
-    delete sc;
   }
+  // Pointers returned by data() may have changed as well, so tell users
+  // even if the sample didn't.
+  notifyResampled();
 }
 
 }  // namespace util
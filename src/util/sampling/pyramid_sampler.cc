@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "util/sampling/pyramid_sampler.h"
+
+
+namespace veles {
+namespace util {
+
+static size_t distance(size_t a, size_t b) {
+  return a < b ? b - a : a - b;
+}
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+PyramidSampler::PyramidSampler(std::shared_ptr<SamplePyramid> pyramid) :
+    WindowSampler(pyramid->source()), pyramid_(pyramid) {
+  setWindowSize(pyramid_->windowSize());
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+PyramidSampler::PyramidSampler(const PyramidSampler& other) :
+    WindowSampler(other), pyramid_(other.pyramid_) {}
+
+bool PyramidSampler::chooseWindows(SamplerConfig *sc, size_t window_size,
+                                   std::vector<size_t> *windows) {
+  size_t windows_count = windows->size();
+  size_t data_size = getDataSize(sc);
+  size_t start = sc->start;
+  size_t end = start + data_size;
+  // Blocks of level with windows within the range are [first, last).
+  size_t level = 0, first = 0, last = 0;
+  if (windows_count > 0 && window_size == pyramid_->windowSize()) {
+    // Use the coarsest level with enough windows in range (its windows are
+    // the most evenly spaced), or level 0 if none has enough.
+    level = pyramid_->levelsCount();
+    while (level > 0) {
+      --level;
+      windowsInRange(level, start, end, &first, &last);
+      if (last - first >= windows_count) {
+        for (size_t i = 0; i < windows_count; ++i) {
+          size_t block = first + scale(last - first, i, windows_count);
+          (*windows)[i] = pyramid_->windowOffset(level, block) - start;
+        }
+        return true;
+      }
+    }
+  }
+
+  // Not enough windows in the pyramid - space windows evenly, as
+  // StrideSampler does.
+  size_t slack = data_size - windows_count * window_size;
+  for (size_t i = 0; i < windows_count; ++i) {
+    (*windows)[i] = i * window_size;
+    if (windows_count > 1) {
+      (*windows)[i] += scale(slack, i, windows_count - 1);
+    }
+  }
+  // Then move the window nearest to each pyramid window onto it, as long as
+  // it doesn't overlap its neighbours, so that those are still served from
+  // the pyramid (and the rest are spread between them).
+  for (size_t block = first; block < last && windows_count > 1; ++block) {
+    size_t offset = pyramid_->windowOffset(level, block) - start;
+    size_t i = scale(offset, windows_count - 1, data_size - window_size);
+    if (i + 1 < windows_count
+        && distance((*windows)[i + 1], offset)
+           < distance((*windows)[i], offset)) {
+      ++i;
+    }
+    if ((i == 0 || (*windows)[i - 1] + window_size <= offset)
+        && (i + 1 == windows_count
+            || offset + window_size <= (*windows)[i + 1])) {
+      (*windows)[i] = offset;
+    }
+  }
+  return true;
+}
+
+void PyramidSampler::readWindow(SamplerConfig *sc, size_t index, size_t size,
+                                char *out) {
+  size_t offset = sc->start + index;
+  if (size == pyramid_->windowSize()) {
+    for (size_t level = 0; level < pyramid_->levelsCount(); ++level) {
+      size_t block = offset / pyramid_->blockSize(level);
+      if (block < pyramid_->blocksCount(level)
+          && pyramid_->windowOffset(level, block) == offset) {
+        if (pyramid_->readWindow(level, block, out)) {
+          return;
+        }
+        break;
+      }
+    }
+  }
+  readData(index, size, out, sc);
+}
+
+void PyramidSampler::windowsInRange(size_t level, size_t start, size_t end,
+                                    size_t *first, size_t *last) {
+  size_t blocks_count = pyramid_->blocksCount(level);
+  size_t block_size = pyramid_->blockSize(level);
+  size_t window_size = pyramid_->windowSize();
+  *first = start / block_size;
+  while (*first < blocks_count
+         && (pyramid_->windowOffset(level, *first)
+             == SamplePyramid::k_no_window
+             || pyramid_->windowOffset(level, *first) < start)) {
+    ++*first;
+  }
+  *last = std::min(blocks_count, end / block_size + 1);
+  while (*last > *first
+         && (pyramid_->windowOffset(level, *last - 1)
+             == SamplePyramid::k_no_window
+             || pyramid_->windowOffset(level, *last - 1) + window_size > end)) {
+    --*last;
+  }
+}
+
+PyramidSampler* PyramidSampler::cloneImpl() {
+  return new PyramidSampler(*this);
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <utility>
+
+#include "util/sampling/sample_pyramid.h"
+#include "util/concurrency/threadpool.h"
+
+
+namespace veles {
+namespace util {
+
+static const size_t k_window_size = 256;
+
+const size_t SamplePyramid::k_fanout;
+const size_t SamplePyramid::k_min_block_size;
+const size_t SamplePyramid::k_max_blocks;
+const size_t SamplePyramid::k_no_window;
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+SamplePyramid::SamplePyramid(std::shared_ptr<IDataSource> source) :
+    source_(std::move(source)), built_(false), generation_(0) {
+  data_size_ = source_->size();
+  Level level;
+  level.block_size = k_min_block_size;
+  while (level.block_size * k_max_blocks < data_size_) {
+    level.block_size *= 2;
+  }
+  level.blocks_count = (data_size_ + level.block_size - 1) / level.block_size;
+  level.first_window = 0;
+  window_size_ = std::min(level.block_size, k_window_size);
+  levels_.push_back(level);
+  while (level.blocks_count > 1) {
+    level.first_window += level.blocks_count;
+    level.block_size *= k_fanout;
+    level.blocks_count = (level.blocks_count + k_fanout - 1) / k_fanout;
+    levels_.push_back(level);
+  }
+  data_changed_cb_id_ = source_->registerChangeCallback(
+      std::bind(&SamplePyramid::update, this, std::placeholders::_1,
+                std::placeholders::_2));
+}
+
+SamplePyramid::~SamplePyramid() {
+  source_->removeChangeCallback(data_changed_cb_id_);
+}
+
+std::shared_ptr<IDataSource> SamplePyramid::source() const {
+  return source_;
+}
+
+size_t SamplePyramid::dataSize() const {
+  return data_size_;
+}
+
+size_t SamplePyramid::levelsCount() const {
+  return levels_.size();
+}
+
+size_t SamplePyramid::blockSize(size_t level) const {
+  return levels_[level].block_size;
+}
+
+size_t SamplePyramid::blocksCount(size_t level) const {
+  return levels_[level].blocks_count;
+}
+
+size_t SamplePyramid::windowSize() const {
+  return window_size_;
+}
+
+size_t SamplePyramid::windowOffset(size_t level, size_t block) const {
+  size_t block_size = levels_[level].block_size;
+  size_t start = block * block_size;
+  size_t size = std::min(block_size, data_size_ - start);
+  if (size < window_size_) {
+    return k_no_window;
+  }
+  return start + (size - window_size_) / 2;
+}
+
+void SamplePyramid::build() {
+  while (true) {
+    uint64_t generation;
+    {
+      std::unique_lock<std::mutex> lc(mutex_);
+      generation = generation_;
+    }
+    const Level &top = levels_.back();
+    std::vector<char> windows((top.first_window + top.blocks_count)
+                              * window_size_);
+    for (size_t level = 0; level < levels_.size(); ++level) {
+      readWindows(level, 0, levels_[level].blocks_count,
+                  &windows[levels_[level].first_window * window_size_]);
+    }
+
+    std::unique_lock<std::mutex> lc(mutex_);
+    // If the data changed meanwhile, some windows may be stale - start over.
+    if (generation == generation_) {
+      windows_.swap(windows);
+      built_ = true;
+      return;
+    }
+  }
+}
+
+void SamplePyramid::buildAsync(std::function<void()> done) {
+  auto self = shared_from_this();
+  auto task = [self, done]() {
+    self->build();
+    if (done) {
+      done();
+    }
+  };
+  if (threadpool::runTask("sampling", task, threadpool::Priority::LOW)
+      != threadpool::SchedulingResult::SCHEDULED) {
+    task();
+  }
+}
+
+bool SamplePyramid::isBuilt() {
+  std::unique_lock<std::mutex> lc(mutex_);
+  return built_;
+}
+
+void SamplePyramid::update(size_t offset, size_t size) {
+  if (size == 0 || offset >= data_size_) {
+    return;
+  }
+  size_t end = std::min(offset + size, data_size_);
+  // Windows are in the middle of their blocks, so only blocks overlapping
+  // the change can have windows overlapping it.
+  std::vector<std::pair<size_t, std::vector<char>>> changed;
+  for (size_t level = 0; level < levels_.size(); ++level) {
+    size_t block_size = levels_[level].block_size;
+    for (size_t block = offset / block_size;
+         block < levels_[level].blocks_count && block * block_size < end;
+         ++block) {
+      size_t window_offset = windowOffset(level, block);
+      if (window_offset == k_no_window || window_offset >= end
+          || window_offset + window_size_ <= offset) {
+        continue;
+      }
+      std::vector<char> window(window_size_);
+      readWindows(level, block, block + 1, window.data());
+      changed.emplace_back(levels_[level].first_window + block,
+                           std::move(window));
+    }
+  }
+
+  std::unique_lock<std::mutex> lc(mutex_);
+  ++generation_;
+  if (!built_) {
+    return;
+  }
+  for (auto &window : changed) {
+    std::copy(window.second.begin(), window.second.end(),
+              windows_.begin() + window.first * window_size_);
+  }
+}
+
+std::unique_lock<std::recursive_mutex> SamplePyramid::lockSource() {
+  return std::unique_lock<std::recursive_mutex>(source_mutex_);
+}
+
+bool SamplePyramid::readWindow(size_t level, size_t block, char *out) {
+  std::unique_lock<std::mutex> lc(mutex_);
+  if (!built_ || level >= levels_.size()
+      || block >= levels_[level].blocks_count
+      || windowOffset(level, block) == k_no_window) {
+    return false;
+  }
+  std::copy_n(windows_.begin()
+              + (levels_[level].first_window + block) * window_size_,
+              window_size_, out);
+  return true;
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+void SamplePyramid::readWindows(size_t level, size_t first, size_t last,
+                                char *out) {
+  for (size_t block = first; block < last; ++block) {
+    size_t window_offset = windowOffset(level, block);
+    if (window_offset != k_no_window) {
+      std::unique_lock<std::recursive_mutex> lc(source_mutex_);
+      source_->read(window_offset, window_size_,
+                    out + (block - first) * window_size_);
+    }
+  }
+}
+
+}  // namespace util
+}  // namespace veles
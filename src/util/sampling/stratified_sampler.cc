@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <random>
+
+#include "util/sampling/stratified_sampler.h"
+
+
+namespace veles {
+namespace util {
+
+// Windows are chosen in parts of at least this many.
+static const size_t k_min_windows_per_part = 4096;
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+bool StratifiedSampler::chooseWindows(SamplerConfig *sc, size_t window_size,
+                                      std::vector<size_t> *windows) {
+  // Stratum i is [n*i/m, n*(i+1)/m) - at least n/m >= k octets long, so
+  // a window fits in each of them and windows never overlap.
+  size_t windows_count = windows->size();
+  size_t data_size = getDataSize(sc);
+  size_t parts = partsFor(windows_count, k_min_windows_per_part);
+  runInParts(parts, [&](size_t part) {
+    auto generator = makeGenerator(part);
+    size_t end = windows_count * (part + 1) / parts;
+    for (size_t i = windows_count * part / parts; i < end; ++i) {
+      size_t stratum_start = scale(data_size, i, windows_count);
+      size_t stratum_end = scale(data_size, i + 1, windows_count);
+      std::uniform_int_distribution<size_t> distribution(
+          stratum_start, stratum_end - window_size);
+      (*windows)[i] = distribution(generator);
+    }
+  });
+  return !resampleCancelled(sc);
+}
+
+StratifiedSampler* StratifiedSampler::cloneImpl() {
+  return new StratifiedSampler(*this);
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "util/sampling/stride_sampler.h"
+
+
+namespace veles {
+namespace util {
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+bool StrideSampler::chooseWindows(SamplerConfig *sc, size_t window_size,
+                                  std::vector<size_t> *windows) {
+  // The space not covered by windows is split evenly between the gaps.
+  size_t windows_count = windows->size();
+  size_t slack = getDataSize(sc) - windows_count * window_size;
+  for (size_t i = 0; i < windows_count; ++i) {
+    (*windows)[i] = i * window_size;
+    if (windows_count > 1) {
+      (*windows)[i] += scale(slack, i, windows_count - 1);
+    }
+  }
+  return true;
+}
+
+StrideSampler* StrideSampler::cloneImpl() {
+  return new StrideSampler(*this);
+}
+
+}  // namespace util
+}  // namespace veles
@@ -15,11 +15,7 @@
  *
  */
 #include <algorithm>
-#include <cmath>
-#include <cstdlib>
-#include <iterator>
 #include <random>
-#include <set>
 
 #include "util/sampling/uniform_sampler.h"
 
@@ -27,76 +23,16 @@
 namespace veles {
 namespace util {
 
-/*****************************************************************************/
-/* Public methods */
-/*****************************************************************************/
-
-UniformSampler::UniformSampler(const QByteArray &data) :
-    ISampler(data), window_size_(0), use_default_window_size_(true),
-    buffer_(nullptr) {}
-
-UniformSampler::~UniformSampler() {
-  if (buffer_ != nullptr) {
-    delete[] buffer_;
-  }
-}
-
-void UniformSampler::setWindowSize(size_t size) {
-  auto lc = waitAndLock();
-  window_size_ = size;
-  use_default_window_size_ = size == 0;
-  resample();
-}
+// Offsets are generated in parts of at least this many windows.
+static const size_t k_min_windows_per_part = 1024;
 
 /*****************************************************************************/
 /* Private methods */
 /*****************************************************************************/
 
-UniformSampler::UniformSampler(const UniformSampler& other) :
-    ISampler(other), window_size_(other.window_size_), buffer_(nullptr) {}
-
-char UniformSampler::getSampleByte(size_t index) {
-  if (buffer_ != nullptr) {
-    return buffer_[index];
-  }
-  size_t base_index = windows_[index / window_size_];
-  return getDataByte(base_index + (index % window_size_));
-}
-
-const char* UniformSampler::getData() {
-  return buffer_;
-}
-
-size_t UniformSampler::getRealSampleSize() {
-  return window_size_ * windows_count_;
-}
-
-size_t UniformSampler::getFileOffsetImpl(size_t index) {
-  size_t base_index = windows_[index / window_size_];
-  return base_index + (index % window_size_);
-}
-
-size_t UniformSampler::getSampleOffsetImpl(size_t address) {
-  // we want the last window less or equal to address (or first window if
-  // no such window exists)
-  if (address < windows_[0]) return 0;
-  auto previous_window = std::upper_bound(windows_.begin(), windows_.end(),
-                                          address);
-  if (previous_window != windows_.begin()) --previous_window;
-  size_t base_index = static_cast<size_t>(
-    std::distance(windows_.begin(), previous_window) * window_size_);
-  return base_index + std::min(window_size_ - 1, address - (*previous_window));
-}
-
-ISampler::ResampleData* UniformSampler::prepareResample(SamplerConfig *sc) {
-  size_t size = getRequestedSampleSize(sc);
-  size_t window_size = window_size_;
-  if (use_default_window_size_ || window_size_ == 0) {
-    window_size = (size_t)floor(sqrt(size));
-  }
-  size_t windows_count = size / window_size;
-  size = window_size * windows_count;
-  std::vector<size_t> windows(windows_count);
+bool UniformSampler::chooseWindows(SamplerConfig *sc, size_t window_size,
+                                   std::vector<size_t> *windows) {
+  size_t windows_count = windows->size();
 
   // Algorithm:
   // First let's mark windows_count_ as m, window_size_ as k and
@@ -113,50 +49,46 @@ ISampler::ResampleData* UniformSampler::prepareResample(SamplerConfig *sc) {
   //   n - m*k + (m-1)*k = n - k
   //   which is exactly what we want because the piece length is k.
   // - For each i the distance d_{i+1}-d_i >= k.
+  //
+  // To spread the work over the thread pool, {0, 1 ... n - m*k} is split
+  // into equal parts, and the number of (c_i) falling into each of them is
+  // drawn first (from the multinomial distribution, as a chain of binomial
+  // ones).  The parts can then generate and sort their numbers
+  // independently - the concatenation of sorted parts is sorted.
   size_t max_index = getDataSize(sc) - windows_count * window_size;
-  std::default_random_engine generator;
-  std::uniform_int_distribution<size_t> distribution(0, max_index);
-  for (size_t i = 0; i < windows_count; ++i) {
-    windows[i] = distribution(generator);
-  }
-  std::sort(windows.begin(), windows.end());
-  for (size_t i = 0; i < windows_count; ++i) {
-    windows[i] += i * window_size;
+  size_t parts = std::min(max_index + 1,
+                          partsFor(windows_count, k_min_windows_per_part));
+  size_t part_values = (max_index + 1) / parts;
+  std::vector<size_t> first_window(parts + 1), first_value(parts + 1);
+  auto generator = makeGenerator();
+  size_t windows_left = windows_count;
+  for (size_t part = 0; part + 1 < parts; ++part) {
+    first_value[part] = part_values * part;
+    std::binomial_distribution<size_t> distribution(windows_left,
+        static_cast<double>(part_values) / (max_index + 1 - first_value[part]));
+    size_t count = windows_left > 0 ? distribution(generator) : 0;
+    first_window[part + 1] = first_window[part] + count;
+    windows_left -= count;
   }
-
-  // Now let's create data array (it's more efficient to do it here,
-  // than later calculate values)
-  const char *raw_data = getRawData(sc);
-  char *tmp_buffer = new char[size];
-  for (size_t i = 0; i < size; ++i) {
-    size_t base_index = windows[i / window_size];
-    tmp_buffer[i] = raw_data[base_index + (i % window_size)];
-  }
-
-  UniformSamplerResampleData *rd = new UniformSamplerResampleData;
-  rd->window_size = window_size;
-  rd->windows_count = windows_count;
-  rd->windows = std::move(windows);
-  rd->data = tmp_buffer;
-  return rd;
-}
-
-void UniformSampler::applyResample(ResampleData *rd) {
-  delete[] buffer_;
-  UniformSamplerResampleData *usrd =
-    static_cast<UniformSamplerResampleData*>(rd);
-  window_size_ = usrd->window_size;
-  windows_count_ = usrd->windows_count;
-  windows_ = std::move(usrd->windows);
-  buffer_ = usrd->data;
-  delete usrd;
-}
-
-void UniformSampler::cleanupResample(ResampleData *rd) {
-  UniformSamplerResampleData *usrd =
-    static_cast<UniformSamplerResampleData*>(rd);
-  delete[] usrd->data;
-  delete usrd;
+  first_value[parts - 1] = part_values * (parts - 1);
+  first_value[parts] = max_index + 1;
+  first_window[parts] = windows_count;
+
+  runInParts(parts, [&](size_t part) {
+    auto part_generator = makeGenerator(part + 1);
+    std::uniform_int_distribution<size_t> distribution(
+        first_value[part], first_value[part + 1] - 1);
+    auto begin = windows->begin() + first_window[part];
+    auto end = windows->begin() + first_window[part + 1];
+    for (auto it = begin; it != end; ++it) {
+      *it = distribution(part_generator);
+    }
+    std::sort(begin, end);
+    for (size_t i = first_window[part]; i < first_window[part + 1]; ++i) {
+      (*windows)[i] += i * window_size;
+    }
+  });
+  return !resampleCancelled(sc);
 }
 
 UniformSampler* UniformSampler::cloneImpl() {
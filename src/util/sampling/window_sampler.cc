@@ -0,0 +1,236 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "util/sampling/window_sampler.h"
+#include "util/concurrency/threadpool.h"
+
+
+namespace veles {
+namespace util {
+
+// How many windows are copied between checks for cancellation.
+static const size_t k_windows_per_cancel_check = 1024;
+// Work is split into at most k_max_parts parts.
+static const size_t k_max_parts = 64;
+static const size_t k_min_windows_per_part = 1024;
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+WindowSampler::WindowSampler(const QByteArray &data) :
+    ISampler(data), window_size_(0), windows_count_(0),
+    use_default_window_size_(true), seed_(0), buffer_(nullptr) {}
+
+WindowSampler::WindowSampler(std::shared_ptr<IDataSource> source) :
+    ISampler(std::move(source)), window_size_(0), windows_count_(0),
+    use_default_window_size_(true), seed_(0), buffer_(nullptr) {}
+
+WindowSampler::~WindowSampler() {
+  if (buffer_ != nullptr) {
+    delete[] buffer_;
+  }
+}
+
+void WindowSampler::setWindowSize(size_t size) {
+  auto lc = waitAndLock();
+  window_size_ = size;
+  use_default_window_size_ = size == 0;
+  resample();
+}
+
+void WindowSampler::setSeed(uint32_t seed) {
+  auto lc = waitAndLock();
+  seed_ = seed;
+  resample();
+}
+
+/*****************************************************************************/
+/* Protected methods */
+/*****************************************************************************/
+
+WindowSampler::WindowSampler(const WindowSampler& other) :
+    ISampler(other), window_size_(other.window_size_), windows_count_(0),
+    use_default_window_size_(other.use_default_window_size_),
+    seed_(other.seed_), buffer_(nullptr) {}
+
+void WindowSampler::readWindow(SamplerConfig *sc, size_t index, size_t size,
+                               char *out) {
+  readData(index, size, out, sc);
+}
+
+std::default_random_engine WindowSampler::makeGenerator(size_t part) {
+  std::seed_seq seed{seed_, static_cast<uint32_t>(part)};
+  return std::default_random_engine(seed);
+}
+
+size_t WindowSampler::partsFor(size_t items, size_t min_items_per_part) {
+  return std::min(k_max_parts,
+                  std::max<size_t>(1, items / min_items_per_part));
+}
+
+size_t WindowSampler::scale(size_t value, size_t numerator,
+                            size_t denominator) {
+  return value / denominator * numerator
+      + value % denominator * numerator / denominator;
+}
+
+void WindowSampler::runInParts(size_t parts,
+                               const std::function<void(size_t)> &part) {
+  threadpool::TaskGroup group;
+  for (size_t i = 1; i < parts; ++i) {
+    if (threadpool::runTask("sampling", std::bind(part, i),
+                            threadpool::Priority::HIGH, &group)
+        != threadpool::SchedulingResult::SCHEDULED) {
+      part(i);
+    }
+  }
+  part(0);
+  group.wait();
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+char WindowSampler::getSampleByte(size_t index) {
+  if (buffer_ != nullptr) {
+    return buffer_[index];
+  }
+  size_t base_index = windows_[index / window_size_];
+  return getDataByte(base_index + (index % window_size_));
+}
+
+const char* WindowSampler::getData() {
+  return buffer_;
+}
+
+size_t WindowSampler::getRealSampleSize() {
+  return window_size_ * windows_count_;
+}
+
+size_t WindowSampler::getFileOffsetImpl(size_t index) {
+  size_t base_index = windows_[index / window_size_];
+  return base_index + (index % window_size_);
+}
+
+size_t WindowSampler::getSampleOffsetImpl(size_t address) {
+  // we want the last window less or equal to address (or first window if
+  // no such window exists)
+  if (address < windows_[0]) return 0;
+  auto previous_window = std::upper_bound(windows_.begin(), windows_.end(),
+                                          address);
+  if (previous_window != windows_.begin()) --previous_window;
+  size_t base_index = static_cast<size_t>(
+    std::distance(windows_.begin(), previous_window) * window_size_);
+  return base_index + std::min(window_size_ - 1, address - (*previous_window));
+}
+
+ISampler::ResampleData* WindowSampler::prepareResample(SamplerConfig *sc) {
+  size_t size = getRequestedSampleSize(sc);
+  size_t window_size = window_size_;
+  if (use_default_window_size_ || window_size_ == 0) {
+    window_size = std::max<size_t>(1, (size_t)floor(sqrt(size)));
+  }
+  size_t windows_count = size / window_size;
+  size = window_size * windows_count;
+  std::vector<size_t> windows(windows_count);
+  if (!chooseWindows(sc, window_size, &windows)) {
+    return nullptr;
+  }
+
+  // Now let's create data array (it's more efficient to do it here,
+  // than later calculate values)
+  char *tmp_buffer = new char[size];
+  size_t parts = partsFor(windows_count, k_min_windows_per_part);
+  runInParts(parts, [&](size_t part) {
+    size_t end = windows_count * (part + 1) / parts;
+    for (size_t i = windows_count * part / parts; i < end; ++i) {
+      if (i % k_windows_per_cancel_check == 0 && resampleCancelled(sc)) {
+        return;
+      }
+      readWindow(sc, windows[i], window_size, tmp_buffer + i * window_size);
+    }
+  });
+  if (resampleCancelled(sc)) {
+    delete[] tmp_buffer;
+    return nullptr;
+  }
+
+  WindowSamplerResampleData *rd = new WindowSamplerResampleData;
+  rd->window_size = window_size;
+  rd->windows_count = windows_count;
+  rd->windows = std::move(windows);
+  rd->data = tmp_buffer;
+  return rd;
+}
+
+void WindowSampler::applyResample(ResampleData *rd) {
+  delete[] buffer_;
+  WindowSamplerResampleData *wsrd =
+    static_cast<WindowSamplerResampleData*>(rd);
+  window_size_ = wsrd->window_size;
+  windows_count_ = wsrd->windows_count;
+  windows_ = std::move(wsrd->windows);
+  buffer_ = wsrd->data;
+  delete wsrd;
+}
+
+void WindowSampler::cleanupResample(ResampleData *rd) {
+  WindowSamplerResampleData *wsrd =
+    static_cast<WindowSamplerResampleData*>(rd);
+  delete[] wsrd->data;
+  delete wsrd;
+}
+
+bool WindowSampler::affectedSampleRanges(
+    size_t start, size_t end,
+    std::vector<std::pair<size_t, size_t>> *ranges) {
+  if (buffer_ == nullptr) {
+    return false;
+  }
+  // Windows are sorted and don't overlap, so the ones overlapping
+  // [start, end) are consecutive, starting with the last one before start.
+  auto window = std::upper_bound(windows_.begin(), windows_.end(), start);
+  if (window != windows_.begin()) {
+    --window;
+  }
+  for (; window != windows_.end() && *window < end; ++window) {
+    size_t window_start = std::max(start, *window);
+    size_t window_end = std::min(end, *window + window_size_);
+    if (window_start >= window_end) {
+      continue;
+    }
+    size_t base_index = static_cast<size_t>(
+        std::distance(windows_.begin(), window) * window_size_);
+    ranges->emplace_back(base_index + (window_start - *window),
+                         base_index + (window_end - *window));
+  }
+  return true;
+}
+
+void WindowSampler::refreshSample(size_t first, size_t last) {
+  size_t window_start = windows_[first / window_size_];
+  readData(window_start + first % window_size_, last - first,
+           buffer_ + first);
+}
+
+}  // namespace util
+}  // namespace veles
@@ -55,6 +55,16 @@ void setIpAddress(QString addr) {
   settings.setValue("network.ip", addr);
 }
 
+QString localSocket() {
+  QSettings settings;
+  return settings.value("network.local_socket", "veles").toString();
+}
+
+void setLocalSocket(QString name) {
+  QSettings settings;
+  settings.setValue("network.local_socket", name);
+}
+
 }  // namespace network
 }  // namespace settings
 }  // namespace util
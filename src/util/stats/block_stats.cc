@@ -0,0 +1,226 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "util/stats/block_stats.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "util/stats/kernels.h"
+
+namespace veles {
+namespace util {
+
+const size_t BlockStats::k_block_size;
+const size_t BlockStats::k_max_digram_checkpoints;
+
+static const size_t k_digrams = 256 * 256;
+
+// Replace the counts between prefixes segment and segment + 1 (width counts
+// each) with those from recount(segment, counts), for each segment in
+// [first, last), adjusting all later prefixes. The differences are
+// accumulated as they go, so each prefix is visited once.
+template <typename T, typename Recount>
+static void recountSegments(std::vector<T> *prefix, size_t width,
+                            size_t first, size_t last, Recount recount) {
+  size_t prefixes = prefix->size() / width;
+  if (first >= last || first + 1 >= prefixes) {
+    return;
+  }
+  std::vector<T> diff(width, 0);
+  std::vector<T> previous(prefix->begin() + first * width,
+                          prefix->begin() + (first + 1) * width);
+  std::vector<uint64_t> counts(width);
+  for (size_t segment = first; segment + 1 < prefixes; ++segment) {
+    T *next = &(*prefix)[(segment + 1) * width];
+    if (segment < last) {
+      std::fill(counts.begin(), counts.end(), 0);
+      recount(segment, counts.data());
+      for (size_t i = 0; i < width; ++i) {
+        // Unsigned arithmetic wraps around, so the result is exact anyway.
+        diff[i] += static_cast<T>(counts[i]) - (next[i] - previous[i]);
+        previous[i] = next[i];
+      }
+    }
+    for (size_t i = 0; i < width; ++i) {
+      next[i] += diff[i];
+    }
+  }
+}
+
+BlockStats::BlockStats(const char *data, size_t size, bool with_digrams)
+    : data_(reinterpret_cast<const uint8_t*>(data)), size_(size),
+      digram_stride_(0) {
+  size_t blocks = size_ / k_block_size;
+  byte_prefix_.assign((blocks + 1) * 256, 0);
+  for (size_t block = 0; block < blocks; ++block) {
+    uint64_t block_counts[256] = {};
+    kernels::countBytes(data_ + block * k_block_size, k_block_size,
+                        block_counts);
+    uint32_t *counts = &byte_prefix_[(block + 1) * 256];
+    for (size_t i = 0; i < 256; ++i) {
+      counts[i] = counts[i - 256] + static_cast<uint32_t>(block_counts[i]);
+    }
+  }
+
+  if (!with_digrams) {
+    return;
+  }
+  size_t pairs = size_ > 0 ? size_ - 1 : 0;
+  size_t stride = (pairs + k_max_digram_checkpoints - 1)
+      / k_max_digram_checkpoints;
+  digram_stride_ = std::max(k_block_size,
+      (stride + k_block_size - 1) / k_block_size * k_block_size);
+  size_t checkpoints = pairs / digram_stride_ + 1;
+  digram_prefix_.assign(checkpoints * k_digrams, 0);
+  position_prefix_.assign(checkpoints * k_digrams, 0);
+  for (size_t c = 1; c < checkpoints; ++c) {
+    uint32_t *counts = &digram_prefix_[c * k_digrams];
+    uint64_t *sums = &position_prefix_[c * k_digrams];
+    std::copy(counts - k_digrams, counts, counts);
+    std::copy(sums - k_digrams, sums, sums);
+    for (size_t i = (c - 1) * digram_stride_; i < c * digram_stride_; ++i) {
+      size_t index = data_[i] * 256 + data_[i + 1];
+      counts[index] += 1;
+      sums[index] += i;
+    }
+  }
+}
+
+size_t BlockStats::size() const {
+  return size_;
+}
+
+bool BlockStats::hasDigrams() const {
+  return digram_stride_ != 0;
+}
+
+BlockStats::Histogram BlockStats::histogram(size_t start, size_t end) const {
+  assert(start <= end && end <= size_);
+  Histogram result;
+  result.fill(0);
+  size_t first_block = (start + k_block_size - 1) / k_block_size;
+  size_t last_block = end / k_block_size;
+  if (first_block >= last_block) {
+    countBytes(start, end, result.data());
+    return result;
+  }
+  const uint32_t *first = &byte_prefix_[first_block * 256];
+  const uint32_t *last = &byte_prefix_[last_block * 256];
+  for (size_t i = 0; i < 256; ++i) {
+    result[i] = last[i] - first[i];
+  }
+  countBytes(start, first_block * k_block_size, result.data());
+  countBytes(last_block * k_block_size, end, result.data());
+  return result;
+}
+
+BlockStats::Histogram BlockStats::histogram() const {
+  return histogram(0, size_);
+}
+
+double BlockStats::entropy(size_t start, size_t end) const {
+  return entropy(histogram(start, end), end - start);
+}
+
+double BlockStats::entropy(const Histogram &histogram, uint64_t total) {
+  return kernels::entropy(histogram.data(), total);
+}
+
+void BlockStats::digrams(size_t start, size_t end, uint64_t *counts,
+                         uint64_t *position_sums) const {
+  assert(hasDigrams());
+  assert(start <= end && end <= size_);
+  if (end - start < 2) {
+    return;
+  }
+  // Digrams are identified by the offset of their first byte.
+  size_t first = start, last = end - 1;
+  size_t first_checkpoint = (first + digram_stride_ - 1) / digram_stride_;
+  size_t last_checkpoint = last / digram_stride_;
+  if (first_checkpoint >= last_checkpoint) {
+    countDigrams(first, last, counts, position_sums);
+    return;
+  }
+  const uint32_t *first_counts = &digram_prefix_[first_checkpoint * k_digrams];
+  const uint32_t *last_counts = &digram_prefix_[last_checkpoint * k_digrams];
+  for (size_t i = 0; i < k_digrams; ++i) {
+    counts[i] += last_counts[i] - first_counts[i];
+  }
+  if (position_sums != nullptr) {
+    const uint64_t *first_sums =
+        &position_prefix_[first_checkpoint * k_digrams];
+    const uint64_t *last_sums = &position_prefix_[last_checkpoint * k_digrams];
+    for (size_t i = 0; i < k_digrams; ++i) {
+      position_sums[i] += last_sums[i] - first_sums[i];
+    }
+  }
+  countDigrams(first, first_checkpoint * digram_stride_, counts,
+               position_sums);
+  countDigrams(last_checkpoint * digram_stride_, last, counts, position_sums);
+}
+
+void BlockStats::update(const char *data, size_t start, size_t end) {
+  assert(start <= end && end <= size_);
+  data_ = reinterpret_cast<const uint8_t*>(data);
+  if (start == end) {
+    return;
+  }
+  recountSegments(&byte_prefix_, 256, start / k_block_size,
+                  (end - 1) / k_block_size + 1,
+                  [this](size_t block, uint64_t *counts) {
+    countBytes(block * k_block_size, (block + 1) * k_block_size, counts);
+  });
+
+  if (!hasDigrams()) {
+    return;
+  }
+  // Digrams starting in [start - 1, end) contain a modified byte.
+  size_t first = (start > 0 ? start - 1 : 0) / digram_stride_;
+  size_t last = (end - 1) / digram_stride_ + 1;
+  size_t stride = digram_stride_;
+  recountSegments(&digram_prefix_, k_digrams, first, last,
+                  [this, stride](size_t segment, uint64_t *counts) {
+    countDigrams(segment * stride, (segment + 1) * stride, counts, nullptr);
+  });
+  std::vector<uint64_t> unused(k_digrams);
+  recountSegments(&position_prefix_, k_digrams, first, last,
+                  [this, stride, &unused](size_t segment, uint64_t *sums) {
+    countDigrams(segment * stride, (segment + 1) * stride, unused.data(),
+                 sums);
+  });
+}
+
+void BlockStats::countBytes(size_t start, size_t end,
+                            uint64_t *counts) const {
+  if (start < end) {
+    kernels::countBytes(data_ + start, end - start, counts);
+  }
+}
+
+void BlockStats::countDigrams(size_t first, size_t last, uint64_t *counts,
+                              uint64_t *position_sums) const {
+  for (size_t i = first; i < last; ++i) {
+    size_t index = data_[i] * 256 + data_[i + 1];
+    counts[index] += 1;
+    if (position_sums != nullptr) {
+      position_sums[index] += i;
+    }
+  }
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "util/stats/entropy_profile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "util/stats/kernels.h"
+
+namespace veles {
+namespace util {
+
+// entropyProfile() of a data source reads it in parts of about this size.
+static const size_t k_profile_part_size = 1 << 20;
+
+/*****************************************************************************/
+/* EntropyAccumulator */
+/*****************************************************************************/
+
+EntropyAccumulator::EntropyAccumulator()
+    : n_log2_n_(kernels::nLog2NTable()) {
+  clear();
+}
+
+void EntropyAccumulator::add(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    add(data[i]);
+  }
+}
+
+void EntropyAccumulator::remove(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    remove(data[i]);
+  }
+}
+
+void EntropyAccumulator::clear() {
+  memset(counts_, 0, sizeof(counts_));
+  total_ = 0;
+  sum_ = 0.0;
+}
+
+/*****************************************************************************/
+/* Entropy profile */
+/*****************************************************************************/
+
+// Profile of windows that overlap and always hold window_size octets, with
+// counts small enough for every lookup to hit the n * log2(n) table. This is
+// the common case, so it's kept in local variables, without branches.
+static void computeSlidingProfile(const uint8_t *data, size_t window_size,
+                                  size_t step, size_t points, float *out) {
+  const double *n_log2_n = kernels::nLog2NTable();
+  uint32_t counts[256] = {};
+  double sum = 0.0;
+  for (size_t i = 0; i < window_size; ++i) {
+    uint32_t count = counts[data[i]]++;
+    sum += n_log2_n[count + 1] - n_log2_n[count];
+  }
+  // log2(t) - sum(c * log2(c)) / t
+  const double total_log2_total = n_log2_n[window_size];
+  const double inverse_total = 1.0 / window_size;
+  out[0] = static_cast<float>(
+      std::max(0.0, (total_log2_total - sum) * inverse_total));
+  for (size_t point = 1; point < points; ++point) {
+    const uint8_t *removed = data + (point - 1) * step;
+    const uint8_t *added = removed + window_size;
+    for (size_t i = 0; i < step; ++i) {
+      uint32_t count = counts[removed[i]]--;
+      sum -= n_log2_n[count] - n_log2_n[count - 1];
+      count = counts[added[i]]++;
+      sum += n_log2_n[count + 1] - n_log2_n[count];
+    }
+    out[point] = static_cast<float>(
+        std::max(0.0, (total_log2_total - sum) * inverse_total));
+  }
+}
+
+static void computeProfile(const uint8_t *data, size_t size,
+                           size_t window_size, size_t step, size_t points,
+                           float *out) {
+  if (size >= window_size && step < window_size
+      && window_size < kernels::k_n_log2_n_table_size) {
+    computeSlidingProfile(data, window_size, step, points, out);
+    return;
+  }
+  EntropyAccumulator window;
+  // Bytes in [start, end) are in the window.
+  size_t start = 0, end = 0;
+  for (size_t point = 0; point < points; ++point) {
+    size_t next_start = point * step;
+    size_t next_end = std::min(size, next_start + window_size);
+    if (next_start >= end) {
+      window.clear();
+      window.add(data + next_start, next_end - next_start);
+    } else {
+      window.remove(data + start, next_start - start);
+      window.add(data + end, next_end - end);
+    }
+    start = next_start;
+    end = next_end;
+    out[point] = static_cast<float>(window.entropy());
+  }
+}
+
+size_t entropyProfileSize(size_t size, size_t window_size, size_t step) {
+  assert(window_size > 0 && step > 0);
+  if (size == 0) {
+    return 0;
+  }
+  if (size <= window_size) {
+    return 1;
+  }
+  return (size - window_size) / step + 1;
+}
+
+std::vector<float> entropyProfile(const uint8_t *data, size_t size,
+                                  size_t window_size, size_t step) {
+  std::vector<float> result(entropyProfileSize(size, window_size, step));
+  computeProfile(data, size, window_size, step, result.size(),
+                 result.data());
+  return result;
+}
+
+std::vector<float> entropyProfile(IDataSource *source, size_t window_size,
+                                  size_t step) {
+  size_t size = source->size();
+  std::vector<float> result(entropyProfileSize(size, window_size, step));
+  // Each part is profiled separately, with its first window counted anew.
+  size_t part_points = std::max<size_t>(1, k_profile_part_size / step);
+  std::vector<char> buffer;
+  for (size_t first = 0; first < result.size(); first += part_points) {
+    size_t last = std::min(result.size(), first + part_points);
+    size_t start = first * step;
+    size_t end = std::min(size, (last - 1) * step + window_size);
+    buffer.resize(end - start);
+    source->read(start, end - start, buffer.data());
+    computeProfile(reinterpret_cast<const uint8_t *>(buffer.data()),
+                   buffer.size(), window_size, step, last - first,
+                   result.data() + first);
+  }
+  return result;
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "util/stats/kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// SSE2 is part of x86-64, AVX2 is only used after checking the CPU.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VELES_KERNELS_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define VELES_KERNELS_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VELES_TARGET_AVX2
+#else
+#define VELES_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VELES_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace veles {
+namespace util {
+namespace kernels {
+
+// Histograms of shorter inputs are counted directly, setting up and merging
+// the banks isn't worth it.
+static const size_t k_banked_count_threshold = 1024;
+static const size_t k_banks = 4;
+// Banks are flushed every this many octets, so that 32-bit counters can't
+// overflow.
+static const size_t k_bank_flush_size = static_cast<size_t>(1) << 30;
+
+typedef uint64_t (*SumBytesFn)(const uint8_t *data, size_t size);
+
+/*****************************************************************************/
+/* Kernel variants */
+/*****************************************************************************/
+
+static uint64_t sumBytesScalar(const uint8_t *data, size_t size) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < size; ++i) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+#ifdef VELES_KERNELS_SSE2
+static uint64_t sumBytesSse2(const uint8_t *data, size_t size) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+        data + i));
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(bytes, zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+  return lanes[0] + lanes[1] + sumBytesScalar(data + i, size - i);
+}
+#endif
+
+#ifdef VELES_KERNELS_AVX2
+VELES_TARGET_AVX2
+static uint64_t sumBytesAvx2(const uint8_t *data, size_t size) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = zero;
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+        data + i));
+    sums = _mm256_add_epi64(sums, _mm256_sad_epu8(bytes, zero));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), sums);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+      + sumBytesScalar(data + i, size - i);
+}
+
+static bool cpuHasAvx2() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  // The OS has to save AVX registers too.
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0
+      || (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef VELES_KERNELS_NEON
+static uint64_t sumBytesNeon(const uint8_t *data, size_t size) {
+  uint64x2_t sums = vdupq_n_u64(0);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    uint16x8_t pairs = vpaddlq_u8(vld1q_u8(data + i));
+    sums = vpadalq_u32(sums, vpaddlq_u16(pairs));
+  }
+  return vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1)
+      + sumBytesScalar(data + i, size - i);
+}
+#endif
+
+/*****************************************************************************/
+/* Dispatch */
+/*****************************************************************************/
+
+static SumBytesFn sumBytesFor(InstructionSet set) {
+  switch (set) {
+  case InstructionSet::SCALAR:
+    return sumBytesScalar;
+#ifdef VELES_KERNELS_SSE2
+  case InstructionSet::SSE2:
+    return sumBytesSse2;
+#endif
+#ifdef VELES_KERNELS_AVX2
+  case InstructionSet::AVX2:
+    return cpuHasAvx2() ? sumBytesAvx2 : nullptr;
+#endif
+#ifdef VELES_KERNELS_NEON
+  case InstructionSet::NEON:
+    return sumBytesNeon;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+static std::atomic<InstructionSet>& activeSet() {
+  static std::atomic<InstructionSet> set(detectInstructionSet());
+  return set;
+}
+
+static std::atomic<SumBytesFn>& activeSumBytes() {
+  static std::atomic<SumBytesFn> fn(sumBytesFor(activeSet().load()));
+  return fn;
+}
+
+InstructionSet detectInstructionSet() {
+  const InstructionSet preferred[] = {
+    InstructionSet::AVX2, InstructionSet::SSE2, InstructionSet::NEON};
+  for (InstructionSet set : preferred) {
+    if (sumBytesFor(set) != nullptr) {
+      return set;
+    }
+  }
+  return InstructionSet::SCALAR;
+}
+
+InstructionSet instructionSet() {
+  return activeSet().load();
+}
+
+bool setInstructionSet(InstructionSet set) {
+  SumBytesFn sum_bytes = sumBytesFor(set);
+  if (sum_bytes == nullptr) {
+    return false;
+  }
+  activeSet() = set;
+  activeSumBytes() = sum_bytes;
+  return true;
+}
+
+const char* instructionSetName(InstructionSet set) {
+  switch (set) {
+  case InstructionSet::SCALAR:
+    return "scalar";
+  case InstructionSet::SSE2:
+    return "SSE2";
+  case InstructionSet::AVX2:
+    return "AVX2";
+  case InstructionSet::NEON:
+    return "NEON";
+  }
+  return "unknown";
+}
+
+/*****************************************************************************/
+/* Kernels */
+/*****************************************************************************/
+
+void countBytes(const uint8_t *data, size_t size, uint64_t *counts) {
+  if (size < k_banked_count_threshold) {
+    for (size_t i = 0; i < size; ++i) {
+      ++counts[data[i]];
+    }
+    return;
+  }
+  uint32_t banks[k_banks][256];
+  while (size > 0) {
+    size_t chunk = std::min(size, k_bank_flush_size);
+    memset(banks, 0, sizeof(banks));
+    size_t i = 0;
+    for (; i + k_banks <= chunk; i += k_banks) {
+      ++banks[0][data[i]];
+      ++banks[1][data[i + 1]];
+      ++banks[2][data[i + 2]];
+      ++banks[3][data[i + 3]];
+    }
+    for (; i < chunk; ++i) {
+      ++banks[0][data[i]];
+    }
+    for (size_t value = 0; value < 256; ++value) {
+      counts[value] += static_cast<uint64_t>(banks[0][value])
+          + banks[1][value] + banks[2][value] + banks[3][value];
+    }
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+uint64_t sumBytes(const uint8_t *data, size_t size) {
+  return activeSumBytes().load()(data, size);
+}
+
+const double* nLog2NTable() {
+  static const std::vector<double> table = [] {
+    std::vector<double> result(k_n_log2_n_table_size, 0.0);
+    for (size_t i = 1; i < k_n_log2_n_table_size; ++i) {
+      result[i] = i * std::log2(static_cast<double>(i));
+    }
+    return result;
+  }();
+  return table.data();
+}
+
+double nLog2N(uint64_t n) {
+  if (n < k_n_log2_n_table_size) {
+    return nLog2NTable()[n];
+  }
+  return n * std::log2(static_cast<double>(n));
+}
+
+double entropy(const uint64_t *counts, uint64_t total) {
+  if (total == 0) {
+    return 0.0;
+  }
+  // -sum(c/t * log2(c/t)) = log2(t) - sum(c * log2(c)) / t
+  const double *table = nLog2NTable();
+  double sum = 0.0;
+  for (size_t i = 0; i < 256; ++i) {
+    uint64_t count = counts[i];
+    sum += count < k_n_log2_n_table_size ? table[count] : nLog2N(count);
+  }
+  return std::max(0.0, std::log2(static_cast<double>(total)) - sum / total);
+}
+
+}  // namespace kernels
+}  // namespace util
+}  // namespace veles
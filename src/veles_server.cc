@@ -0,0 +1,136 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <iostream>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QHostAddress>
+
+#include "data/bindata.h"
+#include "db/db.h"
+#include "dbif/error.h"
+#include "dbif/method.h"
+#include "dbif/promise.h"
+#include "dbif/universe.h"
+#include "network/server.h"
+#include "util/settings/network.h"
+#include "util/version.h"
+
+// A database with the network server and nothing else.  Unlike the GUI, it
+// never changes the settings - options only apply to the current run, so
+// many instances can run side by side.
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  // Same as the GUI, so that settings are shared.
+  app.setApplicationName("Veles");
+  app.setOrganizationName("Codisec");
+  app.setApplicationVersion(veles::util::version::string);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Headless Veles database server.");
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addPositionalArgument("files", "Files to load.", "[files...]");
+  parser.addOptions({
+      {"ip", "IP address to listen on.", "ip",
+       veles::util::settings::network::ipAddress()},
+      {{"p", "port"}, "Port to listen on.", "port",
+       QString::number(veles::util::settings::network::port())},
+      {"local-socket", "Name (or path) of the local socket to listen on, "
+       "empty to disable.", "name",
+       veles::util::settings::network::localSocket()},
+      {"memory-limit", "Limit on blob data held by the database, "
+       "in MiB (0 for none).", "MiB", "0"},
+      {"parser-threads", "Number of parser threads used for unpacking "
+       "(0 for one per core).", "count", "0"},
+      {"parse", "Parse loaded files with automatically detected parsers."},
+      {"parser", "Parse loaded files with the given parser.", "id"},
+      {"unpack", "Parse loaded files, then recursively all sub-blobs "
+       "created by parsing them."},
+  });
+  parser.process(app);
+
+  bool ok;
+  uint32_t port = parser.value("port").toUInt(&ok);
+  if (!ok || port < 1 || port > 65535) {
+    std::cerr << "Bad port value provided." << std::endl;
+    return 1;
+  }
+  QHostAddress ip_addr;
+  if (!ip_addr.setAddress(parser.value("ip"))) {
+    std::cerr << "Bad ip value provided." << std::endl;
+    return 1;
+  }
+  veles::db::DbOptions options;
+  uint64_t memory_limit_mib = parser.value("memory-limit").toULongLong(&ok);
+  if (!ok || memory_limit_mib > (UINT64_MAX >> 20)) {
+    std::cerr << "Bad memory limit provided." << std::endl;
+    return 1;
+  }
+  options.memory_limit = memory_limit_mib << 20;
+  options.parser_threads = parser.value("parser-threads").toUInt(&ok);
+  if (!ok) {
+    std::cerr << "Bad parser thread count provided." << std::endl;
+    return 1;
+  }
+
+  veles::dbif::ObjectHandle root = veles::db::create_db(options);
+  veles::db::NetworkServer server(root, ip_addr, static_cast<uint16_t>(port),
+                                  parser.value("local-socket"));
+  if (!server.isListening()) {
+    std::cerr << "Failed to listen: "
+              << server.errorString().toStdString() << std::endl;
+    return 1;
+  }
+
+  bool unpack = parser.isSet("unpack");
+  bool parse = parser.isSet("parse") || parser.isSet("parser") || unpack;
+  for (auto path : parser.positionalArguments()) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+      std::cerr << "Failed to open " << path.toStdString() << std::endl;
+      return 1;
+    }
+    QByteArray contents = file.readAll();
+    veles::data::BinData data(8, contents.size(),
+                              reinterpret_cast<uint8_t *>(contents.data()));
+    contents.clear();
+    veles::dbif::ObjectHandle blob;
+    try {
+      blob = root->syncRunMethod<
+          veles::dbif::RootCreateFileBlobFromDataRequest>(data, path)->object;
+    } catch (veles::dbif::PError) {
+      std::cerr << "Failed to load " << path.toStdString()
+                << " - over the memory limit?" << std::endl;
+      return 1;
+    }
+    if (!parse) {
+      continue;
+    }
+    auto promise = blob->asyncRunMethod<veles::dbif::BlobParseRequest>(
+        &app, parser.value("parser"), 0, veles::dbif::ObjectHandle(), unpack);
+    QObject::connect(promise, &veles::dbif::MethodResultPromise::gotError,
+                     [path] (veles::dbif::PError) {
+      std::cerr << "Failed to parse " << path.toStdString() << std::endl;
+    });
+  }
+
+  std::cout << "Listening on " << ip_addr.toString().toStdString() << ":"
+            << port << std::endl;
+  return app.exec();
+}
@@ -108,6 +108,14 @@ char VisualisationWidget::getByte(size_t index) {
   return (*sampler_)[index];
 }
 
+std::shared_ptr<const util::BlockStats> VisualisationWidget::getStatistics(
+    bool with_digrams) {
+  if (!initialised_ || sampler_->empty()) {
+    return nullptr;
+  }
+  return sampler_->statistics(with_digrams);
+}
+
 bool VisualisationWidget::prepareOptionsPanel(QBoxLayout *layout) {
   return false;
 }
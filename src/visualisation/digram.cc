@@ -72,22 +72,23 @@ void DigramWidget::initTextures() {
   texture_->setFormat(QOpenGLTexture::RG32F);
   texture_->allocateStorage();
 
-  // effectively arrays of size [256][256][2], represented as single blocks
-  auto bigtab = new uint64_t[256 * 256 * 2];
-  memset(bigtab, 0, 256 * 256 * 2 * sizeof(*bigtab));
+  // digram counts and sums of their positions, indexed by [256][256]
+  auto counts = new uint64_t[256 * 256];
+  auto position_sums = new uint64_t[256 * 256];
+  memset(counts, 0, 256 * 256 * sizeof(*counts));
+  memset(position_sums, 0, 256 * 256 * sizeof(*position_sums));
+  // effectively array of size [256][256][2], represented as single block
   auto ftab = new float[256 * 256 * 2];
-  const uint8_t *rowdata = reinterpret_cast<const uint8_t *>(getData());
-  for (size_t i = 0; i < getDataSize() - 1; i++) {
-    size_t index = rowdata[i] * 512 + rowdata[i + 1] * 2;
-    bigtab[index]++;
-    bigtab[index + 1] += i;
+  size_t size = getDataSize();
+  if (size > 0) {
+    getStatistics(true)->digrams(0, size, counts, position_sums);
   }
   for (int i = 0; i < 256; i++) {
     for (int j = 0; j < 256; j++) {
-      size_t index = i * 512 + j * 2;
-      ftab[index] = static_cast<float>(bigtab[index]) / getDataSize();
-      ftab[index+1] =
-          static_cast<float>(bigtab[index+1]) / getDataSize() / getDataSize();
+      size_t index = i * 256 + j;
+      ftab[index * 2] = static_cast<float>(counts[index]) / size;
+      ftab[index * 2 + 1] =
+          static_cast<float>(position_sums[index]) / size / size;
     }
   }
   texture_->setData(QOpenGLTexture::RG, QOpenGLTexture::Float32,
@@ -100,7 +101,8 @@ void DigramWidget::initTextures() {
 
   texture_->setWrapMode(QOpenGLTexture::ClampToEdge);
 
-  delete[] bigtab;
+  delete[] counts;
+  delete[] position_sums;
   delete[] ftab;
 }
 
@@ -15,9 +15,13 @@
  *
  */
 #include "visualisation/minimap.h"
+#include "util/stats/entropy_profile.h"
+#include "util/stats/kernels.h"
 #include <QImage>
+#include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <functional>
 #include <assert.h>
 
 namespace veles {
@@ -28,9 +32,17 @@ VisualisationMinimap::VisualisationMinimap(QWidget *parent) :
   sampler_(nullptr), rows_(0), cols_(0), selection_start_(0),
   selection_end_(0), top_line_pos_(1.0), bottom_line_pos_(-1.0),
   color_(k_default_color), mode_(k_default_mode), texture_(nullptr),
-  lines_texture_(nullptr) {}
+  lines_texture_(nullptr) {
+  // Samplers call back from the thread that changed the data, with their
+  // locks held.
+  connect(this, &VisualisationMinimap::resampled, this,
+          [this]() { refresh(); }, Qt::QueuedConnection);
+}
 
 VisualisationMinimap::~VisualisationMinimap() {
+  if (sampler_) {
+    sampler_->removeResampleCallback(resample_cb_id_);
+  }
   if (gl_initialised_) {
     makeCurrent();
     delete texture_;
@@ -41,7 +53,12 @@ VisualisationMinimap::~VisualisationMinimap() {
 }
 
 void VisualisationMinimap::setSampler(util::ISampler *sampler) {
+  if (sampler_) {
+    sampler_->removeResampleCallback(resample_cb_id_);
+  }
   sampler_ = sampler;
+  resample_cb_id_ = sampler_->registerResampleCallback(
+      std::bind(&VisualisationMinimap::resampled, this));
   selection_start_ = 0;
   selection_end_ = (empty()) ? 0 : sampler_->getSampleSize();
   initialised_ = true;
@@ -115,70 +132,71 @@ void VisualisationMinimap::setMinimapMode(MinimapMode mode) {
 /* calculate minimap texture methods */
 /*****************************************************************************/
 
+size_t VisualisationMinimap::pointStart(size_t index, double point_size,
+                                        size_t sample_size) {
+  // First i for which i / point_size >= index.
+  auto i = static_cast<size_t>(std::ceil(index * point_size));
+  while (i > 0 && static_cast<double>(i - 1) / point_size >= index) {
+    i -= 1;
+  }
+  while (static_cast<double>(i) / point_size < index) {
+    i += 1;
+  }
+  return std::min(i, sample_size);
+}
+
 float* VisualisationMinimap::calculateAverageValueTexture(
               const uint8_t *sample, size_t sample_size,
               size_t texture_size, double point_size) {
   auto bigtab = new float[texture_size];
   memset(bigtab, 0, texture_size * sizeof(*bigtab));
-  uint64_t point_sum = 0, point_count = 0;
 
-  size_t index = 0;
-  for (size_t i = 0; i < sample_size; ++i) {
-    if (index < texture_size - 1 &&
-        static_cast<double>(i) / point_size >= index + 1) {
-      uint8_t result = (point_count == 0) ? 0 : point_sum / point_count;
-      bigtab[index] = static_cast<float>(result); // HAX
-      index += 1;
-      point_sum = 0;
-      point_count = 0;
-    }
-    point_sum += sample[i];
-    point_count += 1;
+  // Point index covers bytes i with floor(i / point_size) == index, the last
+  // one also takes whatever is left.
+  size_t start = 0;
+  for (size_t index = 0; index < texture_size; ++index) {
+    size_t end = (index == texture_size - 1) ?
+        sample_size : pointStart(index + 1, point_size, sample_size);
+    uint64_t point_count = end - start;
+    uint64_t point_sum = util::kernels::sumBytes(sample + start, point_count);
+    bigtab[index] = static_cast<float>(
+        (point_count == 0) ? 0 : point_sum / point_count);
+    start = end;
   }
-  bigtab[texture_size - 1] = static_cast<float>(
-      (point_count == 0) ? 0 : point_sum / point_count);
   return bigtab;
 }
 
 float* VisualisationMinimap::calculateEntropyTexture(
               const uint8_t *sample, size_t sample_size,
-              size_t texture_size, double point_size) {
+              size_t texture_size, double point_size,
+              const util::BlockStats &stats) {
   if (point_size > k_minimum_entropy_window) {
-    return calculateEntropyTexturePerPixel(sample, sample_size,
-                                           texture_size, point_size);
+    return calculateEntropyTexturePerPixel(sample_size, texture_size,
+                                           point_size, stats);
   }
   if (sample_size < 2 * k_minimum_entropy_window) {
     return calculateEntropyTextureSingleWindow(sample, sample_size,
-                                               texture_size, point_size);
+                                               texture_size, point_size,
+                                               stats);
   }
   return calculateEntropyTextureSlidingWindow(sample, sample_size,
                                               texture_size, point_size);
 }
 
 float* VisualisationMinimap::calculateEntropyTexturePerPixel(
-              const uint8_t *sample, size_t sample_size,
-              size_t texture_size, double point_size) {
+              size_t sample_size, size_t texture_size, double point_size,
+              const util::BlockStats &stats) {
   auto bigtab = new float[texture_size];
   memset(bigtab, 0, texture_size * sizeof(*bigtab));
 
-  auto counts = new uint64_t[256]; // assume 8-bit bytes
-  memset(counts, 0, 256 * sizeof(*counts));
-
-  size_t index = 0, point_count = 0;
-
-  for (size_t i = 0; i < sample_size; ++i) {
-    if (index < texture_size - 1 &&
-        static_cast<double>(i) / point_size >= index + 1) {
-      bigtab[index] = calculateEntropyValue(counts, point_count);
-      index += 1;
-      point_count = 0;
-      memset(counts, 0, 256 * sizeof(*counts));
-    }
-    counts[sample[i]] += 1;
-    point_count += 1;
+  size_t start = 0;
+  for (size_t index = 0; index < texture_size; ++index) {
+    size_t end = (index == texture_size - 1) ?
+        sample_size : pointStart(index + 1, point_size, sample_size);
+    auto counts = stats.histogram(start, end);
+    bigtab[index] = calculateEntropyValue(counts.data(), end - start);
+    start = end;
   }
-  bigtab[texture_size - 1] = calculateEntropyValue(counts, point_count);
-  delete[] counts;
   return bigtab;
 }
 
@@ -188,39 +206,39 @@ float* VisualisationMinimap::calculateEntropyTextureSlidingWindow(
   auto bigtab = new float[texture_size];
   memset(bigtab, 0, texture_size * sizeof(*bigtab));
 
-  auto counts = new uint64_t[256]; // assume 8-bit bytes
-  memset(counts, 0, 256 * sizeof(*counts));
+  util::EntropyAccumulator window;
 
   size_t start = 0, end = 0;
   while (start < sample_size) {
     size_t mid = (start + end) / 2;
     if (mid > 0 && std::floor(mid / point_size) != std::floor((mid - 1) / point_size)) {
-      size_t point_count = end - start;
-      bigtab[static_cast<size_t>(mid / point_size)] = calculateEntropyValue(
-          counts, point_count);
+      // entropy will be in range [0,8], scale it to [0,256]
+      bigtab[static_cast<size_t>(mid / point_size)] = static_cast<float>(
+          window.entropy() * 32);
     }
     if (end > k_minimum_entropy_window || end >= sample_size) {
-      counts[sample[start++]] -= 1;
+      window.remove(sample[start++]);
     }
     if (end < sample_size) {
-      counts[sample[end++]] += 1;
+      window.add(sample[end++]);
     }
   }
-  delete[] counts;
   return bigtab;
 }
 
 float* VisualisationMinimap::calculateEntropyTextureSingleWindow(
               const uint8_t *sample, size_t sample_size,
-              size_t texture_size, double point_size) {
+              size_t texture_size, double point_size,
+              const util::BlockStats &stats) {
   auto bigtab = new float[texture_size];
   memset(bigtab, 0, texture_size * sizeof(*bigtab));
 
-  auto counts = new uint64_t[256]; // assume 8-bit bytes
-  memset(counts, 0, 256 * sizeof(*counts));
-
-  for (size_t i = 0; i < sample_size; ++i) {
-    counts[sample[i]] += 1;
+  auto counts = stats.histogram();
+  // Information content of each byte value.
+  float information[256];
+  for (size_t value = 0; value < 256; ++value) {
+    information[value] = counts[value] == 0 ? 0.0f :
+        -log2(static_cast<float>(counts[value]) / sample_size);
   }
 
   uint64_t point_count = 0;
@@ -237,29 +255,19 @@ float* VisualisationMinimap::calculateEntropyTextureSingleWindow(
       point_sum = 0;
       point_count = 0;
     }
-    point_sum -= log2(static_cast<float>(counts[sample[i]]) / sample_size);
+    point_sum += information[sample[i]];
     point_count += 1;
   }
   result = (point_count == 0) ? 0.0f : point_sum / point_count;
   bigtab[texture_size - 1] = static_cast<float>(result) * 32;  // Normalise to 0-256
-  delete[] counts;
   return bigtab;
 }
 
-float VisualisationMinimap::calculateEntropyValue(uint64_t bytes_counts[],
-                                                  uint64_t total_count) {
-  if (total_count == 0) {
-    return 0.0f;
-  }
-  float entropy = 0.0f;
-  for (int i = 0; i < 256; ++i) {
-    if (bytes_counts[i] > 0) {
-      float fcounts = static_cast<float>(bytes_counts[i]) / total_count;
-      entropy -= fcounts * log2(fcounts);
-    }
-  }
-  entropy *= 32; // 256 / 8 (entropy will be in range [0,8], scale it
-  return entropy;
+float VisualisationMinimap::calculateEntropyValue(
+    const uint64_t bytes_counts[], uint64_t total_count) {
+  // entropy will be in range [0,8], scale it to [0,256]
+  return static_cast<float>(
+      util::kernels::entropy(bytes_counts, total_count) * 32);
 }
 
 /*****************************************************************************/
@@ -350,7 +358,8 @@ void VisualisationMinimap::initTextures() {
                                           texture_size, point_size_);
   } else {
     bigtab = calculateEntropyTexture(rowdata, sample_size_,
-                                     texture_size, point_size_);
+                                     texture_size, point_size_,
+                                     *sampler_->statistics());
   }
 
   texture_->setData(QOpenGLTexture::Red, QOpenGLTexture::Float32,
@@ -52,12 +52,15 @@ void MinimapPanel::setSampler(util::ISampler *sampler) {
   while (minimaps_.size() > 1) {
     removeMinimap();
   }
-  if (!minimap_samplers_.empty()) {
-    delete minimap_samplers_[0];
-    minimap_samplers_.pop_back();
-  }
+  // The minimap stops using the old clone only once given the new one.
+  auto old_sampler = minimap_samplers_.empty() ? nullptr
+                                               : minimap_samplers_[0];
+  minimap_samplers_.clear();
   minimap_samplers_.push_back(sampler_->clone());
   minimaps_[0]->setSampler(minimap_samplers_[0]);
+  if (old_sampler != nullptr) {
+    delete old_sampler;
+  }
   select_range_button_->setEnabled(!sampler_->empty());
   auto range = sampler_->getRange();
   selection_ = qMakePair(range.first, range.second);
@@ -67,6 +70,16 @@ QPair<size_t, size_t> MinimapPanel::getSelection() {
   return selection_;
 }
 
+std::vector<std::unique_lock<util::SamplerMutex>>
+    MinimapPanel::waitAndLockSamplers() {
+  std::vector<std::unique_lock<util::SamplerMutex>> locks;
+  locks.push_back(sampler_->waitAndLock());
+  for (auto sampler : minimap_samplers_) {
+    locks.push_back(sampler->waitAndLock());
+  }
+  return locks;
+}
+
 /*****************************************************************************/
 /* Private methods */
 /*****************************************************************************/
@@ -20,9 +20,15 @@
 #include <QLayoutItem>
 #include <QLabel>
 
+#include <algorithm>
+
 #include "visualisation/panel.h"
 #include "util/icons.h"
+#include "util/sampling/entropy_sampler.h"
 #include "util/sampling/fake_sampler.h"
+#include "util/sampling/pyramid_sampler.h"
+#include "util/sampling/stratified_sampler.h"
+#include "util/sampling/stride_sampler.h"
 #include "util/sampling/uniform_sampler.h"
 #include "visualisation/digram.h"
 #include "visualisation/trigram.h"
@@ -34,7 +40,11 @@ namespace visualisation {
 const std::map<QString, VisualisationPanel::ESampler>
   VisualisationPanel::k_sampler_map = {
     {"No sampling", VisualisationPanel::ESampler::NO_SAMPLER},
-    {"Uniform random sampling", VisualisationPanel::ESampler::UNIFORM_SAMPLER}
+    {"Uniform random sampling", VisualisationPanel::ESampler::UNIFORM_SAMPLER},
+    {"Stride sampling", VisualisationPanel::ESampler::STRIDE_SAMPLER},
+    {"Stratified sampling", VisualisationPanel::ESampler::STRATIFIED_SAMPLER},
+    {"Entropy-weighted sampling",
+     VisualisationPanel::ESampler::ENTROPY_SAMPLER}
 };
 
 /*****************************************************************************/
@@ -45,10 +55,10 @@ VisualisationPanel::VisualisationPanel(QWidget *parent) :
   veles::ui::View("Visualization", ":/images/trigram_icon.png"),
   sampler_type_(k_default_sampler),
   visualisation_type_(k_default_visualisation), sample_size_(1024) {
-    sampler_ = getSampler(sampler_type_, data_, sample_size_);
+    source_ = std::make_shared<util::BufferDataSource>(QByteArray());
+    sampler_ = getSampler(sampler_type_, source_, sample_size_);
     sampler_->allowAsynchronousResampling(true);
-    minimap_sampler_ = getSampler(ESampler::UNIFORM_SAMPLER,
-                                  data_, k_minimap_sample_size);
+    minimap_sampler_ = getMinimapSampler();
     minimap_ = new MinimapPanel(this);
     minimap_->setSampler(minimap_sampler_);
     connect(minimap_, SIGNAL(selectionChanged(size_t, size_t)), this,
@@ -70,22 +80,54 @@ VisualisationPanel::~VisualisationPanel() {
 }
 
 void VisualisationPanel::setData(const QByteArray &data) {
-  if (sampler_ != nullptr) {
-    delete sampler_;
-  }
-  if (minimap_sampler_ != nullptr) {
-    delete minimap_sampler_;
-  }
-  data_ = data;
-  sampler_ = getSampler(sampler_type_, data_, sample_size_);
+  // Widgets stop using the old samplers only once given the new ones.
+  auto old_sampler = sampler_;
+  auto old_minimap_sampler = minimap_sampler_;
+  source_ = std::make_shared<util::BufferDataSource>(data);
+  sampler_ = getSampler(sampler_type_, source_, sample_size_);
   sampler_->allowAsynchronousResampling(true);
-  minimap_sampler_ = getSampler(ESampler::UNIFORM_SAMPLER,
-                                data_, k_minimap_sample_size);
+  minimap_sampler_ = getMinimapSampler();
   minimap_->setSampler(minimap_sampler_);
   visualisation_->setSampler(sampler_);
   selection_label_->setText(prepareAddressString(0,
                             sampler_->getFileOffset(sampler_->getSampleSize())));
+  if (old_sampler != nullptr) {
+    delete old_sampler;
+  }
+  if (old_minimap_sampler != nullptr) {
+    delete old_minimap_sampler;
+  }
+}
 
+void VisualisationPanel::updateData(size_t offset, const QByteArray &bytes) {
+  // Samplers (including the minimap's clones) and the pyramid read the data
+  // from other threads, keep them from doing so while it's being written.
+  // Change callbacks run in this thread, under the same (recursive) locks.
+  auto lc = sampler_->waitAndLock();
+  auto minimap_lcs = minimap_->waitAndLockSamplers();
+  auto pyramid_lc = pyramid_->lockSource();
+  source_->write(offset, bytes.constData(), static_cast<size_t>(bytes.size()));
+}
+
+void VisualisationPanel::replaceData(const QByteArray &data) {
+  size_t size = source_->size();
+  if (static_cast<size_t>(data.size()) != size) {
+    setData(data);
+    return;
+  }
+  const char *old_data = source_->contiguousData();
+  const char *new_data = data.constData();
+  size_t first = static_cast<size_t>(
+      std::mismatch(old_data, old_data + size, new_data).first - old_data);
+  if (first == size) {
+    return;
+  }
+  size_t last = size;
+  while (old_data[last - 1] == new_data[last - 1]) {
+    --last;
+  }
+  updateData(first, data.mid(static_cast<int>(first),
+                             static_cast<int>(last - first)));
 }
 
 void VisualisationPanel::setRange(const size_t start, const size_t end) {
@@ -93,21 +135,42 @@ void VisualisationPanel::setRange(const size_t start, const size_t end) {
 }
 
 /*****************************************************************************/
-/* Static factory methods */
+/* Factory methods */
 /*****************************************************************************/
 
 util::ISampler* VisualisationPanel::getSampler(ESampler type,
-                                          const QByteArray &data,
-                                          int sample_size) {
+    std::shared_ptr<util::IDataSource> source, int sample_size) {
+  util::ISampler *sampler = nullptr;
   switch (type) {
   case ESampler::NO_SAMPLER:
-    return new util::FakeSampler(data);
+    return new util::FakeSampler(source);
   case ESampler::UNIFORM_SAMPLER:
-    util::UniformSampler *sampler = new util::UniformSampler(data);
+    sampler = new util::UniformSampler(source);
+    break;
+  case ESampler::STRIDE_SAMPLER:
+    sampler = new util::StrideSampler(source);
+    break;
+  case ESampler::STRATIFIED_SAMPLER:
+    sampler = new util::StratifiedSampler(source);
+    break;
+  case ESampler::ENTROPY_SAMPLER:
+    sampler = new util::EntropySampler(source);
+    break;
+  }
+  if (sampler != nullptr) {
     sampler->setSampleSize(1024 * sample_size);
-    return sampler;
   }
-  return nullptr;
+  return sampler;
+}
+
+util::ISampler* VisualisationPanel::getMinimapSampler() {
+  // The source keeps its own copy of data, as the pyramid is built in
+  // background.
+  pyramid_ = std::make_shared<util::SamplePyramid>(source_);
+  pyramid_->buildAsync();
+  util::ISampler *sampler = new util::PyramidSampler(pyramid_);
+  sampler->setSampleSize(1024 * k_minimap_sample_size);
+  return sampler;
 }
 
 VisualisationWidget* VisualisationPanel::getVisualisation(EVisualisation type,
@@ -144,7 +207,7 @@ void VisualisationPanel::setSamplingMethod(const QString &name) {
   if (new_sampler_type == sampler_type_) return;
 
   auto old_sampler = sampler_;
-  sampler_ = getSampler(new_sampler_type, data_, sample_size_);
+  sampler_ = getSampler(new_sampler_type, source_, sample_size_);
   sampler_->allowAsynchronousResampling(true);
   auto selection = minimap_->getSelection();
   sampler_->setRange(selection.first, selection.second);
@@ -153,12 +216,12 @@ void VisualisationPanel::setSamplingMethod(const QString &name) {
     delete old_sampler;
   }
   sampler_type_ = new_sampler_type;
-  sample_size_box_->setEnabled(sampler_type_ == ESampler::UNIFORM_SAMPLER);
+  sample_size_box_->setEnabled(sampler_type_ != ESampler::NO_SAMPLER);
 }
 
 void VisualisationPanel::setSampleSize(int kilobytes) {
   sample_size_ = kilobytes;
-  if (sampler_type_ == ESampler::UNIFORM_SAMPLER) {
+  if (sampler_type_ != ESampler::NO_SAMPLER) {
     sampler_->setSampleSize(1024 * kilobytes);
   }
 }
@@ -292,6 +355,9 @@ void VisualisationPanel::initOptionsPanel() {
   QComboBox *sampling_method = new QComboBox;
   sampling_method->addItem("Uniform random sampling");
   sampling_method->addItem("No sampling");
+  sampling_method->addItem("Stride sampling");
+  sampling_method->addItem("Stratified sampling");
+  sampling_method->addItem("Entropy-weighted sampling");
   options_layout_->addWidget(sampling_method);
 
   QLabel *sample_size_label = new QLabel("Sample size (KB):");
@@ -303,7 +369,7 @@ void VisualisationPanel::initOptionsPanel() {
   sample_size_box_->setMaximum(k_max_sample_size);
   sample_size_box_->setSingleStep(1024);
   sample_size_box_->setValue(sample_size_);
-  sample_size_box_->setEnabled(sampler_type_ == ESampler::UNIFORM_SAMPLER);
+  sample_size_box_->setEnabled(sampler_type_ != ESampler::NO_SAMPLER);
   options_layout_->addWidget(sample_size_box_);
 
   connect(sampling_method, SIGNAL(currentIndexChanged(const QString&)),
@@ -194,14 +194,10 @@ bool TrigramWidget::prepareOptionsPanel(QBoxLayout *layout) {
 
 int TrigramWidget::suggestBrightness() {
   size_t size = getDataSize();
-  auto data = reinterpret_cast<const uint8_t*>(getData());
   if (size < 100) {
     return (k_minimum_brightness + k_maximum_brightness) / 2;
   }
-  std::vector<uint64_t> counts(256, 0);
-  for (size_t i = 0; i < size; ++i) {
-    counts[data[i]] += 1;
-  }
+  auto counts = getStatistics()->histogram();
   std::sort(counts.begin(), counts.end());
   int offset = 0, sum = 0;
   while (offset < 255 && sum < k_brightness_heuristic_threshold * size) {
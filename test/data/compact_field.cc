@@ -0,0 +1,198 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "gtest/gtest.h"
+#include "data/compact_field.h"
+
+namespace veles {
+namespace data {
+
+TEST(FieldDescriptorPool, InternName) {
+  FieldDescriptorPool pool;
+  uint32_t a = pool.internName("length");
+  uint32_t b = pool.internName("type");
+  EXPECT_NE(a, b);
+  EXPECT_EQ(pool.internName("length"), a);
+  EXPECT_EQ(pool.name(a), "length");
+  EXPECT_EQ(pool.name(b), "type");
+  EXPECT_EQ(pool.namesCount(), 2);
+}
+
+TEST(FieldDescriptorPool, FindName) {
+  FieldDescriptorPool pool;
+  uint32_t a = pool.internName("length");
+  uint32_t id = 0;
+  EXPECT_TRUE(pool.findName("length", &id));
+  EXPECT_EQ(id, a);
+  EXPECT_FALSE(pool.findName("type", &id));
+  EXPECT_EQ(pool.namesCount(), 1);
+}
+
+TEST(FieldDescriptorPool, InternDescriptor) {
+  FieldDescriptorPool pool;
+  RepackFormat le32{RepackEndian::LITTLE, 32};
+  RepackFormat be32{RepackEndian::BIG, 32};
+  auto u = FieldHighType::fixed(FieldHighType::UNSIGNED);
+  auto s = FieldHighType::fixed(FieldHighType::SIGNED);
+  uint32_t a = pool.internDescriptor(le32, u);
+  EXPECT_EQ(pool.internDescriptor(le32, u), a);
+  EXPECT_NE(pool.internDescriptor(be32, u), a);
+  EXPECT_NE(pool.internDescriptor(le32, s), a);
+  EXPECT_EQ(pool.descriptorsCount(), 3);
+  EXPECT_EQ(pool.descriptor(a).repack.width, 32);
+  EXPECT_EQ(pool.descriptor(a).high_type.mode, FieldHighType::FIXED);
+  EXPECT_EQ(pool.descriptor(a).high_type.sign_mode, FieldHighType::UNSIGNED);
+}
+
+TEST(CompactChunkItems, RoundTrip) {
+  FieldDescriptorPool pool;
+  BinData blob(8, {1, 2, 3, 4, 5, 6, 7, 8});
+  RepackFormat le16{RepackEndian::LITTLE, 16};
+  auto u = FieldHighType::fixed(FieldHighType::UNSIGNED);
+  std::vector<ChunkDataItem> items = {
+    ChunkDataItem::field(0, 4, "a", le16, 2, u, BinData(16, {0x201, 0x403})),
+    ChunkDataItem::field(4, 6, "b", le16, 1, u, BinData(16, {0x1234})),
+    ChunkDataItem::subblob("c", ObjectHandle()),
+  };
+  CompactChunkItems compact;
+  compact.assign(items, &pool, &blob);
+  EXPECT_EQ(compact.size(), 3);
+  auto res = compact.expand(pool, &blob);
+  ASSERT_EQ(res.size(), 3);
+
+  EXPECT_EQ(res[0].type, ChunkDataItem::FIELD);
+  EXPECT_EQ(res[0].start, 0);
+  EXPECT_EQ(res[0].end, 4);
+  EXPECT_EQ(res[0].name, "a");
+  EXPECT_EQ(res[0].repack.width, 16);
+  EXPECT_EQ(res[0].num_elements, 2);
+  EXPECT_EQ(res[0].high_type.mode, FieldHighType::FIXED);
+  EXPECT_EQ(res[0].raw_value.size(), 2);
+  EXPECT_EQ(res[0].raw_value.element64(0), 0x201);
+  EXPECT_EQ(res[0].raw_value.element64(1), 0x403);
+
+  // Doesn't match the blob contents - has to be kept as is.
+  EXPECT_EQ(res[1].name, "b");
+  EXPECT_EQ(res[1].raw_value.size(), 1);
+  EXPECT_EQ(res[1].raw_value.element64(), 0x1234);
+
+  EXPECT_EQ(res[2].type, ChunkDataItem::SUBBLOB);
+  EXPECT_EQ(res[2].name, "c");
+  EXPECT_EQ(res[2].ref.size(), 1);
+}
+
+TEST(CompactChunkItems, ValuesFromBlob) {
+  FieldDescriptorPool pool;
+  BinData blob(8, 0x1000);
+  BinData value(8, 0x1000);
+  for (size_t i = 0; i < blob.size(); i++) {
+    blob.setElement64(i, i & 0xff);
+    value.setElement64(i, i & 0xff);
+  }
+  RepackFormat le8{RepackEndian::LITTLE, 8};
+  auto raw = FieldHighType::string(FieldHighType::STRING_RAW);
+  std::vector<ChunkDataItem> items = {
+    ChunkDataItem::field(0, 0x1000, "data", le8, 0x1000, raw, value),
+  };
+  CompactChunkItems inline_items;
+  inline_items.assign(items, &pool, nullptr);
+  CompactChunkItems blob_items;
+  blob_items.assign(items, &pool, &blob);
+  // The value is recomputed from the blob instead of being stored.
+  EXPECT_LT(blob_items.memoryUsage() + 0x1000, inline_items.memoryUsage());
+  auto res = blob_items.expand(pool, &blob);
+  ASSERT_EQ(res.size(), 1);
+  EXPECT_EQ(res[0].raw_value.size(), 0x1000);
+  EXPECT_EQ(res[0].raw_value.element64(0x123), 0x23);
+}
+
+TEST(CompactChunkItems, FieldPastBlobEnd) {
+  FieldDescriptorPool pool;
+  BinData blob(8, {1, 2, 3});
+  RepackFormat le8{RepackEndian::LITTLE, 8};
+  auto u = FieldHighType::fixed(FieldHighType::UNSIGNED);
+  std::vector<ChunkDataItem> items = {
+    ChunkDataItem::field(1, 5, "tail", le8, 4, u, BinData(8, {2, 3})),
+  };
+  CompactChunkItems compact;
+  compact.assign(items, &pool, &blob);
+  auto res = compact.expand(pool, &blob);
+  ASSERT_EQ(res.size(), 1);
+  EXPECT_EQ(res[0].end, 5);
+  EXPECT_EQ(res[0].raw_value.size(), 2);
+  EXPECT_EQ(res[0].raw_value.element64(1), 3);
+}
+
+TEST(CompactChunkItems, DetachValues) {
+  FieldDescriptorPool pool;
+  BinData blob(8, {1, 2, 3, 4, 5, 6, 7, 8});
+  RepackFormat le8{RepackEndian::LITTLE, 8};
+  auto u = FieldHighType::fixed(FieldHighType::UNSIGNED);
+  std::vector<ChunkDataItem> items = {
+    ChunkDataItem::field(0, 2, "a", le8, 2, u, BinData(8, {1, 2})),
+    ChunkDataItem::field(4, 6, "b", le8, 2, u, BinData(8, {5, 6})),
+    ChunkDataItem::field(6, 8, "c", le8, 2, u, BinData(8, {7, 8})),
+  };
+  CompactChunkItems compact;
+  compact.assign(items, &pool, &blob);
+  size_t usage = compact.memoryUsage();
+  // Doesn't overlap anything.
+  compact.detachValues(pool, &blob, 2, 4, false);
+  EXPECT_EQ(compact.memoryUsage(), usage);
+
+  compact.detachValues(pool, &blob, 5, 6, false);
+  blob.setElement64(0, 10);
+  blob.setElement64(5, 10);
+  blob.setElement64(7, 10);
+  auto res = compact.expand(pool, &blob);
+  EXPECT_EQ(res[0].raw_value.element64(0), 10);
+  EXPECT_EQ(res[1].raw_value.element64(1), 6);
+  EXPECT_EQ(res[2].raw_value.element64(1), 10);
+
+  // Everything past the start of a resize moves.
+  compact.detachValues(pool, &blob, 3, 3, true);
+  blob.setElement64(7, 11);
+  res = compact.expand(pool, &blob);
+  EXPECT_EQ(res[1].raw_value.element64(1), 6);
+  EXPECT_EQ(res[2].raw_value.element64(1), 10);
+}
+
+TEST(CompactChunkItems, Names) {
+  FieldDescriptorPool pool;
+  BinData blob(8, {1, 2, 3, 4, 5, 6, 7, 8});
+  RepackFormat le16{RepackEndian::LITTLE, 16};
+  auto u = FieldHighType::fixed(FieldHighType::UNSIGNED);
+  std::vector<ChunkDataItem> items = {
+    ChunkDataItem::field(0, 2, "b", le16, 1, u, BinData(16, {0x201})),
+    ChunkDataItem::field(2, 4, "a", le16, 1, u, BinData(16, {0x403})),
+    ChunkDataItem::field(4, 6, "b", le16, 1, u, BinData(16, {0x605})),
+    ChunkDataItem::subblob("c", ObjectHandle()),
+  };
+  CompactChunkItems compact;
+  compact.assign(items, &pool, &blob);
+  uint32_t a = pool.internName("a");
+  uint32_t b = pool.internName("b");
+  auto names = compact.names();
+  ASSERT_EQ(names.size(), 2);
+  EXPECT_EQ(names[0], std::min(a, b));
+  EXPECT_EQ(names[1], std::max(a, b));
+  EXPECT_EQ(compact.itemsNamed(a), std::vector<size_t>({1}));
+  EXPECT_EQ(compact.itemsNamed(b), std::vector<size_t>({0, 2}));
+  EXPECT_TRUE(compact.itemsNamed(pool.internName("c")).empty());
+}
+
+}  // namespace data
+}  // namespace veles
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "db/db.h"
+#include "dbif/info.h"
+#include "dbif/method.h"
+#include "dbif/universe.h"
+
+namespace veles {
+namespace db {
+
+static data::BinData bytes(const char *str) {
+  return data::BinData(8, strlen(str),
+                       reinterpret_cast<const uint8_t *>(str));
+}
+
+static data::ChunkDataItem field(uint64_t start, const QString &name,
+                                 const char *value) {
+  return data::ChunkDataItem::field(
+      start, start + strlen(value), name,
+      data::RepackFormat{data::RepackEndian::LITTLE, 8}, strlen(value),
+      data::FieldHighType::fixed(data::FieldHighType::UNSIGNED),
+      bytes(value));
+}
+
+/** A blob with three chunks:
+    - "header" of type "hdr" at [0, 4), with fields magic "ab", size "cd",
+    - "body" of type "sec" at [4, 12), with field magic "ef",
+    - "tail" of type "sec" at [12, 16), with no fields.  */
+class ChunkQueryTest : public ::testing::Test {
+ protected:
+  static dbif::ObjectHandle root_;
+  dbif::ObjectHandle blob_;
+  dbif::ObjectHandle header_;
+  dbif::ObjectHandle body_;
+  dbif::ObjectHandle tail_;
+
+  static void SetUpTestCase() {
+    DbOptions options;
+    options.parser_threads = 1;
+    root_ = create_db(options);
+  }
+
+  static void TearDownTestCase() {
+    root_ = dbif::ObjectHandle();
+  }
+
+  void SetUp() override {
+    // Every test gets a fresh blob - queries don't look past it.
+    blob_ = root_->syncRunMethod<dbif::RootCreateFileBlobFromDataRequest>(
+        bytes("abcdefghijklmnop"), "test")->object;
+    header_ = createChunk("header", "hdr", 0, 4,
+                          {field(0, "magic", "ab"), field(2, "size", "cd")});
+    body_ = createChunk("body", "sec", 4, 12, {field(4, "magic", "ef")});
+    tail_ = createChunk("tail", "sec", 12, 16, {});
+  }
+
+  dbif::ObjectHandle createChunk(
+      const QString &name, const QString &type, uint64_t start, uint64_t end,
+      const std::vector<data::ChunkDataItem> &items) {
+    auto chunk = blob_->syncRunMethod<dbif::ChunkCreateRequest>(
+        name, type, dbif::ObjectHandle(), start, end)->object;
+    chunk->syncRunMethod<dbif::SetChunkParseRequest>(start, end, items);
+    return chunk;
+  }
+
+  /** Returns the ids of the chunks found, and stores the total count of
+      matches in total (if given).  */
+  std::vector<uint64_t> query(const QString &chunk_type, const QString &name,
+                              const QString &field_name = "",
+                              const QByteArray &field_value = QByteArray(),
+                              uint64_t start = 0, uint64_t end = UINT64_MAX,
+                              uint64_t offset = 0, uint64_t limit = 0,
+                              uint64_t *total = nullptr) {
+    auto reply = blob_->syncGetInfo<dbif::QueryRequest>(
+        chunk_type, name, field_name, field_value, start, end, offset, limit);
+    EXPECT_EQ(reply->objects.size(), reply->paths.size());
+    if (total != nullptr) {
+      *total = reply->total;
+    }
+    std::vector<uint64_t> res;
+    for (auto obj : reply->objects) {
+      res.push_back(obj->id());
+    }
+    return res;
+  }
+
+  static std::vector<uint64_t> ids(
+      std::initializer_list<dbif::ObjectHandle> objects) {
+    std::vector<uint64_t> res;
+    for (auto obj : objects) {
+      res.push_back(obj->id());
+    }
+    return res;
+  }
+};
+
+dbif::ObjectHandle ChunkQueryTest::root_;
+
+TEST_F(ChunkQueryTest, ByType) {
+  EXPECT_EQ(query("sec", ""), ids({body_, tail_}));
+  EXPECT_EQ(query("hdr", ""), ids({header_}));
+  EXPECT_EQ(query("none", ""), ids({}));
+}
+
+TEST_F(ChunkQueryTest, ByName) {
+  EXPECT_EQ(query("", "tail"), ids({tail_}));
+  EXPECT_EQ(query("sec", "header"), ids({}));
+}
+
+TEST_F(ChunkQueryTest, ByField) {
+  EXPECT_EQ(query("", "", "magic"), ids({header_, body_}));
+  EXPECT_EQ(query("", "", "magic", "ef"), ids({body_}));
+  EXPECT_EQ(query("", "", "magic", "cd"), ids({}));
+  EXPECT_EQ(query("", "", "size", "cd"), ids({header_}));
+  EXPECT_EQ(query("", "", "unknown"), ids({}));
+  EXPECT_EQ(query("sec", "", "magic"), ids({body_}));
+}
+
+TEST_F(ChunkQueryTest, ByRange) {
+  EXPECT_EQ(query("", "", "", QByteArray(), 4, 16), ids({body_, tail_}));
+  EXPECT_EQ(query("", "", "", QByteArray(), 0, 12), ids({header_, body_}));
+  EXPECT_EQ(query("", "", "", QByteArray(), 2, 14), ids({body_}));
+  EXPECT_EQ(query("sec", "", "", QByteArray(), 0, 12), ids({body_}));
+}
+
+TEST_F(ChunkQueryTest, Pagination) {
+  uint64_t total = 0;
+  EXPECT_EQ(query("", "", "", QByteArray(), 0, UINT64_MAX, 0, 2, &total),
+            ids({header_, body_}));
+  EXPECT_EQ(total, 3);
+  EXPECT_EQ(query("", "", "", QByteArray(), 0, UINT64_MAX, 2, 2, &total),
+            ids({tail_}));
+  EXPECT_EQ(total, 3);
+  EXPECT_EQ(query("", "", "", QByteArray(), 0, UINT64_MAX, 5, 0, &total),
+            ids({}));
+  EXPECT_EQ(total, 3);
+  EXPECT_EQ(query("sec", "", "", QByteArray(), 0, UINT64_MAX, 1, 0, &total),
+            ids({tail_}));
+  EXPECT_EQ(total, 2);
+}
+
+TEST_F(ChunkQueryTest, Rename) {
+  body_->syncRunMethod<dbif::SetNameRequest>("renamed");
+  EXPECT_EQ(query("", "body"), ids({}));
+  EXPECT_EQ(query("", "renamed"), ids({body_}));
+  EXPECT_EQ(query("sec", ""), ids({body_, tail_}));
+}
+
+TEST_F(ChunkQueryTest, Delete) {
+  header_->syncRunMethod<dbif::DeleteRequest>();
+  EXPECT_EQ(query("hdr", ""), ids({}));
+  EXPECT_EQ(query("", "header"), ids({}));
+  EXPECT_EQ(query("", "", "magic"), ids({body_}));
+  EXPECT_EQ(query("", "", "size"), ids({}));
+  EXPECT_EQ(query("", "", "", QByteArray(), 0, 4), ids({}));
+}
+
+TEST_F(ChunkQueryTest, Reparse) {
+  body_->syncRunMethod<dbif::SetChunkParseRequest>(
+      4, 12, std::vector<data::ChunkDataItem>{field(6, "size", "gh")});
+  EXPECT_EQ(query("", "", "magic"), ids({header_}));
+  EXPECT_EQ(query("", "", "size"), ids({header_, body_}));
+  EXPECT_EQ(query("", "", "size", "gh"), ids({body_}));
+}
+
+TEST_F(ChunkQueryTest, Bounds) {
+  body_->syncRunMethod<dbif::SetChunkBoundsRequest>(2, 12);
+  EXPECT_EQ(query("", "", "", QByteArray(), 4, 16), ids({tail_}));
+  EXPECT_EQ(query("", "", "", QByteArray(), 2, 12), ids({body_}));
+}
+
+TEST_F(ChunkQueryTest, DataChange) {
+  // Field values keep what was parsed, whether the edit overwrites them
+  // in place or moves them.
+  blob_->syncRunMethod<dbif::ChangeDataRequest>(4, 6, bytes("XY"));
+  EXPECT_EQ(query("", "", "magic", "ef"), ids({body_}));
+  blob_->syncRunMethod<dbif::ChangeDataRequest>(0, 0, bytes("Z"));
+  EXPECT_EQ(query("", "", "magic", "ab"), ids({header_}));
+  EXPECT_EQ(query("", "", "size", "cd"), ids({header_}));
+  EXPECT_EQ(query("", "", "magic", "ef"), ids({body_}));
+}
+
+}  // namespace db
+}  // namespace veles
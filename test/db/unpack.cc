@@ -0,0 +1,179 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <zlib.h>
+
+#include "gtest/gtest.h"
+#include "db/db.h"
+#include "dbif/info.h"
+#include "dbif/method.h"
+#include "dbif/universe.h"
+
+namespace veles {
+namespace db {
+
+static void append(data::BinData *res, const data::BinData &data) {
+  data::BinData joint(8, res->size() + data.size());
+  joint.setData(0, res->size(), *res);
+  joint.setData(res->size(), joint.size(), data);
+  *res = joint;
+}
+
+static data::BinData compress(const data::BinData &src) {
+  uLongf size = compressBound(src.octets());
+  data::BinData res(8, size);
+  EXPECT_EQ(::compress(res.rawData(), &size, src.rawData(), src.octets()),
+            Z_OK);
+  return res.data(0, size);
+}
+
+static data::BinData pngChunk(const char *type, const data::BinData &data) {
+  uint64_t len = data.size();
+  data::BinData res = data::BinData::fromRawData(8, {
+    static_cast<uint8_t>(len >> 24), static_cast<uint8_t>(len >> 16),
+    static_cast<uint8_t>(len >> 8), static_cast<uint8_t>(len),
+    static_cast<uint8_t>(type[0]), static_cast<uint8_t>(type[1]),
+    static_cast<uint8_t>(type[2]), static_cast<uint8_t>(type[3]),
+  });
+  append(&res, data);
+  // The parser doesn't check the CRC.
+  append(&res, data::BinData(8, 4));
+  return res;
+}
+
+/** Returns a PNG file with the given (bogus) image data, and optionally
+    a zTXt chunk with the given text.  */
+static data::BinData makePng(const data::BinData &image,
+                             const data::BinData *text = nullptr) {
+  data::BinData res = data::BinData::fromRawData(8, {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+  });
+  append(&res, pngChunk("IHDR", data::BinData::fromRawData(8, {
+    0, 0, 0, 1, 0, 0, 0, 1, 8, 0, 0, 0, 0
+  })));
+  if (text) {
+    data::BinData ztxt = data::BinData::fromRawData(8, {'k', 0, 0});
+    append(&ztxt, compress(*text));
+    append(&res, pngChunk("zTXt", ztxt));
+  }
+  append(&res, pngChunk("IDAT", compress(image)));
+  append(&res, pngChunk("IEND", data::BinData(8, 0)));
+  return res;
+}
+
+class RecursiveUnpackTest : public ::testing::Test {
+ protected:
+  // The database threads don't stop until the process exits, so all the
+  // tests share one database.
+  static dbif::ObjectHandle root_;
+
+  static void SetUpTestCase() {
+    DbOptions options;
+    options.parser_threads = 2;
+    root_ = create_db(options);
+  }
+
+  static void TearDownTestCase() {
+    root_ = dbif::ObjectHandle();
+  }
+
+  dbif::ObjectHandle createBlob(const data::BinData &data) {
+    return root_->syncRunMethod<dbif::RootCreateFileBlobFromDataRequest>(
+        data, "test")->object;
+  }
+
+  static std::vector<dbif::ObjectHandle> children(dbif::ObjectHandle obj) {
+    return obj->syncGetInfo<dbif::ChildrenRequest>()->objects;
+  }
+
+  /** Returns the sub-blob with the given name in the file chunk created
+      by the PNG parser, or a null handle.  */
+  static dbif::ObjectHandle subBlob(dbif::ObjectHandle blob,
+                                    const QString &name) {
+    for (auto chunk : children(blob)) {
+      if (chunk->type() != dbif::CHUNK) {
+        continue;
+      }
+      std::vector<dbif::ObjectHandle> queue = {chunk};
+      while (!queue.empty()) {
+        auto obj = queue.back();
+        queue.pop_back();
+        for (auto child : children(obj)) {
+          if (child->type() == dbif::CHUNK) {
+            queue.push_back(child);
+          } else if (child->syncGetInfo<dbif::DescriptionRequest>()->name ==
+                     name) {
+            return child;
+          }
+        }
+      }
+    }
+    return dbif::ObjectHandle();
+  }
+
+  static bool parsed(dbif::ObjectHandle blob) {
+    return !children(blob).empty();
+  }
+};
+
+dbif::ObjectHandle RecursiveUnpackTest::root_;
+
+TEST_F(RecursiveUnpackTest, DepthLimit) {
+  data::BinData inner = makePng(data::BinData::fromRawData(8, {1, 2, 3}));
+  data::BinData outer = makePng(makePng(inner));
+  auto blob = createBlob(outer);
+  blob->syncRunMethod<dbif::BlobParseRequest>("", 0, dbif::ObjectHandle(),
+                                              true, 1);
+  ASSERT_TRUE(parsed(blob));
+  auto level1 = subBlob(blob, "inflated_data");
+  ASSERT_FALSE(level1.isNull());
+  EXPECT_TRUE(parsed(level1));
+  auto level2 = subBlob(level1, "inflated_data");
+  ASSERT_FALSE(level2.isNull());
+  EXPECT_FALSE(parsed(level2));
+}
+
+TEST_F(RecursiveUnpackTest, Dedup) {
+  // The same PNG file stored twice - as image data and as compressed text.
+  data::BinData inner = makePng(data::BinData::fromRawData(8, {1, 2, 3}));
+  auto blob = createBlob(makePng(inner, &inner));
+  blob->syncRunMethod<dbif::BlobParseRequest>("", 0, dbif::ObjectHandle(),
+                                              true);
+  auto image = subBlob(blob, "inflated_data");
+  auto text = subBlob(blob, "text");
+  ASSERT_FALSE(image.isNull());
+  ASSERT_FALSE(text.isNull());
+  EXPECT_EQ(text->syncGetInfo<dbif::BlobDataRequest>(0, UINT64_MAX)->data
+                .size(), inner.size());
+  EXPECT_NE(parsed(image), parsed(text));
+}
+
+TEST_F(RecursiveUnpackTest, Cycle) {
+  // A blob nested in itself, by way of an identity transform.
+  data::BinData data = makePng(data::BinData::fromRawData(8, {1, 2, 3}));
+  auto blob = createBlob(data);
+  auto chunk = blob->syncRunMethod<dbif::ChunkCreateRequest>(
+      "self", "self", dbif::ObjectHandle(), 0, data.size())->object;
+  auto self = chunk->syncRunMethod<dbif::CreateTransformedBlobRequest>(
+      "self", "xor", "00")->object;
+  blob->syncRunMethod<dbif::BlobParseRequest>("", 0, dbif::ObjectHandle(),
+                                              true);
+  EXPECT_FALSE(subBlob(blob, "inflated_data").isNull());
+  EXPECT_FALSE(parsed(self));
+}
+
+}  // namespace db
+}  // namespace veles
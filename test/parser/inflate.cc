@@ -0,0 +1,121 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <zlib.h>
+
+#include "gtest/gtest.h"
+#include "parser/inflate.h"
+
+namespace veles {
+namespace parser {
+
+static data::BinData makeInput(size_t size) {
+  data::BinData res(8, size);
+  for (size_t i = 0; i < size; i++) {
+    res.setElement64(i, (i * 7 + i / 100) & 0xff);
+  }
+  return res;
+}
+
+static data::BinData compress(const data::BinData &src) {
+  uLongf size = compressBound(src.octets());
+  data::BinData res(8, size);
+  EXPECT_EQ(::compress(res.rawData(), &size, src.rawData(), src.octets()),
+            Z_OK);
+  return res.data(0, size);
+}
+
+static bool sameData(const data::BinData &a, const data::BinData &b) {
+  return a.size() == b.size() &&
+      memcmp(a.rawData(), b.rawData(), a.octets()) == 0;
+}
+
+TEST(OctetBuffer, AppendAndTake) {
+  OctetBuffer buf;
+  uint8_t a[] = {1, 2, 3};
+  buf.append(a, 3);
+  buf.append(a, 2);
+  EXPECT_EQ(buf.size(), 5);
+  auto res = buf.take();
+  EXPECT_EQ(res.size(), 5);
+  EXPECT_EQ(res.element64(3), 1);
+  EXPECT_EQ(res.element64(4), 2);
+  EXPECT_EQ(buf.size(), 0);
+}
+
+TEST(Inflater, OneShot) {
+  auto input = makeInput(100000);
+  EXPECT_TRUE(sameData(inflateData(compress(input)), input));
+}
+
+TEST(Inflater, Pieces) {
+  auto input = makeInput(100000);
+  auto compressed = compress(input);
+  for (uint64_t hint : {uint64_t(0), uint64_t(100000), uint64_t(10)}) {
+    Inflater inflater(Inflater::k_default_max_output, hint);
+    for (size_t pos = 0; pos < compressed.size(); pos += 1000) {
+      size_t end = std::min<size_t>(pos + 1000, compressed.size());
+      EXPECT_TRUE(inflater.feed(compressed.data(pos, end)));
+    }
+    EXPECT_TRUE(inflater.finished());
+    EXPECT_EQ(inflater.totalIn(), compressed.size());
+    EXPECT_TRUE(sameData(inflater.result(), input));
+  }
+}
+
+TEST(Inflater, UntrustedHint) {
+  auto input = makeInput(1000);
+  auto compressed = compress(input);
+  // A bogus header claiming a huge output mustn't allocate it up front.
+  Inflater inflater(Inflater::k_default_max_output,
+                    Inflater::k_default_max_output);
+  EXPECT_TRUE(inflater.feed(compressed));
+  EXPECT_TRUE(inflater.finished());
+  EXPECT_LT(inflater.bufferSize(), 0x100000);
+  EXPECT_TRUE(sameData(inflater.result(), input));
+}
+
+TEST(Inflater, Truncated) {
+  auto compressed = compress(makeInput(100000));
+  Inflater inflater;
+  EXPECT_TRUE(inflater.feed(compressed.data(0, compressed.size() / 2)));
+  EXPECT_FALSE(inflater.finished());
+  EXPECT_EQ(inflater.result().size(), 0);
+}
+
+TEST(Inflater, Broken) {
+  data::BinData garbage(8, {1, 2, 3, 4, 5, 6, 7, 8});
+  Inflater inflater;
+  EXPECT_FALSE(inflater.feed(garbage));
+  EXPECT_EQ(inflater.state(), Inflater::State::BROKEN);
+  EXPECT_EQ(inflater.result().size(), 0);
+}
+
+TEST(Inflater, Limit) {
+  // Highly compressible - about 1000:1.
+  auto compressed = compress(data::BinData(8, 1000000));
+  Inflater exact(1000000);
+  EXPECT_TRUE(exact.feed(compressed));
+  EXPECT_TRUE(exact.finished());
+  Inflater bomb(999999);
+  EXPECT_FALSE(bomb.feed(compressed));
+  EXPECT_EQ(bomb.state(), Inflater::State::LIMIT_EXCEEDED);
+  EXPECT_EQ(bomb.result().size(), 0);
+  EXPECT_EQ(inflateData(compressed, 1000).size(), 0);
+}
+
+}  // namespace parser
+}  // namespace veles
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <zlib.h>
+
+#include <QStringList>
+
+#include "gtest/gtest.h"
+#include "parser/transform.h"
+
+namespace veles {
+namespace parser {
+
+static data::BinData fromString(const char *str) {
+  return data::BinData(8, strlen(str), reinterpret_cast<const uint8_t *>(str));
+}
+
+static std::string toString(const data::BinData &data) {
+  return std::string(reinterpret_cast<const char *>(data.rawData()),
+                     data.size());
+}
+
+TEST(Transform, Inflate) {
+  const char *text = "hello hello hello hello";
+  uLongf size = compressBound(strlen(text));
+  data::BinData compressed(8, size);
+  ASSERT_EQ(compress(compressed.rawData(), &size,
+                     reinterpret_cast<const Bytef *>(text), strlen(text)),
+            Z_OK);
+  compressed = compressed.data(0, size);
+
+  InflateTransform zlib("zlib", false);
+  data::BinData out;
+  EXPECT_TRUE(zlib.apply(compressed, "", &out));
+  EXPECT_EQ(toString(out), text);
+  // Over the size limit.
+  EXPECT_FALSE(zlib.apply(compressed, "10", &out));
+
+  // Raw deflate is the zlib stream without its 2-byte header.
+  InflateTransform deflate("deflate", true);
+  EXPECT_TRUE(deflate.apply(compressed.data(2, compressed.size()), "", &out));
+  EXPECT_EQ(toString(out), text);
+  EXPECT_FALSE(deflate.apply(fromString("garbage"), "", &out));
+}
+
+TEST(Transform, Xor) {
+  XorTransform xor_transform;
+  data::BinData out;
+  EXPECT_TRUE(xor_transform.apply(data::BinData(8, {1, 2, 3, 4, 5}), "0102",
+                                  &out));
+  ASSERT_EQ(out.size(), 5);
+  EXPECT_EQ(out.element64(0), 0);
+  EXPECT_EQ(out.element64(1), 0);
+  EXPECT_EQ(out.element64(2), 2);
+  EXPECT_EQ(out.element64(3), 6);
+  EXPECT_EQ(out.element64(4), 4);
+  EXPECT_FALSE(xor_transform.apply(data::BinData(8, {1}), "", &out));
+}
+
+TEST(Transform, Decoders) {
+  DecoderTransform base64("base64");
+  data::BinData out;
+  EXPECT_TRUE(base64.apply(fromString("aGVsbG8=\n"), "", &out));
+  EXPECT_EQ(toString(out), "hello");
+
+  DecoderTransform hex("hex");
+  EXPECT_TRUE(hex.apply(fromString("68656c6c6f"), "", &out));
+  EXPECT_EQ(toString(out), "hello");
+}
+
+TEST(Transform, CreateAll) {
+  QStringList ids;
+  for (auto transform : createAllTransforms()) {
+    ids.append(transform->id());
+    delete transform;
+  }
+  EXPECT_TRUE(ids.contains("zlib"));
+  EXPECT_TRUE(ids.contains("deflate"));
+  EXPECT_TRUE(ids.contains("xor"));
+  EXPECT_TRUE(ids.contains("base64"));
+  EXPECT_TRUE(ids.contains("hex"));
+}
+
+}  // namespace parser
+}  // namespace veles
@@ -14,9 +14,13 @@
  * limitations under the License.
  *
  */
+#include <QCoreApplication>
+
 #include "gtest/gtest.h"
 
 int main(int argc, char **argv) {
+	// Database tests wait for replies in the event loop.
+	QCoreApplication app(argc, argv);
 	::testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();
 }
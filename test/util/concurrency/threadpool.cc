@@ -0,0 +1,318 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/concurrency/threadpool.h"
+#include "util/concurrency/work_stealing_deque.h"
+
+namespace veles {
+namespace util {
+namespace threadpool {
+
+// Blocks tasks until released.
+class Gate {
+ public:
+  Gate() : open_(false) {}
+  void wait() {
+    std::unique_lock<std::mutex> lc(mutex_);
+    cv_.wait(lc, [this] { return open_; });
+  }
+  void open() {
+    std::unique_lock<std::mutex> lc(mutex_);
+    open_ = true;
+    cv_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool open_;
+};
+
+TEST(WorkStealingDeque, SingleThread) {
+  WorkStealingDeque<int> deque(2);
+  int items[5] = {0, 1, 2, 3, 4};
+  EXPECT_TRUE(deque.empty());
+  EXPECT_EQ(deque.pop(), nullptr);
+  for (auto &item : items) {
+    deque.push(&item);
+  }
+  EXPECT_FALSE(deque.empty());
+  EXPECT_EQ(deque.steal(), &items[0]);
+  EXPECT_EQ(deque.pop(), &items[4]);
+  EXPECT_EQ(deque.pop(), &items[3]);
+  EXPECT_EQ(deque.steal(), &items[1]);
+  EXPECT_EQ(deque.pop(), &items[2]);
+  EXPECT_EQ(deque.pop(), nullptr);
+  EXPECT_EQ(deque.steal(), nullptr);
+}
+
+TEST(WorkStealingDeque, ConcurrentSteal) {
+  const int count = 100000;
+  std::vector<int> items(count);
+  std::vector<std::atomic<int>> seen(count);
+  for (auto &s : seen) {
+    s = 0;
+  }
+  WorkStealingDeque<int> deque;
+  std::atomic<bool> done(false);
+  auto take = [&items, &seen](int *item) {
+    seen[item - items.data()]++;
+  };
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; i++) {
+    thieves.emplace_back([&deque, &done, &take] {
+      while (!done.load() || !deque.empty()) {
+        if (int *item = deque.steal()) {
+          take(item);
+        }
+      }
+    });
+  }
+  for (int i = 0; i < count; i++) {
+    deque.push(&items[i]);
+    if (i % 3 == 0) {
+      if (int *item = deque.pop()) {
+        take(item);
+      }
+    }
+  }
+  while (int *item = deque.pop()) {
+    take(item);
+  }
+  done = true;
+  for (auto &thief : thieves) {
+    thief.join();
+  }
+  for (auto &s : seen) {
+    ASSERT_EQ(s.load(), 1);
+  }
+}
+
+TEST(Scheduler, RunsTasks) {
+  Scheduler scheduler(4);
+  scheduler.createTopic("test", 4);
+  std::atomic<int> done(0);
+  TaskGroup group;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(scheduler.runTask("test", [&done] { done++; },
+                                Priority::NORMAL, &group),
+              SchedulingResult::SCHEDULED);
+  }
+  group.wait();
+  EXPECT_EQ(done.load(), 1000);
+  EXPECT_EQ(group.pending(), 0);
+}
+
+TEST(Scheduler, UnknownAndMockTopics) {
+  Scheduler scheduler(1);
+  EXPECT_EQ(scheduler.runTask("nope", [] {}),
+            SchedulingResult::ERR_UNKNOWN_TOPIC);
+  scheduler.createTopic("empty", 0);
+  EXPECT_EQ(scheduler.runTask("empty", [] {}),
+            SchedulingResult::ERR_NO_WORKERS);
+  scheduler.mockTopic("mock");
+  auto caller = std::this_thread::get_id();
+  std::thread::id ran_on;
+  EXPECT_EQ(scheduler.runTask("mock", [&ran_on] {
+    ran_on = std::this_thread::get_id();
+  }), SchedulingResult::SCHEDULED);
+  EXPECT_EQ(ran_on, caller);
+}
+
+TEST(Scheduler, TopicLimit) {
+  Scheduler scheduler(8);
+  scheduler.createTopic("limited", 2);
+  std::atomic<int> running(0);
+  std::atomic<int> max_running(0);
+  TaskGroup group;
+  for (int i = 0; i < 32; i++) {
+    scheduler.runTask("limited", [&running, &max_running] {
+      int now = ++running;
+      int prev = max_running.load();
+      while (now > prev && !max_running.compare_exchange_weak(prev, now)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      running--;
+    }, Priority::NORMAL, &group);
+  }
+  group.wait();
+  EXPECT_GE(max_running.load(), 1);
+  EXPECT_LE(max_running.load(), 2);
+}
+
+TEST(Scheduler, Priorities) {
+  Scheduler scheduler(2);
+  scheduler.createTopic("serial", 1);
+  Gate gate;
+  std::mutex mutex;
+  std::vector<int> order;
+  TaskGroup group;
+  scheduler.runTask("serial", [&gate] { gate.wait(); }, Priority::NORMAL,
+                    &group);
+  for (int i = 0; i < 3; i++) {
+    for (auto priority : {Priority::LOW, Priority::NORMAL, Priority::HIGH}) {
+      scheduler.runTask("serial", [&mutex, &order, priority] {
+        std::unique_lock<std::mutex> lc(mutex);
+        order.push_back(static_cast<int>(priority));
+      }, priority, &group);
+    }
+  }
+  gate.open();
+  group.wait();
+  EXPECT_EQ(order, std::vector<int>({0, 0, 0, 1, 1, 1, 2, 2, 2}));
+}
+
+TEST(Scheduler, NestedGroups) {
+  Scheduler scheduler(2);
+  scheduler.createTopic("outer", 2);
+  scheduler.createTopic("inner", 2);
+  std::atomic<int> done(0);
+  TaskGroup group;
+  for (int i = 0; i < 4; i++) {
+    scheduler.runTask("outer", [&scheduler, &done] {
+      // Waiting runs the inner tasks on this worker if needed, so this
+      // finishes even with all workers waiting.
+      TaskGroup inner;
+      for (int j = 0; j < 16; j++) {
+        scheduler.runTask("inner", [&done] { done++; }, Priority::NORMAL,
+                          &inner);
+      }
+      inner.wait();
+    }, Priority::NORMAL, &group);
+  }
+  group.wait();
+  EXPECT_EQ(done.load(), 64);
+}
+
+TEST(Scheduler, WaitOnlyHelpsWithUrgentTasks) {
+  Scheduler scheduler(2);
+  scheduler.createTopic("topic", 3);
+  std::atomic<bool> child_started(false), outer_waiting(false),
+      low_in_wait(false);
+  Gate child_go;
+  TaskGroup group;
+  scheduler.runTask("topic", [&] {
+    TaskGroup inner;
+    scheduler.runTask("topic", [&] {
+      child_started = true;
+      child_go.wait();
+    }, Priority::NORMAL, &inner);
+    // The other worker takes the child, the low priority task stays here.
+    while (!child_started) {
+      std::this_thread::yield();
+    }
+    std::thread::id outer_thread = std::this_thread::get_id();
+    scheduler.runTask("topic", [&, outer_thread] {
+      if (outer_waiting && std::this_thread::get_id() == outer_thread) {
+        low_in_wait = true;
+      }
+    }, Priority::LOW, &group);
+    outer_waiting = true;
+    inner.wait();
+    outer_waiting = false;
+  }, Priority::NORMAL, &group);
+  while (!child_started) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  child_go.open();
+  group.wait();
+  EXPECT_FALSE(low_in_wait.load());
+}
+
+TEST(Scheduler, Cancel) {
+  Scheduler scheduler(2);
+  scheduler.createTopic("serial", 1);
+  Gate started, gate;
+  std::atomic<int> done(0);
+  TaskGroup group;
+  scheduler.runTask("serial", [&started, &gate, &done] {
+    started.open();
+    gate.wait();
+    done++;
+  }, Priority::NORMAL, &group);
+  started.wait();
+  for (int i = 0; i < 10; i++) {
+    scheduler.runTask("serial", [&done] { done++; }, Priority::NORMAL,
+                      &group);
+  }
+  group.cancel();
+  EXPECT_TRUE(group.cancelled());
+  gate.open();
+  group.wait();
+  EXPECT_EQ(done.load(), 1);
+}
+
+TEST(Scheduler, Shutdown) {
+  Scheduler scheduler(2);
+  scheduler.createTopic("serial", 1);
+  Gate started, gate;
+  std::atomic<int> done(0);
+  TaskGroup group;
+  scheduler.runTask("serial", [&started, &gate, &done] {
+    started.open();
+    gate.wait();
+    done++;
+  }, Priority::NORMAL, &group);
+  started.wait();
+  for (int i = 0; i < 5; i++) {
+    scheduler.runTask("serial", [&done] { done++; }, Priority::NORMAL,
+                      &group);
+  }
+  std::thread stopper([&scheduler] { scheduler.shutdown(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  gate.open();
+  stopper.join();
+  group.wait();
+  EXPECT_EQ(done.load(), 1);
+  EXPECT_EQ(scheduler.runTask("serial", [] {}),
+            SchedulingResult::ERR_SHUT_DOWN);
+}
+
+TEST(Scheduler, RunTaskDuringShutdown) {
+  // Tasks scheduled while the scheduler stops either run or are dropped,
+  // but never left behind for group.wait() to hang on.
+  for (int round = 0; round < 50; round++) {
+    Scheduler scheduler(2);
+    scheduler.createTopic("topic", 1);
+    TaskGroup group;
+    Gate go;
+    std::thread submitter([&scheduler, &group, &go] {
+      go.wait();
+      for (int i = 0; i < 100; i++) {
+        scheduler.runTask("topic", [] {}, Priority::NORMAL, &group);
+      }
+    });
+    go.open();
+    scheduler.shutdown();
+    submitter.join();
+    group.wait();
+    EXPECT_EQ(group.pending(), 0u);
+  }
+}
+
+}  // namespace threadpool
+}  // namespace util
+}  // namespace veles
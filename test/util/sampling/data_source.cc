@@ -0,0 +1,194 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "mock_sampler.h"
+#include "util/sampling/data_source.h"
+#include "util/sampling/entropy_sampler.h"
+#include "util/sampling/fake_sampler.h"
+#include "util/sampling/uniform_sampler.h"
+
+namespace veles {
+namespace util {
+
+// Paged source over a QByteArray, counting fetches.
+class TestPagedDataSource : public PagedDataSource {
+ public:
+  TestPagedDataSource(const QByteArray &data, size_t page_size,
+                      size_t max_pages)
+      : PagedDataSource(page_size, max_pages), data_(data), fetches_(0) {}
+
+  size_t size() override { return static_cast<size_t>(data_.size()); }
+  int fetches() { return fetches_; }
+
+ protected:
+  void fetch(size_t offset, size_t size, char *out) override {
+    ++fetches_;
+    std::memcpy(out, data_.constData() + offset, size);
+  }
+
+ private:
+  QByteArray data_;
+  int fetches_;
+};
+
+TEST(PagedDataSource, read) {
+  auto data = prepare_data(1000);
+  TestPagedDataSource source(data, 64, 4);
+  char buffer[300];
+  source.read(100, 300, buffer);
+  ASSERT_EQ(0, std::memcmp(buffer, data.constData() + 100, 300));
+  ASSERT_EQ(6, source.fetches());
+  // The last page is shorter.
+  source.read(990, 10, buffer);
+  ASSERT_EQ(0, std::memcmp(buffer, data.constData() + 990, 10));
+  ASSERT_EQ(7, source.fetches());
+}
+
+TEST(PagedDataSource, cache) {
+  auto data = prepare_data(1000);
+  TestPagedDataSource source(data, 64, 2);
+  char c;
+  source.read(0, 1, &c);
+  source.read(64, 1, &c);
+  source.read(1, 1, &c);
+  ASSERT_EQ(2, source.fetches());
+  // Evicts page 1, the least recently used one.
+  source.read(128, 1, &c);
+  source.read(2, 1, &c);
+  ASSERT_EQ(3, source.fetches());
+  source.read(65, 1, &c);
+  ASSERT_EQ(4, source.fetches());
+  ASSERT_EQ(data[65], c);
+}
+
+TEST(PagedDataSource, samplers) {
+  auto data = prepare_data(100000);
+  auto paged = std::make_shared<TestPagedDataSource>(data, 4096, 4);
+
+  UniformSampler uniform(data), paged_uniform(paged);
+  uniform.setSampleSize(1000);
+  paged_uniform.setSampleSize(1000);
+  ASSERT_EQ(uniform.getSampleSize(), paged_uniform.getSampleSize());
+  ASSERT_EQ(0, std::memcmp(uniform.data(), paged_uniform.data(),
+                           uniform.getSampleSize()));
+
+  EntropySampler entropy(data), paged_entropy(paged);
+  entropy.setSampleSize(1000);
+  paged_entropy.setSampleSize(1000);
+  ASSERT_EQ(0, std::memcmp(entropy.data(), paged_entropy.data(),
+                           entropy.getSampleSize()));
+
+  FakeSampler fake(paged);
+  fake.setSampleSize(1000);
+  fake.setRange(500, 600);
+  ASSERT_EQ(100, fake.getSampleSize());
+  ASSERT_EQ(0, std::memcmp(data.constData() + 500, fake.data(), 100));
+  ASSERT_EQ(data[510], fake[10]);
+}
+
+TEST(PagedDataSource, changed) {
+  auto data = prepare_data(1000);
+  TestPagedDataSource source(data, 64, 4);
+  char c;
+  source.read(0, 1, &c);
+  source.read(64, 1, &c);
+  ASSERT_EQ(2, source.fetches());
+  source.changed(60, 2);
+  source.read(64, 1, &c);
+  ASSERT_EQ(2, source.fetches());
+  source.read(0, 1, &c);
+  ASSERT_EQ(3, source.fetches());
+}
+
+TEST(BufferDataSource, write) {
+  QByteArray data = prepare_data(1000);
+  BufferDataSource source(data);
+  std::vector<std::pair<size_t, size_t>> changes;
+  auto id = source.registerChangeCallback([&changes](size_t offset,
+                                                     size_t size) {
+    changes.emplace_back(offset, size);
+  });
+  source.write(10, "abc", 3);
+  ASSERT_EQ(0, std::memcmp(source.contiguousData() + 10, "abc", 3));
+  // The original array isn't modified.
+  ASSERT_EQ(data, prepare_data(1000));
+  ASSERT_EQ(1u, changes.size());
+  ASSERT_EQ(10u, changes[0].first);
+  ASSERT_EQ(3u, changes[0].second);
+  source.removeChangeCallback(id);
+  source.write(20, "d", 1);
+  ASSERT_EQ(1u, changes.size());
+}
+
+TEST(BufferDataSource, samplers) {
+  auto source = std::make_shared<BufferDataSource>(prepare_data(100000));
+  UniformSampler uniform(source);
+  uniform.setSampleSize(10000);
+  FakeSampler fake(source);
+  fake.setRange(1000, 50000);
+  uniform.statistics(true);
+  fake.statistics();
+  std::vector<char> edit(5000, 7);
+  for (size_t offset : {0, 1000, 20000, 95000}) {
+    source->write(offset, edit.data(), edit.size());
+    QByteArray current(source->contiguousData(),
+                       static_cast<int>(source->size()));
+
+    UniformSampler expected(current);
+    expected.setSampleSize(10000);
+    ASSERT_EQ(expected.getSampleSize(), uniform.getSampleSize());
+    ASSERT_EQ(0, std::memcmp(expected.data(), uniform.data(),
+                             uniform.getSampleSize()));
+    size_t size = uniform.getSampleSize();
+    ASSERT_EQ(expected.statistics()->histogram(),
+              uniform.statistics()->histogram());
+    std::vector<uint64_t> counts(65536, 0), expected_counts(65536, 0);
+    uniform.statistics(true)->digrams(0, size, counts.data());
+    expected.statistics(true)->digrams(0, size, expected_counts.data());
+    ASSERT_EQ(expected_counts, counts);
+
+    ASSERT_EQ(0, std::memcmp(current.constData() + 1000, fake.data(),
+                             49000));
+    BlockStats fake_expected(current.constData() + 1000, 49000);
+    ASSERT_EQ(fake_expected.histogram(), fake.statistics()->histogram());
+  }
+}
+
+TEST(BufferDataSource, unsampledChange) {
+  QByteArray data = prepare_data(10000);
+  auto source = std::make_shared<BufferDataSource>(data);
+  FakeSampler fake(source);
+  fake.setRange(1000, 2000);
+  fake.statistics();
+  int notified = 0;
+  fake.registerResampleCallback([&notified]() { ++notified; });
+  // Misses the range, but detaches the data from the original array.
+  source->write(0, "abc", 3);
+  ASSERT_EQ(1, notified);
+  ASSERT_EQ(source->contiguousData() + 1000, fake.data());
+  // Statistics no longer read the original array.
+  std::memset(data.data() + 1000, 0, 1000);
+  BlockStats expected(source->contiguousData() + 1000, 1000);
+  ASSERT_EQ(expected.histogram(1, 999), fake.statistics()->histogram(1, 999));
+}
+
+}  // namespace util
+}  // namespace veles
@@ -252,6 +252,33 @@ TEST(ISamplerAsynchronous, prepareAndApplySample) {
   ASSERT_TRUE(sampler.isFinished());
 }
 
+TEST(ISamplerAsynchronous, coalesceAndCancel) {
+  threadpool::mockTopic("visualisation");
+  auto data = prepare_data(100);
+  testing::StrictMock<MockSampler> sampler(data);
+  sampler.allowAsynchronousResampling(true);
+  EXPECT_CALL(sampler, prepareResample(_))
+    .WillOnce(testing::Invoke(&sampler,
+                              &MockSampler::requestTwiceDuringPrepare))
+    .WillOnce(Return(nullptr));
+  EXPECT_CALL(sampler, applyResample(nullptr));
+  sampler.setSampleSize(10);
+  sampler.wait();
+  ASSERT_TRUE(sampler.isFinished());
+  ASSERT_FALSE(sampler.cancelled_before_);
+  ASSERT_TRUE(sampler.cancelled_after_);
+
+  auto stats = sampler.resampleStats();
+  ASSERT_EQ(3u, stats.requested);
+  ASSERT_EQ(1u, stats.coalesced);
+  ASSERT_EQ(1u, stats.cancelled);
+  ASSERT_EQ(1u, stats.completed);
+  ASSERT_LE(stats.last_latency_us, stats.max_latency_us);
+
+  sampler.resetResampleStats();
+  ASSERT_EQ(0u, sampler.resampleStats().requested);
+}
+
 
 }  // namespace util
 }  // namespace veles
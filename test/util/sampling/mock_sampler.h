@@ -38,6 +38,19 @@ class MockSampler : public ISampler {
   size_t proxy_getDataSize() { return getDataSize(); }
   char proxy_getDataByte(size_t index) { return getDataByte(index); }
 
+  // A prepareResample() action issuing two more requests while the first
+  // one is being prepared, as dragging a selection would.
+  ResampleData* requestTwiceDuringPrepare(SamplerConfig *sc) {
+    cancelled_before_ = resampleCancelled(sc);
+    setSampleSize(20);
+    setSampleSize(30);
+    cancelled_after_ = resampleCancelled(sc);
+    return nullptr;
+  }
+
+  bool cancelled_before_ = false;
+  bool cancelled_after_ = false;
+
 };
 
 class MockCallback {
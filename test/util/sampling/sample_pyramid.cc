@@ -0,0 +1,157 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+
+#include "mock_sampler.h"
+#include "util/sampling/pyramid_sampler.h"
+#include "util/sampling/sample_pyramid.h"
+
+namespace veles {
+namespace util {
+
+static QByteArray randomData(size_t size) {
+  QByteArray result(static_cast<int>(size), 0);
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 15);
+  for (size_t i = 0; i < size; ++i) {
+    result.data()[i] = static_cast<char>(distribution(generator));
+  }
+  return result;
+}
+
+TEST(SamplePyramid, geometry) {
+  auto data = randomData(100000);
+  SamplePyramid pyramid(std::make_shared<ByteArrayDataSource>(data));
+  ASSERT_EQ(4096, pyramid.blockSize());
+  ASSERT_EQ(4u, pyramid.levelsCount());
+  ASSERT_EQ(25u, pyramid.blocksCount(0));
+  ASSERT_EQ(7u, pyramid.blocksCount(1));
+  ASSERT_EQ(2u, pyramid.blocksCount(2));
+  ASSERT_EQ(1u, pyramid.blocksCount(3));
+  ASSERT_EQ(256u, pyramid.windowSize());
+  ASSERT_EQ(1920u, pyramid.windowOffset(0, 0));
+  // The last block has 1696 octets.
+  ASSERT_EQ(24u * 4096 + 720, pyramid.windowOffset(0, 24));
+  ASSERT_EQ(16384u + 8064, pyramid.windowOffset(1, 1));
+  ASSERT_EQ(50000u - 128, pyramid.windowOffset(3, 0));
+}
+
+TEST(SamplePyramid, windows) {
+  auto data = randomData(100000);
+  auto pyramid = std::make_shared<SamplePyramid>(
+      std::make_shared<ByteArrayDataSource>(data));
+  char window[256];
+  ASSERT_FALSE(pyramid->isBuilt());
+  ASSERT_FALSE(pyramid->readWindow(0, 0, window));
+  std::atomic<bool> done(false);
+  pyramid->buildAsync([&done]() { done = true; });
+  while (!done) {
+    std::this_thread::yield();
+  }
+  ASSERT_TRUE(pyramid->isBuilt());
+  for (size_t level = 0; level < pyramid->levelsCount(); ++level) {
+    for (size_t block = 0; block < pyramid->blocksCount(level); ++block) {
+      ASSERT_TRUE(pyramid->readWindow(level, block, window));
+      ASSERT_EQ(0, std::memcmp(
+          data.constData() + pyramid->windowOffset(level, block),
+          window, 256));
+    }
+  }
+  ASSERT_FALSE(pyramid->readWindow(0, 25, window));
+
+  // Overlaps the windows of level 0 block 1 and level 3 block 0.
+  for (int i = 5000; i < 5100; ++i) {
+    data.data()[i] = 100;
+  }
+  for (int i = 49900; i < 49950; ++i) {
+    data.data()[i] = 100;
+  }
+  pyramid->update(5000, 100);
+  pyramid->update(49900, 50);
+  for (size_t level = 0; level < pyramid->levelsCount(); ++level) {
+    for (size_t block = 0; block < pyramid->blocksCount(level); ++block) {
+      ASSERT_TRUE(pyramid->readWindow(level, block, window));
+      ASSERT_EQ(0, std::memcmp(
+          data.constData() + pyramid->windowOffset(level, block),
+          window, 256));
+    }
+  }
+}
+
+TEST(PyramidSampler, windows) {
+  auto data = randomData(1 << 20);
+  auto pyramid = std::make_shared<SamplePyramid>(
+      std::make_shared<ByteArrayDataSource>(data));
+  PyramidSampler sampler(pyramid);
+  sampler.setRange(100000, 900000);
+  sampler.setSampleSize(256 * 64);
+  ASSERT_EQ(256 * 64, sampler.getSampleSize());
+  QByteArray before(sampler.data(), 256 * 64);
+  for (size_t i = 1; i < 256 * 64; i += 256) {
+    size_t offset = sampler.getFileOffset(i) - 1;
+    ASSERT_EQ(1920u, offset % 4096);
+    ASSERT_EQ(0, std::memcmp(data.constData() + offset,
+                             before.constData() + i - 1, 256));
+  }
+
+  // Once built, windows come from the pyramid and don't change until
+  // the pyramid is updated.
+  pyramid->build();
+  std::memset(data.data(), 1, data.size());
+  sampler.resample();
+  ASSERT_EQ(0, std::memcmp(before.constData(), sampler.data(), 256 * 64));
+  pyramid->update(0, data.size());
+  sampler.resample();
+  ASSERT_EQ(1, sampler[1000]);
+
+  // Few windows come from a coarser level, with blocks of 65536 octets.
+  sampler.setRange(0, 1 << 20);
+  sampler.setSampleSize(256 * 16);
+  ASSERT_EQ(256 * 16, sampler.getSampleSize());
+  for (size_t i = 1; i < 256 * 16; i += 256) {
+    ASSERT_EQ(32640u, (sampler.getFileOffset(i) - 1) % 65536);
+  }
+
+  // Fewer pyramid windows than needed - all of them are still used, with
+  // the remaining windows spaced evenly between them.
+  sampler.setRange(0, 1 << 20);
+  sampler.setSampleSize(256 * 1024);
+  ASSERT_EQ(256 * 1024, sampler.getSampleSize());
+  size_t pyramid_windows = 0;
+  size_t previous = 0;
+  for (size_t i = 0; i < 256 * 1024; i += 256) {
+    size_t offset = sampler.getFileOffset(i);
+    ASSERT_TRUE(i == 0 || offset >= previous + 256);
+    previous = offset;
+    if (offset % 4096 == 1920) {
+      ++pyramid_windows;
+    }
+  }
+  ASSERT_EQ(256u, pyramid_windows);
+
+  // Too small for the pyramid.
+  sampler.setRange(0, 10000);
+  sampler.setSampleSize(1000);
+  ASSERT_EQ(768, sampler.getSampleSize());
+}
+
+}  // namespace util
+}  // namespace veles
@@ -17,6 +17,7 @@
 
 #include "mock_sampler.h"
 #include "util/sampling/uniform_sampler.h"
+#include "util/concurrency/threadpool.h"
 
 namespace veles {
 namespace util {
@@ -69,5 +70,64 @@ TEST(UniformSampler, testOffsets) {
   }
 }
 
+/** Gives the global "sampling" topic workers for the duration of a test,
+    so that windows are picked in parallel.  */
+class ParallelUniformSampler : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    threadpool::createTopic("sampling", 4);
+  }
+
+  void TearDown() override {
+    // Topics can't be removed, but with no workers allowed the samplers
+    // run everything in the calling thread again, as with no topic.
+    threadpool::createTopic("sampling", 0);
+  }
+};
+
+TEST_F(ParallelUniformSampler, resample) {
+  auto data = prepare_data(1 << 20);
+  UniformSampler sampler(data);
+  sampler.setWindowSize(16);
+  sampler.setSampleSize(1 << 16);
+  ASSERT_EQ(1 << 16, sampler.getSampleSize());
+  auto sample = sampler.data();
+  size_t prev = 0;
+  for (size_t i = 0; i < (1 << 16); i += 16) {
+    size_t window = sampler.getFileOffset(i + 1) - 1;
+    if (i > 0) {
+      ASSERT_LE(prev + 16, window);
+    }
+    for (size_t j = 1; j < 16; ++j) {
+      ASSERT_EQ(data[static_cast<int>(window + j)], sample[i + j]);
+    }
+    prev = window;
+  }
+  ASSERT_LE(prev + 16, static_cast<size_t>(data.size()));
+}
+
+TEST(UniformSampler, statistics) {
+  auto data = prepare_data(10000);
+  UniformSampler sampler(data);
+  sampler.setSampleSize(1000);
+  size_t size = sampler.getSampleSize();
+  auto stats = sampler.statistics();
+  ASSERT_EQ(size, stats->size());
+  ASSERT_FALSE(stats->hasDigrams());
+  ASSERT_EQ(stats, sampler.statistics());
+  auto with_digrams = sampler.statistics(true);
+  ASSERT_TRUE(with_digrams->hasDigrams());
+  ASSERT_EQ(with_digrams, sampler.statistics());
+  BlockStats::Histogram expected;
+  expected.fill(0);
+  for (size_t i = 0; i < size; ++i) {
+    ++expected[static_cast<unsigned char>(sampler[i])];
+  }
+  ASSERT_EQ(expected, with_digrams->histogram());
+  sampler.setSampleSize(500);
+  ASSERT_EQ(sampler.getSampleSize(), sampler.statistics()->size());
+  ASSERT_NE(size, sampler.getSampleSize());
+}
+
 }  // namespace util
 }  // namespace veles
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "mock_sampler.h"
+#include "util/sampling/entropy_sampler.h"
+#include "util/sampling/stratified_sampler.h"
+#include "util/sampling/stride_sampler.h"
+#include "util/sampling/uniform_sampler.h"
+
+namespace veles {
+namespace util {
+
+// Returns window offsets of the sample, checking they're sorted,
+// non-overlapping and match the data.
+static std::vector<size_t> checkWindows(const QByteArray &data,
+                                        ISampler *sampler, size_t window) {
+  std::vector<size_t> result;
+  auto sample = sampler->data();
+  for (size_t i = 0; i < sampler->getSampleSize(); i += window) {
+    size_t offset = sampler->getFileOffset(i + 1) - 1;
+    if (!result.empty()) {
+      EXPECT_LE(result.back() + window, offset);
+    }
+    for (size_t j = 1; j < window; ++j) {
+      EXPECT_EQ(data[static_cast<int>(offset + j)], sample[i + j]);
+    }
+    result.push_back(offset);
+  }
+  EXPECT_LE(result.back() + window, static_cast<size_t>(data.size()));
+  return result;
+}
+
+TEST(StrideSampler, evenlySpaced) {
+  auto data = prepare_data(1000);
+  StrideSampler sampler(data);
+  sampler.setSampleSize(100);
+  sampler.setWindowSize(10);
+  ASSERT_EQ(100, sampler.getSampleSize());
+  auto windows = checkWindows(data, &sampler, 10);
+  for (size_t i = 0; i < windows.size(); ++i) {
+    ASSERT_EQ(i * 110, windows[i]);
+  }
+}
+
+TEST(StratifiedSampler, windowPerStratum) {
+  auto data = prepare_data(1000);
+  StratifiedSampler sampler(data);
+  sampler.setSampleSize(100);
+  sampler.setWindowSize(10);
+  ASSERT_EQ(100, sampler.getSampleSize());
+  auto windows = checkWindows(data, &sampler, 10);
+  for (size_t i = 0; i < windows.size(); ++i) {
+    ASSERT_LE(i * 100, windows[i]);
+    ASSERT_LE(windows[i] + 10, (i + 1) * 100);
+  }
+}
+
+TEST(StratifiedSampler, seed) {
+  auto data = prepare_data(100000);
+  StratifiedSampler first(data), second(data);
+  first.setSampleSize(1000);
+  second.setSampleSize(1000);
+  ASSERT_EQ(checkWindows(data, &first, 31), checkWindows(data, &second, 31));
+  second.setSeed(1);
+  ASSERT_NE(checkWindows(data, &first, 31), checkWindows(data, &second, 31));
+}
+
+TEST(UniformSampler, seed) {
+  auto data = prepare_data(100000);
+  UniformSampler first(data), second(data);
+  first.setSampleSize(1000);
+  second.setSampleSize(1000);
+  ASSERT_EQ(checkWindows(data, &first, 31), checkWindows(data, &second, 31));
+  second.setSeed(1);
+  ASSERT_NE(checkWindows(data, &first, 31), checkWindows(data, &second, 31));
+}
+
+TEST(EntropySampler, prefersHighEntropy) {
+  // Zeros, with pseudo-random data in the middle 1/16.
+  QByteArray data(1 << 20, 0);
+  std::default_random_engine generator;
+  for (int i = 15 << 15; i < 17 << 15; ++i) {
+    data.data()[i] = static_cast<char>(generator());
+  }
+  EntropySampler sampler(data);
+  sampler.setSampleSize(1 << 14);
+  sampler.setWindowSize(64);
+  auto windows = checkWindows(data, &sampler, 64);
+  ASSERT_EQ(256u, windows.size());
+  size_t inside = std::count_if(windows.begin(), windows.end(),
+      [](size_t offset) {
+        return offset + 64 > (15u << 15) && offset < (17u << 15);
+      });
+  // A uniform sampler would put 1/16 of windows there.
+  ASSERT_GT(inside, windows.size() / 2);
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/stats/block_stats.h"
+
+namespace veles {
+namespace util {
+
+static std::vector<char> randomData(size_t size) {
+  std::vector<char> result(size);
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 31);
+  for (size_t i = 0; i < size; ++i) {
+    result[i] = static_cast<char>(distribution(generator) * 8);
+  }
+  return result;
+}
+
+TEST(BlockStats, histogram) {
+  auto data = randomData(50000);
+  BlockStats stats(data.data(), data.size());
+  std::vector<std::pair<size_t, size_t>> ranges = {
+    {0, 0}, {0, 50000}, {1, 100}, {4000, 4200}, {4096, 8192},
+    {123, 45678}, {8191, 12289}, {49999, 50000}};
+  for (auto range : ranges) {
+    BlockStats::Histogram expected;
+    expected.fill(0);
+    for (size_t i = range.first; i < range.second; ++i) {
+      ++expected[static_cast<unsigned char>(data[i])];
+    }
+    ASSERT_EQ(expected, stats.histogram(range.first, range.second));
+  }
+}
+
+TEST(BlockStats, entropy) {
+  std::vector<char> data(10000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i % 16);
+  }
+  BlockStats stats(data.data(), data.size());
+  ASSERT_NEAR(4.0, stats.entropy(0, 9600), 1e-9);
+  ASSERT_NEAR(1.0, stats.entropy(4096, 4098), 1e-9);
+  ASSERT_EQ(0.0, stats.entropy(17, 18));
+  ASSERT_EQ(0.0, stats.entropy(5, 5));
+}
+
+TEST(BlockStats, digrams) {
+  auto data = randomData(200000);
+  BlockStats stats(data.data(), data.size(), true);
+  ASSERT_TRUE(stats.hasDigrams());
+  ASSERT_FALSE(BlockStats(data.data(), data.size()).hasDigrams());
+  std::vector<std::pair<size_t, size_t>> ranges = {
+    {0, 200000}, {0, 1}, {5, 7}, {1, 150001}, {12345, 12346 + 65536},
+    {40000, 200000}};
+  for (auto range : ranges) {
+    std::vector<uint64_t> counts(65536, 0), sums(65536, 0);
+    std::vector<uint64_t> expected_counts(65536, 0), expected_sums(65536, 0);
+    for (size_t i = range.first; i + 1 < range.second; ++i) {
+      size_t index = static_cast<unsigned char>(data[i]) * 256
+          + static_cast<unsigned char>(data[i + 1]);
+      ++expected_counts[index];
+      expected_sums[index] += i;
+    }
+    stats.digrams(range.first, range.second, counts.data(), sums.data());
+    ASSERT_EQ(expected_counts, counts);
+    ASSERT_EQ(expected_sums, sums);
+  }
+}
+
+TEST(BlockStats, update) {
+  auto data = randomData(200000);
+  BlockStats stats(data.data(), data.size(), true);
+  std::vector<std::pair<size_t, size_t>> edits = {
+    {0, 1}, {4095, 4097}, {100000, 100001}, {12289, 80000}, {199999, 200000}};
+  char value = 1;
+  for (auto edit : edits) {
+    for (size_t i = edit.first; i < edit.second; ++i) {
+      data[i] = value++;
+    }
+    stats.update(data.data(), edit.first, edit.second);
+    BlockStats expected(data.data(), data.size(), true);
+    for (size_t start : {0, 1, 4096, 12345, 99999}) {
+      ASSERT_EQ(expected.histogram(start, data.size()),
+                stats.histogram(start, data.size()));
+      std::vector<uint64_t> counts(65536, 0), sums(65536, 0);
+      std::vector<uint64_t> expected_counts(65536, 0),
+          expected_sums(65536, 0);
+      stats.digrams(start, data.size(), counts.data(), sums.data());
+      expected.digrams(start, data.size(), expected_counts.data(),
+                       expected_sums.data());
+      ASSERT_EQ(expected_counts, counts);
+      ASSERT_EQ(expected_sums, sums);
+    }
+  }
+}
+
+}  // namespace util
+}  // namespace veles
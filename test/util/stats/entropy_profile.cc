@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <random>
+#include <vector>
+
+#include <QByteArray>
+
+#include "gtest/gtest.h"
+#include "util/stats/entropy_profile.h"
+#include "util/stats/kernels.h"
+
+namespace veles {
+namespace util {
+
+static std::vector<uint8_t> randomBytes(size_t size) {
+  std::vector<uint8_t> result(size);
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 255);
+  for (size_t i = 0; i < size; ++i) {
+    // Alternate between low and high entropy parts.
+    result[i] = static_cast<uint8_t>((i / 1000) % 2 ?
+        distribution(generator) : distribution(generator) % 4);
+  }
+  return result;
+}
+
+static double directEntropy(const uint8_t *data, size_t size) {
+  uint64_t counts[256] = {};
+  kernels::countBytes(data, size, counts);
+  return kernels::entropy(counts, size);
+}
+
+TEST(EntropyAccumulator, slidingWindow) {
+  auto data = randomBytes(20000);
+  const size_t window_size = 300;
+  EntropyAccumulator window;
+  ASSERT_EQ(0.0, window.entropy());
+  window.add(data.data(), window_size);
+  for (size_t start = 0; start + window_size < data.size(); ++start) {
+    ASSERT_EQ(window_size, window.count());
+    ASSERT_NEAR(directEntropy(data.data() + start, window_size),
+                window.entropy(), 1e-9);
+    window.remove(data[start]);
+    window.add(data[start + window_size]);
+  }
+  window.clear();
+  ASSERT_EQ(0u, window.count());
+  window.add(7);
+  window.add(7);
+  ASSERT_EQ(0.0, window.entropy());
+  window.add(8);
+  window.remove(7);
+  ASSERT_DOUBLE_EQ(1.0, window.entropy());
+}
+
+TEST(EntropyProfile, profile) {
+  auto data = randomBytes(10000);
+  ASSERT_EQ(0u, entropyProfileSize(0, 100));
+  ASSERT_EQ(1u, entropyProfileSize(50, 100));
+  ASSERT_EQ(1u, entropyProfileSize(100, 100));
+  ASSERT_EQ(5u, entropyProfileSize(109, 100, 2));
+
+  const size_t windows[] = {1, 64, 256, 20000};
+  const size_t steps[] = {1, 3, 256, 1000};
+  for (size_t window_size : windows) {
+    for (size_t step : steps) {
+      auto profile = entropyProfile(data.data(), data.size(), window_size,
+                                    step);
+      ASSERT_EQ(entropyProfileSize(data.size(), window_size, step),
+                profile.size());
+      for (size_t point = 0; point < profile.size(); ++point) {
+        size_t start = point * step;
+        size_t size = std::min(window_size, data.size() - start);
+        ASSERT_NEAR(directEntropy(data.data() + start, size),
+                    profile[point], 1e-5);
+      }
+    }
+  }
+}
+
+TEST(EntropyProfile, dataSource) {
+  auto data = randomBytes(3 << 20);
+  QByteArray bytes(reinterpret_cast<const char *>(data.data()),
+                   static_cast<int>(data.size()));
+  ByteArrayDataSource source(bytes);
+  for (size_t step : {1, 4096}) {
+    auto expected = entropyProfile(data.data(), data.size(), 1024, step);
+    auto profile = entropyProfile(&source, 1024, step);
+    ASSERT_EQ(expected.size(), profile.size());
+    for (size_t point = 0; point < profile.size(); ++point) {
+      ASSERT_NEAR(expected[point], profile[point], 1e-5);
+    }
+  }
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/stats/kernels.h"
+
+namespace veles {
+namespace util {
+namespace kernels {
+
+static std::vector<uint8_t> randomBytes(size_t size) {
+  std::vector<uint8_t> result(size);
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 255);
+  for (size_t i = 0; i < size; ++i) {
+    result[i] = static_cast<uint8_t>(distribution(generator));
+  }
+  return result;
+}
+
+TEST(Kernels, instructionSets) {
+  InstructionSet detected = detectInstructionSet();
+  ASSERT_EQ(detected, instructionSet());
+  ASSERT_TRUE(setInstructionSet(InstructionSet::SCALAR));
+  ASSERT_EQ(InstructionSet::SCALAR, instructionSet());
+  ASSERT_TRUE(setInstructionSet(detected));
+  ASSERT_EQ(detected, instructionSet());
+}
+
+TEST(Kernels, sumBytes) {
+  auto data = randomBytes(10000);
+  const InstructionSet sets[] = {
+    InstructionSet::SCALAR, InstructionSet::SSE2, InstructionSet::AVX2,
+    InstructionSet::NEON};
+  InstructionSet detected = instructionSet();
+  for (InstructionSet set : sets) {
+    if (!setInstructionSet(set)) {
+      continue;
+    }
+    for (size_t offset : {0, 1, 7, 31}) {
+      for (size_t size : {0, 1, 15, 16, 33, 100, 9000}) {
+        uint64_t expected = 0;
+        for (size_t i = offset; i < offset + size; ++i) {
+          expected += data[i];
+        }
+        ASSERT_EQ(expected, sumBytes(data.data() + offset, size))
+            << instructionSetName(set);
+      }
+    }
+  }
+  setInstructionSet(detected);
+}
+
+TEST(Kernels, countBytes) {
+  auto data = randomBytes(5000);
+  // Long runs of equal bytes too.
+  data.insert(data.end(), 3000, 0x41);
+  for (size_t size : {0, 3, 1000, 1023, 1024, 1027, 8000}) {
+    std::vector<uint64_t> expected(256, 1), counts(256, 1);
+    for (size_t i = 0; i < size; ++i) {
+      ++expected[data[i]];
+    }
+    countBytes(data.data(), size, counts.data());
+    ASSERT_EQ(expected, counts);
+  }
+}
+
+TEST(Kernels, entropy) {
+  ASSERT_EQ(0.0, nLog2N(0));
+  ASSERT_EQ(0.0, nLog2N(1));
+  ASSERT_DOUBLE_EQ(8.0, nLog2N(4));
+  ASSERT_DOUBLE_EQ(100000 * std::log2(100000.0), nLog2N(100000));
+
+  std::vector<uint64_t> counts(256, 0);
+  ASSERT_EQ(0.0, entropy(counts.data(), 0));
+  counts[3] = 10;
+  ASSERT_EQ(0.0, entropy(counts.data(), 10));
+  counts.assign(256, 5000);
+  ASSERT_NEAR(8.0, entropy(counts.data(), 256 * 5000), 1e-9);
+
+  auto data = randomBytes(3000);
+  counts.assign(256, 0);
+  for (uint8_t byte : data) {
+    ++counts[byte];
+  }
+  double expected = 0;
+  for (uint64_t count : counts) {
+    if (count > 0) {
+      double p = static_cast<double>(count) / data.size();
+      expected -= p * std::log2(p);
+    }
+  }
+  ASSERT_NEAR(expected, entropy(counts.data(), data.size()), 1e-9);
+}
+
+}  // namespace kernels
+}  // namespace util
+}  // namespace veles